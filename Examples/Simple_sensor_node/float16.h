@@ -0,0 +1,235 @@
+/*
+ * Float16 support for the simple sensor node: scalar conversion routines and their batch counterparts.
+ *
+ * The batch routines use the F16C instructions on x86 (compile with -mf16c or -march=native; AVX2, if available,
+ * doubles the vector width) and NEON on AArch64.
+ * Otherwise they fall back to the scalar routines. Either way the results are bit-identical to the scalar
+ * routines. make_float16() rounds ties away from zero, whereas the hardware rounds them to even, so the inputs
+ * that are exactly halfway between two float16 values are detected and converted with the scalar routine,
+ * as well as the inputs that map into the subnormal range of float16 and NaN.
+ *
+ * License: CC0, no copyright reserved
+ * Language: C99
+ */
+
+#ifndef FLOAT16_H
+#define FLOAT16_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__F16C__)
+# include <immintrin.h>
+# define FLOAT16_USE_F16C 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+# include <arm_neon.h>
+# define FLOAT16_USE_NEON 1
+#endif
+
+/**
+ * float32 --> float16. Rounds to nearest, ties away from zero. NaN is converted into 0x7FFF (with the sign preserved).
+ */
+static inline uint16_t make_float16(float value)
+{
+    union fp32
+    {
+        uint32_t u;
+        float f;
+    };
+
+    const union fp32 f32infty = { 255U << 23 };
+    const union fp32 f16infty = { 31U << 23 };
+    const union fp32 magic = { 15U << 23 };
+    const uint32_t sign_mask = 0x80000000U;
+    const uint32_t round_mask = ~0xFFFU;
+
+    union fp32 in;
+    uint16_t out = 0;
+
+    in.f = value;
+
+    uint32_t sign = in.u & sign_mask;
+    in.u ^= sign;
+
+    if (in.u >= f32infty.u)
+    {
+        out = (in.u > f32infty.u) ? 0x7FFFU : 0x7C00U;
+    }
+    else
+    {
+        in.u &= round_mask;
+        in.f *= magic.f;
+        in.u -= round_mask;
+        if (in.u > f16infty.u)
+        {
+            in.u = f16infty.u;
+        }
+        out = (uint16_t)(in.u >> 13);
+    }
+
+    out |= (uint16_t)(sign >> 16);
+
+    return out;
+}
+
+/**
+ * float16 --> float32. The conversion is exact; signaling NaNs are converted into quiet NaNs, like the hardware does.
+ */
+static inline float make_float32(uint16_t value)
+{
+    union fp32
+    {
+        uint32_t u;
+        float f;
+    };
+
+    const union fp32 magic = { (254U - 15U) << 23 };
+    const union fp32 was_infnan = { (127U + 16U) << 23 };
+
+    union fp32 out;
+
+    out.u = (uint32_t)(value & 0x7FFFU) << 13;      // Exponent and mantissa
+    out.f *= magic.f;                               // Exponent adjustment; also handles subnormals exactly
+    if (out.f >= was_infnan.f)
+    {
+        out.u |= 255U << 23;                        // Inf or NaN
+        if ((value & 0x03FFU) != 0)
+        {
+            out.u |= 1U << 22;                      // Quiet NaN
+        }
+    }
+    out.u |= (uint32_t)(value & 0x8000U) << 16;     // Sign
+
+    return out.f;
+}
+
+/**
+ * The hardware conversion differs from make_float16() only for ties, for inputs that map into the subnormal range
+ * of float16 (i.e. magnitude below 2^-14), and for NaN; such inputs are handled by make_float16().
+ * A tie is a float32 value whose 13 least significant mantissa bits, which are dropped, are exactly 0x1000.
+ */
+static const uint32_t FLOAT16_SMALLEST_NORMAL_AS_FLOAT32 = 0x38800000U;
+static const uint32_t FLOAT16_FLOAT32_INFINITY = 0x7F800000U;
+static const uint32_t FLOAT16_DROPPED_BITS_MASK = 0x1FFFU;
+static const uint32_t FLOAT16_TIE = 0x1000U;
+
+/**
+ * Batch float32 --> float16. The output is bit-identical to make_float16() applied to every element.
+ */
+static inline void make_float16_array(uint16_t* out, const float* in, size_t count)
+{
+    size_t i = 0;
+
+#if FLOAT16_USE_F16C
+    const __m128i abs_mask = _mm_set1_epi32(0x7FFFFFFF);
+    const __m128i lower = _mm_set1_epi32((int)FLOAT16_SMALLEST_NORMAL_AS_FLOAT32);
+    const __m128i upper = _mm_set1_epi32((int)FLOAT16_FLOAT32_INFINITY);
+    const __m128i dropped_bits_mask = _mm_set1_epi32((int)FLOAT16_DROPPED_BITS_MASK);
+    const __m128i tie = _mm_set1_epi32((int)FLOAT16_TIE);
+
+# if defined(__AVX2__)
+    const __m256i abs_mask_8 = _mm256_set1_epi32(0x7FFFFFFF);
+    const __m256i lower_8 = _mm256_set1_epi32((int)FLOAT16_SMALLEST_NORMAL_AS_FLOAT32);
+    const __m256i upper_8 = _mm256_set1_epi32((int)FLOAT16_FLOAT32_INFINITY);
+    const __m256i dropped_bits_mask_8 = _mm256_set1_epi32((int)FLOAT16_DROPPED_BITS_MASK);
+    const __m256i tie_8 = _mm256_set1_epi32((int)FLOAT16_TIE);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(&in[i]);
+        _mm_storeu_si128((__m128i*)(void*)&out[i], _mm256_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT));
+
+        const __m256i abs = _mm256_and_si256(_mm256_castps_si256(x), abs_mask_8);
+        const __m256i is_tie = _mm256_cmpeq_epi32(_mm256_and_si256(abs, dropped_bits_mask_8), tie_8);
+        const __m256i special = _mm256_or_si256(_mm256_or_si256(_mm256_cmpgt_epi32(lower_8, abs),
+                                                                _mm256_cmpgt_epi32(abs, upper_8)),
+                                                is_tie);
+        if (_mm256_movemask_epi8(special) != 0)
+        {
+            for (size_t k = i; k < i + 8; k++)
+            {
+                out[k] = make_float16(in[k]);
+            }
+        }
+    }
+# endif
+
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(&in[i]);
+        _mm_storel_epi64((__m128i*)(void*)&out[i], _mm_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT));
+
+        const __m128i abs = _mm_and_si128(_mm_castps_si128(x), abs_mask);
+        const __m128i is_tie = _mm_cmpeq_epi32(_mm_and_si128(abs, dropped_bits_mask), tie);
+        const __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmplt_epi32(abs, lower), _mm_cmpgt_epi32(abs, upper)),
+                                             is_tie);
+        if (_mm_movemask_epi8(special) != 0)
+        {
+            for (size_t k = i; k < i + 4; k++)
+            {
+                out[k] = make_float16(in[k]);
+            }
+        }
+    }
+#elif FLOAT16_USE_NEON
+    const uint32x4_t lower = vdupq_n_u32(FLOAT16_SMALLEST_NORMAL_AS_FLOAT32);
+    const uint32x4_t upper = vdupq_n_u32(FLOAT16_FLOAT32_INFINITY);
+    const uint32x4_t dropped_bits_mask = vdupq_n_u32(FLOAT16_DROPPED_BITS_MASK);
+    const uint32x4_t tie = vdupq_n_u32(FLOAT16_TIE);
+
+    for (; i + 4 <= count; i += 4)
+    {
+        const float32x4_t x = vld1q_f32(&in[i]);
+        vst1_u16(&out[i], vreinterpret_u16_f16(vcvt_f16_f32(x)));
+
+        const uint32x4_t abs = vreinterpretq_u32_f32(vabsq_f32(x));
+        const uint32x4_t is_tie = vceqq_u32(vandq_u32(abs, dropped_bits_mask), tie);
+        const uint32x4_t special = vorrq_u32(vorrq_u32(vcltq_u32(abs, lower), vcgtq_u32(abs, upper)), is_tie);
+        if (vmaxvq_u32(special) != 0)
+        {
+            for (size_t k = i; k < i + 4; k++)
+            {
+                out[k] = make_float16(in[k]);
+            }
+        }
+    }
+#endif
+
+    for (size_t remaining = count - i; remaining > 0; remaining--, i++)
+    {
+        out[i] = make_float16(in[i]);
+    }
+}
+
+/**
+ * Batch float16 --> float32. The output is bit-identical to make_float32() applied to every element.
+ */
+static inline void make_float32_array(float* out, const uint16_t* in, size_t count)
+{
+    size_t i = 0;
+
+#if FLOAT16_USE_F16C
+# if defined(__AVX__)
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm256_storeu_ps(&out[i], _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(const void*)&in[i])));
+    }
+# endif
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_ps(&out[i], _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)(const void*)&in[i])));
+    }
+#elif FLOAT16_USE_NEON
+    for (; i + 4 <= count; i += 4)
+    {
+        vst1q_f32(&out[i], vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(&in[i]))));
+    }
+#endif
+
+    for (size_t remaining = count - i; remaining > 0; remaining--, i++)
+    {
+        out[i] = make_float32(in[i]);
+    }
+}
+
+#endif
@@ -2,8 +2,12 @@
  * This program subscribes to airspeed messages using libuavcan, and prints them into stdout in YAML format.
  * It can be used to test alternative implementations of the UAVCAN stack against the reference implementation.
  *
+ * With the option --batch, the program runs in the high-throughput logging mode: the frames are received in batches
+ * with recvmmsg(), and the messages are formatted on a separate thread (see uavcan_batch_logging.hpp).
+ * This mode is intended for saturated buses, where printing from the subscriber callback can't keep up.
+ *
  * GCC invocation command:
- *     g++ libuavcan_airspeed_subscriber.cpp -std=c++11 -lrt -luavcan
+ *     g++ libuavcan_airspeed_subscriber.cpp -std=c++11 -pthread -lrt -luavcan
  *
  * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
  * License: CC0, no copyright reserved
@@ -14,6 +18,7 @@
 #include <algorithm>
 #include <uavcan_linux/uavcan_linux.hpp>
 #include <uavcan/equipment/air_data/TrueAirspeed.hpp>
+#include "uavcan_batch_logging.hpp"
 
 uavcan_linux::NodePtr initNode(const std::vector<std::string>& ifaces, uavcan::NodeID nid, const std::string& name)
 {
@@ -56,15 +61,80 @@ static void runForever(const uavcan_linux::NodePtr& node)
     }
 }
 
+/**
+ * Runs the node on top of the batch SocketCAN driver, handing the messages over to the formatter thread.
+ * Statistics are printed into stderr every few seconds, so that it's clear whether anything was lost.
+ */
+static void runBatchLoggerForever(const std::vector<std::string>& ifaces, uavcan::NodeID nid, const std::string& name)
+{
+    static constexpr unsigned NodeMemoryPoolSize = 16384;
+    static constexpr unsigned StatsIntervalMsec = 10000;
+
+    uavcan_linux::SystemClock clock;
+    uavcan_batch_logging::BatchSocketCanDriver driver(clock);
+    for (auto& iface : ifaces)
+    {
+        driver.addIface(iface);
+    }
+
+    uavcan::Node<NodeMemoryPoolSize> node(driver, clock);
+    node.setNodeID(nid);
+    node.setName(name.c_str());
+
+    if (node.start() < 0)
+    {
+        throw std::runtime_error("Failed to start UAVCAN node");
+    }
+
+    uavcan_batch_logging::AsyncYamlLogger<uavcan::equipment::air_data::TrueAirspeed> logger(STDOUT_FILENO);
+
+    uavcan::Subscriber<uavcan::equipment::air_data::TrueAirspeed> sub_true_airspeed(node);
+    const int sub_res = sub_true_airspeed.start(
+        [&logger](const uavcan::ReceivedDataStructure<uavcan::equipment::air_data::TrueAirspeed>& msg)
+        {
+            logger.push(msg);
+        });
+    if (sub_res < 0)
+    {
+        throw std::runtime_error("Failed to start the subscriber; error: " + std::to_string(sub_res));
+    }
+
+    node.setModeOperational();
+
+    while (true)
+    {
+        const int res = node.spin(uavcan::MonotonicDuration::fromMSec(StatsIntervalMsec));
+        if (res < 0)
+        {
+            std::cerr << "Transient failure: " << res << std::endl;
+        }
+
+        std::cerr << "Dropped by kernel: " << driver.getKernelDropCount()
+                  << ", dropped by logger: " << logger.getDropCount()
+                  << ", transfer errors: " << sub_true_airspeed.getFailureCount() << std::endl;
+    }
+}
+
 int main(int argc, const char** argv)
 {
-    if (argc < 3)
+    const bool batch_mode = (argc > 1) && (std::string(argv[1]) == "--batch");
+    const int first_arg = batch_mode ? 2 : 1;
+
+    if (argc < first_arg + 2)
     {
-        std::cout << "Usage:\n\t" << argv[0] << " <node-id> <can-iface-name-1> [can-iface-name-N...]" << std::endl;
+        std::cout << "Usage:\n\t" << argv[0] << " [--batch] <node-id> <can-iface-name-1> [can-iface-name-N...]"
+                  << std::endl;
         return 1;
     }
-    const int self_node_id = std::stoi(argv[1]);
-    std::vector<std::string> iface_names(argv + 2, argv + argc);
+    const int self_node_id = std::stoi(argv[first_arg]);
+    std::vector<std::string> iface_names(argv + first_arg + 1, argv + argc);
+
+    if (batch_mode)
+    {
+        runBatchLoggerForever(iface_names, self_node_id, "org.uavcan.example.airspeed_subscriber");
+        return 0;
+    }
+
     uavcan_linux::NodePtr node = initNode(iface_names, self_node_id, "org.uavcan.example.airspeed_subscriber");
     runForever(node);
     return 0;
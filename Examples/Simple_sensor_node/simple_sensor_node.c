@@ -6,15 +6,19 @@
  *     gcc simple_sensor_node.c -lrt -std=gnu99 -o simple_sensor_node
  * With warnings:
  *     gcc simple_sensor_node.c -lrt -std=gnu99 -o simple_sensor_node -Wall -Werror -Wextra -pedantic -Wsign-conversion
+ * Add -mf16c or -march=native to enable the hardware float16 conversion in float16.h (x86 only).
  *
  * Author: Pavel Kirienko <pavel.kirienko@zubax.com>
  * License: CC0, no copyright reserved
  * Language: C99
  */
 
+#define _GNU_SOURCE         // For sendmmsg()
+
 #include <stdio.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
@@ -30,9 +34,15 @@
 #include <sys/ioctl.h>
 #include <linux/can.h>
 #include <linux/can/raw.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <errno.h>
 #include <time.h>
+#include "float16.h"        // For make_float16()
 
 static int can_socket = -1;
+static int wait_timer = -1;     ///< timerfd that expires at the deadline passed to can_receive_until()
+static int wait_epoll = -1;     ///< Waits for the CAN socket and the timer at once
 
 int can_init(const char* can_iface_name)
 {
@@ -67,22 +77,130 @@ int can_init(const char* can_iface_name)
     }
 
     can_socket = sock;
+
+    // The timer uses the same clock as get_monotonic_usec()
+    wait_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    wait_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (wait_timer < 0 || wait_epoll < 0)
+    {
+        return -1;
+    }
+
+    struct epoll_event ev;
+    (void)memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = can_socket;
+    if (epoll_ctl(wait_epoll, EPOLL_CTL_ADD, can_socket, &ev) < 0)
+    {
+        return -1;
+    }
+    ev.data.fd = wait_timer;
+    if (epoll_ctl(wait_epoll, EPOLL_CTL_ADD, wait_timer, &ev) < 0)
+    {
+        return -1;
+    }
+
     return 0;
 }
 
-int can_send(uint32_t extended_can_id, const uint8_t* frame_data, uint8_t frame_data_len)
+/**
+ * Sends the frames in one batch, using as few system calls as possible.
+ * The frames are passed to the kernel directly from the provided array; they are not copied anywhere else.
+ * Returns 0 on success, negative on error.
+ */
+int can_send_frames(struct can_frame* frames, unsigned frame_count)
 {
-    if (frame_data_len > 8 || frame_data == NULL)
+    enum { MaxFramesPerCall = 32 };
+
+    while (frame_count > 0)
+    {
+        const unsigned batch_size = (frame_count < MaxFramesPerCall) ? frame_count : MaxFramesPerCall;
+
+        struct iovec iov[MaxFramesPerCall];
+        struct mmsghdr messages[MaxFramesPerCall];
+        (void)memset(messages, 0, sizeof(messages[0]) * batch_size);
+
+        for (unsigned i = 0; i < batch_size; i++)
+        {
+            iov[i].iov_base = &frames[i];
+            iov[i].iov_len = sizeof(struct can_frame);
+            messages[i].msg_hdr.msg_iov = &iov[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        const int sent = sendmmsg(can_socket, messages, batch_size, 0);
+        if (sent <= 0)
+        {
+            return -1;
+        }
+
+        frames += sent;
+        frame_count -= (unsigned)sent;
+    }
+
+    return 0;
+}
+
+/**
+ * Waits for a frame until the specified monotonic time (see get_monotonic_usec()).
+ * The deadline is absolute and has microsecond resolution, so periodic tasks scheduled with this function don't
+ * accumulate drift. If a frame is available, it is returned even if the deadline has already passed.
+ * Returns 1 if a frame was received, 0 if the deadline was reached, negative on error.
+ */
+int can_receive_until(struct can_frame* out_frame, uint64_t deadline_usec)
+{
+    struct itimerspec its;
+    (void)memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec  = (time_t)(deadline_usec / 1000000U);
+    its.it_value.tv_nsec = (long)((deadline_usec % 1000000U) * 1000U);
+    if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+    {
+        its.it_value.tv_nsec = 1;   // Zero would disarm the timer
+    }
+    if (timerfd_settime(wait_timer, TFD_TIMER_ABSTIME, &its, NULL) < 0)
     {
         return -1;
     }
 
-    struct can_frame frame;
-    frame.can_id  = extended_can_id | CAN_EFF_FLAG;
-    frame.can_dlc = frame_data_len;
-    memcpy(frame.data, frame_data, frame_data_len);
+    for (;;)
+    {
+        struct epoll_event events[2];
+        const int num_events = epoll_wait(wait_epoll, events, 2, -1);
+        if (num_events < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        bool frame_ready = false;
+        bool deadline_reached = false;
+        for (int i = 0; i < num_events; i++)
+        {
+            if (events[i].data.fd == can_socket)
+            {
+                frame_ready = true;
+            }
+            else
+            {
+                uint64_t expirations = 0;
+                (void)read(wait_timer, &expirations, sizeof(expirations));
+                deadline_reached = true;
+            }
+        }
 
-    return write(can_socket, &frame, sizeof(struct can_frame));
+        if (frame_ready)
+        {
+            const ssize_t nbytes = read(can_socket, out_frame, sizeof(struct can_frame));
+            return (nbytes == (ssize_t)sizeof(struct can_frame)) ? 1 : -1;
+        }
+        if (deadline_reached)
+        {
+            return 0;
+        }
+    }
 }
 
 uint64_t get_monotonic_usec(void)
@@ -108,79 +226,171 @@ static const uint8_t PRIORITY_MEDIUM  = 16;
 static const uint8_t PRIORITY_LOW     = 24;
 static const uint8_t PRIORITY_LOWEST  = 31;
 
+/// Longest transfer supported by this implementation; GetNodeInfo response needs up to 18 frames
+#define UAVCAN_MAX_FRAMES_PER_TRANSFER  20
+
+static const uint8_t TAIL_START_OF_TRANSFER = 0x80;
+static const uint8_t TAIL_END_OF_TRANSFER   = 0x40;
+static const uint8_t TAIL_TOGGLE            = 0x20;
+
 static uint8_t uavcan_node_id;
 
-int uavcan_broadcast(uint8_t priority,
-                     uint16_t data_type_id,
-                     uint8_t transfer_id,
-                     const uint8_t* payload,
-                     uint16_t payload_len)
+/// Frames of the transfer that is being sent; the frames are built here directly, without intermediate buffers
+static struct can_frame uavcan_tx_frames[UAVCAN_MAX_FRAMES_PER_TRANSFER];
+
+/**
+ * CRC-16-CCITT, initial value 0xFFFF, no reflection, no final XOR.
+ */
+uint16_t crc16_add(uint16_t crc, const uint8_t* bytes, uint16_t len)
 {
-    if (payload == NULL || payload_len > 7)
+    while (len--)
     {
-        return -1;  // In this super-simple implementation we don't support multi-frame transfers.
+        crc ^= (uint16_t)((uint16_t)*bytes++ << 8);
+        for (int i = 0; i < 8; i++)
+        {
+            crc = (crc & 0x8000U) ? (uint16_t)((uint16_t)(crc << 1) ^ 0x1021U) : (uint16_t)(crc << 1);
+        }
     }
+    return crc;
+}
 
-    if (priority > 31)
+/**
+ * Transfer CRC is computed over the data type signature (little endian) followed by the payload.
+ */
+uint16_t uavcan_compute_transfer_crc(uint64_t data_type_signature, const uint8_t* payload, uint16_t payload_len)
+{
+    uint8_t signature_bytes[8];
+    for (int i = 0; i < 8; i++)
+    {
+        signature_bytes[i] = (uint8_t)(data_type_signature >> (8 * i));
+    }
+    return crc16_add(crc16_add(0xFFFFU, signature_bytes, sizeof(signature_bytes)), payload, payload_len);
+}
+
+/**
+ * Splits the payload into CAN frames, writing them directly into the provided array.
+ * Single-frame transfers carry up to 7 bytes of payload. Longer payloads are sent as multi-frame transfers:
+ * the first frame begins with the transfer CRC, and the toggle bit alternates from frame to frame.
+ * Returns the number of frames, or negative if the array is too short.
+ */
+int uavcan_make_frames(struct can_frame* out_frames,
+                       unsigned max_frames,
+                       uint32_t can_id,
+                       uint64_t data_type_signature,
+                       uint8_t transfer_id,
+                       const uint8_t* payload,
+                       uint16_t payload_len)
+{
+    if (payload_len <= 7)
+    {
+        if (max_frames < 1)
+        {
+            return -1;
+        }
+        out_frames[0].can_id = can_id | CAN_EFF_FLAG;
+        out_frames[0].can_dlc = (uint8_t)(payload_len + 1);
+        memcpy(out_frames[0].data, payload, payload_len);
+        out_frames[0].data[payload_len] = (uint8_t)(TAIL_START_OF_TRANSFER | TAIL_END_OF_TRANSFER |
+                                                    (transfer_id & 31U));
+        return 1;
+    }
+
+    const unsigned frame_count = ((unsigned)payload_len + 2U + 6U) / 7U;     // CRC is prepended to the payload
+    if (frame_count > max_frames)
     {
         return -1;
     }
 
-    const uint32_t can_id = ((uint32_t)priority << 24) | ((uint32_t)data_type_id << 8) | (uint32_t)uavcan_node_id;
+    const uint16_t crc = uavcan_compute_transfer_crc(data_type_signature, payload, payload_len);
 
-    uint8_t payload_with_tail_byte[8];
+    uint16_t offset = 0;
+    for (unsigned i = 0; i < frame_count; i++)
+    {
+        struct can_frame* const frame = &out_frames[i];
+        frame->can_id = can_id | CAN_EFF_FLAG;
 
-    memcpy(payload_with_tail_byte, payload, payload_len);
+        uint8_t len = 0;
+        if (i == 0)
+        {
+            frame->data[len++] = (uint8_t)(crc & 0xFFU);
+            frame->data[len++] = (uint8_t)(crc >> 8);
+        }
+
+        const uint16_t chunk = (uint16_t)(((payload_len - offset) < (7 - len)) ? (payload_len - offset) : (7 - len));
+        memcpy(&frame->data[len], &payload[offset], chunk);
+        offset = (uint16_t)(offset + chunk);
+        len = (uint8_t)(len + chunk);
 
-    payload_with_tail_byte[payload_len] = 0xC0 | (transfer_id & 31);
+        uint8_t tail = (uint8_t)(transfer_id & 31U);
+        tail |= (i == 0) ? TAIL_START_OF_TRANSFER : 0;
+        tail |= (i == (frame_count - 1)) ? TAIL_END_OF_TRANSFER : 0;
+        tail |= (i % 2 == 1) ? TAIL_TOGGLE : 0;
+        frame->data[len++] = tail;
+
+        frame->can_dlc = len;
+    }
 
-    return can_send(can_id, payload_with_tail_byte, payload_len + 1);
+    return (int)frame_count;
 }
 
-/*
- * Float16 support
- */
-uint16_t make_float16(float value)
+int uavcan_send_transfer(uint32_t can_id,
+                         uint64_t data_type_signature,
+                         uint8_t transfer_id,
+                         const uint8_t* payload,
+                         uint16_t payload_len)
 {
-    union fp32
+    if (payload == NULL)
     {
-        uint32_t u;
-        float f;
-    };
-
-    const union fp32 f32infty = { 255U << 23 };
-    const union fp32 f16infty = { 31U << 23 };
-    const union fp32 magic = { 15U << 23 };
-    const uint32_t sign_mask = 0x80000000U;
-    const uint32_t round_mask = ~0xFFFU;
-
-    union fp32 in;
-    uint16_t out = 0;
+        return -1;
+    }
 
-    in.f = value;
+    const int frame_count = uavcan_make_frames(uavcan_tx_frames, UAVCAN_MAX_FRAMES_PER_TRANSFER, can_id,
+                                               data_type_signature, transfer_id, payload, payload_len);
+    if (frame_count < 0)
+    {
+        return -1;
+    }
 
-    uint32_t sign = in.u & sign_mask;
-    in.u ^= sign;
+    return can_send_frames(uavcan_tx_frames, (unsigned)frame_count);
+}
 
-    if (in.u >= f32infty.u)
+int uavcan_broadcast(uint8_t priority,
+                     uint16_t data_type_id,
+                     uint64_t data_type_signature,
+                     uint8_t transfer_id,
+                     const uint8_t* payload,
+                     uint16_t payload_len)
+{
+    if (priority > 31)
     {
-        out = (in.u > f32infty.u) ? 0x7FFFU : 0x7C00U;
+        return -1;
     }
-    else
+
+    const uint32_t can_id = ((uint32_t)priority << 24) | ((uint32_t)data_type_id << 8) | (uint32_t)uavcan_node_id;
+
+    return uavcan_send_transfer(can_id, data_type_signature, transfer_id, payload, payload_len);
+}
+
+/**
+ * Sends a service response. Priority and transfer ID must be the same as in the request.
+ */
+int uavcan_respond(uint8_t priority,
+                   uint8_t service_type_id,
+                   uint64_t data_type_signature,
+                   uint8_t destination_node_id,
+                   uint8_t transfer_id,
+                   const uint8_t* payload,
+                   uint16_t payload_len)
+{
+    if (priority > 31 || destination_node_id < 1 || destination_node_id > 127)
     {
-        in.u &= round_mask;
-        in.f *= magic.f;
-        in.u -= round_mask;
-        if (in.u > f16infty.u)
-        {
-            in.u = f16infty.u;
-        }
-        out = (uint16_t)(in.u >> 13);
+        return -1;
     }
 
-    out |= (uint16_t)(sign >> 16);
+    const uint32_t can_id = ((uint32_t)priority << 24) | ((uint32_t)service_type_id << 16) |
+                            ((uint32_t)destination_node_id << 8) | (1U << 7) | (uint32_t)uavcan_node_id;
 
-    return out;
+    return uavcan_send_transfer(can_id, data_type_signature, transfer_id, payload, payload_len);
 }
 
 /*
@@ -205,8 +415,13 @@ enum node_mode
     MODE_OFFLINE         = 7
 };
 
-/// Standard data type: uavcan.protocol.NodeStatus
-int publish_node_status(enum node_health health, enum node_mode mode, uint16_t vendor_specific_status_code)
+/// Current node status; also reported in GetNodeInfo responses
+static enum node_health node_health = HEALTH_OK;
+static enum node_mode node_mode = MODE_INITIALIZATION;
+static uint16_t node_vendor_specific_status_code;
+
+/// Standard data type: uavcan.protocol.NodeStatus; 7 bytes
+void make_node_status(uint8_t* out_payload)
 {
     static uint64_t startup_timestamp_usec;
     if (startup_timestamp_usec == 0)
@@ -214,26 +429,99 @@ int publish_node_status(enum node_health health, enum node_mode mode, uint16_t v
         startup_timestamp_usec = get_monotonic_usec();
     }
 
-    uint8_t payload[7];
-
     // Uptime in seconds
     const uint32_t uptime_sec = (get_monotonic_usec() - startup_timestamp_usec) / 1000000ULL;
-    payload[0] = (uptime_sec >> 0)  & 0xFF;
-    payload[1] = (uptime_sec >> 8)  & 0xFF;
-    payload[2] = (uptime_sec >> 16) & 0xFF;
-    payload[3] = (uptime_sec >> 24) & 0xFF;
+    out_payload[0] = (uptime_sec >> 0)  & 0xFF;
+    out_payload[1] = (uptime_sec >> 8)  & 0xFF;
+    out_payload[2] = (uptime_sec >> 16) & 0xFF;
+    out_payload[3] = (uptime_sec >> 24) & 0xFF;
 
     // Health and mode
-    payload[4] = ((uint8_t)health << 6) | ((uint8_t)mode << 3);
+    out_payload[4] = ((uint8_t)node_health << 6) | ((uint8_t)node_mode << 3);
 
     // Vendor-specific status code
-    payload[5] = (vendor_specific_status_code >> 0) & 0xFF;
-    payload[6] = (vendor_specific_status_code >> 8) & 0xFF;
+    out_payload[5] = (node_vendor_specific_status_code >> 0) & 0xFF;
+    out_payload[6] = (node_vendor_specific_status_code >> 8) & 0xFF;
+}
+
+/// Standard data type: uavcan.protocol.NodeStatus
+int publish_node_status(void)
+{
+    uint8_t payload[7];
+    make_node_status(payload);
 
     static const uint16_t data_type_id = 341;
+    static const uint64_t data_type_signature = 0x0F0868D0C1A7C6F1ULL;
     static uint8_t transfer_id;
 
-    return uavcan_broadcast(PRIORITY_LOW, data_type_id, transfer_id++, payload, sizeof(payload));
+    return uavcan_broadcast(PRIORITY_LOW, data_type_id, data_type_signature, transfer_id++, payload, sizeof(payload));
+}
+
+/// Standard data type: uavcan.protocol.GetNodeInfo; this node only responds to requests
+int respond_get_node_info(uint8_t priority, uint8_t requesting_node_id, uint8_t transfer_id)
+{
+    static const char node_name[] = "org.uavcan.simple_sensor_node";
+
+    uint8_t payload[41 + sizeof(node_name) - 1];
+    (void)memset(payload, 0, sizeof(payload));
+
+    // Node status
+    make_node_status(&payload[0]);
+
+    // Software version: major, minor, optional field flags (none), VCS commit, image CRC
+    payload[7] = 1;
+    payload[8] = 0;
+
+    // Hardware version: major, minor, unique ID, certificate of authenticity (empty); all zeros in this example
+    payload[22] = 1;
+    payload[23] = 0;
+
+    // Name: the last field, so it has no length prefix (tail array optimization)
+    memcpy(&payload[41], node_name, sizeof(node_name) - 1);
+
+    static const uint8_t service_type_id = 1;
+    static const uint64_t data_type_signature = 0xEE468A8121C46A9EULL;
+
+    return uavcan_respond(priority, service_type_id, data_type_signature, requesting_node_id, transfer_id,
+                          payload, sizeof(payload));
+}
+
+/**
+ * Handles incoming service requests. This node only supports single-frame requests,
+ * which is enough for GetNodeInfo, because its request is empty.
+ */
+void process_received_frame(const struct can_frame* frame)
+{
+    if (((frame->can_id & CAN_EFF_FLAG) == 0) || ((frame->can_id & (CAN_RTR_FLAG | CAN_ERR_FLAG)) != 0) ||
+        (frame->can_dlc < 1))
+    {
+        return;
+    }
+
+    const uint32_t can_id = frame->can_id & CAN_EFF_MASK;
+    const bool service_not_message  = ((can_id >> 7) & 1U) != 0;
+    const bool request_not_response = ((can_id >> 15) & 1U) != 0;
+    const uint8_t destination_node_id = (uint8_t)((can_id >> 8) & 0x7FU);
+    const uint8_t source_node_id      = (uint8_t)(can_id & 0x7FU);
+    const uint8_t service_type_id     = (uint8_t)((can_id >> 16) & 0xFFU);
+    const uint8_t priority            = (uint8_t)((can_id >> 24) & 0x1FU);
+    const uint8_t tail                = frame->data[frame->can_dlc - 1];
+
+    if (!service_not_message || !request_not_response || (destination_node_id != uavcan_node_id))
+    {
+        return;
+    }
+
+    const uint8_t single_frame = TAIL_START_OF_TRANSFER | TAIL_END_OF_TRANSFER;
+    if ((tail & single_frame) != single_frame)
+    {
+        return;
+    }
+
+    if (service_type_id == 1)       // uavcan.protocol.GetNodeInfo
+    {
+        (void)respond_get_node_info(priority, source_node_id, tail & 31U);
+    }
 }
 
 /// Standard data type: uavcan.equipment.air_data.TrueAirspeed
@@ -249,9 +537,11 @@ int publish_true_airspeed(float mean, float variance)
     payload[3] = (f16_variance >> 8) & 0xFF;
 
     static const uint16_t data_type_id = 1020;
+    static const uint64_t data_type_signature = 0x306F69E0A591AFAAULL;
     static uint8_t transfer_id;
     transfer_id += 1;
-    return uavcan_broadcast(PRIORITY_MEDIUM, data_type_id, transfer_id, payload, sizeof(payload));
+    return uavcan_broadcast(PRIORITY_MEDIUM, data_type_id, data_type_signature, transfer_id,
+                            payload, sizeof(payload));
 }
 
 int compute_true_airspeed(float* out_airspeed, float* out_variance)
@@ -261,6 +551,72 @@ int compute_true_airspeed(float* out_airspeed, float* out_variance)
     return 0;
 }
 
+/*
+ * Scheduler
+ */
+/// A function that is invoked periodically
+struct periodic_task
+{
+    uint64_t period_usec;
+    uint64_t next_run_at_usec;
+    void (*handler)(void);
+};
+
+/**
+ * Runs the tasks that are due, and returns the time when the next task is due.
+ * Next run time is computed from the previous one rather than from the current time, so the schedule doesn't drift
+ * by however long the tasks take. If the node has fallen behind by more than one period, the missed runs are skipped.
+ */
+uint64_t run_periodic_tasks(struct periodic_task* tasks, unsigned num_tasks)
+{
+    const uint64_t ts = get_monotonic_usec();
+    uint64_t next_deadline = UINT64_MAX;
+
+    for (unsigned i = 0; i < num_tasks; i++)
+    {
+        struct periodic_task* const t = &tasks[i];
+        if (t->next_run_at_usec <= ts)
+        {
+            t->handler();
+            do
+            {
+                t->next_run_at_usec += t->period_usec;
+            }
+            while (t->next_run_at_usec <= ts);
+        }
+        if (t->next_run_at_usec < next_deadline)
+        {
+            next_deadline = t->next_run_at_usec;
+        }
+    }
+
+    return next_deadline;
+}
+
+void run_airspeed_task(void)
+{
+    float airspeed = 0.0F;
+    float airspeed_variance = 0.0F;
+    const int airspeed_computation_result = compute_true_airspeed(&airspeed, &airspeed_variance);
+
+    if (airspeed_computation_result == 0)
+    {
+        const int publication_result = publish_true_airspeed(airspeed, airspeed_variance);
+        node_health = (publication_result < 0) ? HEALTH_ERROR : HEALTH_OK;
+    }
+    else
+    {
+        node_health = HEALTH_ERROR;
+    }
+}
+
+void run_node_status_task(void)
+{
+    node_vendor_specific_status_code = (uint16_t)rand(); // Can be used to report vendor-specific status info
+
+    (void)publish_node_status();
+}
+
 int main(int argc, char** argv)
 {
     /*
@@ -287,29 +643,31 @@ int main(int argc, char** argv)
 
     /*
      * Main loop
+     * Airspeed is published at 100 Hz, node status at 1 Hz. In between, the node sleeps until either a frame
+     * arrives or the next task is due.
      */
-    enum node_health health = HEALTH_OK;
+    node_mode = MODE_OPERATIONAL;
+
+    const uint64_t started_at = get_monotonic_usec();
+    struct periodic_task tasks[] =
+    {
+        { 10000U,   started_at, &run_airspeed_task },
+        { 1000000U, started_at, &run_node_status_task }
+    };
 
     for (;;)
     {
-        float airspeed = 0.0F;
-        float airspeed_variance = 0.0F;
-        const int airspeed_computation_result = compute_true_airspeed(&airspeed, &airspeed_variance);
+        const uint64_t next_deadline = run_periodic_tasks(tasks, sizeof(tasks) / sizeof(tasks[0]));
 
-        if (airspeed_computation_result == 0)
+        struct can_frame frame;
+        const int receive_result = can_receive_until(&frame, next_deadline);
+        if (receive_result > 0)
         {
-            const int publication_result = publish_true_airspeed(airspeed, airspeed_variance);
-            health = (publication_result < 0) ? HEALTH_ERROR : HEALTH_OK;
+            process_received_frame(&frame);
         }
-        else
+        else if (receive_result < 0)
         {
-            health = HEALTH_ERROR;
+            usleep(1000);   // Avoiding a busy loop if the interface is down
         }
-
-        const uint16_t vendor_specific_status_code = rand(); // Can be used to report vendor-specific status info
-
-        (void)publish_node_status(health, MODE_OPERATIONAL, vendor_specific_status_code);
-
-        usleep(500000);
     }
 }
@@ -0,0 +1,691 @@
+/*
+ * High-throughput reception and logging for libuavcan-based Linux loggers.
+ *
+ * BatchSocketCanDriver is a SocketCAN driver for libuavcan that reads the frames with recvmmsg() in batches
+ * of up to BatchSize frames per system call, and keeps the kernel timestamps of the frames (SO_TIMESTAMP).
+ * It also reports the number of frames dropped by the kernel (SO_RXQ_OVFL), so that it's easy to see whether
+ * the logger keeps up with the bus.
+ *
+ * AsyncYamlLogger moves the formatting off the thread that spins the node: the subscriber callback only copies
+ * the decoded message into a bounded single-producer single-consumer ring, and a separate thread formats
+ * the messages as YAML into one large output buffer, which is flushed with one write() per buffer.
+ *
+ * License: CC0, no copyright reserved
+ * Language: C++11
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <queue>
+#include <vector>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <uavcan/uavcan.hpp>
+
+namespace uavcan_batch_logging
+{
+/**
+ * One SocketCAN interface. The received frames are buffered in the batch until they are consumed by libuavcan.
+ */
+class BatchSocketCanIface final : public uavcan::ICanIface,
+                                  uavcan::Noncopyable
+{
+public:
+    static constexpr unsigned BatchSize = 64;
+    static constexpr unsigned NumFilters = 32;
+
+    /**
+     * A large socket buffer absorbs the bursts while the node is busy with something else.
+     */
+    static constexpr int SocketReceiveBufferSize = 1024 * 1024;
+
+private:
+    struct ReceivedFrame
+    {
+        uavcan::CanFrame frame;
+        uavcan::MonotonicTime ts_mono;
+        uavcan::UtcTime ts_utc;
+        uavcan::CanIOFlags flags = 0;
+    };
+
+    const uavcan::ISystemClock& clock_;
+    const int fd_;
+
+    /*
+     * recvmmsg() buffers; they are set up once and reused by every call.
+     */
+    std::array<::can_frame, BatchSize> batch_frames_;
+    std::array<::iovec, BatchSize> batch_iovecs_;
+    std::array<std::array<std::uint8_t, CMSG_SPACE(sizeof(::timeval)) + CMSG_SPACE(sizeof(std::uint32_t))>,
+               BatchSize> batch_controls_;
+    std::array<::mmsghdr, BatchSize> batch_headers_;
+
+    std::array<ReceivedFrame, BatchSize> rx_batch_;
+    unsigned rx_batch_size_ = 0;
+    unsigned rx_batch_pos_ = 0;
+
+    std::queue<ReceivedFrame> loopback_queue_;      ///< Frames sent with CanIOFlagLoopback; rare
+
+    std::uint64_t error_count_ = 0;
+    std::uint32_t kernel_drop_count_ = 0;
+
+    static ::canid_t toSocketCanID(std::uint32_t id)
+    {
+        if (id & uavcan::CanFrame::FlagEFF)
+        {
+            return (id & uavcan::CanFrame::MaskExtID) | CAN_EFF_FLAG |
+                   ((id & uavcan::CanFrame::FlagRTR) ? CAN_RTR_FLAG : 0U);
+        }
+        return (id & uavcan::CanFrame::MaskStdID) | ((id & uavcan::CanFrame::FlagRTR) ? CAN_RTR_FLAG : 0U);
+    }
+
+    static std::uint32_t fromSocketCanID(::canid_t id)
+    {
+        std::uint32_t out = 0;
+        if (id & CAN_EFF_FLAG)
+        {
+            out = (id & CAN_EFF_MASK) | uavcan::CanFrame::FlagEFF;
+        }
+        else
+        {
+            out = id & CAN_SFF_MASK;
+        }
+        if (id & CAN_RTR_FLAG)
+        {
+            out |= uavcan::CanFrame::FlagRTR;
+        }
+        if (id & CAN_ERR_FLAG)
+        {
+            out |= uavcan::CanFrame::FlagERR;
+        }
+        return out;
+    }
+
+    /**
+     * Reads all frames the kernel has for us, up to BatchSize, in one system call. Never blocks.
+     * Returns the number of frames read or negative error.
+     */
+    int readBatch()
+    {
+        for (unsigned i = 0; i < BatchSize; i++)
+        {
+            batch_headers_[i].msg_hdr.msg_controllen = batch_controls_[i].size();
+        }
+
+        const int res = ::recvmmsg(fd_, batch_headers_.data(), BatchSize, MSG_DONTWAIT, nullptr);
+        if (res < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return 0;
+            }
+            error_count_++;
+            return -errno;
+        }
+
+        /*
+         * The kernel timestamps are in the UTC domain; the monotonic timestamp is sampled once per batch,
+         * which is accurate enough because the batch contains only the frames that were already waiting.
+         */
+        const auto ts_mono = clock_.getMonotonic();
+
+        rx_batch_size_ = 0;
+        rx_batch_pos_ = 0;
+
+        for (int i = 0; i < res; i++)
+        {
+            const ::can_frame& sockcan_frame = batch_frames_[unsigned(i)];
+            ::msghdr& header = batch_headers_[unsigned(i)].msg_hdr;
+
+            ReceivedFrame& rx = rx_batch_[rx_batch_size_];
+            rx.frame = uavcan::CanFrame(fromSocketCanID(sockcan_frame.can_id), sockcan_frame.data,
+                                        sockcan_frame.can_dlc);
+            rx.ts_mono = ts_mono;
+            rx.ts_utc = uavcan::UtcTime();
+            rx.flags = 0;
+
+            for (::cmsghdr* cmsg = CMSG_FIRSTHDR(&header); cmsg != nullptr; cmsg = CMSG_NXTHDR(&header, cmsg))
+            {
+                if (cmsg->cmsg_level != SOL_SOCKET)
+                {
+                    continue;
+                }
+                if (cmsg->cmsg_type == SO_TIMESTAMP)
+                {
+                    ::timeval tv;
+                    std::memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+                    rx.ts_utc = uavcan::UtcTime::fromUSec(std::uint64_t(tv.tv_sec) * 1000000ULL +
+                                                          std::uint64_t(tv.tv_usec));
+                }
+                if (cmsg->cmsg_type == SO_RXQ_OVFL)
+                {
+                    std::memcpy(&kernel_drop_count_, CMSG_DATA(cmsg), sizeof(kernel_drop_count_));
+                }
+            }
+
+            if (sockcan_frame.can_id & CAN_ERR_FLAG)
+            {
+                error_count_++;
+                continue;
+            }
+            rx_batch_size_++;
+        }
+
+        return int(rx_batch_size_);
+    }
+
+public:
+    /**
+     * Throws std::runtime_error if the interface can't be opened.
+     */
+    BatchSocketCanIface(const uavcan::ISystemClock& clock, const std::string& iface_name) :
+        clock_(clock),
+        fd_(::socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW))
+    {
+        if (fd_ < 0)
+        {
+            throw std::runtime_error("Failed to open CAN socket; errno: " + std::to_string(errno));
+        }
+
+        ::ifreq ifr;
+        std::memset(&ifr, 0, sizeof(ifr));
+        (void)std::strncpy(ifr.ifr_name, iface_name.c_str(), IFNAMSIZ - 1);
+
+        ::sockaddr_can addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.can_family = AF_CAN;
+
+        const int on = 1;
+        bool ok = ::ioctl(fd_, SIOCGIFINDEX, &ifr) >= 0;
+        addr.can_ifindex = ifr.ifr_ifindex;
+        ok = ok && ::bind(fd_, reinterpret_cast<::sockaddr*>(&addr), sizeof(addr)) >= 0;
+        ok = ok && ::setsockopt(fd_, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on)) >= 0;
+        ok = ok && ::setsockopt(fd_, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) >= 0;
+        if (!ok)
+        {
+            const int err = errno;
+            (void)::close(fd_);
+            throw std::runtime_error("Failed to set up CAN interface " + iface_name + "; errno: " +
+                                     std::to_string(err));
+        }
+
+        // Not critical; the kernel may cap the value at net.core.rmem_max
+        const int rcvbuf = SocketReceiveBufferSize;
+        (void)::setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+        for (unsigned i = 0; i < BatchSize; i++)
+        {
+            batch_iovecs_[i].iov_base = &batch_frames_[i];
+            batch_iovecs_[i].iov_len = sizeof(::can_frame);
+
+            std::memset(&batch_headers_[i], 0, sizeof(batch_headers_[i]));
+            batch_headers_[i].msg_hdr.msg_iov = &batch_iovecs_[i];
+            batch_headers_[i].msg_hdr.msg_iovlen = 1;
+            batch_headers_[i].msg_hdr.msg_control = batch_controls_[i].data();
+        }
+    }
+
+    ~BatchSocketCanIface()
+    {
+        (void)::close(fd_);
+    }
+
+    int getFileDescriptor() const { return fd_; }
+
+    bool hasPendingRx() const { return (rx_batch_pos_ < rx_batch_size_) || !loopback_queue_.empty(); }
+
+    /**
+     * Called by the driver when the socket is readable.
+     */
+    void poll()
+    {
+        if (rx_batch_pos_ >= rx_batch_size_)
+        {
+            (void)readBatch();
+        }
+    }
+
+    /**
+     * Cumulative number of frames dropped by the kernel because the socket buffer was full.
+     */
+    std::uint32_t getKernelDropCount() const { return kernel_drop_count_; }
+
+    std::int16_t send(const uavcan::CanFrame& frame, uavcan::MonotonicTime, uavcan::CanIOFlags flags) override
+    {
+        ::can_frame sockcan_frame;
+        std::memset(&sockcan_frame, 0, sizeof(sockcan_frame));
+        sockcan_frame.can_id = toSocketCanID(frame.id);
+        sockcan_frame.can_dlc = frame.dlc;
+        std::memcpy(sockcan_frame.data, frame.data, frame.dlc);
+
+        const ssize_t res = ::write(fd_, &sockcan_frame, sizeof(sockcan_frame));
+        if (res < 0)
+        {
+            if (errno == ENOBUFS || errno == EAGAIN)
+            {
+                return 0;                       // The TX queue is full; libuavcan will try again later
+            }
+            error_count_++;
+            return std::int16_t(-errno);
+        }
+
+        if (flags & uavcan::CanIOFlagLoopback)
+        {
+            ReceivedFrame loopback;
+            loopback.frame = frame;
+            loopback.ts_mono = clock_.getMonotonic();
+            loopback.ts_utc = clock_.getUtc();
+            loopback.flags = uavcan::CanIOFlagLoopback;
+            loopback_queue_.push(loopback);
+        }
+        return 1;
+    }
+
+    std::int16_t receive(uavcan::CanFrame& out_frame,
+                         uavcan::MonotonicTime& out_ts_monotonic,
+                         uavcan::UtcTime& out_ts_utc,
+                         uavcan::CanIOFlags& out_flags) override
+    {
+        const ReceivedFrame* rx = nullptr;
+        if (!loopback_queue_.empty())
+        {
+            rx = &loopback_queue_.front();
+        }
+        else
+        {
+            if (rx_batch_pos_ >= rx_batch_size_ && readBatch() <= 0)
+            {
+                return 0;
+            }
+            rx = &rx_batch_[rx_batch_pos_++];
+        }
+
+        out_frame = rx->frame;
+        out_ts_monotonic = rx->ts_mono;
+        out_ts_utc = rx->ts_utc;
+        out_flags = rx->flags;
+
+        if (rx->flags & uavcan::CanIOFlagLoopback)
+        {
+            loopback_queue_.pop();
+        }
+        return 1;
+    }
+
+    std::int16_t configureFilters(const uavcan::CanFilterConfig* filter_configs,
+                                  std::uint16_t num_configs) override
+    {
+        if ((num_configs > NumFilters) || ((num_configs > 0) && (filter_configs == nullptr)))
+        {
+            return -uavcan::ErrInvalidParam;
+        }
+
+        /*
+         * The mask is converted bit by bit rather than via toSocketCanID(), because a mask without FlagEFF
+         * would be cut down to 11 bits.
+         */
+        std::array<::can_filter, NumFilters> filters;
+        for (unsigned i = 0; i < num_configs; i++)
+        {
+            const uavcan::CanFilterConfig& fc = filter_configs[i];
+            filters[i].can_id = fc.id & uavcan::CanFrame::MaskExtID;
+            filters[i].can_mask = fc.mask & uavcan::CanFrame::MaskExtID;
+            if (fc.id & uavcan::CanFrame::FlagEFF)
+            {
+                filters[i].can_id |= CAN_EFF_FLAG;
+            }
+            if (fc.id & uavcan::CanFrame::FlagRTR)
+            {
+                filters[i].can_id |= CAN_RTR_FLAG;
+            }
+            if (fc.mask & uavcan::CanFrame::FlagEFF)
+            {
+                filters[i].can_mask |= CAN_EFF_FLAG;
+            }
+            if (fc.mask & uavcan::CanFrame::FlagRTR)
+            {
+                filters[i].can_mask |= CAN_RTR_FLAG;
+            }
+        }
+        if (num_configs == 0)
+        {
+            filters[0] = ::can_filter();            // Zero mask accepts everything
+            num_configs = 1;
+        }
+
+        if (::setsockopt(fd_, SOL_CAN_RAW, CAN_RAW_FILTER, filters.data(),
+                         socklen_t(sizeof(::can_filter) * num_configs)) < 0)
+        {
+            return std::int16_t(-errno);
+        }
+        return 0;
+    }
+
+    std::uint16_t getNumFilters() const override { return NumFilters; }
+
+    std::uint64_t getErrorCount() const override { return error_count_; }
+};
+
+/**
+ * Driver for any number of SocketCAN interfaces, up to uavcan::MaxCanIfaces.
+ */
+class BatchSocketCanDriver final : public uavcan::ICanDriver,
+                                   uavcan::Noncopyable
+{
+    const uavcan::ISystemClock& clock_;
+    std::vector<std::unique_ptr<BatchSocketCanIface>> ifaces_;
+
+public:
+    explicit BatchSocketCanDriver(const uavcan::ISystemClock& clock) :
+        clock_(clock)
+    { }
+
+    /**
+     * Throws std::runtime_error if the interface can't be opened or there are too many interfaces.
+     */
+    void addIface(const std::string& iface_name)
+    {
+        if (ifaces_.size() >= uavcan::MaxCanIfaces)
+        {
+            throw std::runtime_error("Too many CAN interfaces");
+        }
+        ifaces_.emplace_back(new BatchSocketCanIface(clock_, iface_name));
+    }
+
+    /**
+     * Sum over all interfaces.
+     */
+    std::uint64_t getKernelDropCount() const
+    {
+        std::uint64_t sum = 0;
+        for (auto& iface : ifaces_)
+        {
+            sum += iface->getKernelDropCount();
+        }
+        return sum;
+    }
+
+    uavcan::ICanIface* getIface(std::uint8_t iface_index) override
+    {
+        return (iface_index < ifaces_.size()) ? ifaces_[iface_index].get() : nullptr;
+    }
+
+    std::uint8_t getNumIfaces() const override { return std::uint8_t(ifaces_.size()); }
+
+    std::int16_t select(uavcan::CanSelectMasks& inout_masks,
+                        const uavcan::CanFrame* (&)[uavcan::MaxCanIfaces],
+                        uavcan::MonotonicTime blocking_deadline) override
+    {
+        /*
+         * If some frames are still buffered from the previous batch, we don't need to wait at all.
+         */
+        bool have_buffered_rx = false;
+        for (auto& iface : ifaces_)
+        {
+            have_buffered_rx = have_buffered_rx || iface->hasPendingRx();
+        }
+
+        int timeout_msec = 0;
+        if (!have_buffered_rx)
+        {
+            const auto now = clock_.getMonotonic();
+            if (blocking_deadline > now)
+            {
+                timeout_msec = int(((blocking_deadline - now).toUSec() + 999) / 1000);
+            }
+        }
+
+        std::array<::pollfd, uavcan::MaxCanIfaces> fds;
+        for (unsigned i = 0; i < ifaces_.size(); i++)
+        {
+            fds[i].fd = ifaces_[i]->getFileDescriptor();
+            fds[i].events = POLLIN;
+            if (inout_masks.write & (1U << i))
+            {
+                fds[i].events |= POLLOUT;
+            }
+            fds[i].revents = 0;
+        }
+
+        const int res = ::poll(fds.data(), ::nfds_t(ifaces_.size()), timeout_msec);
+        if (res < 0 && errno != EINTR)
+        {
+            return std::int16_t(-errno);
+        }
+
+        inout_masks.read = 0;
+        inout_masks.write = 0;
+        for (unsigned i = 0; i < ifaces_.size(); i++)
+        {
+            if (fds[i].revents & POLLIN)
+            {
+                ifaces_[i]->poll();
+            }
+            if (ifaces_[i]->hasPendingRx())
+            {
+                inout_masks.read |= std::uint8_t(1U << i);
+            }
+            if (fds[i].revents & POLLOUT)
+            {
+                inout_masks.write |= std::uint8_t(1U << i);
+            }
+        }
+
+        return std::int16_t(ifaces_.size());
+    }
+};
+
+/**
+ * Bounded lock-free ring for one producer thread and one consumer thread.
+ * Capacity must be a power of two.
+ */
+template <typename T, unsigned Capacity>
+class SpscRing : uavcan::Noncopyable
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    std::array<T, Capacity> items_;
+    alignas(64) std::atomic<unsigned> head_{0};     ///< Written by the consumer
+    alignas(64) std::atomic<unsigned> tail_{0};     ///< Written by the producer
+
+public:
+    /**
+     * Returns false if the ring is full.
+     */
+    bool push(const T& item)
+    {
+        const unsigned tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) >= Capacity)
+        {
+            return false;
+        }
+        items_[tail % Capacity] = item;
+        tail_.store(tail + 1U, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Returns false if the ring is empty.
+     */
+    bool pop(T& out_item)
+    {
+        const unsigned head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        out_item = items_[head % Capacity];
+        head_.store(head + 1U, std::memory_order_release);
+        return true;
+    }
+};
+
+/**
+ * Output buffer that is flushed into a file descriptor with one write() call per BufferSize bytes.
+ */
+class BufferedFdWriter final : public std::streambuf
+{
+public:
+    static constexpr unsigned BufferSize = 64 * 1024;
+
+private:
+    const int fd_;
+    std::vector<char> buffer_;
+
+    int_type overflow(int_type ch) override
+    {
+        if (sync() < 0)
+        {
+            return traits_type::eof();
+        }
+        if (ch != traits_type::eof())
+        {
+            *pptr() = char(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override
+    {
+        const char* p = pbase();
+        while (p < pptr())
+        {
+            const ssize_t res = ::write(fd_, p, std::size_t(pptr() - p));
+            if (res < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return -1;
+            }
+            p += res;
+        }
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+        return 0;
+    }
+
+public:
+    explicit BufferedFdWriter(int fd) :
+        fd_(fd),
+        buffer_(BufferSize)
+    {
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+    }
+
+    ~BufferedFdWriter() { (void)sync(); }
+};
+
+/**
+ * Formats the received messages as YAML on a separate thread.
+ * push() is to be called from the thread that spins the node, normally from the subscriber callback.
+ */
+template <typename DataType, unsigned RingCapacity = 4096>
+class AsyncYamlLogger : uavcan::Noncopyable
+{
+    struct Record
+    {
+        DataType msg;
+        uavcan::MonotonicTime ts_mono;
+        uavcan::UtcTime ts_utc;
+        std::uint8_t source_node_id = 0;
+        std::uint8_t transfer_id = 0;
+    };
+
+    /**
+     * The formatter sleeps this long when the ring is empty; the ring is large enough to absorb what arrives
+     * in the meantime on a saturated bus.
+     */
+    static constexpr unsigned IdleSleepMsec = 1;
+
+    SpscRing<Record, RingCapacity> ring_;
+    BufferedFdWriter writer_;
+    std::atomic<bool> running_{true};
+    std::atomic<std::uint64_t> drop_count_{0};
+    std::thread formatter_;
+
+    void formatterThread()
+    {
+        std::ostream out(&writer_);
+        Record record;
+        while (true)
+        {
+            // Sampled before draining, so that the messages pushed before the destruction are not lost
+            const bool stop_requested = !running_.load(std::memory_order_acquire);
+
+            bool got_any = false;
+            while (ring_.pop(record))
+            {
+                got_any = true;
+                out << "[" << DataType::getDataTypeFullName() << "]\n"
+                    << "# Source node " << int(record.source_node_id)
+                    << ", transfer ID " << int(record.transfer_id)
+                    << ", monotonic " << record.ts_mono.toUSec()
+                    << " us, UTC " << record.ts_utc.toUSec() << " us\n"
+                    << record.msg << "\n---\n";
+            }
+            if (got_any)
+            {
+                out.flush();
+            }
+            else if (stop_requested)
+            {
+                break;
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(IdleSleepMsec));
+            }
+        }
+    }
+
+public:
+    explicit AsyncYamlLogger(int output_fd) :
+        writer_(output_fd),
+        formatter_(&AsyncYamlLogger::formatterThread, this)
+    { }
+
+    ~AsyncYamlLogger()
+    {
+        running_.store(false, std::memory_order_release);
+        formatter_.join();
+    }
+
+    /**
+     * Never blocks. If the ring is full, the message is dropped and accounted in getDropCount().
+     */
+    void push(const uavcan::ReceivedDataStructure<DataType>& msg)
+    {
+        Record record;
+        record.msg = msg;
+        record.ts_mono = msg.getMonotonicTimestamp();
+        record.ts_utc = msg.getUtcTimestamp();
+        record.source_node_id = msg.getSrcNodeID().get();
+        record.transfer_id = msg.getTransferID().get();
+        if (!ring_.push(record))
+        {
+            drop_count_++;
+        }
+    }
+
+    std::uint64_t getDropCount() const { return drop_count_; }
+};
+
+}
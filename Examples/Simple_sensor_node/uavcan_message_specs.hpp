@@ -0,0 +1,222 @@
+/*
+ * Compile-time message specifications for the data types used by the simple sensor node.
+ *
+ * Every message is described by a set of constexpr constants: data type ID, data type signature, default priority,
+ * and the bit offset and length of each field. The CAN ID prefix and the field offsets are therefore computed at
+ * compile time, and each message gets a specialised pack()/unpack() function with no runtime descriptor lookup.
+ * The encoding follows the UAVCAN bit stream rules: bytes are filled starting from the most significant bit,
+ * multi-byte values are little-endian.
+ *
+ * Only single-frame messages whose fields are either byte-aligned multiples of 8 bits or fit into one byte are
+ * supported; this is enforced with static_assert. That covers the data types used by the example node.
+ *
+ * License: CC0, no copyright reserved
+ * Language: C++11
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include "float16.h"        // For make_float16(), make_float32()
+
+namespace uavcan_message_specs
+{
+/**
+ * Transfer priorities, same values as in simple_sensor_node.c.
+ */
+constexpr std::uint8_t PriorityHighest = 0;
+constexpr std::uint8_t PriorityHigh    = 8;
+constexpr std::uint8_t PriorityMedium  = 16;
+constexpr std::uint8_t PriorityLow     = 24;
+constexpr std::uint8_t PriorityLowest  = 31;
+
+/**
+ * Maximum payload of a single-frame transfer; the last byte of the CAN frame is occupied by the tail byte.
+ */
+constexpr unsigned MaxSingleFramePayloadBytes = 7;
+
+/**
+ * A field of BitLength_ bits located at BitOffset_ bits from the beginning of the payload.
+ * Both read() and write() are resolved at compile time into a handful of shifts; the branches below depend
+ * only on the template parameters.
+ */
+template <unsigned BitOffset_, unsigned BitLength_>
+struct Field
+{
+    static constexpr unsigned BitOffset = BitOffset_;
+    static constexpr unsigned BitLength = BitLength_;
+    static constexpr unsigned EndBitOffset = BitOffset + BitLength;
+
+    static constexpr unsigned ByteOffset = BitOffset / 8;
+    static constexpr bool IsByteAligned = (BitOffset % 8 == 0) && (BitLength % 8 == 0);
+    static constexpr bool IsWithinOneByte = (BitOffset % 8 + BitLength) <= 8;
+
+    static_assert(BitLength > 0 && BitLength <= 64, "Invalid field length");
+    static_assert(IsByteAligned || IsWithinOneByte, "Fields must be byte-aligned or fit into one byte");
+
+    /// Shift of a sub-byte field within its byte; bytes are filled starting from the most significant bit
+    static constexpr unsigned ShiftWithinByte = IsByteAligned ? 0 : (8 - BitOffset % 8 - BitLength);
+    static constexpr std::uint64_t Mask = (BitLength == 64) ? ~std::uint64_t(0) :
+                                                              ((std::uint64_t(1) << BitLength) - 1U);
+
+    /**
+     * The byte must be zero-initialized before a sub-byte field is written into it.
+     */
+    static void write(std::uint8_t* payload, std::uint64_t value)
+    {
+        value &= Mask;
+        if (IsByteAligned)
+        {
+            for (unsigned i = 0; i < BitLength / 8; i++)
+            {
+                payload[ByteOffset + i] = std::uint8_t(value >> (i * 8));
+            }
+        }
+        else
+        {
+            payload[ByteOffset] = std::uint8_t(payload[ByteOffset] | (value << ShiftWithinByte));
+        }
+    }
+
+    static std::uint64_t read(const std::uint8_t* payload)
+    {
+        std::uint64_t value = 0;
+        if (IsByteAligned)
+        {
+            for (unsigned i = 0; i < BitLength / 8; i++)
+            {
+                value |= std::uint64_t(payload[ByteOffset + i]) << (i * 8);
+            }
+        }
+        else
+        {
+            value = (payload[ByteOffset] >> ShiftWithinByte) & Mask;
+        }
+        return value;
+    }
+};
+
+/**
+ * A field that immediately follows the field Previous.
+ */
+template <typename Previous, unsigned BitLength>
+using FieldAfter = Field<Previous::EndBitOffset, BitLength>;
+
+/**
+ * Properties shared by all message specs.
+ * LastField is the last field of the message; it defines the payload length.
+ */
+template <std::uint16_t DataTypeID_, std::uint64_t DataTypeSignature_, std::uint8_t DefaultPriority_,
+          typename LastField>
+struct MessageSpec
+{
+    static constexpr std::uint16_t DataTypeID = DataTypeID_;
+    static constexpr std::uint64_t DataTypeSignature = DataTypeSignature_;
+    static constexpr std::uint8_t DefaultPriority = DefaultPriority_;
+
+    static constexpr unsigned PayloadBytes = (LastField::EndBitOffset + 7) / 8;
+
+    static_assert(DefaultPriority <= 31, "Invalid priority");
+    static_assert(PayloadBytes <= MaxSingleFramePayloadBytes, "Only single-frame messages are supported");
+
+    /**
+     * CAN ID without the source node ID; priority << 24 | data type ID << 8.
+     */
+    static constexpr std::uint32_t CanIDPrefix = (std::uint32_t(DefaultPriority) << 24) |
+                                                 (std::uint32_t(DataTypeID) << 8);
+
+    static constexpr std::uint32_t makeCanID(std::uint8_t source_node_id)
+    {
+        return CanIDPrefix | source_node_id;
+    }
+
+    static constexpr std::uint32_t makeCanID(std::uint8_t source_node_id, std::uint8_t priority)
+    {
+        return (std::uint32_t(priority) << 24) | (std::uint32_t(DataTypeID) << 8) | source_node_id;
+    }
+};
+
+/**
+ * Standard data type uavcan.protocol.NodeStatus.
+ */
+struct NodeStatus
+{
+    typedef Field<0, 32> UptimeSec;
+    typedef FieldAfter<UptimeSec, 2> Health;
+    typedef FieldAfter<Health, 3> Mode;
+    typedef FieldAfter<Mode, 3> SubMode;
+    typedef FieldAfter<SubMode, 16> VendorSpecificStatusCode;
+
+    typedef MessageSpec<341, 0x0F0868D0C1A7C6F1ULL, PriorityLow, VendorSpecificStatusCode> Spec;
+
+    std::uint32_t uptime_sec = 0;
+    std::uint8_t health = 0;
+    std::uint8_t mode = 0;
+    std::uint8_t sub_mode = 0;
+    std::uint16_t vendor_specific_status_code = 0;
+
+    /**
+     * Writes exactly Spec::PayloadBytes bytes.
+     */
+    void pack(std::uint8_t* out_payload) const
+    {
+        std::fill_n(out_payload, Spec::PayloadBytes, std::uint8_t(0));
+        UptimeSec::write(out_payload, uptime_sec);
+        Health::write(out_payload, health);
+        Mode::write(out_payload, mode);
+        SubMode::write(out_payload, sub_mode);
+        VendorSpecificStatusCode::write(out_payload, vendor_specific_status_code);
+    }
+
+    /**
+     * Reads exactly Spec::PayloadBytes bytes.
+     */
+    static NodeStatus unpack(const std::uint8_t* payload)
+    {
+        NodeStatus s;
+        s.uptime_sec = std::uint32_t(UptimeSec::read(payload));
+        s.health = std::uint8_t(Health::read(payload));
+        s.mode = std::uint8_t(Mode::read(payload));
+        s.sub_mode = std::uint8_t(SubMode::read(payload));
+        s.vendor_specific_status_code = std::uint16_t(VendorSpecificStatusCode::read(payload));
+        return s;
+    }
+};
+
+static_assert(NodeStatus::Spec::PayloadBytes == 7, "NodeStatus layout");
+static_assert(NodeStatus::Spec::CanIDPrefix == 0x18015500U, "NodeStatus CAN ID");
+
+/**
+ * Standard data type uavcan.equipment.air_data.TrueAirspeed.
+ */
+struct TrueAirspeed
+{
+    typedef Field<0, 16> TrueAirspeedValue;
+    typedef FieldAfter<TrueAirspeedValue, 16> TrueAirspeedVariance;
+
+    typedef MessageSpec<1020, 0x306F69E0A591AFAAULL, PriorityMedium, TrueAirspeedVariance> Spec;
+
+    float true_airspeed = 0.0F;
+    float true_airspeed_variance = 0.0F;
+
+    void pack(std::uint8_t* out_payload) const
+    {
+        std::fill_n(out_payload, Spec::PayloadBytes, std::uint8_t(0));
+        TrueAirspeedValue::write(out_payload, make_float16(true_airspeed));
+        TrueAirspeedVariance::write(out_payload, make_float16(true_airspeed_variance));
+    }
+
+    static TrueAirspeed unpack(const std::uint8_t* payload)
+    {
+        TrueAirspeed s;
+        s.true_airspeed = make_float32(std::uint16_t(TrueAirspeedValue::read(payload)));
+        s.true_airspeed_variance = make_float32(std::uint16_t(TrueAirspeedVariance::read(payload)));
+        return s;
+    }
+};
+
+static_assert(TrueAirspeed::Spec::PayloadBytes == 4, "TrueAirspeed layout");
+static_assert(TrueAirspeed::Spec::CanIDPrefix == 0x1003FC00U, "TrueAirspeed CAN ID");
+
+}
@@ -0,0 +1,449 @@
+/**
+ * Server-side fast path for the dynamic node ID allocation, useful when many known nodes start at once.
+ *
+ * The allocators process allocation requests one at a time, and every allocatee has to deliver its unique ID in
+ * three stages before it gets a response, so the time needed to re-allocate a vehicle full of nodes after power up
+ * grows linearly with the number of nodes. However, after the first power up the allocation table already contains
+ * every node, and it never changes - allocation tables can only grow.
+ *
+ * This header provides two classes:
+ *  - AllocationTableIndex, a storage backend decorator that keeps an in-memory hash index of the allocation table.
+ *    It is pre-loaded from the storage on startup and then updated as the allocator writes new entries.
+ *  - AllocationFastPath, which answers the first-stage requests of the known allocatees with the final allocation
+ *    response straight away, if the first part of the unique ID matches exactly one entry of the table.
+ *    The allocatee accepts the response only if the complete unique ID matches, so the fast path can't cause
+ *    a wrong allocation. The requests of unknown allocatees are still handled by the allocator as usual.
+ *
+ * With a distributed allocator, the fast path responds only if the local server is the Raft leader, and only
+ * with the log entries that have been committed.
+ *
+ * The centralized allocator doesn't allow to enumerate the table - its keys are the unique IDs - so the index
+ * stores an additional reverse entry (node ID to unique ID) per allocation. Entries that have been allocated
+ * before the index was used will be picked up once the respective nodes are allocated again via the regular path.
+ *
+ * @file allocation_fast_path.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <algorithm>                                                // For std::equal()
+#include <array>                                                    // For std::array
+#include <cstdlib>                                                  // For std::strtoul()
+#include <cstring>                                                  // For std::strcmp(), std::strncmp()
+#include <functional>                                               // For std::function
+#include <map>                                                      // For std::map
+#include <unordered_map>                                            // For std::unordered_map
+#include <vector>                                                   // For std::vector
+#include <uavcan/uavcan.hpp>                                        // Main libuavcan header
+#include <uavcan/protocol/dynamic_node_id/Allocation.hpp>           // For uavcan::protocol::dynamic_node_id::Allocation
+#include <uavcan/protocol/dynamic_node_id_server/distributed.hpp>   // For the Raft state report
+
+namespace allocation_fast_path
+{
+using uavcan::protocol::dynamic_node_id::Allocation;
+using uavcan::dynamic_node_id_server::IStorageBackend;
+
+typedef std::array<std::uint8_t, 16> UniqueID;
+
+/**
+ * Storage backend decorator that indexes the allocation table; all calls are forwarded to the real backend.
+ * Both the centralized and the distributed allocators are supported.
+ */
+class AllocationTableIndex : public IStorageBackend,
+                             uavcan::Noncopyable
+{
+public:
+    struct Entry
+    {
+        UniqueID unique_id;
+        std::uint8_t node_id = 0;
+        std::uint32_t log_index = 0;        ///< Index of the Raft log entry; always zero for the centralized allocator
+    };
+
+private:
+    /**
+     * Number of bytes of the unique ID that are delivered in the first stage of the allocation exchange.
+     */
+    static constexpr unsigned PrefixLength = 6;
+
+    /**
+     * A distributed log entry is indexed once both its unique ID and node ID have been written.
+     */
+    struct PendingLogEntry
+    {
+        UniqueID unique_id;
+        std::uint8_t node_id = 0;
+        bool has_unique_id = false;
+        bool has_node_id = false;
+    };
+
+    IStorageBackend& backend_;
+    std::unordered_map<std::uint64_t, std::vector<Entry>> entries_by_prefix_;
+    std::map<std::uint32_t, PendingLogEntry> pending_log_entries_;
+    unsigned num_entries_ = 0;
+
+    static std::uint64_t makePrefixKey(const std::uint8_t* unique_id)
+    {
+        std::uint64_t key = 0;
+        for (unsigned i = 0; i < PrefixLength; i++)
+        {
+            key = (key << 8) | unique_id[i];
+        }
+        return key;
+    }
+
+    static String makeReverseKey(std::uint8_t node_id)
+    {
+        String key;
+        key += "node";
+        key.appendFormatted("%d", int(node_id));
+        key += "_unique_id";
+        return key;
+    }
+
+    static bool parseHexUniqueID(const String& str, UniqueID& out)
+    {
+        if (str.size() != out.size() * 2)
+        {
+            return false;
+        }
+        for (unsigned i = 0; i < str.size(); i++)
+        {
+            const char c = char(str[i]);
+            unsigned nibble = 0;
+            if ((c >= '0') && (c <= '9'))
+            {
+                nibble = unsigned(c - '0');
+            }
+            else if ((c >= 'a') && (c <= 'f'))
+            {
+                nibble = unsigned(c - 'a' + 10);
+            }
+            else if ((c >= 'A') && (c <= 'F'))
+            {
+                nibble = unsigned(c - 'A' + 10);
+            }
+            else
+            {
+                return false;
+            }
+            out[i / 2] = std::uint8_t((i % 2 == 0) ? (nibble << 4) : (out[i / 2] | nibble));
+        }
+        return true;
+    }
+
+    static bool parseUnsigned(const String& str, std::uint32_t& out)
+    {
+        if (str.empty())
+        {
+            return false;
+        }
+        char* end = nullptr;
+        out = std::uint32_t(std::strtoul(str.c_str(), &end, 10));
+        return *end == '\0';
+    }
+
+    /**
+     * Parses keys of the form "log<index>_<postfix>", which are used by the distributed allocator.
+     */
+    static bool parseLogEntryKey(const String& key, const char* postfix, std::uint32_t& out_index)
+    {
+        const char* const str = key.c_str();
+        if (std::strncmp(str, "log", 3) != 0)
+        {
+            return false;
+        }
+        char* end = nullptr;
+        out_index = std::uint32_t(std::strtoul(str + 3, &end, 10));
+        return (end != str + 3) && (*end == '_') && (std::strcmp(end + 1, postfix) == 0);
+    }
+
+    void addEntry(const UniqueID& unique_id, std::uint8_t node_id, std::uint32_t log_index)
+    {
+        if (node_id == 0)
+        {
+            return;                         // The first entry of the Raft log doesn't describe an allocation
+        }
+        auto& bucket = entries_by_prefix_[makePrefixKey(unique_id.data())];
+        for (auto& e : bucket)
+        {
+            if (e.unique_id == unique_id)
+            {
+                e.node_id = node_id;
+                e.log_index = log_index;
+                return;
+            }
+        }
+        Entry entry;
+        entry.unique_id = unique_id;
+        entry.node_id = node_id;
+        entry.log_index = log_index;
+        bucket.push_back(entry);
+        num_entries_++;
+    }
+
+    /**
+     * Invoked when the Raft log is truncated; the entries above the new last index are no longer valid.
+     */
+    void removeLogEntriesAbove(std::uint32_t last_index)
+    {
+        for (auto& kv : entries_by_prefix_)
+        {
+            auto& bucket = kv.second;
+            for (auto it = bucket.begin(); it != bucket.end();)
+            {
+                if (it->log_index > last_index)
+                {
+                    it = bucket.erase(it);
+                    num_entries_--;
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+        pending_log_entries_.erase(pending_log_entries_.upper_bound(last_index), pending_log_entries_.end());
+    }
+
+    void updatePendingLogEntry(std::uint32_t index, const std::function<void (PendingLogEntry&)>& updater)
+    {
+        auto& pending = pending_log_entries_[index];
+        updater(pending);
+        if (pending.has_unique_id && pending.has_node_id)
+        {
+            addEntry(pending.unique_id, pending.node_id, index);
+            pending_log_entries_.erase(index);
+        }
+    }
+
+    /**
+     * Updates the index according to a key/value pair written by the allocator.
+     */
+    void learn(const String& key, const String& value)
+    {
+        UniqueID unique_id;
+        std::uint32_t number = 0;
+        std::uint32_t index = 0;
+
+        if (parseHexUniqueID(key, unique_id) && parseUnsigned(value, number))
+        {
+            // Centralized allocator: the key is the unique ID, the value is the node ID
+            addEntry(unique_id, std::uint8_t(number), 0);
+            backend_.set(makeReverseKey(std::uint8_t(number)), key);
+        }
+        else if (parseLogEntryKey(key, "unique_id", index) && parseHexUniqueID(value, unique_id))
+        {
+            updatePendingLogEntry(index, [&](PendingLogEntry& p)
+                {
+                    p.unique_id = unique_id;
+                    p.has_unique_id = true;
+                });
+        }
+        else if (parseLogEntryKey(key, "node_id", index) && parseUnsigned(value, number))
+        {
+            updatePendingLogEntry(index, [&](PendingLogEntry& p)
+                {
+                    p.node_id = std::uint8_t(number);
+                    p.has_node_id = true;
+                });
+        }
+        else if ((std::strcmp(key.c_str(), "log_last_index") == 0) && parseUnsigned(value, number))
+        {
+            removeLogEntriesAbove(number);
+        }
+        else
+        {
+            ;   // Not a part of the allocation table
+        }
+    }
+
+public:
+    explicit AllocationTableIndex(IStorageBackend& backend) :
+        backend_(backend)
+    { }
+
+    /**
+     * Pre-loads the index from the storage. Must be invoked before the allocator is initialized.
+     * Returns the number of entries loaded.
+     */
+    unsigned load()
+    {
+        entries_by_prefix_.clear();
+        pending_log_entries_.clear();
+        num_entries_ = 0;
+
+        UniqueID unique_id;
+        std::uint32_t number = 0;
+
+        // Reverse entries written for the centralized allocator
+        for (unsigned node_id = 1; node_id <= uavcan::NodeID::Max; node_id++)
+        {
+            if (parseHexUniqueID(backend_.get(makeReverseKey(std::uint8_t(node_id))), unique_id))
+            {
+                addEntry(unique_id, std::uint8_t(node_id), 0);
+            }
+        }
+
+        // Raft log of the distributed allocator
+        std::uint32_t last_index = 0;
+        if (parseUnsigned(backend_.get("log_last_index"), last_index))
+        {
+            for (std::uint32_t index = 0; index <= last_index; index++)
+            {
+                String key;
+                key += "log";
+                key.appendFormatted("%d", int(index));
+                key += "_";
+                const String prefix = key;
+
+                key += "unique_id";
+                const bool valid_unique_id = parseHexUniqueID(backend_.get(key), unique_id);
+                key = prefix;
+                key += "node_id";
+                if (valid_unique_id && parseUnsigned(backend_.get(key), number))
+                {
+                    addEntry(unique_id, std::uint8_t(number), index);
+                }
+            }
+        }
+
+        return num_entries_;
+    }
+
+    /**
+     * Finds the only entry whose unique ID starts with the specified bytes.
+     * Returns nullptr if there is no such entry, or if the bytes are not enough to tell the entries apart.
+     */
+    const Entry* find(const std::uint8_t* unique_id_prefix, unsigned length) const
+    {
+        if (length < PrefixLength)
+        {
+            return nullptr;
+        }
+        const auto it = entries_by_prefix_.find(makePrefixKey(unique_id_prefix));
+        if (it == entries_by_prefix_.end())
+        {
+            return nullptr;
+        }
+        const Entry* match = nullptr;
+        for (auto& e : it->second)
+        {
+            if (std::equal(unique_id_prefix, unique_id_prefix + length, e.unique_id.begin()))
+            {
+                if (match != nullptr)
+                {
+                    return nullptr;         // Ambiguous
+                }
+                match = &e;
+            }
+        }
+        return match;
+    }
+
+    unsigned getNumEntries() const { return num_entries_; }
+
+    String get(const String& key) const override
+    {
+        return backend_.get(key);
+    }
+
+    void set(const String& key, const String& value) override
+    {
+        backend_.set(key, value);
+        learn(key, value);
+    }
+};
+
+/**
+ * Answers the first-stage allocation requests of the known allocatees.
+ * It runs alongside the allocator, on the same node.
+ */
+class AllocationFastPath : uavcan::Noncopyable
+{
+    typedef std::function<void (const uavcan::ReceivedDataStructure<Allocation>&)> AllocationCallback;
+
+    uavcan::Subscriber<Allocation, AllocationCallback> sub_;
+    uavcan::Publisher<Allocation> pub_;
+    const AllocationTableIndex& index_;
+    uavcan::dynamic_node_id_server::DistributedServer* const distributed_server_;
+    unsigned num_responses_ = 0;
+
+    bool isCommitted(const AllocationTableIndex::Entry& entry) const
+    {
+        if (distributed_server_ == nullptr)
+        {
+            return true;
+        }
+        using uavcan::dynamic_node_id_server::distributed::RaftCore;
+        const uavcan::dynamic_node_id_server::distributed::StateReport report(*distributed_server_);
+        return (report.state == RaftCore::ServerStateLeader) && (entry.log_index <= report.commit_index);
+    }
+
+    void handleAllocation(const uavcan::ReceivedDataStructure<Allocation>& msg)
+    {
+        /*
+         * Only the first stage of a request can be answered. Responses from other allocators are ignored.
+         * Note that a CAN FD frame may contain the complete unique ID.
+         */
+        if (!msg.isAnonymousTransfer() ||
+            !msg.first_part_of_unique_id ||
+            (msg.unique_id.size() < Allocation::MAX_LENGTH_OF_UNIQUE_ID_IN_REQUEST))
+        {
+            return;
+        }
+
+        const auto entry = index_.find(msg.unique_id.begin(), msg.unique_id.size());
+        if ((entry == nullptr) || !isCommitted(*entry))
+        {
+            return;
+        }
+
+        Allocation response;
+        response.node_id = entry->node_id;
+        for (auto x : entry->unique_id)
+        {
+            response.unique_id.push_back(x);
+        }
+
+        const int res = pub_.broadcast(response);
+        if (res >= 0)
+        {
+            num_responses_++;
+        }
+    }
+
+public:
+    /**
+     * @param node                  The node the allocator is running on.
+     * @param index                 The index that is used as the storage backend of the allocator.
+     * @param distributed_server    Must be provided if the allocator is distributed.
+     */
+    AllocationFastPath(uavcan::INode& node,
+                       const AllocationTableIndex& index,
+                       uavcan::dynamic_node_id_server::DistributedServer* distributed_server = nullptr) :
+        sub_(node),
+        pub_(node),
+        index_(index),
+        distributed_server_(distributed_server)
+    { }
+
+    /**
+     * The priority should be the same as that of the allocator.
+     */
+    int start(const uavcan::TransferPriority priority = uavcan::TransferPriority::OneHigherThanLowest)
+    {
+        const int pub_res = pub_.init(priority);
+        if (pub_res < 0)
+        {
+            return pub_res;
+        }
+        return sub_.start(std::bind(&AllocationFastPath::handleAllocation, this, std::placeholders::_1));
+    }
+
+    unsigned getNumResponses() const { return num_responses_; }
+};
+
+}
@@ -0,0 +1,228 @@
+/**
+ * Dynamic node ID allocation client with a contention-aware request timing.
+ *
+ * This class is a drop-in replacement for uavcan::DynamicNodeIDClient. It implements the same allocatee algorithm,
+ * but it is better behaved when many allocatees start at the same moment:
+ *  - The client listens to the responses that are addressed to other allocatees. While the allocator is engaged
+ *    in an exchange with another allocatee, it ignores new first-stage requests, so the client postpones its
+ *    request until that exchange is finished or timed out, plus a random delay.
+ *  - Every time an exchange is lost to another allocatee or receives no response at all, the random request period
+ *    is drawn from a wider window; the window is reset once the allocator makes progress with this client.
+ *    The lower bound of the window is always MIN_REQUEST_PERIOD_MS; the upper bound starts at
+ *    MAX_REQUEST_PERIOD_MS and can grow up to MaxRequestPeriodMultiplier times wider than the original window.
+ *  - The random generator is seeded with the unique ID, so identical nodes powered up at the same moment
+ *    don't pick identical delays.
+ *
+ * @file backoff_allocation_client.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <algorithm>                                        // For std::equal(), std::min()
+#include <functional>                                       // For std::function
+#include <random>                                           // For std::minstd_rand
+#include <uavcan/uavcan.hpp>                                // Main libuavcan header
+#include <uavcan/protocol/dynamic_node_id/Allocation.hpp>   // For uavcan::protocol::dynamic_node_id::Allocation
+
+namespace backoff_allocation_client
+{
+using uavcan::protocol::dynamic_node_id::Allocation;
+
+class BackoffAllocationClient : private uavcan::TimerBase
+{
+public:
+    typedef uavcan::protocol::HardwareVersion::FieldTypes::unique_id UniqueID;
+
+    static constexpr unsigned MaxRequestPeriodMultiplier = 8;
+
+private:
+    typedef std::function<void (const uavcan::ReceivedDataStructure<Allocation>&)> AllocationCallback;
+
+    uavcan::Subscriber<Allocation, AllocationCallback> sub_;
+    uavcan::Publisher<Allocation> pub_;
+    std::minstd_rand prng_;
+
+    UniqueID unique_id_;
+    std::uint8_t preferred_node_id_ = 0;
+    unsigned num_confirmed_bytes_ = 0;          ///< Length of the part of the unique ID echoed by the allocator
+    bool awaiting_response_ = false;
+    unsigned request_period_multiplier_ = 1;
+    uavcan::MonotonicTime allocator_busy_until_;
+
+    uavcan::NodeID allocated_node_id_;
+    uavcan::NodeID allocator_node_id_;
+    unsigned num_requests_ = 0;
+
+    unsigned getRandomMSec(unsigned min, unsigned max)
+    {
+        return min + unsigned(prng_() % (max - min + 1U));
+    }
+
+    uavcan::MonotonicDuration getRandomRequestPeriod()
+    {
+        const unsigned min = Allocation::MIN_REQUEST_PERIOD_MS;
+        const unsigned max = min + (Allocation::MAX_REQUEST_PERIOD_MS - min) * request_period_multiplier_;
+        return uavcan::MonotonicDuration::fromMSec(getRandomMSec(min, max));
+    }
+
+    uavcan::MonotonicDuration getRandomFollowupDelay()
+    {
+        return uavcan::MonotonicDuration::fromMSec(getRandomMSec(Allocation::MIN_FOLLOWUP_DELAY_MS,
+                                                                 Allocation::MAX_FOLLOWUP_DELAY_MS));
+    }
+
+    void backOff()
+    {
+        num_confirmed_bytes_ = 0;
+        request_period_multiplier_ = std::min(request_period_multiplier_ * 2U, MaxRequestPeriodMultiplier);
+    }
+
+    void sendRequest()
+    {
+        Allocation msg;
+        msg.node_id = preferred_node_id_;
+        msg.first_part_of_unique_id = (num_confirmed_bytes_ == 0);
+
+        const unsigned end = std::min<unsigned>(num_confirmed_bytes_ + Allocation::MAX_LENGTH_OF_UNIQUE_ID_IN_REQUEST,
+                                                unique_id_.size());
+        for (unsigned i = num_confirmed_bytes_; i < end; i++)
+        {
+            msg.unique_id.push_back(unique_id_[i]);
+        }
+
+        const int res = pub_.broadcast(msg);
+        if (res >= 0)
+        {
+            num_requests_++;
+        }
+    }
+
+    void handleTimerEvent(const uavcan::TimerEvent& event) override
+    {
+        if (awaiting_response_)
+        {
+            backOff();                      // The allocator didn't respond in time, starting over
+        }
+        awaiting_response_ = false;
+
+        /*
+         * A new exchange shall not be started while the allocator is busy with another allocatee.
+         */
+        if ((num_confirmed_bytes_ == 0) && (event.real_time < allocator_busy_until_))
+        {
+            startOneShotWithDeadline(allocator_busy_until_ + getRandomFollowupDelay());
+            return;
+        }
+
+        sendRequest();
+        awaiting_response_ = true;
+        startOneShotWithDelay(getRandomRequestPeriod());
+    }
+
+    void handleAllocation(const uavcan::ReceivedDataStructure<Allocation>& msg)
+    {
+        if (isAllocationComplete() ||
+            msg.isAnonymousTransfer() ||            // Requests from other allocatees
+            msg.unique_id.empty())
+        {
+            return;
+        }
+
+        const bool complete = msg.unique_id.size() == msg.unique_id.capacity();
+
+        if (!std::equal(msg.unique_id.begin(), msg.unique_id.end(), unique_id_.begin()))
+        {
+            /*
+             * The allocator is serving another allocatee. If this client was in the middle of an exchange,
+             * the exchange has been lost.
+             */
+            allocator_busy_until_ = complete ?
+                msg.getMonotonicTimestamp() :
+                msg.getMonotonicTimestamp() + uavcan::MonotonicDuration::fromMSec(Allocation::FOLLOWUP_TIMEOUT_MS);
+
+            if (awaiting_response_ || (num_confirmed_bytes_ > 0))
+            {
+                backOff();
+                awaiting_response_ = false;
+                startOneShotWithDelay(getRandomRequestPeriod());
+            }
+            return;
+        }
+
+        request_period_multiplier_ = 1;
+        awaiting_response_ = false;
+
+        if (complete)
+        {
+            if (msg.node_id > 0)
+            {
+                allocated_node_id_ = msg.node_id;
+                allocator_node_id_ = msg.getSrcNodeID();
+                stop();
+            }
+            return;
+        }
+
+        num_confirmed_bytes_ = msg.unique_id.size();
+        startOneShotWithDelay(getRandomFollowupDelay());
+    }
+
+public:
+    explicit BackoffAllocationClient(uavcan::INode& node) :
+        uavcan::TimerBase(node),
+        sub_(node),
+        pub_(node)
+    { }
+
+    /**
+     * @param unique_id             Must be the same as in the hardware version of the node.
+     * @param preferred_node_id     Zero means no preference.
+     * @param priority              The priority of the allocation requests.
+     */
+    int start(const UniqueID& unique_id,
+              const uavcan::NodeID preferred_node_id = uavcan::NodeID(0),
+              const uavcan::TransferPriority priority = uavcan::TransferPriority::OneHigherThanLowest)
+    {
+        unique_id_ = unique_id;
+        preferred_node_id_ = preferred_node_id.isUnicast() ? preferred_node_id.get() : 0;
+        allocated_node_id_ = uavcan::NodeID();
+        allocator_node_id_ = uavcan::NodeID();
+        num_confirmed_bytes_ = 0;
+        awaiting_response_ = false;
+        request_period_multiplier_ = 1;
+
+        std::seed_seq seed(unique_id_.begin(), unique_id_.end());
+        prng_.seed(seed);
+
+        const int pub_res = pub_.init(priority);
+        if (pub_res < 0)
+        {
+            return pub_res;
+        }
+        pub_.allowAnonymousTransfers();
+
+        const int sub_res = sub_.start(std::bind(&BackoffAllocationClient::handleAllocation, this,
+                                                 std::placeholders::_1));
+        if (sub_res < 0)
+        {
+            return sub_res;
+        }
+
+        startOneShotWithDelay(getRandomRequestPeriod());
+        return 0;
+    }
+
+    bool isAllocationComplete() const { return allocated_node_id_.isUnicast(); }
+
+    uavcan::NodeID getAllocatedNodeID() const { return allocated_node_id_; }
+    uavcan::NodeID getAllocatorNodeID() const { return allocator_node_id_; }
+
+    /**
+     * Number of requests sent so far; useful for evaluating the request timing.
+     */
+    unsigned getNumRequests() const { return num_requests_; }
+};
+
+}
@@ -0,0 +1,246 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <uavcan/uavcan.hpp>
+#include <uavcan/protocol/dynamic_node_id_client.hpp>
+#include <uavcan/protocol/dynamic_node_id_server/centralized.hpp>
+#include <uavcan_linux/uavcan_linux.hpp>    // For uavcan_linux::SocketCanDriver, uavcan_linux::makeApplicationID()
+
+/*
+ * The fast path, the client, and the storage backend are implemented in separate headers (see below).
+ */
+#include "allocation_fast_path.hpp"
+#include "backoff_allocation_client.hpp"
+#include "journal_storage_backend.hpp"
+
+/*
+ * This application measures the time until all allocatees get their node IDs, when all of them start at once.
+ * All nodes run in this process, each with its own CAN driver, so they communicate through the virtual CAN bus
+ * just like separate processes would. Make sure that the interface "vcan0" is up, and that no other nodes
+ * are running on it.
+ */
+extern uavcan::ISystemClock& getSystemClock();
+
+constexpr unsigned AllocatorNodeMemoryPoolSize = 32768;
+constexpr unsigned AllocateeNodeMemoryPoolSize = 8192;
+
+static const std::string NodeName = "org.uavcan.tutorial.bulk_allocation_benchmark";
+static const char* const StorageDirectory = "uavcan_db_bulk_benchmark";
+static const char* const StoragePath = "uavcan_db_bulk_benchmark/journal";
+
+static const auto TrialTimeout = std::chrono::seconds(300);
+
+/**
+ * The allocator's events are not needed here.
+ */
+class NullEventTracer : public uavcan::dynamic_node_id_server::IEventTracer
+{
+    void onEvent(uavcan::dynamic_node_id_server::TraceCode, std::int64_t) override { }
+};
+
+static std::unique_ptr<uavcan_linux::SocketCanDriver> makeCanDriver()
+{
+    std::unique_ptr<uavcan_linux::SocketCanDriver> driver(
+        new uavcan_linux::SocketCanDriver(dynamic_cast<const uavcan_linux::SystemClock&>(getSystemClock())));
+    if (driver->addIface("vcan0") < 0)
+    {
+        throw std::runtime_error("Failed to add iface");
+    }
+    return driver;
+}
+
+static uavcan::protocol::HardwareVersion::FieldTypes::unique_id getUniqueID(std::uint8_t instance_id)
+{
+    const auto id = uavcan_linux::makeApplicationID(uavcan_linux::MachineIDReader().read(), NodeName, instance_id);
+    uavcan::protocol::HardwareVersion::FieldTypes::unique_id out;
+    std::copy(id.begin(), id.end(), out.begin());
+    return out;
+}
+
+template <typename Client>
+struct Allocatee
+{
+    std::unique_ptr<uavcan_linux::SocketCanDriver> driver = makeCanDriver();
+    uavcan::Node<AllocateeNodeMemoryPoolSize> node;
+    Client client;
+    bool done = false;
+
+    explicit Allocatee(std::uint8_t instance_id) :
+        node(*driver, getSystemClock()),
+        client(node)
+    {
+        uavcan::protocol::HardwareVersion hwver;
+        hwver.unique_id = getUniqueID(instance_id);
+        node.setName(NodeName.c_str());
+        node.setHardwareVersion(hwver);
+
+        const int node_start_res = node.start();
+        if (node_start_res < 0)
+        {
+            throw std::runtime_error("Failed to start the allocatee; error: " + std::to_string(node_start_res));
+        }
+    }
+};
+
+/**
+ * Runs one allocator and the specified number of allocatees until all allocatees get their node IDs.
+ * Returns the time it took in seconds, or a negative value on timeout.
+ */
+template <typename Client>
+static double runTrial(unsigned num_allocatees, bool use_fast_path)
+{
+    /*
+     * The allocator. A fast storage backend is used in order to keep the performance of the file system
+     * out of the measurements.
+     */
+    auto allocator_driver = makeCanDriver();
+    uavcan::Node<AllocatorNodeMemoryPoolSize> allocator_node(*allocator_driver, getSystemClock());
+    allocator_node.setNodeID(1);
+    allocator_node.setName(NodeName.c_str());
+
+    const int node_start_res = allocator_node.start();
+    if (node_start_res < 0)
+    {
+        throw std::runtime_error("Failed to start the allocator node; error: " + std::to_string(node_start_res));
+    }
+
+    journal_storage::JournalStorageBackend storage_backend;
+    const int storage_res = storage_backend.init(StoragePath);
+    if (storage_res < 0)
+    {
+        throw std::runtime_error("Failed to start the storage backend; error: " + std::to_string(storage_res));
+    }
+
+    allocation_fast_path::AllocationTableIndex table_index(storage_backend);
+    (void)table_index.load();
+
+    NullEventTracer event_tracer;
+    uavcan::dynamic_node_id_server::CentralizedServer server(allocator_node, table_index, event_tracer);
+    const int server_init_res = server.init(getUniqueID(0));
+    if (server_init_res < 0)
+    {
+        throw std::runtime_error("Failed to start the server; error " + std::to_string(server_init_res));
+    }
+
+    allocation_fast_path::AllocationFastPath fast_path(allocator_node, table_index);
+    if (use_fast_path)
+    {
+        const int fast_path_res = fast_path.start();
+        if (fast_path_res < 0)
+        {
+            throw std::runtime_error("Failed to start the fast path; error " + std::to_string(fast_path_res));
+        }
+    }
+
+    allocator_node.setModeOperational();
+
+    /*
+     * The allocatees. Instance ID 0 is taken by the allocator.
+     */
+    std::vector<std::unique_ptr<Allocatee<Client>>> allocatees;
+    for (unsigned i = 0; i < num_allocatees; i++)
+    {
+        allocatees.emplace_back(new Allocatee<Client>(std::uint8_t(i + 1)));
+    }
+
+    const auto started_at = std::chrono::steady_clock::now();
+
+    for (auto& a : allocatees)
+    {
+        const int client_start_res = a->client.start(a->node.getHardwareVersion().unique_id);
+        if (client_start_res < 0)
+        {
+            throw std::runtime_error("Failed to start the client; error: " + std::to_string(client_start_res));
+        }
+    }
+
+    unsigned num_allocated = 0;
+    while (num_allocated < num_allocatees)
+    {
+        if ((std::chrono::steady_clock::now() - started_at) > TrialTimeout)
+        {
+            return -1.0;
+        }
+
+        (void)allocator_node.spinOnce();
+
+        for (auto& a : allocatees)
+        {
+            (void)a->node.spinOnce();
+            if (!a->done && a->client.isAllocationComplete())
+            {
+                a->node.setNodeID(a->client.getAllocatedNodeID());
+                a->node.setModeOperational();
+                a->done = true;
+                num_allocated++;
+            }
+        }
+
+        ::usleep(100);
+    }
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - started_at).count();
+}
+
+static void printResult(double seconds)
+{
+    if (seconds < 0)
+    {
+        std::cout << std::setw(14) << "timeout" << std::flush;
+    }
+    else
+    {
+        std::cout << std::setw(14) << std::fixed << std::setprecision(2) << seconds << std::flush;
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    unsigned max_allocatees = 120;
+    if (argc > 1)
+    {
+        max_allocatees = unsigned(std::stoi(argv[1]));
+    }
+    if ((max_allocatees < 1) || (max_allocatees > 124))
+    {
+        std::cerr << "Usage: " << argv[0] << " [max-allocatees (1..124)]" << std::endl;
+        return 1;
+    }
+
+    (void)::mkdir(StorageDirectory, 0755);                                  // May already exist
+
+    /*
+     * Columns:
+     *  - Cold:         empty allocation table, standard client, standard allocator.
+     *  - Warm:         the table contains all allocatees, standard client, standard allocator.
+     *  - Fast path:    the table contains all allocatees, standard client, allocator with the fast path.
+     *  - Backoff:      the table contains all allocatees, backoff-aware client, allocator with the fast path.
+     */
+    std::cout << std::setw(5) << "N" << std::setw(14) << "Cold, s" << std::setw(14) << "Warm, s"
+              << std::setw(14) << "Fast path, s" << std::setw(14) << "Backoff, s" << std::endl;
+
+    std::vector<unsigned> trial_sizes;
+    for (unsigned n = 10; n < max_allocatees; n += 10)
+    {
+        trial_sizes.push_back(n);
+    }
+    trial_sizes.push_back(max_allocatees);
+
+    for (auto n : trial_sizes)
+    {
+        (void)::unlink(StoragePath);                                        // Starting with an empty table
+
+        std::cout << std::setw(5) << n << std::flush;
+        printResult(runTrial<uavcan::DynamicNodeIDClient>(n, false));
+        printResult(runTrial<uavcan::DynamicNodeIDClient>(n, false));
+        printResult(runTrial<uavcan::DynamicNodeIDClient>(n, true));
+        printResult(runTrial<backoff_allocation_client::BackoffAllocationClient>(n, true));
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
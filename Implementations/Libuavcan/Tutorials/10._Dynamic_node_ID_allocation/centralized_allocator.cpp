@@ -13,6 +13,11 @@
 #include <uavcan_posix/dynamic_node_id_server/file_storage_backend.hpp>
 #include <uavcan_posix/dynamic_node_id_server/file_event_tracer.hpp>
 
+/*
+ * The allocation fast path is implemented in a separate header (see below).
+ */
+#include "allocation_fast_path.hpp"
+
 #if __linux__
 /*
  * This inclusion is specific to Linux.
@@ -103,11 +108,18 @@ int main(int argc, const char** argv)
         throw std::runtime_error("Failed to start the storage backend; error: " + std::to_string(storage_res));
     }
 
+    /*
+     * The allocation table index wraps the storage backend, so that it can keep track of the allocation table.
+     * It must be loaded before the allocator is started.
+     */
+    allocation_fast_path::AllocationTableIndex table_index(storage_backend);
+    std::cout << table_index.load() << " known allocatees" << std::endl;
+
     /*
      * Starting the allocator itself.
      * Its constructor accepts references to the node, to the event tracer, and to the storage backend.
      */
-    uavcan::dynamic_node_id_server::CentralizedServer server(node, storage_backend, event_tracer);
+    uavcan::dynamic_node_id_server::CentralizedServer server(node, table_index, event_tracer);
 
     // USING THE SAME UNIQUE ID HERE
     const int server_init_res = server.init(node.getHardwareVersion().unique_id);
@@ -116,6 +128,16 @@ int main(int argc, const char** argv)
         throw std::runtime_error("Failed to start the server; error " + std::to_string(server_init_res));
     }
 
+    /*
+     * The fast path answers the first-stage requests of the known allocatees right away.
+     */
+    allocation_fast_path::AllocationFastPath fast_path(node, table_index);
+    const int fast_path_res = fast_path.start();
+    if (fast_path_res < 0)
+    {
+        throw std::runtime_error("Failed to start the fast path; error " + std::to_string(fast_path_res));
+    }
+
     std::cout << "Centralized server started successfully" << std::endl;
 
     /*
@@ -138,6 +160,8 @@ int main(int argc, const char** argv)
                   << std::flush;
 
         std::cout << "Node ID           " << int(node.getNodeID().get()) << "\n"
+                  << "Known allocatees  " << table_index.getNumEntries() << "\n"
+                  << "Fast responses    " << fast_path.getNumResponses() << "\n"
                   << "Node failures     " << node.getInternalFailureCount() << "\n"
                   << std::flush;
     }
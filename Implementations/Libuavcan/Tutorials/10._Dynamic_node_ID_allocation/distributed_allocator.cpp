@@ -12,6 +12,13 @@
  */
 #include <uavcan_posix/dynamic_node_id_server/file_storage_backend.hpp>
 #include <uavcan_posix/dynamic_node_id_server/file_event_tracer.hpp>
+#include <sys/stat.h>                   // For mkdir()
+
+/*
+ * The journal storage backend and the allocation fast path are implemented in separate headers (see below).
+ */
+#include "journal_storage_backend.hpp"
+#include "allocation_fast_path.hpp"
 
 #if __linux__
 /*
@@ -42,12 +49,13 @@ int main(int argc, const char** argv)
 {
     if (argc < 3)
     {
-        std::cerr << "Usage: " << argv[0] << " <node-id> <cluster-size>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <node-id> <cluster-size> [file|journal]" << std::endl;
         return 1;
     }
 
     const int self_node_id = std::stoi(argv[1]);
     const int cluster_size = std::stoi(argv[2]);
+    const bool use_journal = (argc > 3) && (std::string(argv[3]) == "journal");
 
     /*
      * Configuring the node.
@@ -83,9 +91,25 @@ int main(int argc, const char** argv)
 
     /*
      * Initializing the storage backend - refer to the Centralized Allocator example for details.
+     * The journal storage backend keeps all data in one preallocated file, which is much faster and easier on
+     * flash media than one file per key. Either way, every update is flushed to the storage before the server
+     * proceeds, because the Raft algorithm relies on that.
      */
-    uavcan_posix::dynamic_node_id_server::FileStorageBackend storage_backend;
-    const int storage_res = storage_backend.init("uavcan_db_distributed");              // Using a hard-coded path here.
+    uavcan_posix::dynamic_node_id_server::FileStorageBackend file_storage_backend;
+    journal_storage::JournalStorageBackend journal_storage_backend;
+    uavcan::dynamic_node_id_server::IStorageBackend* storage_backend = &file_storage_backend;
+
+    int storage_res = 0;
+    if (use_journal)
+    {
+        (void)::mkdir("uavcan_db_distributed", 0755);                                   // May already exist
+        storage_res = journal_storage_backend.init("uavcan_db_distributed/journal");    // Using a hard-coded path here.
+        storage_backend = &journal_storage_backend;
+    }
+    else
+    {
+        storage_res = file_storage_backend.init("uavcan_db_distributed");               // Using a hard-coded path here.
+    }
     if (storage_res < 0)
     {
         throw std::runtime_error("Failed to start the storage backend; error: " + std::to_string(storage_res));
@@ -94,7 +118,10 @@ int main(int argc, const char** argv)
     /*
      * Starting the allocator itself.
      */
-    uavcan::dynamic_node_id_server::DistributedServer server(node, storage_backend, event_tracer);
+    allocation_fast_path::AllocationTableIndex table_index(*storage_backend);
+    std::cout << table_index.load() << " known allocatees" << std::endl;
+
+    uavcan::dynamic_node_id_server::DistributedServer server(node, table_index, event_tracer);
 
     // USING THE SAME UNIQUE ID HERE
     const int server_init_res = server.init(node.getHardwareVersion().unique_id, cluster_size);
@@ -103,6 +130,17 @@ int main(int argc, const char** argv)
         throw std::runtime_error("Failed to start the server; error " + std::to_string(server_init_res));
     }
 
+    /*
+     * The fast path needs the server in order to respond only when the local node is the leader,
+     * and only with the committed entries - refer to the Centralized Allocator example for details.
+     */
+    allocation_fast_path::AllocationFastPath fast_path(node, table_index, &server);
+    const int fast_path_res = fast_path.start();
+    if (fast_path_res < 0)
+    {
+        throw std::runtime_error("Failed to start the fast path; error " + std::to_string(fast_path_res));
+    }
+
     std::cout << "Distributed server started successfully" << std::endl;
 
     /*
@@ -158,6 +196,7 @@ int main(int argc, const char** argv)
                   << "Since activity    " << duration_to_string(time - report.last_activity_timestamp).c_str() << "\n"
                   << "Random timeout    " << duration_to_string(report.randomized_timeout).c_str() << "\n"
                   << "Unknown nodes     " << int(report.num_unknown_nodes) << "\n"
+                  << "Fast responses    " << fast_path.getNumResponses() << "\n"
                   << "Node failures     " << node.getInternalFailureCount() << "\n"
                   << std::flush;
     }
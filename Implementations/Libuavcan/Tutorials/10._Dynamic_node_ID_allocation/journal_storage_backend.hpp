@@ -0,0 +1,496 @@
+/**
+ * Storage backend for the dynamic node ID allocators that keeps all data in one append-only journal file.
+ *
+ * The file storage backend from uavcan_posix stores every key in a separate file, so every update of the Raft log
+ * or of the current term costs a file creation or truncation, which is slow and wears out flash media such as
+ * SD cards. This backend appends every update to a preallocated, memory-mapped journal instead; the metadata of the
+ * file system is not touched during normal operation. All values are also kept in memory, so reads don't access
+ * the file at all.
+ *
+ * Journal layout: a 16-byte header, then the records, then zeros up to the end of the file. Every record is:
+ *
+ *      key length (1 byte), value length (1 byte), key, value, CRC-16-CCITT of all preceding record bytes (2 bytes)
+ *
+ * A later record for the same key supersedes the earlier ones. On startup, the journal is read sequentially until
+ * the first zero or invalid record; a record that was being written when the power was lost is thus discarded.
+ * When the journal fills up with superseded records, it is compacted: the current values are written into a new
+ * file, which then atomically replaces the old one.
+ *
+ * By default, every update is flushed to the storage before set() returns, as required by the Raft algorithm.
+ * Group commit can be enabled by specifying a non-zero sync interval; then the updates are flushed at most once per
+ * interval, and the application must call flush() periodically. Note that an update that has not been flushed
+ * can be lost if the power goes down, which can make the allocator forget a vote or a log entry.
+ *
+ * @file journal_storage_backend.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <cerrno>                       // For errno
+#include <cstring>                      // For std::memcpy(), std::memcmp()
+#include <ctime>                        // For clock_gettime()
+#include <algorithm>                    // For std::max(), std::all_of()
+#include <iterator>                     // For std::next()
+#include <string>                       // For std::string
+#include <unordered_map>                // For std::unordered_map
+#include <fcntl.h>                      // For open(), posix_fallocate()
+#include <unistd.h>                     // For close(), fsync(), unlink(), pread()
+#include <sys/mman.h>                   // For mmap(), msync()
+#include <sys/stat.h>                   // For fstat()
+#include <uavcan/uavcan.hpp>            // Main libuavcan header
+#include <uavcan/protocol/dynamic_node_id_server/storage_backend.hpp>
+
+namespace journal_storage
+{
+class JournalStorageBackend : public uavcan::dynamic_node_id_server::IStorageBackend,
+                              uavcan::Noncopyable
+{
+public:
+    static constexpr std::size_t DefaultCapacity = 256 * 1024;
+
+    /**
+     * The journal is compacted when its size exceeds this fraction of the capacity, and the superseded records
+     * take more space than the current ones.
+     */
+    static constexpr double CompactionThreshold = 0.5;
+
+private:
+    static constexpr std::size_t HeaderSize = 16;
+    static constexpr std::size_t RecordOverhead = 4;
+    static constexpr std::size_t MaxRecordSize = RecordOverhead + MaxStringLength * 2;
+    static constexpr unsigned MagicSize = 8;
+
+    std::string path_;
+    std::size_t capacity_ = 0;
+    int fd_ = -1;
+    std::uint8_t* map_ = nullptr;
+
+    std::size_t tail_ = 0;                  ///< Offset where the next record will be written
+    std::size_t live_size_ = 0;             ///< Size of the records that are not superseded
+    std::unordered_map<std::string, std::string> values_;
+
+    std::int64_t sync_interval_usec_ = 0;
+    std::int64_t last_sync_at_usec_ = 0;
+    std::size_t unsynced_from_ = 0;         ///< Start of the region that has not been flushed yet
+    unsigned num_syncs_ = 0;
+    unsigned num_compactions_ = 0;
+    unsigned num_failed_writes_ = 0;
+
+    static std::int64_t getMonotonicUSec()
+    {
+        ::timespec ts = ::timespec();
+        (void)::clock_gettime(CLOCK_MONOTONIC, &ts);
+        return std::int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+    }
+
+    static std::size_t getRecordSize(const std::string& key, const std::string& value)
+    {
+        return RecordOverhead + key.size() + value.size();
+    }
+
+    static std::uint16_t computeCRC(const std::uint8_t* data, std::size_t size)
+    {
+        uavcan::TransferCRC crc;
+        crc.add(data, unsigned(size));
+        return crc.get();
+    }
+
+    static void writeRecord(std::uint8_t* out, const std::string& key, const std::string& value)
+    {
+        out[0] = std::uint8_t(key.size());
+        out[1] = std::uint8_t(value.size());
+        std::memcpy(out + 2, key.data(), key.size());
+        std::memcpy(out + 2 + key.size(), value.data(), value.size());
+        const std::size_t crc_offset = 2 + key.size() + value.size();
+        const std::uint16_t crc = computeCRC(out, crc_offset);
+        out[crc_offset] = std::uint8_t(crc);
+        out[crc_offset + 1] = std::uint8_t(crc >> 8);
+    }
+
+    static const char* getMagic() { return "UAVCANJ1"; }
+
+    static void writeHeader(std::uint8_t* out)
+    {
+        std::memset(out, 0, HeaderSize);
+        std::memcpy(out, getMagic(), MagicSize);
+    }
+
+    static bool isBlank(const std::uint8_t* data, std::size_t size)
+    {
+        return std::all_of(data, data + size, [](std::uint8_t x) { return x == 0; });
+    }
+
+    /**
+     * The header is recognized if it contains the magic, or if it is blank, i.e. the file was created
+     * but the header was never written.
+     */
+    static bool hasRecognizedHeader(int fd)
+    {
+        std::uint8_t header[HeaderSize] = {};
+        const ssize_t res = ::pread(fd, header, HeaderSize, 0);
+        if (res < 0)
+        {
+            return false;
+        }
+        return (std::memcmp(header, getMagic(), MagicSize) == 0) || isBlank(header, std::size_t(res));
+    }
+
+    /**
+     * Opens or creates the file, makes sure that the whole capacity is allocated, and maps it.
+     * An existing file is refused if it doesn't have a recognized header.
+     */
+    static int openAndMap(const std::string& path, std::size_t capacity, int& out_fd, std::uint8_t*& out_map)
+    {
+        const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            return -errno;
+        }
+
+        // Allocating all blocks up front, so that the appends don't update the file system metadata
+        struct ::stat st;
+        std::memset(&st, 0, sizeof(st));
+        int res = ::fstat(fd, &st);
+        if ((res == 0) && (std::size_t(st.st_size) > capacity))
+        {
+            (void)::close(fd);
+            return -uavcan::ErrInvalidParam;    // The records beyond the capacity would be lost
+        }
+        if ((res == 0) && (st.st_size > 0) && !hasRecognizedHeader(fd))
+        {
+            (void)::close(fd);
+            return -uavcan::ErrInvalidParam;    // Not a journal; the file is left untouched
+        }
+        if ((res == 0) && (std::size_t(st.st_size) < capacity))
+        {
+            res = ::posix_fallocate(fd, 0, off_t(capacity));
+            if (res != 0)
+            {
+                errno = res;
+                res = -1;
+            }
+        }
+        if (res != 0)
+        {
+            const int err = errno;
+            (void)::close(fd);
+            return -err;
+        }
+
+        void* const map = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            const int err = errno;
+            (void)::close(fd);
+            return -err;
+        }
+
+        out_fd = fd;
+        out_map = static_cast<std::uint8_t*>(map);
+        return 0;
+    }
+
+    void unmapAndClose()
+    {
+        if (map_ != nullptr)
+        {
+            (void)::munmap(map_, capacity_);
+            map_ = nullptr;
+        }
+        if (fd_ >= 0)
+        {
+            (void)::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    /**
+     * Reads the journal sequentially and rebuilds the values in memory.
+     */
+    void recover()
+    {
+        (void)::madvise(map_, capacity_, MADV_SEQUENTIAL);
+
+        values_.clear();
+        live_size_ = 0;
+        std::size_t offset = HeaderSize;
+        while (offset + RecordOverhead <= capacity_)
+        {
+            const std::uint8_t* const rec = map_ + offset;
+            const std::size_t key_len = rec[0];
+            const std::size_t value_len = rec[1];
+            const std::size_t size = RecordOverhead + key_len + value_len;
+            if ((key_len == 0) || (key_len > MaxStringLength) || (value_len > MaxStringLength) ||
+                (offset + size > capacity_))
+            {
+                break;
+            }
+            const std::size_t crc_offset = size - 2;
+            const std::uint16_t crc = std::uint16_t(rec[crc_offset] | (rec[crc_offset + 1] << 8));
+            if (crc != computeCRC(rec, crc_offset))
+            {
+                break;
+            }
+
+            const std::string key(reinterpret_cast<const char*>(rec + 2), key_len);
+            const std::string value(reinterpret_cast<const char*>(rec + 2 + key_len), value_len);
+            const auto it = values_.find(key);
+            if (it != values_.end())
+            {
+                live_size_ -= getRecordSize(key, it->second);
+            }
+            values_[key] = value;
+            live_size_ += size;
+            offset += size;
+        }
+        tail_ = offset;
+
+        // Whatever follows the last valid record is garbage left by an interrupted write; it must not be
+        // mistaken for valid records once the journal grows past it. Normally there is none, and nothing is written.
+        std::size_t garbage_end = capacity_;
+        while ((garbage_end > tail_) && (map_[garbage_end - 1] == 0))
+        {
+            garbage_end--;
+        }
+        std::memset(map_ + tail_, 0, garbage_end - tail_);
+        (void)sync(0, garbage_end);
+        unsynced_from_ = tail_;
+
+        (void)::madvise(map_, capacity_, MADV_NORMAL);
+    }
+
+    int sync(std::size_t from, std::size_t to)
+    {
+        if (to <= from)
+        {
+            return 0;
+        }
+        const std::size_t page_size = std::size_t(::sysconf(_SC_PAGESIZE));
+        const std::size_t begin = from - from % page_size;
+        if (::msync(map_ + begin, to - begin, MS_SYNC) < 0)
+        {
+            return -errno;
+        }
+        num_syncs_++;
+        last_sync_at_usec_ = getMonotonicUSec();
+        return 0;
+    }
+
+    /**
+     * Writes the current values into a new file and atomically replaces the journal with it.
+     */
+    int compact()
+    {
+        const std::string tmp_path = path_ + ".tmp";
+        (void)::unlink(tmp_path.c_str());
+
+        int tmp_fd = -1;
+        std::uint8_t* tmp_map = nullptr;
+        int res = openAndMap(tmp_path, capacity_, tmp_fd, tmp_map);
+        if (res < 0)
+        {
+            return res;
+        }
+
+        // Empty value is the same as no value, so such keys are dropped
+        for (auto it = values_.begin(); it != values_.end();)
+        {
+            it = it->second.empty() ? values_.erase(it) : std::next(it);
+        }
+
+        writeHeader(tmp_map);
+        std::size_t offset = HeaderSize;
+        for (auto& kv : values_)
+        {
+            writeRecord(tmp_map + offset, kv.first, kv.second);
+            offset += getRecordSize(kv.first, kv.second);
+        }
+
+        res = (::msync(tmp_map, offset, MS_SYNC) < 0) ? -errno : 0;
+        if (res >= 0)
+        {
+            res = (::rename(tmp_path.c_str(), path_.c_str()) < 0) ? -errno : 0;
+        }
+        if (res < 0)
+        {
+            (void)::munmap(tmp_map, capacity_);
+            (void)::close(tmp_fd);
+            (void)::unlink(tmp_path.c_str());
+            return res;
+        }
+        syncDirectory();
+
+        unmapAndClose();
+        fd_ = tmp_fd;
+        map_ = tmp_map;
+        tail_ = offset;
+        live_size_ = offset - HeaderSize;
+        unsynced_from_ = tail_;
+        num_compactions_++;
+        return 0;
+    }
+
+    void syncDirectory() const
+    {
+        const auto slash = path_.find_last_of('/');
+        const std::string dir = (slash == std::string::npos) ? "." : path_.substr(0, std::max<std::size_t>(slash, 1));
+        const int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd >= 0)
+        {
+            (void)::fsync(dir_fd);
+            (void)::close(dir_fd);
+        }
+    }
+
+    bool needsCompaction(std::size_t next_record_size) const
+    {
+        const bool full = tail_ + next_record_size > capacity_;
+        const bool mostly_garbage = (double(tail_) > double(capacity_) * CompactionThreshold) &&
+                                    ((tail_ - HeaderSize - live_size_) > live_size_);
+        return full || mostly_garbage;
+    }
+
+public:
+    ~JournalStorageBackend()
+    {
+        if (map_ != nullptr)
+        {
+            (void)flush();
+        }
+        unmapAndClose();
+    }
+
+    /**
+     * Opens the journal, creating it if it doesn't exist, and loads the stored values.
+     * Returns -ErrInvalidParam without modifying the file if the file exists but is not a journal.
+     * @param path              Path to the journal file; its directory must exist.
+     * @param capacity          Size of the file. May be increased for an existing journal, but not decreased.
+     * @param sync_interval     Zero disables group commit; see the description above.
+     */
+    int init(const std::string& path,
+             std::size_t capacity = DefaultCapacity,
+             uavcan::MonotonicDuration sync_interval = uavcan::MonotonicDuration())
+    {
+        if ((map_ != nullptr) || path.empty() || (capacity < HeaderSize + MaxRecordSize))
+        {
+            return -uavcan::ErrInvalidParam;
+        }
+
+        const int res = openAndMap(path, capacity, fd_, map_);
+        if (res < 0)
+        {
+            return res;
+        }
+        path_ = path;
+        capacity_ = capacity;
+        sync_interval_usec_ = sync_interval.toUSec();
+
+        if (std::memcmp(map_, getMagic(), MagicSize) != 0)
+        {
+            /*
+             * A new journal. Whatever follows the blank header was not written by this backend, so it is erased
+             * rather than parsed as records; a freshly allocated file is all zeros, and nothing is written then.
+             */
+            std::size_t end = capacity_;
+            while ((end > HeaderSize) && (map_[end - 1] == 0))
+            {
+                end--;
+            }
+            std::memset(map_ + HeaderSize, 0, end - HeaderSize);
+            writeHeader(map_);
+            const int sync_res = sync(0, end);
+            if (sync_res < 0)
+            {
+                unmapAndClose();
+                return sync_res;
+            }
+        }
+        recover();
+        return 0;
+    }
+
+    String get(const String& key) const override
+    {
+        String out;
+        const auto it = values_.find(key.c_str());
+        if (it != values_.end())
+        {
+            out = it->second.c_str();
+        }
+        return out;
+    }
+
+    void set(const String& key, const String& value) override
+    {
+        if ((map_ == nullptr) || key.empty())
+        {
+            num_failed_writes_++;
+            return;
+        }
+
+        const std::string k(key.c_str());
+        const std::string v(value.c_str());
+        const std::size_t size = getRecordSize(k, v);
+
+        if (needsCompaction(size))
+        {
+            (void)flush();
+            if ((compact() < 0) || (tail_ + size > capacity_))
+            {
+                num_failed_writes_++;
+                return;
+            }
+        }
+
+        writeRecord(map_ + tail_, k, v);
+        tail_ += size;
+
+        auto it = values_.find(k);
+        if (it != values_.end())
+        {
+            live_size_ -= getRecordSize(k, it->second);
+            it->second = v;
+        }
+        else
+        {
+            values_[k] = v;
+        }
+        live_size_ += size;
+
+        if ((sync_interval_usec_ <= 0) || ((getMonotonicUSec() - last_sync_at_usec_) >= sync_interval_usec_))
+        {
+            if (flush() < 0)
+            {
+                num_failed_writes_++;
+            }
+        }
+    }
+
+    /**
+     * Flushes the pending updates to the storage. Must be called periodically if group commit is enabled.
+     */
+    int flush()
+    {
+        const int res = sync(unsynced_from_, tail_);
+        if (res >= 0)
+        {
+            unsynced_from_ = tail_;
+        }
+        return res;
+    }
+
+    std::size_t getJournalSize() const { return tail_; }
+    std::size_t getCapacity() const { return capacity_; }
+    unsigned getNumKeys() const { return unsigned(values_.size()); }
+    unsigned getNumSyncs() const { return num_syncs_; }
+    unsigned getNumCompactions() const { return num_compactions_; }
+
+    /**
+     * IStorageBackend can't report errors, so the failed writes are counted instead.
+     */
+    unsigned getNumFailedWrites() const { return num_failed_writes_; }
+};
+
+}
@@ -0,0 +1,244 @@
+/**
+ * This header implements a file server backend for libuavcan that is optimized for serving firmware images to many
+ * nodes at once. Every file is memory-mapped once, and all read requests are served directly from the mapping,
+ * so that updating dozens of identical nodes doesn't result in repeated open()/lseek()/read() calls for the same bytes.
+ *
+ * Different paths that resolve to the same file (e.g. several symlinks pointing to one firmware image) share one
+ * mapping, because the files are identified by their device and inode numbers rather than by path.
+ *
+ * This backend only works on POSIX-compliant systems that support mmap() (e.g. Linux).
+ * Firmware files should be replaced atomically (i.e. write a new file, then rename it over the old one), because
+ * truncating a file while it is mapped would cause SIGBUS on access to the truncated part.
+ *
+ * @file caching_file_server_backend.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <uavcan/uavcan.hpp>
+#include <uavcan/protocol/file_server.hpp>
+
+namespace uavcan_caching_file_server
+{
+/**
+ * Implements uavcan::IFileServerBackend for read-only access.
+ * The class is not thread-safe; it is supposed to be used from the thread that runs the file server.
+ */
+class CachingFileServerBackend final : public uavcan::IFileServerBackend,
+                                       uavcan::Noncopyable
+{
+    /**
+     * One memory-mapped file. The mapping is released when the last path referring to it is evicted.
+     */
+    struct MappedFile : uavcan::Noncopyable
+    {
+        const std::uint8_t* data = nullptr;
+        std::uint64_t size = 0;
+        struct ::timespec mtime = {};
+
+        ~MappedFile()
+        {
+            if (data != nullptr)
+            {
+                (void)::munmap(const_cast<std::uint8_t*>(data), std::size_t(size));
+            }
+        }
+    };
+
+    typedef std::pair<dev_t, ino_t> FileKey;
+
+    struct PathEntry
+    {
+        std::shared_ptr<MappedFile> file;
+        std::chrono::steady_clock::time_point validated_at;
+    };
+
+    const std::chrono::steady_clock::duration revalidation_period_;
+
+    std::map<FileKey, std::weak_ptr<MappedFile>> files_;
+    std::unordered_map<std::string, PathEntry> paths_;
+
+    static std::int16_t errnoToError(int e)
+    {
+        // The error codes defined in uavcan.protocol.file.Error are chosen to match POSIX errno
+        return (e > 0 && e <= 0x7FFF) ? std::int16_t(e) : std::int16_t(Error::UNKNOWN_ERROR);
+    }
+
+    static bool isSameVersion(const MappedFile& file, const struct ::stat& st)
+    {
+        return (file.size == std::uint64_t(st.st_size)) &&
+               (file.mtime.tv_sec == st.st_mtim.tv_sec) &&
+               (file.mtime.tv_nsec == st.st_mtim.tv_nsec);
+    }
+
+    static std::shared_ptr<MappedFile> mapFile(const char* path, const struct ::stat& st, int& out_errno)
+    {
+        std::shared_ptr<MappedFile> file(new MappedFile);
+        file->size = std::uint64_t(st.st_size);
+        file->mtime = st.st_mtim;
+
+        if (file->size > 0)
+        {
+            const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                out_errno = errno;
+                return nullptr;
+            }
+
+            void* const addr = ::mmap(nullptr, std::size_t(file->size), PROT_READ, MAP_PRIVATE, fd, 0);
+            out_errno = errno;
+            (void)::close(fd);          // The mapping remains valid after the descriptor is closed
+
+            if (addr == MAP_FAILED)
+            {
+                return nullptr;
+            }
+            file->data = static_cast<const std::uint8_t*>(addr);
+        }
+
+        return file;
+    }
+
+    /**
+     * Finds the mapping for the given path, creating it if needed.
+     * The file system is only accessed if the path is unknown, or if it was last checked more than one
+     * revalidation period ago; the file is re-mapped if it has been modified.
+     */
+    std::shared_ptr<MappedFile> resolve(const Path& path, int& out_errno)
+    {
+        const std::string path_str(path.c_str());
+        const auto now = std::chrono::steady_clock::now();
+
+        {
+            const auto it = paths_.find(path_str);
+            if ((it != paths_.end()) && ((now - it->second.validated_at) < revalidation_period_))
+            {
+                return it->second.file;
+            }
+        }
+
+        struct ::stat st;
+        if (::stat(path_str.c_str(), &st) < 0)          // Follows symlinks
+        {
+            out_errno = errno;
+            paths_.erase(path_str);
+            return nullptr;
+        }
+        if (!S_ISREG(st.st_mode))
+        {
+            out_errno = S_ISDIR(st.st_mode) ? EISDIR : EINVAL;
+            paths_.erase(path_str);
+            return nullptr;
+        }
+
+        const FileKey key(st.st_dev, st.st_ino);
+        std::shared_ptr<MappedFile> file = files_[key].lock();
+        if (!file || !isSameVersion(*file, st))
+        {
+            file = mapFile(path_str.c_str(), st, out_errno);
+            if (!file)
+            {
+                files_.erase(key);
+                paths_.erase(path_str);
+                return nullptr;
+            }
+            files_[key] = file;
+        }
+
+        PathEntry& entry = paths_[path_str];
+        entry.file = file;
+        entry.validated_at = now;
+
+        // Removing the keys of the files that are no longer mapped
+        for (auto it = files_.begin(); it != files_.end();)
+        {
+            it = it->second.expired() ? files_.erase(it) : std::next(it);
+        }
+
+        return file;
+    }
+
+public:
+    /**
+     * @param revalidation_period   How often the backend checks whether a path still refers to the same file,
+     *                              and whether the file has been modified. Requests that arrive within this period
+     *                              are served from the cache without accessing the file system at all.
+     */
+    explicit CachingFileServerBackend(std::chrono::steady_clock::duration revalidation_period =
+                                          std::chrono::seconds(1)) :
+        revalidation_period_(revalidation_period)
+    { }
+
+    /**
+     * Backend for uavcan.protocol.file.GetInfo.
+     */
+    std::int16_t getInfo(const Path& path, std::uint64_t& out_size, EntryType& out_type) override
+    {
+        int err = 0;
+        const auto file = resolve(path, err);
+        if (!file)
+        {
+            if (err == EISDIR)
+            {
+                out_size = 0;
+                out_type.flags = EntryType::FLAG_DIRECTORY | EntryType::FLAG_READABLE;
+                return 0;
+            }
+            return errnoToError(err);
+        }
+
+        out_size = file->size;
+        out_type.flags = EntryType::FLAG_FILE | EntryType::FLAG_READABLE;
+        return 0;
+    }
+
+    /**
+     * Backend for uavcan.protocol.file.Read.
+     * The data is copied directly from the mapping into the response; no system calls are involved.
+     */
+    std::int16_t read(const Path& path, const std::uint64_t offset, std::uint8_t* out_buffer,
+                      std::uint16_t& inout_size) override
+    {
+        int err = 0;
+        const auto file = resolve(path, err);
+        if (!file)
+        {
+            return errnoToError(err);
+        }
+
+        if (offset >= file->size)
+        {
+            inout_size = 0;
+            return 0;
+        }
+
+        const std::uint64_t remaining = file->size - offset;
+        if (inout_size > remaining)
+        {
+            inout_size = std::uint16_t(remaining);
+        }
+        std::memcpy(out_buffer, file->data + offset, inout_size);
+        return 0;
+    }
+
+    /**
+     * Number of distinct files that are currently mapped into memory.
+     */
+    unsigned getNumMappedFiles() const { return unsigned(files_.size()); }
+};
+
+}
@@ -0,0 +1,326 @@
+/**
+ * This header implements an in-memory catalogue of the firmware images available in a directory.
+ * The directory is scanned once at startup; after that, the catalogue is kept up to date incrementally using
+ * inotify, so that looking up the best firmware for a node doesn't touch the file system at all.
+ *
+ * This matters when many nodes appear at once (e.g. after a bus reset): without the catalogue, every GetNodeInfo
+ * response would trigger a full directory scan.
+ *
+ * The catalogue doesn't depend on libuavcan. It only works on Linux, because inotify is Linux-specific.
+ *
+ * @file firmware_catalogue.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <dirent.h>             // For opendir(), readdir()
+#include <sys/inotify.h>        // For inotify_init1(), inotify_add_watch()
+#include <unistd.h>             // For read(), close()
+
+namespace uavcan_firmware_catalogue
+{
+/**
+ * Information extracted from the firmware file name.
+ */
+struct FirmwareInfo
+{
+    std::string path;               ///< Path to the file, relative to the working directory
+    std::string node_name;
+    std::uint8_t hardware_version_major = 0;
+    std::uint8_t hardware_version_minor = 0;
+    std::uint8_t software_version_major = 0;
+    std::uint8_t software_version_minor = 0;
+    std::uint64_t vcs_commit = 0;
+};
+
+/**
+ * Extracts the version information from firmware file name.
+ * Expected format is:
+ *      <node-name>-<hw-major>.<hw-minor>-<sw-major>.<sw-minor>.<vcs-hash-hex>.uavcan.bin
+ * Returns false if the name doesn't match the format; the output structure is left in an undefined state then.
+ * The field FirmwareInfo::path is not modified.
+ */
+inline bool parseFirmwareFileName(const char* name, FirmwareInfo& out_info)
+{
+    static const char Suffix[] = ".uavcan.bin";
+
+    const auto parse_number = [](const char*& pos, int base, std::uint64_t max, std::uint64_t& out_value)
+    {
+        const unsigned char first = static_cast<unsigned char>(*pos);
+        if ((base == 10) ? !std::isdigit(first) : !std::isxdigit(first))
+        {
+            return false;           // strtoull() would accept leading spaces and signs
+        }
+        char* end = nullptr;
+        errno = 0;
+        const unsigned long long value = std::strtoull(pos, &end, base);
+        if ((errno != 0) || (value > max))
+        {
+            return false;
+        }
+        pos = end;
+        out_value = value;
+        return true;
+    };
+
+    const auto parse_uint8 = [&parse_number](const char*& pos, char separator, std::uint8_t& out_value)
+    {
+        std::uint64_t value = 0;
+        if (!parse_number(pos, 10, 0xFF, value) || (*pos != separator))
+        {
+            return false;
+        }
+        pos++;
+        out_value = std::uint8_t(value);
+        return true;
+    };
+
+    const char* pos = name;
+    while ((*pos != '\0') && (*pos != '-'))
+    {
+        pos++;
+    }
+    if ((pos == name) || (*pos != '-'))
+    {
+        return false;
+    }
+    out_info.node_name.assign(name, pos);
+    pos++;
+
+    if (!parse_uint8(pos, '.', out_info.hardware_version_major) ||
+        !parse_uint8(pos, '-', out_info.hardware_version_minor) ||
+        !parse_uint8(pos, '.', out_info.software_version_major) ||
+        !parse_uint8(pos, '.', out_info.software_version_minor) ||
+        !parse_number(pos, 16, 0xFFFFFFFFFFFFFFFFULL, out_info.vcs_commit))
+    {
+        return false;
+    }
+
+    return std::string(pos) == Suffix;
+}
+
+/**
+ * Keeps track of the firmware files in one directory, and of the best (newest) firmware for every combination of
+ * node name and hardware version. Files whose names don't match the format are ignored.
+ *
+ * The class is not thread-safe. It doesn't start any threads; the inotify events are processed when
+ * @ref processEvents() is called, which is also done automatically on every lookup.
+ */
+class FirmwareCatalogue
+{
+    /// Files of one node type are ordered by version; ties are resolved by the file name
+    typedef std::pair<unsigned, std::string> VersionKey;
+    typedef std::map<VersionKey, FirmwareInfo> Versions;
+
+    const std::string directory_;
+    int inotify_fd_ = -1;
+    std::unordered_map<std::string, Versions> entries_;     ///< Key is generated by @ref makeKey()
+    unsigned num_files_ = 0;
+
+    static std::string makeKey(const std::string& node_name, std::uint8_t hw_major, std::uint8_t hw_minor)
+    {
+        return node_name + '\0' + char(hw_major) + char(hw_minor);
+    }
+
+    static VersionKey makeVersionKey(const FirmwareInfo& info, const std::string& file_name)
+    {
+        return VersionKey((unsigned(info.software_version_major) << 8) + info.software_version_minor, file_name);
+    }
+
+    void add(const char* file_name)
+    {
+        FirmwareInfo info;
+        if (!parseFirmwareFileName(file_name, info))
+        {
+            return;
+        }
+        info.path = (directory_ == ".") ? std::string(file_name) : (directory_ + "/" + file_name);
+
+        Versions& versions = entries_[makeKey(info.node_name, info.hardware_version_major,
+                                             info.hardware_version_minor)];
+        const auto res = versions.insert(std::make_pair(makeVersionKey(info, file_name), info));
+        if (res.second)
+        {
+            num_files_++;
+        }
+    }
+
+    void remove(const char* file_name)
+    {
+        FirmwareInfo info;
+        if (!parseFirmwareFileName(file_name, info))
+        {
+            return;
+        }
+
+        const auto it = entries_.find(makeKey(info.node_name, info.hardware_version_major,
+                                              info.hardware_version_minor));
+        if (it != entries_.end())
+        {
+            num_files_ -= unsigned(it->second.erase(makeVersionKey(info, file_name)));
+            if (it->second.empty())
+            {
+                entries_.erase(it);
+            }
+        }
+    }
+
+    int rescan()
+    {
+        entries_.clear();
+        num_files_ = 0;
+
+        DIR* const dir = ::opendir(directory_.c_str());
+        if (dir == nullptr)
+        {
+            return -errno;
+        }
+
+        while (const ::dirent* const ent = ::readdir(dir))
+        {
+            if (ent->d_type != DT_DIR)
+            {
+                add(ent->d_name);
+            }
+        }
+
+        (void)::closedir(dir);
+        return 0;
+    }
+
+public:
+    explicit FirmwareCatalogue(const std::string& directory = ".") :
+        directory_(directory)
+    { }
+
+    ~FirmwareCatalogue()
+    {
+        if (inotify_fd_ >= 0)
+        {
+            (void)::close(inotify_fd_);
+        }
+    }
+
+    FirmwareCatalogue(const FirmwareCatalogue&) = delete;
+    FirmwareCatalogue& operator=(const FirmwareCatalogue&) = delete;
+
+    /**
+     * Starts watching the directory and performs the initial scan.
+     * The watch is set up before the scan, so that changes made during the scan are not lost.
+     * Returns negative errno on failure.
+     */
+    int init()
+    {
+        if (inotify_fd_ < 0)
+        {
+            inotify_fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (inotify_fd_ < 0)
+            {
+                return -errno;
+            }
+
+            /*
+             * Symlinks and hard links only produce IN_CREATE, so it is used instead of IN_CLOSE_WRITE.
+             * The catalogue only cares about the names of the files, not about their contents.
+             */
+            const auto mask = IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM;
+            if (::inotify_add_watch(inotify_fd_, directory_.c_str(), mask) < 0)
+            {
+                const int err = errno;
+                (void)::close(inotify_fd_);
+                inotify_fd_ = -1;
+                return -err;
+            }
+        }
+
+        return rescan();
+    }
+
+    /**
+     * Applies the changes that were made to the directory since the last call.
+     * This method never blocks. If the kernel event queue has overflowed, the directory is rescanned.
+     */
+    void processEvents()
+    {
+        if (inotify_fd_ < 0)
+        {
+            return;
+        }
+
+        bool rescan_needed = false;
+
+        alignas(::inotify_event) char buffer[4096];
+        for (;;)
+        {
+            const ssize_t len = ::read(inotify_fd_, buffer, sizeof(buffer));
+            if (len <= 0)
+            {
+                break;          // EAGAIN - no more events
+            }
+
+            for (const char* ptr = buffer; ptr < buffer + len;)
+            {
+                const auto event = reinterpret_cast<const ::inotify_event*>(ptr);
+                ptr += sizeof(::inotify_event) + event->len;
+
+                if ((event->mask & IN_Q_OVERFLOW) != 0)
+                {
+                    rescan_needed = true;
+                }
+                else if ((event->len == 0) || ((event->mask & IN_ISDIR) != 0))
+                {
+                    ;   // Not a file in the watched directory
+                }
+                else if ((event->mask & (IN_CREATE | IN_MOVED_TO)) != 0)
+                {
+                    add(event->name);
+                }
+                else if ((event->mask & (IN_DELETE | IN_MOVED_FROM)) != 0)
+                {
+                    remove(event->name);
+                }
+                else
+                {
+                    ;   // Ignored
+                }
+            }
+        }
+
+        if (rescan_needed)
+        {
+            (void)rescan();
+        }
+    }
+
+    /**
+     * Returns the newest firmware for the given node type, or nullptr if there is none.
+     * Apart from processing the pending inotify events, this is a single hash table lookup.
+     * The returned pointer is valid until the next call to a non-const method.
+     */
+    const FirmwareInfo* findBestFirmware(const std::string& node_name,
+                                         std::uint8_t hardware_version_major,
+                                         std::uint8_t hardware_version_minor)
+    {
+        processEvents();
+
+        const auto it = entries_.find(makeKey(node_name, hardware_version_major, hardware_version_minor));
+        return (it == entries_.end()) ? nullptr : &it->second.rbegin()->second;
+    }
+
+    /**
+     * Number of known firmware files, across all node types.
+     */
+    unsigned getNumFiles() const { return num_files_; }
+};
+
+}
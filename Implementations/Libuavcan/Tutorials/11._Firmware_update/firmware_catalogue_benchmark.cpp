@@ -0,0 +1,171 @@
+/*
+ * This program compares two ways of finding the best firmware file for a node:
+ *  - glob() over the directory and parsing of every matching file name on every lookup;
+ *  - lookup in the firmware catalogue, which is built once and then updated via inotify.
+ *
+ * It creates a temporary directory with 1000 firmware files (100 node types, 10 versions each), and then performs
+ * the same sequence of lookups using both methods. The program doesn't depend on libuavcan.
+ *
+ * Usage: ./firmware_catalogue_benchmark [number_of_lookups]
+ */
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <glob.h>
+#include <unistd.h>
+#include "firmware_catalogue.hpp"
+
+using uavcan_firmware_catalogue::FirmwareInfo;
+
+constexpr unsigned NumNodeTypes = 100;
+constexpr unsigned NumVersionsPerNodeType = 10;
+
+static std::string makeNodeName(unsigned index)
+{
+    return "org.uavcan.benchmark.node" + std::to_string(index);
+}
+
+static std::string makeFileName(unsigned node_index, unsigned version_index)
+{
+    return makeNodeName(node_index) + "-1.0-" + std::to_string(version_index / 4) + "." +
+           std::to_string(version_index % 4) + ".deadbeef.uavcan.bin";
+}
+
+static void createFirmwareFiles()
+{
+    for (unsigned i = 0; i < NumNodeTypes; i++)
+    {
+        for (unsigned k = 0; k < NumVersionsPerNodeType; k++)
+        {
+            const std::string name = makeFileName(i, k);
+            const int fd = ::open(name.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+            if (fd < 0)
+            {
+                throw std::runtime_error("Could not create " + name);
+            }
+            (void)::close(fd);
+        }
+    }
+}
+
+/**
+ * This is the algorithm that the updater used before the catalogue was introduced.
+ */
+static std::string findBestFirmwareUsingGlob(const std::string& node_name, unsigned hw_major, unsigned hw_minor)
+{
+    const std::string glob_pattern = node_name + "-" + std::to_string(hw_major) + "." +
+                                     std::to_string(hw_minor) + "-*.uavcan.bin";
+
+    auto result = ::glob_t();
+    const int res = ::glob(glob_pattern.c_str(), 0, nullptr, &result);
+    if (res != 0)
+    {
+        ::globfree(&result);
+        if (res == GLOB_NOMATCH)
+        {
+            return "";
+        }
+        throw std::runtime_error("Can't glob()");
+    }
+
+    std::string best_file_name;
+    unsigned best_combined_version = 0;
+    for (unsigned i = 0; i < result.gl_pathc; ++i)
+    {
+        FirmwareInfo inf;
+        if (uavcan_firmware_catalogue::parseFirmwareFileName(result.gl_pathv[i], inf))
+        {
+            const unsigned combined_version = (unsigned(inf.software_version_major) << 8) + inf.software_version_minor;
+            if (combined_version >= best_combined_version)
+            {
+                best_combined_version = combined_version;
+                best_file_name = result.gl_pathv[i];
+            }
+        }
+    }
+
+    ::globfree(&result);
+    return best_file_name;
+}
+
+template <typename Lookup>
+static double measure(unsigned num_lookups, Lookup lookup)
+{
+    const auto started_at = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < num_lookups; i++)
+    {
+        const std::string name = makeNodeName(i % NumNodeTypes);
+        if (lookup(name).empty())
+        {
+            throw std::runtime_error("Firmware not found for " + name);
+        }
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - started_at;
+    return std::chrono::duration<double, std::micro>(elapsed).count() / num_lookups;
+}
+
+int main(int argc, const char** argv)
+{
+    const unsigned num_lookups = (argc > 1) ? unsigned(std::stoul(argv[1])) : 1000;
+
+    char dir_template[] = "/tmp/firmware_catalogue_benchmark.XXXXXX";
+    if ((::mkdtemp(dir_template) == nullptr) || (::chdir(dir_template) < 0))
+    {
+        throw std::runtime_error("Could not create the temporary directory");
+    }
+
+    createFirmwareFiles();
+
+    const auto init_started_at = std::chrono::steady_clock::now();
+    uavcan_firmware_catalogue::FirmwareCatalogue catalogue;
+    const int init_res = catalogue.init();
+    if (init_res < 0)
+    {
+        throw std::runtime_error("Failed to init the catalogue: " + std::to_string(init_res));
+    }
+    const auto init_elapsed = std::chrono::steady_clock::now() - init_started_at;
+
+    const double glob_us = measure(num_lookups, [](const std::string& name)
+        {
+            return findBestFirmwareUsingGlob(name, 1, 0);
+        });
+
+    const double catalogue_us = measure(num_lookups, [&catalogue](const std::string& name)
+        {
+            const FirmwareInfo* const info = catalogue.findBestFirmware(name, 1, 0);
+            return (info == nullptr) ? std::string() : info->path;
+        });
+
+    // Making sure that both methods agree
+    for (unsigned i = 0; i < NumNodeTypes; i++)
+    {
+        const std::string name = makeNodeName(i);
+        if (findBestFirmwareUsingGlob(name, 1, 0) != catalogue.findBestFirmware(name, 1, 0)->path)
+        {
+            throw std::runtime_error("Results differ for " + name);
+        }
+    }
+
+    std::cout << "Files:                 " << catalogue.getNumFiles() << "\n"
+              << "Lookups:               " << num_lookups << "\n"
+              << "Catalogue init:        "
+              << std::chrono::duration<double, std::milli>(init_elapsed).count() << " ms\n"
+              << "glob() per lookup:     " << glob_us << " us\n"
+              << "Catalogue per lookup:  " << catalogue_us << " us" << std::endl;
+
+    for (unsigned i = 0; i < NumNodeTypes; i++)
+    {
+        for (unsigned k = 0; k < NumVersionsPerNodeType; k++)
+        {
+            (void)::unlink(makeFileName(i, k).c_str());
+        }
+    }
+    (void)::chdir("/");
+    (void)::rmdir(dir_template);
+
+    return 0;
+}
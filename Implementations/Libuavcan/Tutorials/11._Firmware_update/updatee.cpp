@@ -1,8 +1,10 @@
 #include <iostream>
 #include <cstdlib>
+#include <cerrno>
 #include <vector>
-#include <iomanip>
+#include <algorithm>
 #include <unistd.h>
+#include <fcntl.h>
 #include <uavcan/uavcan.hpp>
 
 /*
@@ -15,10 +17,98 @@ extern uavcan::ICanDriver& getCanDriver();
 extern uavcan::ISystemClock& getSystemClock();
 
 /**
- * This class downloads a firmware image from specified location to memory.
+ * This interface accepts the downloaded firmware image chunk by chunk, so that the downloader doesn't need to keep
+ * the whole image in memory. Implementations can write the data directly into flash memory, a file, a memory-mapped
+ * region, etc.
+ */
+class IFirmwareSink
+{
+public:
+    virtual ~IFirmwareSink() { }
+
+    /**
+     * Writes one chunk of the image at the specified offset.
+     * The downloader invokes this method for consecutive offsets, in ascending order.
+     * Returns negative error code on failure.
+     */
+    virtual int write(std::uint64_t offset, const std::uint8_t* data, unsigned size) = 0;
+
+    /**
+     * Invoked once the whole image has been written.
+     * Returns negative error code on failure.
+     *
+     * @param image_size    Total size of the image in bytes.
+     * @param image_crc     CRC-64-WE of the image, the same as used in @ref uavcan::protocol::SoftwareVersion.
+     */
+    virtual int finalize(std::uint64_t image_size, std::uint64_t image_crc) = 0;
+};
+
+/**
+ * This sink writes the image into a file on the local file system.
+ */
+class FileFirmwareSink final : public IFirmwareSink
+{
+    int fd_ = -1;
+
+public:
+    ~FileFirmwareSink() { close(); }
+
+    /**
+     * Creates the file, or truncates it if it already exists.
+     * Returns negative error code on failure.
+     */
+    int open(const char* path)
+    {
+        close();
+        fd_ = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        return (fd_ < 0) ? -errno : 0;
+    }
+
+    void close()
+    {
+        if (fd_ >= 0)
+        {
+            (void)::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    int write(std::uint64_t offset, const std::uint8_t* data, unsigned size) override
+    {
+        while (size > 0)
+        {
+            const ssize_t res = ::pwrite(fd_, data, size, off_t(offset));
+            if (res <= 0)
+            {
+                return (res < 0) ? -errno : -EIO;
+            }
+            data += res;
+            offset += std::uint64_t(res);
+            size -= unsigned(res);
+        }
+        return 0;
+    }
+
+    int finalize(std::uint64_t, std::uint64_t) override
+    {
+        const int res = (::fsync(fd_) < 0) ? -errno : 0;
+        close();
+        return res;
+    }
+};
+
+/**
+ * This class downloads a firmware image from specified location into the specified sink.
  * Download will start immediately after the object is constructed,
  * and it can be cancelled by means of deleting the object.
  *
+ * In order to make the download fast, the loader keeps several read requests in flight at consecutive offsets
+ * (a window); a new request is sent as soon as a response arrives, and the responses, which may arrive out of order,
+ * are reassembled in the right order. Every chunk has its own timeout and retry counter.
+ *
+ * The image is not stored in memory; every chunk is written into the sink as soon as all preceding chunks are written,
+ * so the memory footprint is limited by the window size rather than by the image size.
+ *
  * This is just a made-up example - real applications will likely behave differently, either:
  * - Downloading the image using a dedicated bootloader application.
  * - Downloading the image to a file, that will be deployed later.
@@ -39,11 +129,50 @@ public:
         Failure
     };
 
+    /**
+     * Default number of read requests that are kept in flight simultaneously.
+     * The exact value depends on the application's requirements and CAN bit rate - higher values make the download
+     * faster, but increase bus load and memory footprint of the server and the client.
+     */
+    static constexpr unsigned DefaultWindowSize = 8;
+
 private:
+    typedef uavcan::protocol::file::Read::Response::FieldTypes::data ChunkData;
+
+    static constexpr unsigned ChunkSize = ChunkData::MaxSize;
+    static constexpr unsigned MaxAttemptsPerChunk = 5;
+    static constexpr std::uint64_t UnknownEndOffset = ~std::uint64_t(0);
+
+    /**
+     * One element of the window, i.e. one chunk of the image that is being read.
+     */
+    struct Chunk
+    {
+        enum class State
+        {
+            Free,           ///< The slot is not used
+            Pending,        ///< The request needs to be (re)sent
+            InFlight,       ///< The request has been sent, waiting for the response
+            Received        ///< The data has been received, waiting for the preceding chunks to be reassembled
+        };
+
+        State state = State::Free;
+        std::uint64_t offset = 0;
+        uavcan::ServiceCallID call_id;
+        unsigned attempts = 0;
+        ChunkData data;
+    };
+
     const uavcan::NodeID source_node_id_;
     const uavcan::protocol::file::Path::FieldTypes::path source_path_;
 
-    std::vector<std::uint8_t> image_;
+    IFirmwareSink& sink_;
+    std::uint64_t image_size_ = 0;                    ///< Number of bytes written into the sink so far
+    uavcan::DataTypeSignatureCRC image_crc_;          ///< This class implements CRC-64-WE
+
+    std::vector<Chunk> window_;
+    std::uint64_t next_request_offset_ = 0;
+    std::uint64_t end_offset_ = UnknownEndOffset;     ///< Becomes known once a short chunk is received
 
     typedef uavcan::MethodBinder<FirmwareLoader*,
         void (FirmwareLoader::*)(const uavcan::ServiceCallResult<uavcan::protocol::file::Read>&)>
@@ -53,42 +182,164 @@ private:
 
     Status status_ = Status::InProgress;
 
-    void handleTimerEvent(const uavcan::TimerEvent&) final override
+    /**
+     * Calls that are still in flight will be cancelled when the object is destroyed.
+     */
+    void finish(Status status)
+    {
+        status_ = status;
+        uavcan::TimerBase::stop();
+    }
+
+    void sendRequest(Chunk& chunk)
     {
-        if (!read_client_.hasPendingCalls())
+        uavcan::protocol::file::Read::Request req;
+        req.path.path = source_path_;
+        req.offset = chunk.offset;
+
+        const int res = read_client_.call(source_node_id_, req, chunk.call_id);
+        if (res < 0)
         {
-            uavcan::protocol::file::Read::Request req;
-            req.path.path = source_path_;
-            req.offset = image_.size();
+            std::cerr << "Read call failed: " << res << std::endl;
+            chunk.state = Chunk::State::Pending;        // Will be retried from the timer
+        }
+        else
+        {
+            chunk.state = Chunk::State::InFlight;
+        }
+    }
+
+    /**
+     * Fills the window with requests at consecutive offsets, and resends the pending ones.
+     */
+    void sendRequests()
+    {
+        for (auto& chunk : window_)
+        {
+            if (status_ != Status::InProgress)
+            {
+                break;
+            }
 
-            const int res = read_client_.call(source_node_id_, req);
+            if ((chunk.state == Chunk::State::Free) && (next_request_offset_ < end_offset_))
+            {
+                chunk.offset = next_request_offset_;
+                chunk.attempts = 0;
+                next_request_offset_ += ChunkSize;
+                sendRequest(chunk);
+            }
+            else if (chunk.state == Chunk::State::Pending)
+            {
+                sendRequest(chunk);
+            }
+            else
+            {
+                ;   // Nothing to do
+            }
+        }
+    }
+
+    /**
+     * Writes the received chunks into the sink in the order of their offsets.
+     */
+    void reassemble()
+    {
+        bool progress = true;
+        while (progress && (status_ == Status::InProgress))
+        {
+            progress = false;
+            for (auto& chunk : window_)
+            {
+                if ((chunk.state == Chunk::State::Received) && (chunk.offset == image_size_))
+                {
+                    const int res = sink_.write(chunk.offset, chunk.data.begin(), unsigned(chunk.data.size()));
+                    if (res < 0)
+                    {
+                        std::cerr << "Sink write failed: " << res << std::endl;
+                        finish(Status::Failure);
+                        return;
+                    }
+                    image_crc_.add(chunk.data.begin(), unsigned(chunk.data.size()));
+                    image_size_ += chunk.data.size();
+                    chunk.state = Chunk::State::Free;
+                    progress = true;
+                }
+            }
+        }
+
+        if (image_size_ >= end_offset_)
+        {
+            const int res = sink_.finalize(image_size_, image_crc_.get());
             if (res < 0)
             {
-                std::cerr << "Read call failed: " << res << std::endl;
+                std::cerr << "Sink finalization failed: " << res << std::endl;
             }
+            finish((res < 0) ? Status::Failure : Status::Success);
         }
     }
 
+    void handleTimerEvent(const uavcan::TimerEvent&) final override
+    {
+        sendRequests();
+    }
+
     void handleReadResponse(const uavcan::ServiceCallResult<uavcan::protocol::file::Read>& result)
     {
-        if (result.isSuccessful() &&
-            result.getResponse().error.value == 0)
+        if (status_ != Status::InProgress)
         {
-            auto& data = result.getResponse().data;
+            return;
+        }
 
-            image_.insert(image_.end(), data.begin(), data.end());
+        Chunk* chunk = nullptr;
+        for (auto& c : window_)
+        {
+            if ((c.state == Chunk::State::InFlight) && (c.call_id == result.getCallID()))
+            {
+                chunk = &c;
+                break;
+            }
+        }
+        if (chunk == nullptr)
+        {
+            return;     // Stale response, e.g. the chunk is beyond the end of the file
+        }
+
+        if (chunk->offset >= end_offset_)
+        {
+            chunk->state = Chunk::State::Free;          // Beyond the end of the file, not needed
+            sendRequests();
+            return;
+        }
 
-            if (data.size() < data.capacity())  // Termination condition
+        if (!result.isSuccessful())
+        {
+            chunk->attempts++;
+            if (chunk->attempts >= MaxAttemptsPerChunk)
             {
-                status_ = Status::Success;
-                uavcan::TimerBase::stop();
+                std::cerr << "Read at offset " << chunk->offset << " timed out" << std::endl;
+                finish(Status::Failure);
+                return;
             }
+            sendRequest(*chunk);                        // Retrying this chunk only
+            return;
         }
-        else
+
+        if (result.getResponse().error.value != 0)
+        {
+            finish(Status::Failure);
+            return;
+        }
+
+        chunk->data = result.getResponse().data;
+        chunk->state = Chunk::State::Received;
+
+        if (chunk->data.size() < ChunkSize)             // Termination condition
         {
-            status_ = Status::Failure;
-            uavcan::TimerBase::stop();
+            end_offset_ = chunk->offset + chunk->data.size();
         }
+
+        reassemble();
+        sendRequests();
     }
 
 public:
@@ -98,14 +349,16 @@ public:
      */
     FirmwareLoader(uavcan::INode& node,
                    uavcan::NodeID source_node_id,
-                   const uavcan::protocol::file::Path::FieldTypes::path& source_path) :
+                   const uavcan::protocol::file::Path::FieldTypes::path& source_path,
+                   IFirmwareSink& sink,
+                   unsigned window_size = DefaultWindowSize) :
         uavcan::TimerBase(node),
         source_node_id_(source_node_id),
         source_path_(source_path),
+        sink_(sink),
+        window_(std::max(window_size, 1U)),
         read_client_(node)
     {
-        image_.reserve(1024);   // Arbitrary value
-
         /*
          * According to the specification, response priority equals request priority.
          * Typically, file I/O should be executed at a very low priority level.
@@ -114,10 +367,17 @@ public:
         read_client_.setCallback(ReadResponseCallback(this, &FirmwareLoader::handleReadResponse));
 
         /*
-         * Rate-limiting is necessary to avoid bus congestion.
-         * The exact rate depends on the application's requirements and CAN bit rate.
+         * This is the per-chunk timeout. A chunk that has timed out will be requested again.
+         */
+        read_client_.setRequestTimeout(uavcan::MonotonicDuration::fromMSec(1000));
+
+        /*
+         * New requests are normally sent from the response handler; the timer is only needed to retry requests
+         * that could not be sent, e.g. because the TX queue was full.
          */
-        uavcan::TimerBase::startPeriodic(uavcan::MonotonicDuration::fromMSec(200));
+        uavcan::TimerBase::startPeriodic(uavcan::MonotonicDuration::fromMSec(100));
+
+        sendRequests();
     }
 
     /**
@@ -126,72 +386,15 @@ public:
     Status getStatus() const { return status_; }
 
     /**
-     * Returns the downloaded image.
+     * Returns the number of bytes written into the sink so far.
      */
-    const std::vector<std::uint8_t>& getImage() const { return image_; }
-};
+    std::uint64_t getImageSize() const { return image_size_; }
 
-/**
- * This function is used to display the downloaded image.
- */
-template <typename InputIterator>
-void printHexDump(InputIterator begin, const InputIterator end)
-{
-    struct RAIIFlagsSaver
-    {
-        const std::ios::fmtflags flags_ = std::cout.flags();
-        ~RAIIFlagsSaver() { std::cout.flags(flags_); }
-    } _flags_saver;
-
-    static constexpr unsigned BytesPerRow = 16;
-    unsigned offset = 0;
-
-    std::cout << std::hex << std::setfill('0');
-
-    do
-    {
-        std::cout << std::setw(8) << offset << "  ";
-        offset += BytesPerRow;
-
-        {
-            auto it = begin;
-            for (unsigned i = 0; i < BytesPerRow; ++i)
-            {
-                if (i == 8)
-                {
-                    std::cout << ' ';
-                }
-
-                if (it != end)
-                {
-                    std::cout << std::setw(2) << unsigned(*it) << ' ';
-                    ++it;
-                }
-                else
-                {
-                    std::cout << "   ";
-                }
-            }
-        }
-
-        std::cout << "  ";
-        for (unsigned i = 0; i < BytesPerRow; ++i)
-        {
-            if (begin != end)
-            {
-                std::cout << ((unsigned(*begin) >= 32U && unsigned(*begin) <= 126U) ? char(*begin) : '.');
-                ++begin;
-            }
-            else
-            {
-                std::cout << ' ';
-            }
-        }
-
-        std::cout << std::endl;
-    }
-    while (begin != end);
-}
+    /**
+     * Returns CRC-64-WE of the data written into the sink so far.
+     */
+    std::uint64_t getImageCRC() const { return image_crc_.get(); }
+};
 
 int main(int argc, const char** argv)
 {
@@ -231,15 +434,22 @@ int main(int argc, const char** argv)
      */
     uavcan::LazyConstructor<FirmwareLoader> fw_loader;
 
+    /*
+     * The downloaded image will be written into this file.
+     * On a deeply embedded system, the sink would write the image directly into the flash memory instead.
+     */
+    static const char* const DownloadedImagePath = "firmware.bin";
+    FileFirmwareSink fw_sink;
+
     /*
      * Initializing the BeginFirmwareUpdate server.
      */
     uavcan::ServiceServer<uavcan::protocol::file::BeginFirmwareUpdate> bfu_server(node);
 
     const int bfu_res = bfu_server.start(
-        [&fw_loader, &node]
+        [&fw_loader, &fw_sink, &node]
         (const uavcan::ReceivedDataStructure<uavcan::protocol::file::BeginFirmwareUpdate::Request>& req,
-         uavcan::protocol::file::BeginFirmwareUpdate::Response resp)
+         uavcan::protocol::file::BeginFirmwareUpdate::Response& resp)
         {
             std::cout << "Firmware update request:\n" << req << std::endl;
 
@@ -247,12 +457,18 @@ int main(int argc, const char** argv)
             {
                 resp.error = resp.ERROR_IN_PROGRESS;
             }
+            else if (fw_sink.open(DownloadedImagePath) < 0)
+            {
+                resp.error = resp.ERROR_UNKNOWN;
+                resp.optional_error_message = "Could not open the output file";
+            }
             else
             {
                 const auto source_node_id = (req.source_node_id == 0) ? req.getSrcNodeID() : req.source_node_id;
 
-                fw_loader.construct<uavcan::INode&, uavcan::NodeID, decltype(req.image_file_remote_path.path)>
-                    (node, source_node_id, req.image_file_remote_path.path);
+                fw_loader.construct<uavcan::INode&, uavcan::NodeID, decltype(req.image_file_remote_path.path),
+                                    IFirmwareSink&>
+                    (node, source_node_id, req.image_file_remote_path.path, fw_sink);
             }
 
             std::cout << "Response:\n" << resp << std::endl;
@@ -277,12 +493,11 @@ int main(int argc, const char** argv)
             {
                 if (fw_loader->getStatus() == FirmwareLoader::Status::Success)
                 {
-                    auto image = fw_loader->getImage();
-
-                    std::cout << "Firmware download succeeded [" << image.size() << " bytes]" << std::endl;
-                    printHexDump(std::begin(image), std::end(image));
+                    std::cout << "Firmware download succeeded [" << fw_loader->getImageSize() << " bytes, CRC64 "
+                              << std::hex << std::showbase << fw_loader->getImageCRC() << std::dec << std::noshowbase
+                              << "], saved to " << DownloadedImagePath << std::endl;
 
-                    // TODO: save the firmware image somewhere.
+                    // TODO: verify the CRC, deploy the firmware image.
                 }
                 else
                 {
@@ -292,6 +507,7 @@ int main(int argc, const char** argv)
                 }
 
                 fw_loader.destroy();
+                fw_sink.close();
             }
         }
         else
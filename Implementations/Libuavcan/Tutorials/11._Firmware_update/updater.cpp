@@ -1,7 +1,7 @@
 #include <iostream>
 #include <cstdlib>
-#include <cctype>
-#include <vector>
+#include <map>
+#include <set>
 #include <algorithm>
 #include <unistd.h>
 #include <uavcan/uavcan.hpp>
@@ -16,13 +16,179 @@
  * We're using POSIX-dependent classes and POSIX API in this example.
  * This means that the example will only work as-is on a POSIX-compliant system (e.g. Linux, NuttX),
  * otherwise the said classes will have to be re-implemented.
+ *
+ * The file server backend keeps the firmware images memory-mapped. Optionally, it can be replaced with
+ * uavcan_posix::BasicFileServerBackend from the POSIX platform driver, which accesses the file system on every request.
+ *
+ * The firmware catalogue keeps track of the available firmware files using inotify, which is Linux-specific.
+ *
+ * Both classes are defined in separate headers (see below).
  */
-#include <uavcan_posix/basic_file_server_backend.hpp>
-#include <glob.h>                                       // POSIX glob() function
+#include "caching_file_server_backend.hpp"
+#include "firmware_catalogue.hpp"
+
+/*
+ * Node info cache that shares one retriever between all components, see the tutorial "Node discovery".
+ */
+#include "../9._Node_discovery/node_info_cache.hpp"
 
 extern uavcan::ICanDriver& getCanDriver();
 extern uavcan::ISystemClock& getSystemClock();
 
+/**
+ * This class limits the number of nodes that can be updating their firmware simultaneously.
+ * It is needed because every node that is being updated generates a certain amount of bus traffic - if all nodes
+ * were updated at once, the bus would be overloaded, which could interfere with other nodes.
+ *
+ * A node takes a slot when the update request is about to be sent, and releases it when it leaves the software
+ * update mode (e.g. restarts with the new firmware), goes offline, rejects the request, or doesn't start updating
+ * within a reasonable time. Nodes that couldn't get a slot are deferred; once a slot is released, the cached node info
+ * of the deferred nodes is delivered to the firmware update trigger again, so that it reconsiders them without
+ * sending any requests to the bus. The libuavcan retriever can only re-request the info from all nodes at once.
+ *
+ * The status information is provided by the node info cache via the interface uavcan::INodeInfoListener.
+ */
+class UpdateConcurrencyLimiter final : public uavcan::INodeInfoListener,
+                                       private uavcan::TimerBase
+{
+    struct Slot
+    {
+        uavcan::MonotonicTime acquired_at;
+        bool update_started = false;
+    };
+
+    static constexpr unsigned StartTimeoutSec = 30;   ///< Slot is released if the node doesn't start updating
+
+    uavcan::INode& node_;
+    node_info_cache::NodeInfoCache& cache_;
+    const unsigned max_concurrent_updates_;
+    std::map<std::uint8_t, Slot> slots_;              ///< Key is node ID
+    std::set<std::uint8_t> deferred_;                 ///< Nodes that couldn't get a slot
+    uavcan::INodeInfoListener* checker_ = nullptr;    ///< Receives the node info of the deferred nodes again
+    bool recheck_pending_ = false;
+
+    void handleNodeInfoRetrieved(uavcan::NodeID, const uavcan::protocol::GetNodeInfo::Response&) override { }
+
+    void handleNodeInfoUnavailable(uavcan::NodeID node_id) override
+    {
+        (void)deferred_.erase(node_id.get());
+        release(node_id);
+    }
+
+    void handleNodeStatusChange(const uavcan::NodeStatusMonitor::NodeStatusChangeEvent& event) override
+    {
+        if (event.status.mode == uavcan::protocol::NodeStatus::MODE_OFFLINE)
+        {
+            (void)deferred_.erase(event.node_id.get());
+        }
+
+        const auto it = slots_.find(event.node_id.get());
+        if (it == slots_.end())
+        {
+            return;
+        }
+
+        if (event.status.mode == uavcan::protocol::NodeStatus::MODE_SOFTWARE_UPDATE)
+        {
+            it->second.update_started = true;
+        }
+        else if (it->second.update_started ||
+                 (event.status.mode == uavcan::protocol::NodeStatus::MODE_OFFLINE))
+        {
+            release(event.node_id);
+        }
+        else
+        {
+            ;   // The node didn't begin the update yet
+        }
+    }
+
+    /**
+     * The deferred nodes are checked from the timer rather than from release(), because release() may be invoked
+     * from the callbacks of the trigger.
+     */
+    void recheckDeferredNodes()
+    {
+        recheck_pending_ = false;
+        const std::set<std::uint8_t> deferred = deferred_;
+        deferred_.clear();                            // The nodes that still don't fit will be deferred again
+        for (auto node_id : deferred)
+        {
+            if (checker_ != nullptr)
+            {
+                // If the info is not cached anymore, the node has restarted, and it will be checked anyway
+                (void)cache_.replay(node_id, *checker_);
+            }
+        }
+    }
+
+    void handleTimerEvent(const uavcan::TimerEvent& event) override
+    {
+        if (recheck_pending_)
+        {
+            recheckDeferredNodes();
+        }
+
+        for (auto it = slots_.begin(); it != slots_.end();)
+        {
+            const auto elapsed = event.real_time - it->second.acquired_at;
+            const bool expired = !it->second.update_started &&
+                                 (elapsed > uavcan::MonotonicDuration::fromMSec(StartTimeoutSec * 1000));
+            const uavcan::NodeID node_id = it->first;
+            ++it;
+            if (expired)
+            {
+                std::cout << "Node " << int(node_id.get()) << " did not start the update in time" << std::endl;
+                release(node_id);
+            }
+        }
+    }
+
+public:
+    UpdateConcurrencyLimiter(uavcan::INode& node,
+                             node_info_cache::NodeInfoCache& cache,
+                             unsigned max_concurrent_updates) :
+        uavcan::TimerBase(node),
+        node_(node),
+        cache_(cache),
+        max_concurrent_updates_(max_concurrent_updates)
+    {
+        uavcan::TimerBase::startPeriodic(uavcan::MonotonicDuration::fromMSec(1000));
+    }
+
+    /**
+     * The listener that decides whether the deferred nodes need an update, i.e. the firmware update trigger.
+     */
+    void setChecker(uavcan::INodeInfoListener& checker) { checker_ = &checker; }
+
+    /**
+     * Returns true if the node can begin the update now. Otherwise the node will be checked again later.
+     */
+    bool tryAcquire(uavcan::NodeID node_id)
+    {
+        if (slots_.count(node_id.get()) > 0)
+        {
+            return true;
+        }
+        if (slots_.size() >= max_concurrent_updates_)
+        {
+            (void)deferred_.insert(node_id.get());
+            return false;
+        }
+        (void)deferred_.erase(node_id.get());
+        slots_[node_id.get()].acquired_at = node_.getMonotonicTime();
+        return true;
+    }
+
+    void release(uavcan::NodeID node_id)
+    {
+        if ((slots_.erase(node_id.get()) > 0) && !deferred_.empty())
+        {
+            recheck_pending_ = true;            // The deferred nodes will be checked again shortly
+        }
+    }
+};
+
 /**
  * This class implements the application-specific part of uavcan::FirmwareUpdateTrigger
  * via the interface uavcan::IFirmwareVersionChecker.
@@ -42,6 +208,9 @@ extern uavcan::ISystemClock& getSystemClock();
  */
 class ExampleFirmwareVersionChecker final : public uavcan::IFirmwareVersionChecker
 {
+    uavcan_firmware_catalogue::FirmwareCatalogue& catalogue_;
+    UpdateConcurrencyLimiter& limiter_;
+
     /**
      * This method will be invoked when the class obtains a response to GetNodeInfo request.
      *
@@ -88,49 +257,40 @@ class ExampleFirmwareVersionChecker final : public uavcan::IFirmwareVersionCheck
                   << node_info << std::endl;
 
         /*
-         * Looking for matching firmware files.
+         * Looking for the firmware file with highest version number.
+         * The catalogue already knows the best file for every node type, so the file system is not accessed here.
          */
-        auto files = findAvailableFirmwareFiles(node_info);
-        if (files.empty())
+        const auto best_firmware_info = catalogue_.findBestFirmware(node_info.name.c_str(),
+                                                                    node_info.hardware_version.major,
+                                                                    node_info.hardware_version.minor);
+        if (best_firmware_info == nullptr)
         {
             std::cout << "No firmware files found for this node" << std::endl;
             return false;
         }
 
-        std::cout << "Matching firmware files:";
-        for (auto x: files)
-        {
-            std::cout << "\n\t" << x << "\n" << parseFirmwareFileName(x.c_str()) << std::endl;
-        }
+        const std::string best_file_name = best_firmware_info->path;
+
+        std::cout << "Preferred firmware: " << best_file_name << std::endl;
 
         /*
-         * Looking for the firmware file with highest version number
+         * Comparing the best firmware with the actual one, requesting an update if they differ.
          */
-        std::string best_file_name;
-        unsigned best_combined_version = 0;
-        for (auto x: files)
+        if (best_firmware_info->software_version_major == node_info.software_version.major &&
+            best_firmware_info->software_version_minor == node_info.software_version.minor &&
+            best_firmware_info->vcs_commit == node_info.software_version.vcs_commit)
         {
-            const auto inf = parseFirmwareFileName(x.c_str());
-            const unsigned combined_version = (unsigned(inf.software_version.major) << 8) + inf.software_version.minor;
-            if (combined_version >= best_combined_version)
-            {
-                best_combined_version = combined_version;
-                best_file_name = x;
-            }
+            std::cout << "Firmware is already up-to-date" << std::endl;
+            return false;
         }
 
-        std::cout << "Preferred firmware: " << best_file_name << std::endl;
-
-        const auto best_firmware_info = parseFirmwareFileName(best_file_name.c_str());
-
         /*
-         * Comparing the best firmware with the actual one, requesting an update if they differ.
+         * The update will only be requested if the number of nodes that are being updated at the moment is below
+         * the limit. Otherwise this node will be checked again later, once one of the updates is finished.
          */
-        if (best_firmware_info.software_version.major == node_info.software_version.major &&
-            best_firmware_info.software_version.minor == node_info.software_version.minor &&
-            best_firmware_info.software_version.vcs_commit == node_info.software_version.vcs_commit)
+        if (!limiter_.tryAcquire(node_id))
         {
-            std::cout << "Firmware is already up-to-date" << std::endl;
+            std::cout << "Too many nodes are being updated at the moment, node deferred" << std::endl;
             return false;
         }
 
@@ -155,10 +315,12 @@ class ExampleFirmwareVersionChecker final : public uavcan::IFirmwareVersionCheck
         if (symlink_res < 0)
         {
             std::cout << "Could not create symlink: " << symlink_res << std::endl;
+            limiter_.release(node_id);
             return false;
         }
 
         std::cout << "Firmware file symlink: " << out_firmware_file_path.c_str() << std::endl;
+
         return true;
     }
 
@@ -193,6 +355,7 @@ class ExampleFirmwareVersionChecker final : public uavcan::IFirmwareVersionCheck
                   << "\t" << out_firmware_file_path.c_str()
                   << "\nresponse was:\n"
                   << error_response << std::endl;
+        limiter_.release(node_id);
         return false;
     }
 
@@ -240,83 +403,12 @@ class ExampleFirmwareVersionChecker final : public uavcan::IFirmwareVersionCheck
         return out;
     }
 
-    /*
-     * This function is specific for this example implementation.
-     * It extracts the version information from firmware file name.
-     * The implementation is made so that it can work even on a deeply embedded system.
-     * Assumed format is:
-     *      <node-name>-<hw-major>.<hw-minor>-<sw-major>.<sw-minor>.<vcs-hash-hex>.uavcan.bin
-     */
-    static uavcan::protocol::GetNodeInfo::Response parseFirmwareFileName(const char* name)
-    {
-        // Must be static in order to avoid heap allocation
-        static const auto extract_uint8 = [](unsigned& pos, const char* name)
-        {
-            std::uint8_t res = 0;
-            pos++;
-            while (std::isdigit(name[pos]))
-            {
-                res = res * 10 + int(name[pos] - '0');
-                pos++;
-            }
-            return res;
-        };
-
-        uavcan::protocol::GetNodeInfo::Response res;
-        unsigned pos = 0;
-
-        while (name[pos] != '-')
-        {
-            res.name.push_back(name[pos]);
-            pos++;
-        }
-
-        res.hardware_version.major = extract_uint8(pos, name);
-        res.hardware_version.minor = extract_uint8(pos, name);
-        res.software_version.major = extract_uint8(pos, name);
-        res.software_version.minor = extract_uint8(pos, name);
-
-        pos++;
-        res.software_version.vcs_commit = ::strtoul(name + pos, nullptr, 16);
-        res.software_version.optional_field_flags = res.software_version.OPTIONAL_FIELD_FLAG_VCS_COMMIT;
-
-        return res;
-    }
-
-    /*
-     * This function is specific for this example implementation.
-     * It returns the firmware files available for given node info struct.
-     */
-    static std::vector<std::string> findAvailableFirmwareFiles(const uavcan::protocol::GetNodeInfo::Response& info)
-    {
-        std::vector<std::string> glob_matches;
-
-        const std::string glob_pattern = std::string(info.name.c_str()) + "-" +
-                                         std::to_string(info.hardware_version.major) + "." +
-                                         std::to_string(info.hardware_version.minor) + "-*.uavcan.bin";
-
-        auto result = ::glob_t();
-
-        const int res = ::glob(glob_pattern.c_str(), 0, nullptr, &result);
-        if (res != 0)
-        {
-            ::globfree(&result);
-            if (res == GLOB_NOMATCH)
-            {
-                return glob_matches;
-            }
-            throw std::runtime_error("Can't glob()");
-        }
-
-        for(unsigned i = 0; i < result.gl_pathc; ++i)
-        {
-            glob_matches.emplace_back(result.gl_pathv[i]);
-        }
-
-        ::globfree(&result);
-
-        return glob_matches;
-    }
+public:
+    ExampleFirmwareVersionChecker(uavcan_firmware_catalogue::FirmwareCatalogue& catalogue,
+                                  UpdateConcurrencyLimiter& limiter) :
+        catalogue_(catalogue),
+        limiter_(limiter)
+    { }
 };
 
 int main(int argc, const char** argv)
@@ -354,18 +446,26 @@ int main(int argc, const char** argv)
     }
 
     /*
-     * Initializing the node info retriever.
+     * Initializing the node info cache, which contains the node info retriever.
      *
      * We don't need it, but it will be used by the firmware version checker, which will be initialized next.
+     * All components of the application obtain node info through the cache, so every node is queried only once
+     * after it appears or restarts, no matter how many components are interested in it. The requests are spread
+     * in time so that they don't take more than the specified share of the bus capacity.
      */
-    uavcan::NodeInfoRetriever node_info_retriever(node);
+    node_info_cache::NodeInfoCache node_info_cache(node);
 
-    const int retriever_res = node_info_retriever.start();
-    if (retriever_res < 0)
+    node_info_cache::RequestBudget request_budget;
+    request_budget.max_bus_load_permille = 20;
+
+    const int cache_res = node_info_cache.start(request_budget);
+    if (cache_res < 0)
     {
-        throw std::runtime_error("Failed to start the node info retriever: " + std::to_string(retriever_res));
+        throw std::runtime_error("Failed to start the node info cache: " + std::to_string(cache_res));
     }
 
+    uavcan::NodeInfoRetriever& node_info_retriever = node_info_cache.getRetriever();
+
     /*
      * Initializing the firmware update trigger.
      *
@@ -375,8 +475,42 @@ int main(int argc, const char** argv)
      *
      * The application-specific logic that performs the checks is implemented in the class
      * ExampleFirmwareVersionChecker, defined above in this file.
+     *
+     * The number of nodes that are allowed to update simultaneously is derived from the bus utilization ceiling.
+     * Every node that is being updated generates roughly the same amount of traffic (it is limited by the read window
+     * of the updatee), so the total bus load is proportional to the number of concurrent updates.
+     * The values below are just an example; they should be adjusted for the actual bus and updatees.
      */
-    ExampleFirmwareVersionChecker checker;
+    constexpr unsigned CanBitRate = 1000000;
+    constexpr unsigned BusUtilizationCeilingPercent = 50;
+    constexpr unsigned EstimatedBitRatePerUpdate = 100000;
+    constexpr unsigned MaxConcurrentUpdates =
+        (CanBitRate / 100U * BusUtilizationCeilingPercent) / EstimatedBitRatePerUpdate;
+    static_assert(MaxConcurrentUpdates > 0, "The bus can't sustain even one update");
+
+    UpdateConcurrencyLimiter limiter(node, node_info_cache, MaxConcurrentUpdates);
+
+    const int limiter_res = node_info_cache.addListener(&limiter);
+    if (limiter_res < 0)
+    {
+        throw std::runtime_error("Failed to add the concurrency limiter: " + std::to_string(limiter_res));
+    }
+
+    /*
+     * The firmware catalogue scans the working directory once, and then keeps track of changes using inotify.
+     * Firmware files can be added or removed while the updater is running.
+     */
+    uavcan_firmware_catalogue::FirmwareCatalogue catalogue;
+
+    const int catalogue_res = catalogue.init();
+    if (catalogue_res < 0)
+    {
+        throw std::runtime_error("Failed to init the firmware catalogue: " + std::to_string(catalogue_res));
+    }
+
+    std::cout << "Firmware files found: " << catalogue.getNumFiles() << std::endl;
+
+    ExampleFirmwareVersionChecker checker(catalogue, limiter);
 
     uavcan::FirmwareUpdateTrigger trigger(node, checker);
 
@@ -386,13 +520,18 @@ int main(int argc, const char** argv)
         throw std::runtime_error("Failed to start the firmware update trigger: " + std::to_string(trigger_res));
     }
 
+    limiter.setChecker(trigger);                // The deferred nodes will be re-checked by the trigger
+
     /*
      * Initializing the file server.
      *
      * It is not necessary to run the file server on the same node with the firmware update trigger
      * (this is explained in the specification), but this use case is the most common, so we'll demonstrate it here.
+     *
+     * The caching backend maps every firmware image into memory once, and serves all read requests from there,
+     * which is important when many identical nodes are being updated at once.
      */
-    uavcan_posix::BasicFileServerBackend file_server_backend(node);
+    uavcan_caching_file_server::CachingFileServerBackend file_server_backend;
     uavcan::FileServer file_server(node, file_server_backend);
 
     const int file_server_res = file_server.start();
@@ -4,15 +4,27 @@
  * The main thread is publishing KeyValue messages, simulating a hard real-time task.
  *
  * The secondary thread is running an active node monitor (based on uavcan::NodeInfoRetriever),
- * which performs blocking filesystem I/O and therefore cannot be implemented in the main thread.
+ * which prints the collected node info and saves it into a file; the file is written by yet another thread,
+ * so that the blocking filesystem I/O doesn't delay the node.
+ *
+ * The third thread is running another sub-node that prints log messages received from the bus.
+ * Both sub-nodes are connected to the main node via one hub.
  */
 
 /*
  * Standard C++ headers.
  */
 #include <iostream>                     // For std::cout and std::cerr
-#include <fstream>                      // For std::ofstream, which is used in the demo payload logic
 #include <thread>                       // For std::thread
+#include <algorithm>                    // For std::min()
+#include <cerrno>                       // For errno
+
+/*
+ * POSIX headers. The main node uses them to block on the CAN sockets and on the sub-node TX signal at once.
+ */
+#include <poll.h>                       // For ::poll()
+#include <sys/eventfd.h>                // For ::eventfd()
+#include <unistd.h>                     // For ::read(), ::write(), ::close()
 
 /*
  * Libuavcan headers.
@@ -20,24 +32,81 @@
 #include <uavcan/uavcan.hpp>            // Main libuavcan header
 #include <uavcan/node/sub_node.hpp>     // For uavcan::SubNode, which is essential for multithreaded nodes
 #include <uavcan/helpers/heap_based_pool_allocator.hpp> // In this example we're going to use heap-based allocator
+#include <uavcan_linux/uavcan_linux.hpp> // For uavcan_linux::SocketCanIface, needed to access the CAN socket FD
 
 /*
  * These are purely for demonstrational purposes - they have no relation to multithreading.
  */
 #include <uavcan/protocol/debug/KeyValue.hpp>
+#include <uavcan/protocol/debug/LogMessage.hpp>
 #include <uavcan/protocol/node_info_retriever.hpp>
+#include <uavcan/transport/can_acceptance_filter_configurator.hpp>
 
 /*
  * Demo implementation of a virtual CAN driver.
  */
 #include "uavcan_virtual_driver.hpp"
 
+/*
+ * Thread-safe block allocator with per-thread caches, see below.
+ */
+#include "thread_cached_pool_allocator.hpp"
+
+/*
+ * Node info cache with asynchronous persistence, see the tutorial "Node discovery".
+ */
+#include "../9._Node_discovery/node_info_cache.hpp"
+
 /*
  * These functions are explained in one of the first tutorials.
  */
 extern uavcan::ICanDriver& getCanDriver();
 extern uavcan::ISystemClock& getSystemClock();
 
+/**
+ * This is the Linux-specific implementation of the TX pending signal, based on eventfd.
+ * The main node polls its file descriptor together with the CAN sockets, so it wakes up immediately when
+ * the sub-node emits new frames.
+ */
+class EventFdTxPendingSignal final : public uavcan_virtual_driver::ITxPendingSignal,
+                                     uavcan::Noncopyable
+{
+    const int fd_;
+
+    /**
+     * Will be invoked by the secondary thread. Writing into an eventfd is thread-safe.
+     */
+    void signalTxPending() override
+    {
+        const std::uint64_t one = 1;
+        (void)::write(fd_, &one, sizeof(one));
+    }
+
+public:
+    EventFdTxPendingSignal() :
+        fd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    {
+        if (fd_ < 0)
+        {
+            throw std::runtime_error("Failed to create eventfd");
+        }
+    }
+
+    ~EventFdTxPendingSignal() { (void)::close(fd_); }
+
+    int getFileDescriptor() const { return fd_; }
+
+    /**
+     * Resets the signal. Must be invoked by the main thread before the TX queues are flushed,
+     * otherwise notifications that arrive during the flush could be lost.
+     */
+    void clear()
+    {
+        std::uint64_t value = 0;
+        (void)::read(fd_, &value, sizeof(value));
+    }
+};
+
 /**
  * This class demonstrates a simple main node that is supposed to run some hard real-time tasks.
  */
@@ -84,8 +153,15 @@ class MainNodeDemo
      * applications, so this allocator should be used with care. If in doubt, use traditional one, since it also
      * can be made thread-safe. Or even use independent allocators per every (sub)node object, this is even more
      * deterministic, but takes much more memory.
+     *
+     * With the plain heap-based allocator, every allocation and deallocation locks the synchronizer, so the main node
+     * would be contending for one mutex with the sub-nodes. Therefore we're using its thread-cached variant, which has
+     * the same properties, but every thread keeps a small cache of free blocks, so the shared mutex is only taken when
+     * a batch of blocks needs to be moved between the cache and the shared pool.
+     * Replacing it with uavcan::HeapBasedPoolAllocator<uavcan::MemPoolBlockSize, AllocatorSynchronizer> is trivial.
      */
-    uavcan::HeapBasedPoolAllocator<uavcan::MemPoolBlockSize, AllocatorSynchronizer> allocator_;
+    uavcan_thread_cached_allocator::ThreadCachedPoolAllocator<uavcan::MemPoolBlockSize, AllocatorSynchronizer>
+        allocator_;
 
     /**
      * Note that we don't provide the pool size parameter to the @ref uavcan::Node template.
@@ -94,6 +170,58 @@ class MainNodeDemo
      */
     uavcan::Node<> node_;
 
+    /**
+     * The main node will be woken up by the sub-node via this signal when there are TX frames to inject.
+     */
+    EventFdTxPendingSignal tx_pending_signal_;
+
+    /**
+     * Maximum time the main node will block waiting for events if none of its deadlines is due earlier.
+     * This is a fallback that ensures that no frames remain stuck in the sub-node's queues if something goes wrong
+     * with the notifications; the tutorial on node initialization recommends spinning at least every 10 milliseconds.
+     */
+    static constexpr std::int64_t FallbackPollingPeriodMSec = 10;
+
+    /**
+     * If some frames of the sub-node could not be injected because the TX queue of the main node was full,
+     * the injection is retried after this delay; there will be no notification for these frames.
+     */
+    static constexpr std::int64_t TxInjectionRetryPeriodMSec = 1;
+
+    /**
+     * Returns the specified CAN iface of the main node.
+     * This part is specific for the Linux SocketCAN driver; if the main node uses a different driver, this method
+     * will throw.
+     */
+    uavcan_linux::SocketCanIface& getCanIface(std::uint8_t iface_index)
+    {
+        auto iface = dynamic_cast<uavcan_linux::SocketCanIface*>(
+            node_.getDispatcher().getCanIOManager().getCanDriver().getIface(iface_index));
+        if (iface == nullptr)
+        {
+            throw std::runtime_error("The main node must use the SocketCAN driver");
+        }
+        return *iface;
+    }
+
+    /**
+     * The node must wake up when its earliest deadline (a timer, a service call timeout, etc.) is due.
+     * The timeout is rounded up, so that the node never wakes up too early and spins in vain.
+     */
+    int computePollTimeoutMSec(const uavcan_virtual_driver::ITxQueueInjector& tx_injector) const
+    {
+        const auto now = node_.getMonotonicTime();
+        const auto deadline = node_.getScheduler().getDeadlineScheduler().getEarliestDeadline();
+        if (deadline <= now)
+        {
+            return 0;
+        }
+        const std::int64_t max_timeout_msec =
+            tx_injector.hasPendingTxFrames() ? TxInjectionRetryPeriodMSec : FallbackPollingPeriodMSec;
+        const std::int64_t timeout_msec = ((deadline - now).toUSec() + 999) / 1000;
+        return static_cast<int>(std::min(timeout_msec, max_timeout_msec));
+    }
+
 public:
     MainNodeDemo(uavcan::NodeID self_node_id, const std::string& self_node_name) :
         allocator_(AllocatorBlockCapacitySoftLimit),
@@ -139,7 +267,7 @@ public:
             });
 
         /*
-         * We know that in this implementation the class uavcan_virtual_driver::Driver inherits uavcan::IRxFrameListener,
+         * We know that in this implementation the class uavcan_virtual_driver::Hub inherits uavcan::IRxFrameListener,
          * so we can simply restore the reference to uavcan_virtual_driver::ITxQueueInjector using dynamic_cast<>.
          *
          * In other implementations this approach may be unacceptable (e.g. RTTI, which is required for dynamic_cast<>,
@@ -154,47 +282,78 @@ public:
         auto& tx_injector =
             dynamic_cast<uavcan_virtual_driver::ITxQueueInjector&>(*node_.getDispatcher().getRxFrameListener());
 
+        tx_injector.setTxPendingSignal(&tx_pending_signal_);
+
+        /*
+         * The main node is blocking on its CAN sockets and on the TX pending signal of the sub-node at once.
+         * This is the single-threaded poll()-based configuration explained in the tutorial on node initialization.
+         */
+        const unsigned num_ifaces = node_.getDispatcher().getCanIOManager().getNumIfaces();
+        uavcan_linux::SocketCanIface* ifaces[uavcan::MaxCanIfaces] = {};
+        ::pollfd fds[uavcan::MaxCanIfaces + 1] = {};
+        for (unsigned i = 0; i < num_ifaces; i++)
+        {
+            ifaces[i] = &getCanIface(static_cast<std::uint8_t>(i));
+            fds[i].fd = ifaces[i]->getFileDescriptor();
+        }
+        fds[num_ifaces].fd = tx_pending_signal_.getFileDescriptor();
+        fds[num_ifaces].events = POLLIN;
+
         /*
          * Running the node ALMOST normally.
          *
-         * Spinning must break every once in a while in order to unload TX queue of the sub-node into the
-         * TX queue of the main node. Duration of spinning defines worst-case transmission delay for sub-node's
-         * outgoing frames. Since sub-nodes are not supposed to run hard real-time processes, transmission delays
-         * introduced by periodic queue synchronizations are acceptable.
+         * Instead of spinning for a fixed period, the node sleeps until either a CAN frame arrives, or the sub-node
+         * signals that it has frames to transmit, or the earliest deadline of the node is due. In the second case
+         * all pending frames are injected into the TX queue of the main node in one batch, so the transmission delay
+         * for sub-node's outgoing frames is not tied to a polling period, and the timers of the main node fire
+         * on time. The main thread doesn't wake up when there's nothing to do.
          */
         node_.setModeOperational();
 
         while (true)
         {
-            const int res = node_.spin(uavcan::MonotonicDuration::fromMSec(2));
-            if (res < 0)
+            for (unsigned i = 0; i < num_ifaces; i++)
             {
-                std::cerr << "Transient failure: " << res << std::endl;
+                // If the driver holds frames that the socket couldn't take, the node waits until it can write again
+                fds[i].events = static_cast<short>(POLLIN | (ifaces[i]->hasReadyTx() ? POLLOUT : 0));
             }
+
+            const int poll_res = ::poll(fds, num_ifaces + 1, computePollTimeoutMSec(tx_injector));
+            if (poll_res < 0 && errno != EINTR)
+            {
+                throw std::runtime_error("poll() failed: " + std::to_string(errno));
+            }
+
             // CAN frame transfer from sub-node to the main node occurs here.
+            tx_pending_signal_.clear();
             tx_injector.injectTxFramesInto(node_);
+
+            const int res = node_.spinOnce();
+            if (res < 0)
+            {
+                std::cerr << "Transient failure: " << res << std::endl;
+            }
         }
     }
 };
 
 /**
  * This is just some demo logic, it has nothing to do with multithreading.
- * This class implements uavcan::INodeInfoListener, storing node info on the file system, one file per node.
+ * This class implements uavcan::INodeInfoListener, printing node info to the console.
+ * The node info is saved on the file system by the cache it is subscribed to.
  * Please refer to the tutorial "Node discovery" to learn more.
  */
-class FileBasedNodeInfoCollector final : public uavcan::INodeInfoListener
+class NodeInfoPrinter final : public uavcan::INodeInfoListener
 {
     void handleNodeInfoRetrieved(uavcan::NodeID node_id,
                                  const uavcan::protocol::GetNodeInfo::Response& node_info) override
     {
         std::cout << "Node info for " << int(node_id.get()) << ":\n" << node_info << std::endl;
-        std::ofstream(std::to_string(node_id.get())) << node_info;
     }
 
     void handleNodeInfoUnavailable(uavcan::NodeID node_id) override
     {
         std::cout << "Node info for " << int(node_id.get()) << " is unavailable" << std::endl;
-        std::ofstream(std::to_string(node_id.get())) << uavcan::protocol::GetNodeInfo::Response();
     }
 
     void handleNodeStatusChange(const uavcan::NodeStatusMonitor::NodeStatusChangeEvent& event) override
@@ -202,63 +361,70 @@ class FileBasedNodeInfoCollector final : public uavcan::INodeInfoListener
         if (event.status.mode == uavcan::protocol::NodeStatus::MODE_OFFLINE)
         {
             std::cout << "Node " << int(event.node_id.get()) << " went offline" << std::endl;
-            (void)std::remove(std::to_string(event.node_id.get()).c_str());
         }
     }
 };
 
 /**
- * This class demonstrates a simple sub-node that is supposed to run CPU-intensive, blocking, non-realtime tasks.
+ * All sub-nodes of this demo are connected to the main node via this hub, which copies RX frames to every sub-node
+ * and merges their TX queues by priority. The template argument defines the maximum number of sub-nodes.
+ */
+typedef uavcan_virtual_driver::Hub<4> SubNodeHub;
+
+/**
+ * This class contains the part that is common for all sub-nodes in this demo: the virtual driver and the sub-node
+ * object itself. Every sub-node runs in its own thread.
  */
-class SubNodeDemo
+class SubNodeBase
 {
-    static constexpr unsigned BlockAllocationQuotaPerIface = 80;
+    /**
+     * Depth of the lock-free RX and TX queues of every virtual iface, in CAN frames. Must be a power of two.
+     */
+    static constexpr unsigned VirtualIfaceQueueCapacity = 128;
 
-    uavcan_virtual_driver::Driver driver_;
-    uavcan::SubNode<> node_;
+    uavcan_virtual_driver::Driver<VirtualIfaceQueueCapacity> driver_;
 
-    uavcan::NodeInfoRetriever retriever_;
-    FileBasedNodeInfoCollector collector_;
+protected:
+    uavcan::SubNode<> node_;
 
-public:
     /**
      * Sub-node needs a reference to the main node in order to bind its virtual CAN driver to it.
-     * Also, the sub-node and the virtual iface all use the same allocator from the main node (it is thread-safe).
+     * Also, the sub-node uses the same allocator as the main node (it is thread-safe).
      * It is also possible to use dedicated allocators for every entity, but that would lead to higher memory
-     * footprint.
+     * footprint. The virtual driver doesn't need an allocator at all, since its queues are statically sized.
      */
-    SubNodeDemo(uavcan::INode& main_node) :
+    SubNodeBase(uavcan::INode& main_node, SubNodeHub& hub) :
         driver_(main_node.getDispatcher().getCanIOManager().getCanDriver().getNumIfaces(), // Nice?
-                getSystemClock(),
-                main_node.getAllocator(),       // Installing our custom allocator from the main node.
-                BlockAllocationQuotaPerIface),
+                getSystemClock()),
         node_(driver_,
               getSystemClock(),
-              main_node.getAllocator()),        // Installing our custom allocator from the main node.
-        retriever_(node_)
+              main_node.getAllocator())         // Installing our custom allocator from the main node.
     {
         node_.setNodeID(main_node.getNodeID());                     // Obviously, we must use the same node ID.
 
-        main_node.getDispatcher().installRxFrameListener(&driver_); // RX frames will be copied to the virtual driver.
+        const int hub_res = hub.addSubNodeDriver(driver_);          // RX frames will be copied to the virtual driver.
+        if (hub_res < 0)
+        {
+            throw std::runtime_error("Failed to add the sub-node to the hub; error: " + std::to_string(hub_res));
+        }
     }
 
-    void runForever()
+    /**
+     * Must be invoked once the payload of the sub-node is initialized.
+     */
+    void spinForever()
     {
         /*
-         * Initializing the demo payload.
-         * Note that the payload doesn't know that it's being runned by a secondary node - on the application level,
-         * there's no difference between a sub-node and the main node.
+         * The virtual driver implements software acceptance filters, which can be configured in the same way as
+         * hardware filters - refer to the tutorial "CAN acceptance filters" for details.
+         * This must be done after all subscribers and service clients are initialized. Once configured, the main
+         * node will be copying only those frames that the sub-node is actually interested in, which saves
+         * queue space and CPU time in both threads.
          */
-        const int retriever_res = retriever_.start();
-        if (retriever_res < 0)
+        const int filter_res = uavcan::configureCanAcceptanceFilters(node_);
+        if (filter_res < 0)
         {
-            throw std::runtime_error("Failed to start the retriever; error: " + std::to_string(retriever_res));
-        }
-
-        const int add_listener_res = retriever_.addListener(&collector_);
-        if (add_listener_res < 0)
-        {
-            throw std::runtime_error("Failed to add listener; error: " + std::to_string(add_listener_res));
+            throw std::runtime_error("Failed to configure acceptance filters; error: " + std::to_string(filter_res));
         }
 
         /*
@@ -276,6 +442,82 @@ public:
     }
 };
 
+/**
+ * This class demonstrates a simple sub-node that is supposed to run CPU-intensive, blocking, non-realtime tasks.
+ */
+class SubNodeDemo : public SubNodeBase
+{
+    node_info_cache::NodeInfoCache cache_;
+    NodeInfoPrinter printer_;
+
+public:
+    SubNodeDemo(uavcan::INode& main_node, SubNodeHub& hub) :
+        SubNodeBase(main_node, hub),
+        cache_(node_)
+    { }
+
+    void runForever()
+    {
+        /*
+         * Initializing the demo payload.
+         * Note that the payload doesn't know that it's being runned by a secondary node - on the application level,
+         * there's no difference between a sub-node and the main node.
+         */
+        const int cache_res = cache_.start();
+        if (cache_res < 0)
+        {
+            throw std::runtime_error("Failed to start the node info cache; error: " + std::to_string(cache_res));
+        }
+
+        /*
+         * All collected node info will be saved into this file. The file is rewritten at most once per second,
+         * and only if something has changed.
+         */
+        cache_.enablePersistence("node_info.yaml");
+
+        const int add_listener_res = cache_.addListener(&printer_);
+        if (add_listener_res < 0)
+        {
+            throw std::runtime_error("Failed to add listener; error: " + std::to_string(add_listener_res));
+        }
+
+        spinForever();
+    }
+};
+
+/**
+ * This class demonstrates another sub-node, running in yet another thread: it prints log messages emitted by
+ * other nodes. Since it doesn't need anything else, the main node won't copy any other traffic into its queues.
+ *
+ * Remember that only one sub-node can implement a certain publisher or service client (see the limitations above),
+ * which is why this sub-node doesn't perform any service calls.
+ */
+class LoggerSubNodeDemo : public SubNodeBase
+{
+    uavcan::Subscriber<uavcan::protocol::debug::LogMessage> log_sub_;
+
+public:
+    LoggerSubNodeDemo(uavcan::INode& main_node, SubNodeHub& hub) :
+        SubNodeBase(main_node, hub),
+        log_sub_(node_)
+    { }
+
+    void runForever()
+    {
+        const int log_sub_res = log_sub_.start(
+            [](const uavcan::ReceivedDataStructure<uavcan::protocol::debug::LogMessage>& msg)
+            {
+                std::cout << "Log message from " << int(msg.getSrcNodeID().get()) << ":\n" << msg << std::endl;
+            });
+        if (log_sub_res < 0)
+        {
+            throw std::runtime_error("Failed to start the log subscriber; error: " + std::to_string(log_sub_res));
+        }
+
+        spinForever();
+    }
+};
+
 
 int main(int argc, const char** argv)
 {
@@ -289,9 +531,17 @@ int main(int argc, const char** argv)
 
     MainNodeDemo main_node(self_node_id, "org.uavcan.tutorial.multithreading");
 
-    SubNodeDemo sub_node(main_node.getNode());
+    /*
+     * All sub-nodes must be added to the hub before it is installed into the main node.
+     */
+    SubNodeHub hub;
+    SubNodeDemo sub_node(main_node.getNode(), hub);
+    LoggerSubNodeDemo logger_sub_node(main_node.getNode(), hub);
+
+    main_node.getNode().getDispatcher().installRxFrameListener(&hub);  // RX frames will be copied to the sub-nodes.
 
     std::thread secondary_thread(std::bind(&SubNodeDemo::runForever, &sub_node));
+    std::thread logger_thread(std::bind(&LoggerSubNodeDemo::runForever, &logger_sub_node));
 
     // This thread is only needed for demo purposes; can be removed freely.
     std::thread allocator_stat_reporting_thread([&main_node]()
@@ -315,4 +565,8 @@ int main(int argc, const char** argv)
     {
         secondary_thread.join();
     }
+    if (logger_thread.joinable())
+    {
+        logger_thread.join();
+    }
 }
@@ -0,0 +1,337 @@
+/**
+ * This header implements a thread-safe block allocator for multi-threaded libuavcan nodes, where every thread
+ * keeps a small private cache of free blocks. Threads access the shared pool only in batches, when their cache
+ * runs empty or overflows, so the lock guarding the shared pool is taken rarely and is almost never contended.
+ *
+ * It is a drop-in replacement for uavcan::HeapBasedPoolAllocator with a thread-safe synchronizer.
+ *
+ * @file thread_cached_pool_allocator.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <cstdlib>              // For std::malloc(), std::free()
+#include <algorithm>            // For std::min()
+#include <atomic>               // For std::atomic
+#include <uavcan/uavcan.hpp>    // Main libuavcan header
+
+namespace uavcan_thread_cached_allocator
+{
+/**
+ * Works like uavcan::HeapBasedPoolAllocator: blocks are taken from the heap using std::malloc() when needed, and then
+ * kept for future re-use until @ref shrink() is called. The difference is that freed blocks first go into the cache
+ * of the calling thread, from where they are re-used by the same thread without any locking.
+ *
+ * Deterministic upper bound: the total number of blocks taken from the heap (including the cached ones) never exceeds
+ * the hard limit. Note though that blocks sitting in the cache of one thread are not available to other threads,
+ * so a thread is guaranteed to be able to allocate at least (hard limit - (MaxThreads - 1) * CacheSize) blocks.
+ *
+ * Threads beyond the first MaxThreads ones (in the order of their first allocation) bypass the cache and work with
+ * the shared pool directly, which is slower but still correct.
+ *
+ * @tparam BlockSize        Size of one block in bytes; normally it should be uavcan::MemPoolBlockSize.
+ *
+ * @tparam Synchronizer     RAII lock type, same as for uavcan::HeapBasedPoolAllocator. It is instantiated only
+ *                          when the shared pool is accessed.
+ *
+ * @tparam CacheSize        Maximum number of free blocks kept by each thread. Half of this number is transferred
+ *                          between the cache and the shared pool at once.
+ *
+ * @tparam MaxThreads       Maximum number of threads that can have a cache.
+ */
+template <std::size_t BlockSize,
+          typename Synchronizer,
+          unsigned CacheSize = 16,
+          unsigned MaxThreads = 8>
+class ThreadCachedPoolAllocator final : public uavcan::IPoolAllocator,
+                                        uavcan::Noncopyable
+{
+    static_assert(CacheSize >= 2, "Cache is too small");
+
+    static constexpr unsigned BatchSize = CacheSize / 2;
+
+    union Node
+    {
+        Node* next;
+    private:
+        std::uint8_t data[BlockSize];
+        long double _aligner1;
+        long long _aligner2;
+    };
+
+    /**
+     * Every cache is only accessed by its owning thread, except for @ref drain_requested and the counter, which are
+     * atomic so that other threads can request a flush and read the statistics.
+     */
+    struct ThreadCache
+    {
+        Node* blocks[CacheSize] = {};
+        std::atomic<unsigned> num_blocks;
+        std::atomic<bool> drain_requested;
+
+        ThreadCache() : num_blocks(0), drain_requested(false) { }
+    };
+
+    const std::uint16_t capacity_soft_limit_;
+    const std::uint16_t capacity_hard_limit_;
+
+    // These are protected by the synchronizer
+    Node* free_list_ = nullptr;
+    std::uint16_t num_reserved_blocks_ = 0;
+    std::uint16_t num_blocks_out_of_pool_ = 0;      ///< Used by the application or sitting in the thread caches
+
+    ThreadCache caches_[MaxThreads];
+
+    /**
+     * Returns the cache of the calling thread, or nullptr if the thread has none.
+     */
+    ThreadCache* getThreadCache()
+    {
+        static std::atomic<unsigned> thread_counter(0);
+        thread_local const unsigned thread_index = thread_counter.fetch_add(1);
+        return (thread_index < MaxThreads) ? &caches_[thread_index] : nullptr;
+    }
+
+    /**
+     * Takes up to max_blocks blocks from the shared pool. Allocates new ones from the heap if needed.
+     * Returns the number of blocks written to out_blocks.
+     */
+    unsigned takeFromPool(Node** out_blocks, unsigned max_blocks)
+    {
+        Synchronizer lock;
+        (void)lock;
+
+        unsigned num_taken = 0;
+        while (num_taken < max_blocks)
+        {
+            Node* n = free_list_;
+            if (n != nullptr)
+            {
+                free_list_ = n->next;
+            }
+            else if (num_reserved_blocks_ < capacity_hard_limit_)
+            {
+                n = static_cast<Node*>(std::malloc(sizeof(Node)));
+                if (n == nullptr)
+                {
+                    break;
+                }
+                num_reserved_blocks_++;
+            }
+            else
+            {
+                break;
+            }
+            out_blocks[num_taken++] = n;
+        }
+
+        num_blocks_out_of_pool_ = std::uint16_t(num_blocks_out_of_pool_ + num_taken);
+        return num_taken;
+    }
+
+    void returnToPool(Node* const* blocks, unsigned num_blocks)
+    {
+        Synchronizer lock;
+        (void)lock;
+
+        for (unsigned i = 0; i < num_blocks; i++)
+        {
+            blocks[i]->next = free_list_;
+            free_list_ = blocks[i];
+        }
+
+        UAVCAN_ASSERT(num_blocks_out_of_pool_ >= num_blocks);
+        num_blocks_out_of_pool_ = std::uint16_t(num_blocks_out_of_pool_ - num_blocks);
+    }
+
+    /**
+     * Moves the topmost num_blocks blocks from the cache back into the shared pool. Call from the owner thread only.
+     */
+    void drainCache(ThreadCache& cache, unsigned num_blocks)
+    {
+        const unsigned cached = cache.num_blocks.load(std::memory_order_relaxed);
+        num_blocks = (num_blocks < cached) ? num_blocks : cached;
+        returnToPool(&cache.blocks[cached - num_blocks], num_blocks);
+        cache.num_blocks.store(cached - num_blocks, std::memory_order_relaxed);
+    }
+
+    void handleDrainRequest(ThreadCache& cache)
+    {
+        if (cache.drain_requested.load(std::memory_order_relaxed))
+        {
+            cache.drain_requested.store(false, std::memory_order_relaxed);
+            drainCache(cache, CacheSize);
+        }
+    }
+
+public:
+    /**
+     * The meaning of the arguments is the same as for uavcan::HeapBasedPoolAllocator.
+     */
+    ThreadCachedPoolAllocator(std::uint16_t block_capacity_soft_limit,
+                              std::uint16_t block_capacity_hard_limit = 0) :
+        capacity_soft_limit_(block_capacity_soft_limit),
+        capacity_hard_limit_((block_capacity_hard_limit > 0) ? block_capacity_hard_limit :
+                             static_cast<std::uint16_t>(std::min(2U * block_capacity_soft_limit, 0xFFFFU)))
+    { }
+
+    /**
+     * The destructor frees all blocks, including the ones in the thread caches.
+     * It must not be called while other threads are still using the allocator.
+     */
+    ~ThreadCachedPoolAllocator()
+    {
+        for (auto& c : caches_)
+        {
+            for (unsigned i = 0; i < c.num_blocks.load(); i++)
+            {
+                std::free(c.blocks[i]);
+            }
+        }
+        while (free_list_ != nullptr)
+        {
+            Node* const next = free_list_->next;
+            std::free(free_list_);
+            free_list_ = next;
+        }
+    }
+
+    /**
+     * Takes a block from the cache of the calling thread; refills the cache from the shared pool if it is empty.
+     * Returns nullptr if there's no memory left or if the requested size is larger than the block size.
+     */
+    void* allocate(std::size_t size) override
+    {
+        if (size > BlockSize)
+        {
+            return nullptr;
+        }
+
+        ThreadCache* const cache = getThreadCache();
+        if (cache == nullptr)
+        {
+            Node* n = nullptr;
+            (void)takeFromPool(&n, 1);
+            return n;
+        }
+
+        handleDrainRequest(*cache);
+
+        unsigned cached = cache->num_blocks.load(std::memory_order_relaxed);
+        if (cached == 0)
+        {
+            cached = takeFromPool(cache->blocks, BatchSize);
+            if (cached == 0)
+            {
+                return nullptr;
+            }
+        }
+
+        cached--;
+        Node* const n = cache->blocks[cached];
+        cache->num_blocks.store(cached, std::memory_order_relaxed);
+        return n;
+    }
+
+    /**
+     * Puts the block into the cache of the calling thread; returns half of the cache into the shared pool
+     * if the cache is full.
+     */
+    void deallocate(const void* ptr) override
+    {
+        if (ptr == nullptr)
+        {
+            return;
+        }
+
+        Node* const n = static_cast<Node*>(const_cast<void*>(ptr));
+
+        ThreadCache* const cache = getThreadCache();
+        if (cache == nullptr)
+        {
+            returnToPool(&n, 1);
+            return;
+        }
+
+        handleDrainRequest(*cache);
+
+        if (cache->num_blocks.load(std::memory_order_relaxed) >= CacheSize)
+        {
+            drainCache(*cache, BatchSize);
+        }
+
+        const unsigned cached = cache->num_blocks.load(std::memory_order_relaxed);
+        cache->blocks[cached] = n;
+        cache->num_blocks.store(cached + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Same as uavcan::HeapBasedPoolAllocator::getBlockCapacity(), i.e. returns the soft limit.
+     */
+    std::uint16_t getBlockCapacity() const override { return capacity_soft_limit_; }
+
+    std::uint16_t getBlockCapacityHardLimit() const { return capacity_hard_limit_; }
+
+    /**
+     * Frees all blocks that are not in use, like uavcan::HeapBasedPoolAllocator::shrink().
+     * The cache of the calling thread is flushed immediately; other threads are requested to flush their caches
+     * on their next allocation or deallocation, so the blocks they hold will be freed by the next call to this method.
+     */
+    void shrink()
+    {
+        ThreadCache* const cache = getThreadCache();
+        if (cache != nullptr)
+        {
+            drainCache(*cache, CacheSize);
+        }
+        for (auto& c : caches_)
+        {
+            if (&c != cache)
+            {
+                c.drain_requested.store(true, std::memory_order_relaxed);
+            }
+        }
+
+        Synchronizer lock;
+        (void)lock;
+        while (free_list_ != nullptr)
+        {
+            Node* const next = free_list_->next;
+            std::free(free_list_);
+            free_list_ = next;
+            num_reserved_blocks_--;
+        }
+    }
+
+    /**
+     * Number of blocks taken from the heap, including the ones in the thread caches.
+     * This is the same metric as uavcan::HeapBasedPoolAllocator::getNumReservedBlocks().
+     */
+    std::uint16_t getNumReservedBlocks() const
+    {
+        Synchronizer lock;
+        (void)lock;
+        return num_reserved_blocks_;
+    }
+
+    /**
+     * Number of blocks that are currently used by the application.
+     * The result may be slightly inaccurate if other threads are allocating concurrently.
+     */
+    std::uint16_t getNumAllocatedBlocks() const
+    {
+        unsigned cached = 0;
+        for (auto& c : caches_)
+        {
+            cached += c.num_blocks.load(std::memory_order_relaxed);
+        }
+
+        Synchronizer lock;
+        (void)lock;
+        return static_cast<std::uint16_t>((num_blocks_out_of_pool_ > cached) ? (num_blocks_out_of_pool_ - cached) : 0);
+    }
+};
+
+}
@@ -15,146 +15,314 @@
 
 #include <iostream>             // For std::cout
 #include <thread>               // For std::mutex
+#include <atomic>               // For std::atomic, used by the lock-free queues
+#include <type_traits>          // For std::is_trivially_copyable
+#include <cstring>              // For std::memcpy()
 #include <condition_variable>   // For std::condition_variable
 #include <uavcan/uavcan.hpp>    // Main libuavcan header
 
 namespace uavcan_virtual_driver
 {
 /**
- * Generic queue based on the linked list class defined in libuavcan.
- * It does not use heap memory, but uses the libuavcan's deterministic pool allocator.
+ * Fixed-capacity lock-free single-producer single-consumer ring buffer.
+ * It does not use heap memory and never blocks, therefore it is safe to use from a hard real-time thread.
  *
- * This class is used to implement synchronized RX queue of the secondary thread.
+ * This class is used to implement the RX and TX queues between the main thread and the secondary thread.
+ * Exactly one thread may call @ref push() and @ref tryPush(), and exactly one (other) thread may call @ref pop().
+ *
+ * When the ring is full, @ref push() drops the oldest item to make room for the new one. Since the consumer may be
+ * reading the oldest item at that moment, every slot is protected with a sequence number, and the items are stored
+ * as atomic words: the consumer copies the item, then makes sure that the slot has not been rewritten meanwhile,
+ * and only then claims the item. The producer claims the oldest item the same way before it overwrites the slot,
+ * so every item is delivered or counted as dropped exactly once, and no memory is accessed concurrently
+ * by the two threads without synchronization.
+ *
+ * @tparam T            Item type, must be trivially copyable.
+ * @tparam Capacity     Maximum number of items; must be a power of two.
  */
-template <typename T>
-class Queue
+template <typename T, unsigned Capacity>
+class SpscRing : uavcan::Noncopyable
 {
-    struct Item : public uavcan::LinkedListNode<Item>
-    {
-        T payload;
+    static_assert((Capacity >= 2) && ((Capacity & (Capacity - 1)) == 0), "Capacity must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "Items must be trivially copyable");
 
-        template <typename... Args>
-        Item(Args... args) : payload(args...) { }
+    static constexpr std::uint32_t Mask = Capacity - 1;
+    static constexpr unsigned NumWords = (sizeof(T) + sizeof(std::uint32_t) - 1) / sizeof(std::uint32_t);
+
+    struct Slot
+    {
+        std::atomic<std::uint32_t> seq;         ///< 2 * position + 1 while being written, 2 * position + 2 after
+        std::atomic<std::uint32_t> words[NumWords];
     };
 
-    uavcan::LimitedPoolAllocator allocator_;
-    uavcan::LinkedListRoot<Item> list_;
+    Slot slots_[Capacity];
+    std::atomic<std::uint32_t> head_;           ///< Written by the producer only
+    std::atomic<std::uint32_t> tail_;           ///< Advanced by the consumer, and by the producer when dropping
+    std::atomic<std::uint32_t> overflow_count_;
 
-public:
-    /**
-     * @param arg_allocator             Used to allocate memory for stored items.
-     *
-     * @param block_allocation_quota    Maximum number of memory blocks this queue can take from the allocator.
-     *                                  Defines the depth of the queue.
-     */
-    Queue(uavcan::IPoolAllocator& arg_allocator,
-          std::size_t block_allocation_quota) :
-        allocator_(arg_allocator, block_allocation_quota)
+    void write(std::uint32_t position, const T& item)
     {
-        uavcan::IsDynamicallyAllocatable<Item>::check();
-    }
+        std::uint32_t words[NumWords] = {};
+        std::memcpy(words, &item, sizeof(T));
 
-    bool isEmpty() const { return list_.isEmpty(); }
+        Slot& slot = slots_[position & Mask];
+        slot.seq.store(2 * position + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (unsigned i = 0; i < NumWords; i++)
+        {
+            slot.words[i].store(words[i], std::memory_order_relaxed);
+        }
+        slot.seq.store(2 * position + 2, std::memory_order_release);
+    }
 
     /**
-     * Creates one item in-place at the end of the list.
-     * Returns true if the item has been appended successfully, false if there's not enough memory.
-     * Complexity is O(N) where N is queue length.
+     * Returns false if the slot has been rewritten since the item at the specified position was stored.
      */
-    template <typename... Args>
-    bool tryEmplace(Args... args)
+    bool read(std::uint32_t position, T& out_item) const
     {
-        // Allocating memory
-        void* const ptr = allocator_.allocate(sizeof(Item));
-        if (ptr == nullptr)
+        const Slot& slot = slots_[position & Mask];
+        const std::uint32_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq != 2 * position + 2)
         {
             return false;
         }
 
-        // Constructing the new item
-        Item* const item = new (ptr) Item(args...);
-        assert(item != nullptr);
+        std::uint32_t words[NumWords];
+        for (unsigned i = 0; i < NumWords; i++)
+        {
+            words[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != seq)
+        {
+            return false;
+        }
+
+        std::memcpy(&out_item, words, sizeof(T));
+        return true;
+    }
 
-        // Inserting the new item at the end of the list
-        Item* p = list_.get();
-        if (p == nullptr)
+public:
+    SpscRing() :
+        head_(0),
+        tail_(0),
+        overflow_count_(0)
+    {
+        for (unsigned i = 0; i < Capacity; i++)
         {
-            list_.insert(item);
+            slots_[i].seq.store(0, std::memory_order_relaxed);
+            for (unsigned k = 0; k < NumWords; k++)
+            {
+                slots_[i].words[k].store(0, std::memory_order_relaxed);
+            }
         }
-        else
+    }
+
+    /**
+     * Appends one item to the ring. Call from the producer thread only.
+     * If the ring is full, the oldest item will be dropped and the overflow counter will be incremented.
+     * Complexity is O(1), wait-free.
+     */
+    void push(const T& item)
+    {
+        const std::uint32_t head = head_.load(std::memory_order_relaxed);
+        std::uint32_t tail = tail_.load(std::memory_order_acquire);
+
+        if ((head - tail) >= Capacity)
         {
-            while (p->getNextListNode() != nullptr)
+            // If the consumer has claimed the oldest item first, there is room already.
+            if (tail_.compare_exchange_strong(tail, tail + 1, std::memory_order_acq_rel, std::memory_order_acquire))
             {
-                p = p->getNextListNode();
+                overflow_count_.fetch_add(1, std::memory_order_relaxed);
             }
-            assert(p->getNextListNode() == nullptr);
-            p->setNextListNode(item);
-            assert(p->getNextListNode()->getNextListNode() == nullptr);
         }
 
-        return true;
+        write(head, item);
+        head_.store(head + 1, std::memory_order_release);
     }
 
     /**
-     * Accesses the first element.
-     * Nullptr will be returned if the queue is empty.
-     * Complexity is O(1).
+     * Same as @ref push(), but if the ring is full, the new item is refused rather than the oldest one dropped.
+     * Returns true if the item has been added. Call from the producer thread only.
+     * Complexity is O(1), wait-free.
      */
-    T*       peek()       { return isEmpty() ? nullptr : &list_.get()->payload; }
-    const T* peek() const { return isEmpty() ? nullptr : &list_.get()->payload; }
+    bool tryPush(const T& item)
+    {
+        const std::uint32_t head = head_.load(std::memory_order_relaxed);
+        if ((head - tail_.load(std::memory_order_acquire)) >= Capacity)
+        {
+            return false;
+        }
+
+        write(head, item);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
 
     /**
-     * Removes the first element.
-     * If the queue is empty, nothing will be done and assertion failure will be triggered.
-     * Complexity is O(1).
+     * Removes the oldest item from the ring and writes it into the output argument.
+     * Returns true if an item has been extracted, false if the ring is empty. Call from the consumer thread only.
+     * Complexity is O(1); the consumer retries only if the producer drops the item it is reading, which is bounded
+     * by the rate of the producer.
      */
-    void pop()
+    bool pop(T& out_item)
     {
-        Item* const item = list_.get();
-        assert(item != nullptr);
-        if (item != nullptr)
+        std::uint32_t tail = tail_.load(std::memory_order_acquire);
+        while (tail != head_.load(std::memory_order_acquire))
         {
-            list_.remove(item);
-            item->~Item();
-            allocator_.deallocate(item);
+            T item;
+            if (read(tail, item) &&
+                tail_.compare_exchange_strong(tail, tail + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                out_item = item;
+                return true;
+            }
+            tail = tail_.load(std::memory_order_acquire);   // The item has been dropped by the producer
         }
+        return false;
+    }
+
+    /**
+     * Safe to call from any thread, but the result is only reliable when called from the consumer thread.
+     */
+    bool isEmpty() const
+    {
+        return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Safe to call from any thread, but the result is only reliable when called from the producer thread.
+     */
+    bool isFull() const
+    {
+        return (head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire)) >= Capacity;
     }
+
+    /**
+     * Number of items that were dropped by @ref push() because the ring was full. Safe to call from any thread.
+     */
+    std::uint32_t getOverflowCount() const { return overflow_count_.load(std::memory_order_relaxed); }
+
+    static constexpr unsigned getCapacity() { return Capacity; }
+};
+
+/**
+ * One outgoing CAN frame emitted by a sub-node, waiting to be injected into the main node's TX queue.
+ */
+struct TxFrame
+{
+    uavcan::CanFrame frame;
+    uavcan::MonotonicTime deadline;
+    uavcan::CanIOFlags flags = 0;
+};
+
+/**
+ * This interface is used by the virtual driver to notify the main node that the sub-node has emitted TX frames
+ * that need to be injected into the main node's TX queue. This allows the main node to sleep until there is
+ * actual work to do, instead of polling the virtual driver periodically.
+ *
+ * The notification is emitted from the secondary thread for every frame that is added to the TX queue, so
+ * the implementation should be cheap, must be thread-safe, and should merge the notifications that arrive before
+ * the main node wakes up. Deciding whether the queue was empty would race with the main thread draining it, and
+ * a lost notification would leave the frame in the queue until the main node wakes up for another reason.
+ * On Linux, an eventfd that is polled by the main thread alongside the CAN sockets is a natural choice.
+ */
+class ITxPendingSignal
+{
+public:
+    virtual ~ITxPendingSignal() { }
+
+    virtual void signalTxPending() = 0;
 };
 
 /**
  * This class implements one virtual interface.
  *
  * Objects of this class are owned by the secondary thread.
- * This class does not use heap memory, instead it uses a block allocator provided by reference to the constructor.
+ * This class does not use heap memory; the RX and TX queues are fixed-capacity lock-free rings, one pair per iface,
+ * so neither the main thread nor the secondary thread ever has to take a lock in order to exchange frames.
+ *
+ * The interface also implements software acceptance filters, so that the main thread doesn't copy frames the
+ * sub-node is not interested in. They can be configured by the sub-node as usual, e.g. via
+ * @ref uavcan::CanAcceptanceFilterConfigurator. Since there is no hardware limit on the number of software filters,
+ * the interface reports as many as libuavcan can use, so that filter configurations never have to be merged.
+ *
+ * @tparam QueueCapacity    Defines how many frames the queues, both RX and TX, can accommodate.
+ *                          Must be a power of two.
  */
+template <unsigned QueueCapacity>
 class Iface final : public uavcan::ICanIface,
                     uavcan::Noncopyable
 {
     struct RxItem
     {
-        const uavcan::CanRxFrame frame;
-        const uavcan::CanIOFlags flags;
-
-        RxItem(const uavcan::CanRxFrame& arg_frame,
-               uavcan::CanIOFlags arg_flags) :
-            frame(arg_frame),
-            flags(arg_flags)
-        { }
+        uavcan::CanRxFrame frame;
+        uavcan::CanIOFlags flags = 0;
     };
 
-    std::mutex& mutex_;
-    uavcan::CanTxQueue prioritized_tx_queue_;
-    Queue<RxItem> rx_queue_;
+    SpscRing<RxItem, QueueCapacity> rx_queue_;      ///< Producer - main thread, consumer - secondary thread
+    SpscRing<TxFrame, QueueCapacity> tx_queue_;      ///< Producer - secondary thread, consumer - main thread
+    std::atomic<ITxPendingSignal*> tx_pending_signal_;
+
+    TxFrame tx_lookahead_;                          ///< Popped, but not injected yet; main thread only
+    bool tx_lookahead_valid_ = false;
+
+    static constexpr std::uint16_t NumFilters = uavcan::MaxCanAcceptanceFilters;
+
+    /*
+     * Software acceptance filters. They are written by the secondary thread and read by the main thread,
+     * so they are protected with a sequence counter rather than a lock: if the main thread observes that the
+     * configuration is being modified, it simply accepts the frame. Accepting a few extra frames during
+     * reconfiguration is harmless, since the sub-node's dispatcher will discard them anyway.
+     */
+    std::atomic<std::uint32_t> filter_ids_[NumFilters];
+    std::atomic<std::uint32_t> filter_masks_[NumFilters];
+    std::atomic<std::uint16_t> num_filters_;        ///< Zero means that all frames are accepted
+    std::atomic<std::uint32_t> filter_seqlock_;     ///< Odd while the configuration is being modified
+
+    bool isAcceptedByFilters(const uavcan::CanFrame& frame) const
+    {
+        const std::uint32_t seq = filter_seqlock_.load(std::memory_order_acquire);
+        if ((seq & 1U) != 0)
+        {
+            return true;
+        }
+
+        const std::uint16_t num_filters = num_filters_.load(std::memory_order_relaxed);
+        bool accepted = (num_filters == 0);
+        for (std::uint16_t i = 0; !accepted && (i < num_filters); i++)
+        {
+            const std::uint32_t mask = filter_masks_[i].load(std::memory_order_relaxed);
+            accepted = (frame.id & mask) == (filter_ids_[i].load(std::memory_order_relaxed) & mask);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return accepted || (filter_seqlock_.load(std::memory_order_relaxed) != seq);
+    }
 
     /**
      * Implements uavcan::ICanDriver. Will be invoked by the sub-node.
+     * If the TX queue is full, the frame is not accepted, so that the sub-node keeps it in its own TX queue
+     * and retries once the main node has unloaded the queue.
      */
     std::int16_t send(const uavcan::CanFrame& frame,
                       uavcan::MonotonicTime tx_deadline,
                       uavcan::CanIOFlags flags) override
     {
-        std::lock_guard<std::mutex> lock(mutex_);
-        prioritized_tx_queue_.push(frame, tx_deadline, uavcan::CanTxQueue::Volatile, flags);
+        TxFrame item;
+        item.frame = frame;
+        item.deadline = tx_deadline;
+        item.flags = flags;
+        if (!tx_queue_.tryPush(item))
+        {
+            return 0;
+        }
+
+        ITxPendingSignal* const signal = tx_pending_signal_.load(std::memory_order_acquire);
+        if (signal != nullptr)
+        {
+            signal->signalTxPending();
+        }
         return 1;
     }
 
@@ -166,16 +334,12 @@ class Iface final : public uavcan::ICanIface,
                          uavcan::UtcTime& out_ts_utc,
                          uavcan::CanIOFlags& out_flags) override
     {
-        std::lock_guard<std::mutex> lock(mutex_);
-
-        if (rx_queue_.isEmpty())
+        RxItem item;
+        if (!rx_queue_.pop(item))
         {
             return 0;
         }
 
-        const auto item = *rx_queue_.peek();
-        rx_queue_.pop();
-
         out_frame = item.frame;
         out_ts_monotonic = item.frame.ts_mono;
         out_ts_utc = item.frame.ts_utc;
@@ -185,61 +349,96 @@ class Iface final : public uavcan::ICanIface,
     }
 
     /**
-     * Stubs for uavcan::ICanDriver. Will be invoked by the sub-node.
-     * These methods are meaningless for a virtual interface.
+     * Implements uavcan::ICanDriver. Will be invoked by the sub-node.
+     * Zero filter configs means that all frames will be accepted.
      */
-    std::int16_t configureFilters(const uavcan::CanFilterConfig*, std::uint16_t) override { return -uavcan::ErrDriver; }
-    std::uint16_t getNumFilters() const override { return 0; }
-    std::uint64_t getErrorCount() const override { return 0; }
+    std::int16_t configureFilters(const uavcan::CanFilterConfig* filter_configs,
+                                  std::uint16_t num_configs) override
+    {
+        if ((num_configs > NumFilters) || ((num_configs > 0) && (filter_configs == nullptr)))
+        {
+            return -uavcan::ErrInvalidParam;
+        }
+
+        const std::uint32_t seq = filter_seqlock_.load(std::memory_order_relaxed);
+        filter_seqlock_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (std::uint16_t i = 0; i < num_configs; i++)
+        {
+            filter_ids_[i].store(filter_configs[i].id, std::memory_order_relaxed);
+            filter_masks_[i].store(filter_configs[i].mask, std::memory_order_relaxed);
+        }
+        num_filters_.store(num_configs, std::memory_order_relaxed);
+
+        filter_seqlock_.store(seq + 2, std::memory_order_release);
+        return 0;
+    }
+
+    /**
+     * Implements uavcan::ICanDriver. Will be invoked by the sub-node.
+     */
+    std::uint16_t getNumFilters() const override { return NumFilters; }
+
+    /**
+     * Implements uavcan::ICanDriver. Will be invoked by the sub-node.
+     * RX queue overflows are the only kind of errors that can happen in a virtual interface;
+     * TX frames are never dropped, see @ref send().
+     */
+    std::uint64_t getErrorCount() const override { return getRxQueueOverflowCount(); }
 
 public:
+    Iface() :
+        tx_pending_signal_(nullptr),
+        num_filters_(0),
+        filter_seqlock_(0)
+    {
+        for (std::uint16_t i = 0; i < NumFilters; i++)
+        {
+            filter_ids_[i].store(0, std::memory_order_relaxed);
+            filter_masks_[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
     /**
-     * This class should be instantiated by the secondary thread.
-     *
-     * @param allocator         Needed to provide storage for the prioritized TX queue and the RX queue.
-     *
-     * @param clock             Needed for the TX queue so it can discard stale frames.
-     *
-     * @param arg_mutex         Needed because the main and the secondary threads communicate through this class,
-     *                          therefore it must be thread-safe.
-     *
-     * @param quota_per_queue   Defines how many frames the queues, both RX and TX, can accommodate.
+     * Installs the object that will be notified when the TX queue becomes non-empty.
+     * Nullptr removes the notification. Safe to call from any thread.
      */
-    Iface(uavcan::IPoolAllocator& allocator,
-          uavcan::ISystemClock& clock,
-          std::mutex& arg_mutex,
-          unsigned quota_per_queue) :
-        mutex_(arg_mutex),
-        prioritized_tx_queue_(allocator, clock, quota_per_queue),
-        rx_queue_(allocator, quota_per_queue)
-    { }
+    void setTxPendingSignal(ITxPendingSignal* signal) { tx_pending_signal_.store(signal, std::memory_order_release); }
 
     /**
      * This method adds one frame to the RX queue of the secondary thread.
      * It is invoked by the main thread when the node receives a frame from the bus.
      *
-     * Note that RX queue overwrites oldest items when overflowed.
-     * No additional locking is required - this method is thread-safe. Call from the main thread only.
+     * Frames that are not accepted by the software acceptance filters are discarded.
+     * If the RX queue is full, the oldest frame in it is dropped to make room for the new one.
+     * This method never blocks. Call from the main thread only.
      *
      * @param frame     The frame to be received by the sub-node.
      *
      * @param flags     Flags associated with the frame. See @ref uavcan::CanIOFlags for available flags.
+     *
+     * @return          True if the frame has been enqueued, false if it has been filtered out.
      */
-    void addRxFrame(const uavcan::CanRxFrame& frame,
+    bool addRxFrame(const uavcan::CanRxFrame& frame,
                     uavcan::CanIOFlags flags)
     {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (!rx_queue_.tryEmplace(frame, flags) && !rx_queue_.isEmpty())
+        if (!isAcceptedByFilters(frame))
         {
-            rx_queue_.pop();
-            (void)rx_queue_.tryEmplace(frame, flags);
+            return false;
         }
+
+        RxItem item;
+        item.frame = frame;
+        item.flags = flags;
+        rx_queue_.push(item);
+        return true;
     }
 
     /**
      * This method flushes frames from the sub-node's TX queue into the main node's TX queue.
      *
-     * No additional locking is required - this method is thread-safe. Call from the main thread only.
+     * This method never blocks. Call from the main thread only.
      *
      * @param main_node         Reference to the main node, which will receive the frames.
      *
@@ -248,41 +447,85 @@ public:
     void flushTxQueueTo(uavcan::INode& main_node,
                         std::uint8_t iface_index)
     {
-        std::lock_guard<std::mutex> lock(mutex_);
-
         const std::uint8_t iface_mask = static_cast<std::uint8_t>(1U << iface_index);
 
-        while (auto e = prioritized_tx_queue_.peek())
+        while (tx_lookahead_valid_ || tx_queue_.pop(tx_lookahead_))
         {
+            tx_lookahead_valid_ = true;
 #if !NDEBUG && UAVCAN_TOSTRING
             std::cout << "uavcan_virtual_driver::Iface: TX injection [iface_index=" << int(iface_index) << "]: "
-                      << e->toString() << std::endl;
+                      << tx_lookahead_.frame.toString() << std::endl;
 #endif
-            const int res = main_node.injectTxFrame(e->frame, e->deadline, iface_mask,
-                                                    uavcan::CanTxQueue::Qos(e->qos), e->flags);
-            prioritized_tx_queue_.remove(e);
+            const int res = main_node.injectTxFrame(tx_lookahead_.frame, tx_lookahead_.deadline, iface_mask,
+                                                    uavcan::CanTxQueue::Volatile, tx_lookahead_.flags);
             if (res <= 0)
             {
-                break;
+                break;                  // The frame is kept and will be retried on the next call
             }
+            tx_lookahead_valid_ = false;
         }
     }
 
     /**
      * This method reports whether there's data for the sub-node to read from the RX thread.
      *
-     * No additional locking is required - this method is thread-safe. Call from the secondary thread only.
+     * This method never blocks. Call from the secondary thread only.
+     */
+    bool hasDataInRxQueue() const { return !rx_queue_.isEmpty(); }
+
+    /**
+     * This method reports whether the sub-node can emit one more frame.
+     *
+     * This method never blocks. Call from the secondary thread only.
+     */
+    bool hasSpaceInTxQueue() const { return !tx_queue_.isFull(); }
+
+    /**
+     * This method reports whether there are frames waiting to be flushed into the main node.
+     *
+     * This method never blocks. Call from the main thread only.
      */
-    bool hasDataInRxQueue() const
+    bool hasDataInTxQueue() const { return tx_lookahead_valid_ || !tx_queue_.isEmpty(); }
+
+    /**
+     * This method reports whether a frame could not be injected by the last call of @ref flushTxQueueTo()
+     * because the TX queue of the main node was full.
+     *
+     * This method never blocks. Call from the main thread only.
+     */
+    bool hasFailedTxInjection() const { return tx_lookahead_valid_; }
+
+    /**
+     * This method extracts the oldest frame from the sub-node's TX queue, without injecting it anywhere.
+     * Returns false if the queue is empty.
+     *
+     * This method never blocks. Call from the main thread only.
+     */
+    bool popTxFrame(TxFrame& out_frame)
     {
-        std::lock_guard<std::mutex> lock(mutex_);
-        return !rx_queue_.isEmpty();
+        if (tx_lookahead_valid_)
+        {
+            out_frame = tx_lookahead_;
+            tx_lookahead_valid_ = false;
+            return true;
+        }
+        return tx_queue_.pop(out_frame);
     }
+
+    /**
+     * Number of RX frames dropped because the RX queue was full. Safe to call from any thread.
+     */
+    std::uint32_t getRxQueueOverflowCount() const { return rx_queue_.getOverflowCount(); }
 };
 
 /**
- * This interface defines one method that will be called by the main node thread periodically in order to
+ * This interface defines the methods that will be called by the main node thread in order to
  * transfer contents of TX queue of the sub-node into the TX queue of the main node.
+ *
+ * The main node would normally install a TX pending signal, and then call @ref injectTxFramesInto() every time
+ * the signal is triggered; periodic calls are then only needed as a fallback. The signal is not triggered again
+ * for the frames that could not be injected because the TX queue of the main node was full, so the main node
+ * has to check @ref hasPendingTxFrames() and retry soon.
  */
 class ITxQueueInjector
 {
@@ -294,6 +537,25 @@ public:
      * @param main_node         Reference to the main node.
      */
     virtual void injectTxFramesInto(uavcan::INode& main_node) = 0;
+
+    /**
+     * True if the last call of @ref injectTxFramesInto() has left some frames behind because the TX queue of
+     * the main node was full.
+     */
+    virtual bool hasPendingTxFrames() const = 0;
+
+    /**
+     * Extract one frame from the TX queue of the specified iface without injecting it.
+     * This allows the caller to implement its own injection policy, e.g. to merge several sub-nodes.
+     * Returns false if the queue is empty or if the iface index is invalid.
+     */
+    virtual bool popTxFrame(std::uint8_t iface_index, TxFrame& out_frame) = 0;
+
+    /**
+     * Install the object that will be notified when the sub-node emits new TX frames.
+     * Nullptr removes the notification. Safe to call from any thread.
+     */
+    virtual void setTxPendingSignal(ITxPendingSignal* signal) = 0;
 };
 
 /**
@@ -301,8 +563,12 @@ public:
  * This class will be instantiated by the application and passed into the sub-node as its CAN interface.
  *
  * Objects of this class are owned by the secondary thread.
- * This class does not use heap memory, instead it uses a block allocator provided by reference to the constructor.
+ * This class does not use heap memory; all queues are statically sized via the template parameter.
+ *
+ * @tparam QueueCapacity    Depth of the RX queue and the TX queue of every virtual iface, in CAN frames.
+ *                          Must be a power of two.
  */
+template <unsigned QueueCapacity = 64>
 class Driver final : public uavcan::ICanDriver,
                      public uavcan::IRxFrameListener,
                      public ITxQueueInjector,
@@ -330,8 +596,7 @@ class Driver final : public uavcan::ICanDriver,
     };
 
     Event event_;                                   ///< Used to unblock the sub-node's select() call when IO happens.
-    std::mutex mutex_;                              ///< Shared across all ifaces
-    uavcan::LazyConstructor<Iface> ifaces_[uavcan::MaxCanIfaces];
+    uavcan::LazyConstructor<Iface<QueueCapacity>> ifaces_[uavcan::MaxCanIfaces];
     const unsigned num_ifaces_;
     uavcan::ISystemClock& clock_;
 
@@ -340,7 +605,7 @@ class Driver final : public uavcan::ICanDriver,
      */
     uavcan::ICanIface* getIface(std::uint8_t iface_index) override
     {
-        return (iface_index < num_ifaces_) ? ifaces_[iface_index].operator Iface*() : nullptr;
+        return (iface_index < num_ifaces_) ? ifaces_[iface_index].operator Iface<QueueCapacity>*() : nullptr;
     }
 
     /**
@@ -355,11 +620,12 @@ class Driver final : public uavcan::ICanDriver,
                         const uavcan::CanFrame* (&)[uavcan::MaxCanIfaces],
                         uavcan::MonotonicTime blocking_deadline) override
     {
-        bool need_block = (inout_masks.write == 0);    // Write queue is infinite
+        bool need_block = true;
         for (unsigned i = 0; need_block && (i < num_ifaces_); i++)
         {
             const bool need_read = inout_masks.read & (1U << i);
-            if (need_read && ifaces_[i]->hasDataInRxQueue())
+            const bool need_write = inout_masks.write & (1U << i);
+            if ((need_read && ifaces_[i]->hasDataInRxQueue()) || (need_write && ifaces_[i]->hasSpaceInTxQueue()))
             {
                 need_block = false;
             }
@@ -371,17 +637,27 @@ class Driver final : public uavcan::ICanDriver,
         }
 
         inout_masks = uavcan::CanSelectMasks();
+        std::int16_t num_ready = 0;
         for (unsigned i = 0; i < num_ifaces_; i++)
         {
             const std::uint8_t iface_mask = 1U << i;
-            inout_masks.write |= iface_mask;           // Always ready to write
-            if (ifaces_[i]->hasDataInRxQueue())
+            const bool readable = ifaces_[i]->hasDataInRxQueue();
+            const bool writable = ifaces_[i]->hasSpaceInTxQueue();     // Otherwise waiting for the main node
+            if (readable)
             {
                 inout_masks.read |= iface_mask;
             }
+            if (writable)
+            {
+                inout_masks.write |= iface_mask;
+            }
+            if (readable || writable)
+            {
+                num_ready++;
+            }
         }
 
-        return num_ifaces_;       // We're always ready to write, hence > 0.
+        return num_ready;
     }
 
     /**
@@ -394,10 +670,10 @@ class Driver final : public uavcan::ICanDriver,
             std::cout << "uavcan_virtual_driver::Driver: RX [flags=" << flags << "]: "
                       << frame.toString(uavcan::CanFrame::StrAligned) << std::endl;
 #endif
-        if (frame.iface_index < num_ifaces_)
+        if ((frame.iface_index < num_ifaces_) &&
+            ifaces_[frame.iface_index]->addRxFrame(frame, flags))
         {
-            ifaces_[frame.iface_index]->addRxFrame(frame, flags);
-            event_.signal();
+            event_.signal();        // Filtered out frames do not wake up the sub-node
         }
     }
 
@@ -413,6 +689,45 @@ class Driver final : public uavcan::ICanDriver,
         event_.signal();
     }
 
+    /**
+     * Implements ITxQueueInjector. Will be invoked by the main thread.
+     */
+    bool hasPendingTxFrames() const override
+    {
+        for (unsigned i = 0; i < num_ifaces_; i++)
+        {
+            if (ifaces_[i]->hasFailedTxInjection())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Implements ITxQueueInjector. Will be invoked by the main thread.
+     */
+    bool popTxFrame(std::uint8_t iface_index, TxFrame& out_frame) override
+    {
+        if ((iface_index < num_ifaces_) && ifaces_[iface_index]->popTxFrame(out_frame))
+        {
+            event_.signal();        // The sub-node may be waiting for space in the TX queue
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Implements ITxQueueInjector. Will be invoked by the main thread.
+     */
+    void setTxPendingSignal(ITxPendingSignal* signal) override
+    {
+        for (unsigned i = 0; i < num_ifaces_; i++)
+        {
+            ifaces_[i]->setTxPendingSignal(signal);
+        }
+    }
+
 public:
     /**
      * This class should be instantiated by the secondary thread.
@@ -425,37 +740,181 @@ public:
      *                          three interfaces with indices 0, 1, 2, and the virtual driver implements only two,
      *                          the sub-node will only have access to interfaces 0 and 1.
      *
-     * @param clock             Needed by the virtual iface class, and for select() timing.
-     *
-     * @param shared_allocator  This allocator will be used to keep inter-thread queues.
-     *
-     * @param block_allocation_quota_per_virtual_iface  Maximum number of blocks that can be allocated per virtual
-     *                                                  iface. Ifaces use dynamic memory to keep RX/TX queues, so
-     *                                                  higher quota enables deeper queues. Note that ifaces DO NOT
-     *                                                  allocate memory unless they need it, i.e. the memory will not
-     *                                                  be taken unless there is data to enqueue; once a queue is
-     *                                                  flushed, the memory will be immediately freed.
-     *                                                  One block fits exactly one CAN frame, i.e. a quota of 64
-     *                                                  blocks allows the interface to keep up to 64 RX+TX CAN frames.
+     * @param clock             Needed for select() timing.
      */
     Driver(unsigned arg_num_ifaces,
-           uavcan::ISystemClock& clock,
-           uavcan::IPoolAllocator& shared_allocator,
-           unsigned block_allocation_quota_per_virtual_iface) :
+           uavcan::ISystemClock& clock) :
         num_ifaces_(arg_num_ifaces),
         clock_(clock)
     {
         assert(num_ifaces_ > 0 && num_ifaces_ <= uavcan::MaxCanIfaces);
 
-        const unsigned quota_per_queue = block_allocation_quota_per_virtual_iface; // 2x overcommit
+        for (unsigned i = 0; i < num_ifaces_; i++)
+        {
+            ifaces_[i].construct();
+        }
+    }
 
+    /**
+     * Total number of frames dropped because of RX queue overflows, across all virtual ifaces.
+     * Safe to call from any thread.
+     */
+    std::uint64_t getRxQueueOverflowCount() const
+    {
+        std::uint64_t out = 0;
         for (unsigned i = 0; i < num_ifaces_; i++)
         {
-            ifaces_[i].template
-                construct<uavcan::IPoolAllocator&, uavcan::ISystemClock&, std::mutex&, unsigned>
-                    (shared_allocator, clock_, mutex_, quota_per_queue);
+            out += ifaces_[i]->getRxQueueOverflowCount();
         }
+        return out;
     }
 };
 
+/**
+ * This class allows one main node to feed several sub-nodes, each running in its own thread with its own
+ * virtual driver. It is installed into the main node in place of a single virtual driver, i.e. it is both
+ * the RX frame listener and the TX queue injector of the main node.
+ *
+ * RX frames are broadcast to every registered driver; since every driver applies its own software acceptance
+ * filters, a frame is only copied into the queues of those sub-nodes that are actually interested in it.
+ *
+ * TX queues of the sub-nodes are merged by CAN priority: on every injection, the hub keeps one look-ahead frame
+ * per sub-node and iface, and always injects the highest-priority one first. This way a sub-node that emits a lot
+ * of low-priority traffic cannot starve other sub-nodes when the TX queue of the main node is congested.
+ * Frames that could not be injected are kept in the look-ahead buffer and retried on the next call;
+ * the main node learns that it has to call again soon via @ref hasPendingTxFrames().
+ *
+ * Objects of this class are owned by the main thread; sub-nodes must be added before the hub is installed.
+ *
+ * @tparam MaxSubNodes      Maximum number of sub-nodes (drivers) the hub can serve.
+ */
+template <unsigned MaxSubNodes>
+class Hub final : public uavcan::IRxFrameListener,
+                  public ITxQueueInjector,
+                  uavcan::Noncopyable
+{
+    struct SubNodeLink
+    {
+        uavcan::IRxFrameListener* rx_listener = nullptr;
+        ITxQueueInjector* tx_injector = nullptr;
+        TxFrame lookahead[uavcan::MaxCanIfaces];
+        bool lookahead_valid[uavcan::MaxCanIfaces] = {};
+    };
+
+    SubNodeLink links_[MaxSubNodes];
+    unsigned num_links_ = 0;
+    ITxPendingSignal* tx_pending_signal_ = nullptr;
+    bool injection_failed_ = false;                 ///< Some look-ahead frames are waiting for the main TX queue
+
+    /**
+     * Implements uavcan::IRxFrameListener. Will be invoked by the main node.
+     */
+    void handleRxFrame(const uavcan::CanRxFrame& frame,
+                       uavcan::CanIOFlags flags) override
+    {
+        for (unsigned i = 0; i < num_links_; i++)
+        {
+            links_[i].rx_listener->handleRxFrame(frame, flags);
+        }
+    }
+
+    /**
+     * Implements ITxQueueInjector. Will be invoked by the main thread.
+     */
+    void injectTxFramesInto(uavcan::INode& main_node) override
+    {
+        const uavcan::MonotonicTime ts = main_node.getMonotonicTime();
+        injection_failed_ = false;
+
+        for (std::uint8_t iface_index = 0; iface_index < uavcan::MaxCanIfaces; iface_index++)
+        {
+            const std::uint8_t iface_mask = static_cast<std::uint8_t>(1U << iface_index);
+
+            while (true)
+            {
+                SubNodeLink* best = nullptr;
+                for (unsigned i = 0; i < num_links_; i++)
+                {
+                    SubNodeLink& l = links_[i];
+                    while (!l.lookahead_valid[iface_index] &&
+                           l.tx_injector->popTxFrame(iface_index, l.lookahead[iface_index]))
+                    {
+                        l.lookahead_valid[iface_index] = l.lookahead[iface_index].deadline > ts;   // Drop expired
+                    }
+
+                    if (l.lookahead_valid[iface_index] &&
+                        ((best == nullptr) ||
+                         l.lookahead[iface_index].frame.priorityHigherThan(best->lookahead[iface_index].frame)))
+                    {
+                        best = &l;
+                    }
+                }
+
+                if (best == nullptr)
+                {
+                    break;                  // All queues are empty
+                }
+
+                const TxFrame& f = best->lookahead[iface_index];
+                const int res = main_node.injectTxFrame(f.frame, f.deadline, iface_mask,
+                                                        uavcan::CanTxQueue::Volatile, f.flags);
+                if (res <= 0)
+                {
+                    injection_failed_ = true;
+                    break;                  // The frame will be retried on the next call
+                }
+                best->lookahead_valid[iface_index] = false;
+            }
+        }
+    }
+
+    /**
+     * Implements ITxQueueInjector. Will be invoked by the main thread.
+     */
+    bool hasPendingTxFrames() const override { return injection_failed_; }
+
+    /**
+     * Implements ITxQueueInjector. Will be invoked by the main thread.
+     * This method is not meaningful for the hub, since it is always the final stage.
+     */
+    bool popTxFrame(std::uint8_t, TxFrame&) override { return false; }
+
+    /**
+     * Implements ITxQueueInjector. Will be invoked by the main thread.
+     */
+    void setTxPendingSignal(ITxPendingSignal* signal) override
+    {
+        tx_pending_signal_ = signal;
+        for (unsigned i = 0; i < num_links_; i++)
+        {
+            links_[i].tx_injector->setTxPendingSignal(signal);
+        }
+    }
+
+public:
+    /**
+     * Registers one sub-node's driver with the hub.
+     * This method is not thread-safe; all sub-nodes must be added before the hub is installed into the main node.
+     *
+     * @param driver    Virtual driver of the sub-node; normally it is @ref uavcan_virtual_driver::Driver.
+     *
+     * @return          Zero on success, negative error code if there are too many sub-nodes.
+     */
+    template <typename SubNodeDriver>
+    int addSubNodeDriver(SubNodeDriver& driver)
+    {
+        if (num_links_ >= MaxSubNodes)
+        {
+            return -uavcan::ErrLogic;
+        }
+        SubNodeLink& l = links_[num_links_++];
+        l.rx_listener = &driver;
+        l.tx_injector = &driver;
+        l.tx_injector->setTxPendingSignal(tx_pending_signal_);
+        return 0;
+    }
+
+    unsigned getNumSubNodes() const { return num_links_; }
+};
+
 }
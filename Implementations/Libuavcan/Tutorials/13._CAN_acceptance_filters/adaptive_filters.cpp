@@ -0,0 +1,125 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <unistd.h>
+#include <uavcan/uavcan.hpp>
+
+#include <uavcan/equipment/air_data/Sideslip.hpp>
+#include <uavcan/equipment/air_data/TrueAirspeed.hpp>
+#include <uavcan/equipment/air_data/StaticPressure.hpp>
+#include <uavcan/equipment/air_data/StaticTemperature.hpp>
+#include <uavcan/equipment/air_data/AngleOfAttack.hpp>
+
+/*
+ * The optimizer is implemented in a separate header (see below).
+ */
+#include "rate_weighted_filter_optimizer.hpp"
+
+extern uavcan::ICanDriver& getCanDriver();
+extern uavcan::ISystemClock& getSystemClock();
+
+constexpr unsigned NodeMemoryPoolSize = 16384;
+typedef uavcan::Node<NodeMemoryPoolSize> Node;
+
+static Node& getNode()
+{
+    static Node node(getCanDriver(), getSystemClock());
+    return node;
+}
+
+template <typename DataType>
+static void startSubscriber(uavcan::Subscriber<DataType>& sub)
+{
+    const int res = sub.start([](const DataType&) { });
+    if (res < 0)
+    {
+        throw std::runtime_error("Failed to start the subscriber; error: " + std::to_string(res));
+    }
+}
+
+static void printStatus(const uavcan_filter_optimizer::AdaptiveFilterManager& manager)
+{
+    if (manager.isLearning())
+    {
+        std::cout << "Learning the traffic rates, all frames are accepted" << std::endl;
+        return;
+    }
+    std::cout << "Reconfigurations: " << manager.getNumReconfigurations()
+              << ", expected false accepts: " << std::fixed << std::setprecision(1) << manager.getFalseAcceptRate()
+              << " frames/s" << std::endl;
+    for (auto& f : manager.getAppliedConfiguration())
+    {
+        std::cout << "\tID 0x" << std::hex << std::setw(8) << std::setfill('0') << f.id
+                  << " mask 0x" << std::setw(8) << f.mask << std::dec << std::setfill(' ') << std::endl;
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <node-id>" << std::endl;
+        return 1;
+    }
+
+    const int self_node_id = std::stoi(argv[1]);
+
+    auto& node = getNode();
+    node.setNodeID(self_node_id);
+    node.setName("org.uavcan.tutorial.adaptive_filters");
+    const int node_start_res = node.start();
+    if (node_start_res < 0)
+    {
+        throw std::runtime_error("Failed to start the node; error: " + std::to_string(node_start_res));
+    }
+
+    /*
+     * Four subscriptions (a fifth one is added later), the service configuration, and the anonymous messages have
+     * to be squeezed into three filters (the override is only used to make the tutorial more illustrative).
+     */
+    uavcan::Subscriber<uavcan::equipment::air_data::TrueAirspeed> airspeed_sub(node);
+    uavcan::Subscriber<uavcan::equipment::air_data::StaticPressure> pressure_sub(node);
+    uavcan::Subscriber<uavcan::equipment::air_data::StaticTemperature> temperature_sub(node);
+    uavcan::Subscriber<uavcan::equipment::air_data::AngleOfAttack> aoa_sub(node);
+    startSubscriber(airspeed_sub);
+    startSubscriber(pressure_sub);
+    startSubscriber(temperature_sub);
+    startSubscriber(aoa_sub);
+
+    /*
+     * For the first 10 seconds, all frames are accepted, so that the rates of all traffic can be observed.
+     * After that, the filters are re-optimized every 5 seconds.
+     */
+    uavcan_filter_optimizer::AdaptiveFilterManager manager(node, 3 /* not needed in real apps */);
+    const int manager_start_res = manager.start(uavcan::MonotonicDuration::fromMSec(5000),
+                                                uavcan::MonotonicDuration::fromMSec(10000));
+    if (manager_start_res < 0)
+    {
+        throw std::runtime_error("Failed to start the filter manager; error: " + std::to_string(manager_start_res));
+    }
+
+    node.setModeOperational();
+
+    /*
+     * The subscriber for air_data::Sideslip is added later; the manager will notice the change of the subscriptions
+     * and will reconfigure the filters.
+     */
+    uavcan::Subscriber<uavcan::equipment::air_data::Sideslip> sideslip_sub(node);
+
+    for (unsigned iteration = 0; true; iteration++)
+    {
+        const int res = node.spin(uavcan::MonotonicDuration::fromMSec(5000));
+        if (res < 0)
+        {
+            std::cerr << "Transient failure: " << res << std::endl;
+        }
+
+        if (iteration == 6)
+        {
+            std::cout << "Subscribing to air_data::Sideslip" << std::endl;
+            startSubscriber(sideslip_sub);
+        }
+
+        printStatus(manager);
+    }
+}
@@ -0,0 +1,155 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <cstdlib>
+#include <unistd.h>
+#include <uavcan/uavcan.hpp>
+
+#include <uavcan/equipment/air_data/Sideslip.hpp>
+#include <uavcan/equipment/air_data/TrueAirspeed.hpp>
+#include <uavcan/equipment/air_data/StaticPressure.hpp>
+#include <uavcan/equipment/air_data/StaticTemperature.hpp>
+#include <uavcan/equipment/air_data/AngleOfAttack.hpp>
+
+/*
+ * The configurator is implemented in a separate header (see below).
+ */
+#include "incremental_filter_configurator.hpp"
+
+extern uavcan::ICanDriver& getCanDriver();
+extern uavcan::ISystemClock& getSystemClock();
+
+constexpr unsigned NodeMemoryPoolSize = 16384;
+typedef uavcan::Node<NodeMemoryPoolSize> Node;
+
+static Node& getNode()
+{
+    static Node node(getCanDriver(), getSystemClock());
+    return node;
+}
+
+template <typename DataType>
+static void startSubscriber(uavcan::Subscriber<DataType>& sub)
+{
+    const int res = sub.start([](const DataType& msg) { std::cout << msg << std::endl; });
+    if (res < 0)
+    {
+        throw std::runtime_error("Failed to start the subscriber; error: " + std::to_string(res));
+    }
+}
+
+/*
+ * Subscriptions that are only needed in one flight mode. The subscribers are destroyed when the mode is left,
+ * which removes them from the node.
+ */
+struct CruiseSubscriptions
+{
+    uavcan::Subscriber<uavcan::equipment::air_data::TrueAirspeed> airspeed_sub;
+    uavcan::Subscriber<uavcan::equipment::air_data::AngleOfAttack> aoa_sub;
+
+    explicit CruiseSubscriptions(uavcan::INode& node) :
+        airspeed_sub(node),
+        aoa_sub(node)
+    {
+        startSubscriber(airspeed_sub);
+        startSubscriber(aoa_sub);
+    }
+};
+
+struct LandingSubscriptions
+{
+    uavcan::Subscriber<uavcan::equipment::air_data::TrueAirspeed> airspeed_sub;
+    uavcan::Subscriber<uavcan::equipment::air_data::Sideslip> sideslip_sub;
+
+    explicit LandingSubscriptions(uavcan::INode& node) :
+        airspeed_sub(node),
+        sideslip_sub(node)
+    {
+        startSubscriber(airspeed_sub);
+        startSubscriber(sideslip_sub);
+    }
+};
+
+static void reconfigureFilters(uavcan_filter_optimizer::IncrementalFilterConfigurator& configurator)
+{
+    const int res = configurator.reconfigure();
+    if (res < 0)
+    {
+        throw std::runtime_error("Failed to reconfigure the filters; error: " + std::to_string(res));
+    }
+
+    std::cout << "Filters reconfigured in " << res << " steps:" << std::endl;
+    for (auto& f : configurator.getAppliedConfiguration())
+    {
+        std::cout << "\tID 0x" << std::hex << std::setw(8) << std::setfill('0') << f.id
+                  << " mask 0x" << std::setw(8) << f.mask << std::dec << std::setfill(' ') << std::endl;
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <node-id>" << std::endl;
+        return 1;
+    }
+
+    const int self_node_id = std::stoi(argv[1]);
+
+    auto& node = getNode();
+    node.setNodeID(self_node_id);
+    node.setName("org.uavcan.tutorial.flight_mode_filters");
+    const int node_start_res = node.start();
+    if (node_start_res < 0)
+    {
+        throw std::runtime_error("Failed to start the node; error: " + std::to_string(node_start_res));
+    }
+
+    /*
+     * These subscriptions are needed in all flight modes.
+     */
+    uavcan::Subscriber<uavcan::equipment::air_data::StaticPressure> pressure_sub(node);
+    uavcan::Subscriber<uavcan::equipment::air_data::StaticTemperature> temperature_sub(node);
+    startSubscriber(pressure_sub);
+    startSubscriber(temperature_sub);
+
+    std::unique_ptr<CruiseSubscriptions> cruise(new CruiseSubscriptions(node));
+    std::unique_ptr<LandingSubscriptions> landing;
+
+    /*
+     * The first configuration is loaded at once, because the contents of the filters are not known yet.
+     * The number of filters is overridden only to make the tutorial more illustrative; the subscriptions,
+     * the service configuration, and the anonymous messages don't fit into four filters, so some of them are merged.
+     */
+    uavcan_filter_optimizer::IncrementalFilterConfigurator configurator(node, 4 /* not needed in real apps */);
+    reconfigureFilters(configurator);
+
+    node.setModeOperational();
+
+    /*
+     * The flight mode is switched every 10 seconds. The messages that are needed in both modes, i.e.
+     * air_data::TrueAirspeed and the common subscriptions, keep coming while the filters are being reconfigured.
+     */
+    while (true)
+    {
+        const int res = node.spin(uavcan::MonotonicDuration::fromMSec(10000));
+        if (res < 0)
+        {
+            std::cerr << "Transient failure: " << res << std::endl;
+        }
+
+        if (cruise)
+        {
+            std::cout << "Switching to landing mode" << std::endl;
+            cruise.reset();
+            landing.reset(new LandingSubscriptions(node));
+        }
+        else
+        {
+            std::cout << "Switching to cruise mode" << std::endl;
+            landing.reset();
+            cruise.reset(new CruiseSubscriptions(node));
+        }
+        reconfigureFilters(configurator);
+    }
+}
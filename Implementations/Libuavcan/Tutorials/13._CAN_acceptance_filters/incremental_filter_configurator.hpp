@@ -0,0 +1,261 @@
+/**
+ * This header implements incremental reconfiguration of CAN hardware acceptance filters.
+ *
+ * Calling configureCanAcceptanceFilters() again after the subscriptions have changed recomputes the configuration
+ * from scratch and reloads all filter banks, although most of them usually stay the same. The configurator
+ * implemented here remembers what is loaded into every bank, and moves the filters to the new configuration in
+ * small steps, so that the traffic which is needed both before and after the change is never rejected:
+ *  - Banks that are not changed keep their position and contents.
+ *  - First, every changed bank is widened to accept both its old and its new traffic, and the new filters that
+ *    don't replace anything are added into the free banks.
+ *  - Then the widened banks are narrowed to their new contents, and the banks that are no longer needed are removed.
+ *
+ * Consecutive steps differ in one bank only, so a driver that skips the banks whose contents are not changed
+ * rewrites one bank per step. Every intermediate configuration is safe to apply as long as loading a bank is
+ * atomic with respect to reception (e.g. SocketCAN replaces the filters atomically); on a controller where a bank
+ * must be deactivated in order to be rewritten, only the traffic of that single bank is at risk for the duration
+ * of a few register writes.
+ *
+ * @file incremental_filter_configurator.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <vector>                               // For std::vector
+#include <algorithm>                            // For std::max()
+#include <uavcan/uavcan.hpp>                    // Main libuavcan header
+#include "rate_weighted_filter_optimizer.hpp"   // For mergeFilters(), optimizeFilters(), etc.
+
+namespace uavcan_filter_optimizer
+{
+/**
+ * Contents of the filter banks, in the order they are loaded into the CAN controller.
+ */
+typedef std::vector<uavcan::CanFilterConfig> FilterConfiguration;
+
+static inline bool isSameFilter(const uavcan::CanFilterConfig& a, const uavcan::CanFilterConfig& b)
+{
+    return (a.id == b.id) && (a.mask == b.mask);
+}
+
+/**
+ * Plans the transition of the filter banks from the current configuration to the target configuration.
+ * Returns the sequence of configurations to be loaded one after another; the last one contains all of the
+ * target filters. The sequence is empty if no change is needed.
+ *
+ * If the current configuration is empty (i.e. the contents of the banks are unknown), the target is loaded in one
+ * step. The target must not be empty and must not contain more than num_banks filters.
+ */
+static inline std::vector<FilterConfiguration> planFilterTransition(const FilterConfiguration& current,
+                                                                    const FilterConfiguration& target,
+                                                                    unsigned num_banks)
+{
+    std::vector<FilterConfiguration> steps;
+    if (current.empty())
+    {
+        steps.push_back(target);
+        return steps;
+    }
+
+    /*
+     * Every target filter is assigned to a bank; -1 means that the bank is not needed anymore.
+     */
+    const unsigned num_old_banks = unsigned(current.size());
+    std::vector<int> bank_target(std::max(num_banks, num_old_banks), -1);
+    std::vector<bool> target_placed(target.size(), false);
+
+    // The banks that already contain a target filter are kept as is
+    for (unsigned t = 0; t < target.size(); t++)
+    {
+        for (unsigned b = 0; b < num_old_banks; b++)
+        {
+            if ((bank_target[b] < 0) && isSameFilter(current[b], target[t]))
+            {
+                bank_target[b] = int(t);
+                target_placed[t] = true;
+                break;
+            }
+        }
+    }
+
+    // The remaining target filters replace the changed banks that are closest to them, so that the temporarily
+    // widened banks accept as little extra traffic as possible
+    while (true)
+    {
+        int best_bits = -1;
+        unsigned best_t = 0;
+        unsigned best_b = 0;
+        for (unsigned t = 0; t < target.size(); t++)
+        {
+            for (unsigned b = 0; (b < num_old_banks) && !target_placed[t]; b++)
+            {
+                const int bits = int(countMaskBits(mergeFilters(current[b], target[t]).mask));
+                if ((bank_target[b] < 0) && (bits > best_bits))
+                {
+                    best_bits = bits;
+                    best_t = t;
+                    best_b = b;
+                }
+            }
+        }
+        if (best_bits < 0)
+        {
+            break;
+        }
+        bank_target[best_b] = int(best_t);
+        target_placed[best_t] = true;
+    }
+
+    // Whatever is left goes into the free banks
+    unsigned num_new_banks = num_old_banks;
+    for (unsigned t = 0; t < target.size(); t++)
+    {
+        if (!target_placed[t])
+        {
+            bank_target[num_new_banks++] = int(t);
+        }
+    }
+
+    FilterConfiguration banks = current;
+
+    /*
+     * Widening. After every step, the banks accept everything they accepted before.
+     */
+    for (unsigned b = 0; b < num_old_banks; b++)
+    {
+        if (bank_target[b] >= 0)
+        {
+            const auto widened = mergeFilters(banks[b], target[unsigned(bank_target[b])]);
+            if (!isSameFilter(widened, banks[b]))
+            {
+                banks[b] = widened;
+                steps.push_back(banks);
+            }
+        }
+    }
+    for (unsigned b = num_old_banks; b < num_new_banks; b++)
+    {
+        banks.push_back(target[unsigned(bank_target[b])]);
+        steps.push_back(banks);
+    }
+
+    /*
+     * Narrowing. All target filters are covered by now, and stay covered after every step.
+     */
+    for (unsigned b = 0; b < num_old_banks; b++)
+    {
+        if ((bank_target[b] >= 0) && !isSameFilter(banks[b], target[unsigned(bank_target[b])]))
+        {
+            banks[b] = target[unsigned(bank_target[b])];
+            steps.push_back(banks);
+        }
+    }
+
+    // The banks that are not needed anymore are dropped if they are at the end; the others can't be removed without
+    // shifting the following banks, so they are loaded with a copy of a target filter, which adds nothing
+    unsigned new_size = num_new_banks;
+    while ((new_size > 0) && (bank_target[new_size - 1] < 0))
+    {
+        new_size--;
+    }
+    for (unsigned b = 0; b < new_size; b++)
+    {
+        if ((bank_target[b] < 0) && !isSameFilter(banks[b], target[0]))
+        {
+            banks[b] = target[0];
+            steps.push_back(banks);
+        }
+    }
+    if (new_size < banks.size())
+    {
+        banks.resize(new_size);
+        steps.push_back(banks);
+    }
+
+    return steps;
+}
+
+/**
+ * Replacement for uavcan::configureCanAcceptanceFilters() for applications that change their subscriptions
+ * at runtime. Call reconfigure() every time the subscriptions or services have been changed.
+ *
+ * The configurator assumes that nothing else reconfigures the filters; if something does (e.g. the driver
+ * has been reinitialized), call invalidate(), then the next transition will reload all of the banks at once.
+ */
+class IncrementalFilterConfigurator : uavcan::Noncopyable
+{
+    uavcan::INode& node_;
+    const std::uint16_t num_filters_override_;
+    FilterConfiguration applied_;       ///< Empty if the contents of the banks are unknown
+    unsigned num_steps_ = 0;
+
+public:
+    /**
+     * The second argument overrides the number of hardware filters reported by the driver, like the second argument
+     * of uavcan::CanAcceptanceFilterConfigurator; it's not needed in real applications.
+     */
+    explicit IncrementalFilterConfigurator(uavcan::INode& node, std::uint16_t num_filters_override = 0) :
+        node_(node),
+        num_filters_override_(num_filters_override)
+    { }
+
+    /**
+     * Computes the configuration for the current subscriptions and services, and moves the filters to it.
+     * If the traffic rates are provided, the excessive configurations are merged by the rate-weighted strategy,
+     * otherwise by the similarity of their IDs and masks.
+     * @return Number of steps applied (zero if nothing has changed), or a negative error code.
+     */
+    int reconfigure(const std::vector<TrafficClass>& traffic = std::vector<TrafficClass>())
+    {
+        FilterConfiguration desired;
+        const int res = computeDesiredConfiguration(node_, desired);
+        if (res < 0)
+        {
+            return res;
+        }
+        const std::uint16_t num_filters = getNumHardwareFilters(node_, num_filters_override_);
+        return applyConfiguration(optimizeFilters(desired, traffic, num_filters));
+    }
+
+    /**
+     * Moves the filters to an arbitrary configuration, e.g. one that contains custom filters.
+     * If a step fails, the contents of the banks are considered unknown.
+     * @return Number of steps applied (zero if nothing has changed), or a negative error code.
+     */
+    int applyConfiguration(const FilterConfiguration& target)
+    {
+        const unsigned num_banks = getNumHardwareFilters(node_, num_filters_override_);
+        if (target.empty() || (target.size() > num_banks))
+        {
+            return -uavcan::ErrInvalidParam;
+        }
+
+        const auto steps = planFilterTransition(applied_, target, num_banks);
+        for (auto& s : steps)
+        {
+            const int res = applyFilterConfiguration(node_, s);
+            if (res < 0)
+            {
+                applied_.clear();
+                return res;
+            }
+            applied_ = s;
+        }
+
+        num_steps_ = unsigned(steps.size());
+        return int(num_steps_);
+    }
+
+    void invalidate() { applied_.clear(); }
+
+    /**
+     * Contents of the banks after the last transition, including the banks that hold copies of other filters.
+     */
+    const FilterConfiguration& getAppliedConfiguration() const { return applied_; }
+
+    unsigned getNumStepsOfLastTransition() const { return num_steps_; }
+};
+
+}
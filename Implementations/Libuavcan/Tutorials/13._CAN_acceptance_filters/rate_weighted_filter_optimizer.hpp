@@ -0,0 +1,481 @@
+/**
+ * This header implements an alternative merge strategy for CAN hardware acceptance filters.
+ *
+ * When there are more subscriptions than hardware filters, uavcan::CanAcceptanceFilterConfigurator merges the filter
+ * configurations by their ID/mask similarity only, so the resulting configuration may accept a lot of unwanted
+ * traffic. The optimizer implemented here weights every CAN ID observed on the bus by its frame rate, and picks
+ * the merges that add the smallest expected number of falsely accepted frames per second.
+ *
+ * The frame rates are collected by TrafficObserver, which is installed into the node as an RX frame listener.
+ * AdaptiveFilterManager puts it all together: it periodically updates the rates, re-runs the optimizer when the set
+ * of subscriptions changes or when a better configuration becomes available, and applies the result to all ifaces.
+ *
+ * @file rate_weighted_filter_optimizer.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <vector>               // For std::vector
+#include <unordered_map>        // For std::unordered_map
+#include <algorithm>            // For std::min()
+#include <limits>               // For std::numeric_limits<>
+#include <uavcan/uavcan.hpp>    // Main libuavcan header
+#include <uavcan/transport/can_acceptance_filter_configurator.hpp>
+
+namespace uavcan_filter_optimizer
+{
+/**
+ * UAVCAN filters never look at the priority field, so the frame rates are collected per CAN ID without priority.
+ */
+static constexpr std::uint32_t PriorityMask = 0x1FU << 24;
+
+/**
+ * All frames with this CAN ID (less the priority) are received at this rate.
+ */
+struct TrafficClass
+{
+    std::uint32_t can_id = 0;
+    double frames_per_sec = 0.0;
+};
+
+static inline bool isAccepted(const uavcan::CanFilterConfig& filter, std::uint32_t can_id)
+{
+    return (can_id & filter.mask) == (filter.id & filter.mask);
+}
+
+static inline bool isAccepted(const std::vector<uavcan::CanFilterConfig>& filters, std::uint32_t can_id)
+{
+    for (auto& f : filters)
+    {
+        if (isAccepted(f, can_id))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * The narrowest filter that accepts everything that both arguments accept.
+ */
+static inline uavcan::CanFilterConfig mergeFilters(const uavcan::CanFilterConfig& a, const uavcan::CanFilterConfig& b)
+{
+    uavcan::CanFilterConfig out;
+    out.mask = a.mask & b.mask & ~(a.id ^ b.id);
+    out.id = a.id & out.mask;
+    return out;
+}
+
+static inline unsigned countMaskBits(std::uint32_t mask)
+{
+    unsigned out = 0;
+    for (; mask != 0; mask &= mask - 1U)
+    {
+        out++;
+    }
+    return out;
+}
+
+/**
+ * Expected number of frames per second that are accepted by the filters, but are not accepted by any of
+ * the desired configurations, i.e. are not needed by the node.
+ */
+static inline double computeFalseAcceptRate(const std::vector<uavcan::CanFilterConfig>& filters,
+                                            const std::vector<uavcan::CanFilterConfig>& desired,
+                                            const std::vector<TrafficClass>& traffic)
+{
+    double out = 0.0;
+    for (auto& t : traffic)
+    {
+        if (isAccepted(filters, t.can_id) && !isAccepted(desired, t.can_id))
+        {
+            out += t.frames_per_sec;
+        }
+    }
+    return out;
+}
+
+/**
+ * Reduces the desired filter configurations to at most num_filters configurations.
+ *
+ * The merge is greedy: on every step, the pair of configurations whose merge adds the smallest false accept rate is
+ * merged. If several merges add the same rate (e.g. no traffic has been observed that would be accepted by either
+ * of them), the one that drops the fewest mask bits is preferred, which is roughly what the default strategy does.
+ * Complexity is O(N^3 * T), where N is the number of desired configurations and T is the number of traffic classes;
+ * both are small, and the optimizer is only invoked when the configuration needs to be changed.
+ */
+static inline std::vector<uavcan::CanFilterConfig> optimizeFilters(const std::vector<uavcan::CanFilterConfig>& desired,
+                                                                   const std::vector<TrafficClass>& traffic,
+                                                                   unsigned num_filters)
+{
+    std::vector<uavcan::CanFilterConfig> filters = desired;
+    if (num_filters == 0)
+    {
+        return std::vector<uavcan::CanFilterConfig>();
+    }
+
+    /*
+     * Only the unwanted traffic matters, so it is extracted once.
+     */
+    std::vector<TrafficClass> unwanted;
+    for (auto& t : traffic)
+    {
+        if (!isAccepted(desired, t.can_id) && (t.frames_per_sec > 0.0))
+        {
+            unwanted.push_back(t);
+        }
+    }
+    std::vector<bool> unwanted_accepted(unwanted.size(), false);
+
+    while (filters.size() > num_filters)
+    {
+        double best_cost = std::numeric_limits<double>::infinity();
+        unsigned best_bits_lost = std::numeric_limits<unsigned>::max();
+        unsigned best_i = 0;
+        unsigned best_j = 1;
+
+        for (unsigned i = 0; i < filters.size(); i++)
+        {
+            for (unsigned j = i + 1; j < filters.size(); j++)
+            {
+                const auto merged = mergeFilters(filters[i], filters[j]);
+
+                // The merged filter accepts everything that the original two accept, so only the newly
+                // accepted unwanted traffic adds to the cost
+                double cost = 0.0;
+                for (unsigned k = 0; k < unwanted.size(); k++)
+                {
+                    if (!unwanted_accepted[k] && isAccepted(merged, unwanted[k].can_id))
+                    {
+                        cost += unwanted[k].frames_per_sec;
+                    }
+                }
+
+                const unsigned bits_lost = countMaskBits(filters[i].mask) + countMaskBits(filters[j].mask) -
+                                           2U * countMaskBits(merged.mask);
+
+                if ((cost < best_cost) || ((cost == best_cost) && (bits_lost < best_bits_lost)))
+                {
+                    best_cost = cost;
+                    best_bits_lost = bits_lost;
+                    best_i = i;
+                    best_j = j;
+                }
+            }
+        }
+
+        filters[best_i] = mergeFilters(filters[best_i], filters[best_j]);
+        filters.erase(filters.begin() + best_j);
+
+        for (unsigned k = 0; k < unwanted.size(); k++)
+        {
+            unwanted_accepted[k] = unwanted_accepted[k] || isAccepted(filters[best_i], unwanted[k].can_id);
+        }
+    }
+
+    return filters;
+}
+
+/**
+ * Number of hardware filters available on all ifaces of the node.
+ * A non-zero override replaces the number reported by the driver, like the second argument of
+ * uavcan::CanAcceptanceFilterConfigurator; it's not needed in real applications.
+ */
+static inline std::uint16_t getNumHardwareFilters(uavcan::INode& node, std::uint16_t num_filters_override = 0)
+{
+    if (num_filters_override > 0)
+    {
+        return num_filters_override;
+    }
+
+    auto& driver = node.getDispatcher().getCanIOManager().getCanDriver();
+    std::uint16_t out = uavcan::MaxCanAcceptanceFilters;
+    for (std::uint8_t i = 0; i < driver.getNumIfaces(); i++)
+    {
+        uavcan::ICanIface* const iface = driver.getIface(i);
+        if (iface != nullptr)
+        {
+            out = std::min(out, iface->getNumFilters());
+        }
+    }
+    return out;
+}
+
+/**
+ * Loads the filters into all ifaces of the node.
+ */
+static inline int applyFilterConfiguration(uavcan::INode& node, const std::vector<uavcan::CanFilterConfig>& filters)
+{
+    auto& driver = node.getDispatcher().getCanIOManager().getCanDriver();
+    for (std::uint8_t i = 0; i < driver.getNumIfaces(); i++)
+    {
+        uavcan::ICanIface* const iface = driver.getIface(i);
+        if (iface == nullptr)
+        {
+            return -uavcan::ErrDriver;
+        }
+        const std::int16_t res = iface->configureFilters(filters.data(), std::uint16_t(filters.size()));
+        if (res < 0)
+        {
+            return -uavcan::ErrDriver;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Filter configurations that accept exactly the traffic needed by the current subscriptions and services,
+ * computed by the default configurator without merging.
+ */
+static inline int computeDesiredConfiguration(uavcan::INode& node, std::vector<uavcan::CanFilterConfig>& out_desired)
+{
+    // The filter budget is given explicitly so that the configurator doesn't merge anything on its own
+    uavcan::CanAcceptanceFilterConfigurator configurator(node, uavcan::MaxCanAcceptanceFilters);
+    const int res = configurator.computeConfiguration();
+    if (res < 0)
+    {
+        return res;
+    }
+
+    const auto& configs = configurator.getConfiguration();
+    out_desired.clear();
+    for (std::uint16_t i = 0; i < configs.getSize(); i++)
+    {
+        out_desired.push_back(*configs.getByIndex(i));
+    }
+    return 0;
+}
+
+/**
+ * Counts the frames received by the node per CAN ID, and turns the counts into rates on every update.
+ * Install with uavcan::Dispatcher::installRxFrameListener(); note that the node supports only one listener.
+ *
+ * Once the filters are applied, the frames they reject can't be observed anymore. Therefore the rates of
+ * the CAN IDs that are rejected by the currently applied filters are frozen at their last known values
+ * instead of decaying to zero; otherwise the optimizer would conclude that the rejected traffic is gone.
+ */
+class TrafficObserver : public uavcan::IRxFrameListener,
+                        uavcan::Noncopyable
+{
+    struct Entry
+    {
+        std::uint32_t count = 0;
+        double frames_per_sec = 0.0;
+        bool rate_known = false;
+    };
+
+    std::unordered_map<std::uint32_t, Entry> entries_;
+
+    void handleRxFrame(const uavcan::CanRxFrame& frame, uavcan::CanIOFlags flags) override
+    {
+        if (frame.isExtended() && ((flags & uavcan::CanIOFlagLoopback) == 0))
+        {
+            entries_[frame.id & ~PriorityMask].count++;
+        }
+    }
+
+public:
+    /**
+     * Weight of the new observation in the exponential moving average of the rate.
+     */
+    static constexpr double SmoothingFactor = 0.3;
+
+    /**
+     * @param elapsed           Time since the previous update.
+     * @param applied_filters   The filters that were applied during that time; empty means that all frames
+     *                          were accepted.
+     */
+    void update(uavcan::MonotonicDuration elapsed, const std::vector<uavcan::CanFilterConfig>& applied_filters)
+    {
+        const double elapsed_sec = double(elapsed.toUSec()) * 1e-6;
+        if (elapsed_sec <= 0.0)
+        {
+            return;
+        }
+
+        for (auto& kv : entries_)
+        {
+            Entry& e = kv.second;
+            const bool observable = applied_filters.empty() || isAccepted(applied_filters, kv.first);
+            if (observable)
+            {
+                const double rate = double(e.count) / elapsed_sec;
+                e.frames_per_sec = e.rate_known ? (e.frames_per_sec + SmoothingFactor * (rate - e.frames_per_sec))
+                                                : rate;
+                e.rate_known = true;
+            }
+            e.count = 0;
+        }
+    }
+
+    std::vector<TrafficClass> getTraffic() const
+    {
+        std::vector<TrafficClass> out;
+        out.reserve(entries_.size());
+        for (auto& kv : entries_)
+        {
+            TrafficClass t;
+            t.can_id = kv.first;
+            t.frames_per_sec = kv.second.frames_per_sec;
+            out.push_back(t);
+        }
+        return out;
+    }
+};
+
+/**
+ * Keeps the hardware acceptance filters of the node optimized.
+ *
+ * After start() the filters accept all frames for the learning period, so that the rates of all traffic can be
+ * observed. Then, on every period:
+ *  - The desired configuration is recomputed from the current subscriptions, using the default configurator.
+ *  - The rate-weighted merge is computed from the desired configuration and the current rates.
+ *  - The result is applied if the subscriptions have changed, or if it reduces the false accept rate
+ *    by more than the hysteresis, which prevents flapping when the rates fluctuate.
+ *
+ * libuavcan doesn't report changes of the subscriptions, so they are detected by comparing the desired
+ * configurations; computing them is cheap.
+ */
+class AdaptiveFilterManager : private uavcan::TimerBase
+{
+public:
+    static constexpr double Hysteresis = 0.2;
+
+private:
+    uavcan::INode& node_;
+    const std::uint16_t num_filters_override_;
+    TrafficObserver observer_;
+    uavcan::MonotonicDuration learning_period_;
+    uavcan::MonotonicTime started_at_;
+    uavcan::MonotonicTime last_update_at_;
+
+    std::vector<uavcan::CanFilterConfig> desired_;
+    std::vector<uavcan::CanFilterConfig> applied_;      ///< As applied to the hardware, accept-all while learning
+    bool learning_ = true;                              ///< Set until the first optimized configuration is applied
+    double false_accept_rate_ = 0.0;
+    unsigned num_reconfigurations_ = 0;
+    int last_error_ = 0;
+
+    static bool isSameConfiguration(const std::vector<uavcan::CanFilterConfig>& a,
+                                    const std::vector<uavcan::CanFilterConfig>& b)
+    {
+        if (a.size() != b.size())
+        {
+            return false;
+        }
+        for (unsigned i = 0; i < a.size(); i++)
+        {
+            if ((a[i].id != b[i].id) || (a[i].mask != b[i].mask))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void handleTimerEvent(const uavcan::TimerEvent& event) override
+    {
+        observer_.update(event.real_time - last_update_at_, applied_);
+        last_update_at_ = event.real_time;
+
+        if ((event.real_time - started_at_) < learning_period_)
+        {
+            return;
+        }
+
+        std::vector<uavcan::CanFilterConfig> desired;
+        last_error_ = computeDesiredConfiguration(node_, desired);
+        if (last_error_ < 0)
+        {
+            return;
+        }
+
+        const auto traffic = observer_.getTraffic();
+        const auto optimized = optimizeFilters(desired, traffic, getNumHardwareFilters(node_, num_filters_override_));
+        const double optimized_rate = computeFalseAcceptRate(optimized, desired, traffic);
+
+        const bool desired_changed = !isSameConfiguration(desired, desired_);
+        const double current_rate = desired_changed ? 0.0 : computeFalseAcceptRate(applied_, desired, traffic);
+        const bool improved = optimized_rate < current_rate * (1.0 - Hysteresis);
+
+        if (learning_ || desired_changed || improved)
+        {
+            last_error_ = applyFilterConfiguration(node_, optimized);
+            if (last_error_ >= 0)
+            {
+                learning_ = false;
+                desired_ = desired;
+                applied_ = optimized;
+                false_accept_rate_ = optimized_rate;
+                num_reconfigurations_++;
+            }
+        }
+        else
+        {
+            false_accept_rate_ = current_rate;
+        }
+    }
+
+public:
+    /**
+     * The observer is installed into the node as the RX frame listener.
+     * The second argument overrides the number of hardware filters reported by the driver, like the second argument
+     * of uavcan::CanAcceptanceFilterConfigurator; it's not needed in real applications.
+     */
+    explicit AdaptiveFilterManager(uavcan::INode& node, std::uint16_t num_filters_override = 0) :
+        uavcan::TimerBase(node),
+        node_(node),
+        num_filters_override_(num_filters_override)
+    {
+        node_.getDispatcher().installRxFrameListener(&observer_);
+    }
+
+    ~AdaptiveFilterManager()
+    {
+        node_.getDispatcher().removeRxFrameListener();
+    }
+
+    /**
+     * @param period            How often the rates are updated and the optimizer is re-run.
+     * @param learning_period   How long all frames are accepted before the first optimization.
+     */
+    int start(uavcan::MonotonicDuration period, uavcan::MonotonicDuration learning_period)
+    {
+        const uavcan::CanFilterConfig accept_all;            // Zero ID and zero mask
+        const int res = applyFilterConfiguration(node_, std::vector<uavcan::CanFilterConfig>(1, accept_all));
+        if (res < 0)
+        {
+            return res;
+        }
+
+        learning_period_ = learning_period;
+        started_at_ = last_update_at_ = node_.getMonotonicTime();
+        desired_.clear();
+        applied_.assign(1, accept_all);
+        learning_ = true;
+        startPeriodic(period);
+        return 0;
+    }
+
+    /**
+     * Expected number of unwanted frames per second that pass the applied filters, according to the observed rates.
+     */
+    double getFalseAcceptRate() const { return false_accept_rate_; }
+
+    const std::vector<uavcan::CanFilterConfig>& getAppliedConfiguration() const { return applied_; }
+
+    /**
+     * True until the first optimized configuration is applied; all frames are accepted meanwhile.
+     */
+    bool isLearning() const { return learning_; }
+
+    unsigned getNumReconfigurations() const { return num_reconfigurations_; }
+
+    int getLastError() const { return last_error_; }
+
+    const TrafficObserver& getObserver() const { return observer_; }
+};
+
+}
@@ -0,0 +1,124 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <unistd.h>
+#include <uavcan/uavcan.hpp>
+#include <uavcan/protocol/NodeStatus.hpp>       // uavcan.protocol.NodeStatus
+
+/*
+ * Instrumentation is implemented in a separate header (see below).
+ */
+#include "uavcan_instrumentation.hpp"
+
+extern uavcan::ICanDriver& getCanDriver();
+extern uavcan::ISystemClock& getSystemClock();
+
+constexpr unsigned NodeMemoryPoolSize = 16384;
+typedef uavcan::Node<NodeMemoryPoolSize> Node;
+
+/*
+ * The instrumented driver must be constructed before the node, because the node keeps a reference to its driver.
+ */
+static uavcan_instrumentation::InstrumentedCanDriver& getInstrumentedCanDriver()
+{
+    static uavcan_instrumentation::InstrumentedCanDriver driver(getCanDriver(), getSystemClock());
+    return driver;
+}
+
+static Node& getNode()
+{
+    static Node node(getInstrumentedCanDriver(), getSystemClock());
+    return node;
+}
+
+static void printSnapshot(const uavcan_instrumentation::NodeInstrumentation::Snapshot& s)
+{
+    std::cout << std::fixed << std::setprecision(1)
+              << "Bus load " << s.bus_load_percent << "%, "
+              << s.frames_per_sec << " frames/s, " << s.payload_bytes_per_sec << " bytes/s; "
+              << "TX margin p1 " << s.tx_deadline_margin_p1_usec << " us, refused " << s.tx_refused
+              << ", errors " << s.tx_errors << "; iface errors " << s.iface_errors
+              << "; pool HWM " << s.pool_usage_high_water_mark << " blocks\n";
+
+    for (unsigned i = 0; i < s.num_data_types; i++)
+    {
+        const auto& dt = s.data_types[i];
+        std::cout << "\t" << ((dt.kind == uavcan::DataTypeKindService) ? "Service " : "Message ")
+                  << std::setw(5) << dt.data_type_id
+                  << "  RX " << dt.rx_frames_per_sec << " frames/s " << dt.rx_transfers_per_sec << " transfers/s"
+                  << "  TX " << dt.tx_frames_per_sec << " frames/s " << dt.tx_transfers_per_sec << " transfers/s";
+        if (dt.rx_latency_p99_usec > 0)
+        {
+            std::cout << "  latency p50/p99 " << dt.rx_latency_p50_usec << "/" << dt.rx_latency_p99_usec << " us";
+        }
+        std::cout << "\n";
+    }
+    std::cout << std::flush;
+}
+
+int main(int argc, const char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <node-id>" << std::endl;
+        return 1;
+    }
+
+    const int self_node_id = std::stoi(argv[1]);
+
+    auto& node = getNode();
+    node.setNodeID(self_node_id);
+    node.setName("org.uavcan.tutorial.instrumentation");
+
+    const int node_start_res = node.start();
+    if (node_start_res < 0)
+    {
+        throw std::runtime_error("Failed to start the node; error: " + std::to_string(node_start_res));
+    }
+
+    /*
+     * The instrumentation makes a snapshot once a second, and publishes it via uavcan.protocol.debug.KeyValue.
+     * The second argument can be set to false in order to keep the snapshots local (see getSnapshot()).
+     */
+    uavcan_instrumentation::NodeInstrumentation instrumentation(node, getInstrumentedCanDriver());
+
+    instrumentation.setPoolUsageProbe([&node]() { return unsigned(node.getAllocator().getPeakNumUsedBlocks()); });
+
+    const int instrumentation_start_res = instrumentation.start(uavcan::MonotonicDuration::fromMSec(1000), true);
+    if (instrumentation_start_res < 0)
+    {
+        throw std::runtime_error("Failed to start the instrumentation; error: " +
+                                 std::to_string(instrumentation_start_res));
+    }
+
+    /*
+     * RX-to-callback latency is only recorded for the subscriptions that request it explicitly.
+     * Here we're subscribing to the status messages of all other nodes.
+     */
+    uavcan::Subscriber<uavcan::protocol::NodeStatus> status_sub(node);
+    const int status_sub_start_res = status_sub.start(
+        [&instrumentation](const uavcan::ReceivedDataStructure<uavcan::protocol::NodeStatus>& msg)
+        {
+            instrumentation.recordRxLatency(msg);
+        });
+    if (status_sub_start_res < 0)
+    {
+        throw std::runtime_error("Failed to start the subscriber; error: " + std::to_string(status_sub_start_res));
+    }
+
+    /*
+     * Running the node.
+     */
+    node.setModeOperational();
+
+    while (true)
+    {
+        const int spin_res = node.spin(uavcan::MonotonicDuration::fromMSec(1000));
+        if (spin_res < 0)
+        {
+            std::cerr << "Transient failure: " << spin_res << std::endl;
+        }
+
+        printSnapshot(instrumentation.getSnapshot());
+    }
+}
@@ -0,0 +1,637 @@
+/**
+ * This header implements run-time instrumentation for libuavcan nodes: per data type frame and transfer rates,
+ * bus load, TX deadline margins, RX-to-callback latency histograms, and memory pool high-water marks.
+ *
+ * The frames are observed by a CAN driver decorator that sits between the node and the real driver, so neither
+ * the library nor the application logic need to be modified. The per-frame overhead is a few counter increments
+ * in a small fixed-size table; no dynamic memory is used on the hot path.
+ *
+ * Everything here must be used from the thread that runs the node.
+ *
+ * @file uavcan_instrumentation.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>                            // For std::sort(), std::max()
+#include <functional>                           // For std::function<>
+#include <string>                               // For std::to_string()
+#include <uavcan/uavcan.hpp>                    // Main libuavcan header
+#include <uavcan/protocol/debug/KeyValue.hpp>   // For publishing the snapshots
+
+namespace uavcan_instrumentation
+{
+/**
+ * Logarithmic histogram. Bucket N holds the values in the range [2^N, 2^(N+1)); bucket 0 also holds zero.
+ */
+class LogHistogram
+{
+public:
+    static constexpr unsigned NumBuckets = 24;
+
+private:
+    std::uint32_t buckets_[NumBuckets] = {};
+    std::uint32_t count_ = 0;
+
+public:
+    void add(std::uint64_t value)
+    {
+        unsigned index = 0;
+        while (((value >>= 1) != 0) && (index < (NumBuckets - 1)))
+        {
+            index++;
+        }
+        buckets_[index]++;
+        count_++;
+    }
+
+    /**
+     * Returns the upper bound of the bucket that contains the specified percentile (0 to 100).
+     * Returns zero if the histogram is empty.
+     */
+    std::uint64_t getPercentileUpperBound(unsigned percentile) const
+    {
+        if (count_ == 0)
+        {
+            return 0;
+        }
+        const std::uint64_t threshold = (std::uint64_t(count_) * percentile + 99U) / 100U;
+        std::uint64_t accumulated = 0;
+        for (unsigned i = 0; i < NumBuckets; i++)
+        {
+            accumulated += buckets_[i];
+            if ((accumulated >= threshold) && (accumulated > 0))
+            {
+                return (std::uint64_t(1) << (i + 1)) - 1;
+            }
+        }
+        return (std::uint64_t(1) << NumBuckets) - 1;
+    }
+
+    std::uint32_t getCount() const { return count_; }
+
+    void reset() { *this = LogHistogram(); }
+};
+
+/**
+ * Frame and transfer counters of one direction.
+ */
+struct TrafficCounters
+{
+    std::uint64_t frames = 0;
+    std::uint64_t transfers = 0;
+    std::uint64_t payload_bytes = 0;
+    std::uint64_t bus_bits = 0;         ///< Estimated, including the protocol overhead and worst case bit stuffing
+};
+
+struct DataTypeStatistics
+{
+    uavcan::DataTypeKind kind = uavcan::DataTypeKindMessage;
+    std::uint16_t data_type_id = 0;
+    bool used = false;
+
+    TrafficCounters rx;
+    TrafficCounters tx;
+    LogHistogram rx_latency_usec;       ///< Reset when a snapshot is made
+};
+
+/**
+ * Statistics collected by the driver decorator, indexed by data type.
+ * Data types that don't fit into the table are accounted for in the totals only.
+ */
+class Statistics
+{
+    static constexpr unsigned MaxDataTypesLog2 = 6;
+
+public:
+    static constexpr unsigned MaxDataTypes = 1U << MaxDataTypesLog2;
+
+private:
+
+    DataTypeStatistics data_types_[MaxDataTypes];
+
+    TrafficCounters rx_total_;
+    TrafficCounters tx_total_;
+    std::uint64_t tx_refused_ = 0;                  ///< The driver was not ready to accept the frame
+    std::uint64_t tx_errors_ = 0;
+    std::uint64_t data_type_table_overflows_ = 0;
+    LogHistogram tx_deadline_margin_usec_;          ///< Reset when a snapshot is made
+
+    DataTypeStatistics* findOrAdd(uavcan::DataTypeKind kind, std::uint16_t data_type_id)
+    {
+        // Multiplicative hashing; the upper bits of the product are the best mixed ones
+        const std::uint32_t key = std::uint32_t(data_type_id) | (std::uint32_t(kind) << 16);
+        const std::uint32_t hash = std::uint32_t(key * 2654435761U) >> (32U - MaxDataTypesLog2);
+        for (unsigned i = 0; i < MaxDataTypes; i++)
+        {
+            DataTypeStatistics& entry = data_types_[(hash + i) & (MaxDataTypes - 1)];
+            if (!entry.used)
+            {
+                entry.used = true;
+                entry.kind = kind;
+                entry.data_type_id = data_type_id;
+                return &entry;
+            }
+            if ((entry.kind == kind) && (entry.data_type_id == data_type_id))
+            {
+                return &entry;
+            }
+        }
+        data_type_table_overflows_++;
+        return nullptr;
+    }
+
+    static void count(TrafficCounters& counters, const uavcan::CanFrame& frame, bool end_of_transfer)
+    {
+        /*
+         * CAN 2.0B frame with extended ID: 67 bits of overhead, data, and at most one stuff bit per four bits
+         * over the stuffed region (from SOF till the end of CRC, 34 bits plus data).
+         */
+        const unsigned data_bits = frame.dlc * 8U;
+        counters.frames++;
+        counters.transfers += end_of_transfer ? 1U : 0U;
+        counters.payload_bytes += frame.dlc;
+        counters.bus_bits += 67U + data_bits + (34U + data_bits - 1U) / 4U;
+    }
+
+    /**
+     * Extracts the data type from a UAVCAN frame. Returns false if the frame is not a UAVCAN frame.
+     */
+    static bool parseFrame(const uavcan::CanFrame& frame,
+                           uavcan::DataTypeKind& out_kind,
+                           std::uint16_t& out_data_type_id,
+                           bool& out_end_of_transfer)
+    {
+        if (!frame.isExtended() || frame.isRemoteTransmissionRequest() || frame.isErrorFrame() || (frame.dlc == 0))
+        {
+            return false;
+        }
+
+        const std::uint32_t id = frame.id & uavcan::CanFrame::MaskExtID;
+        const bool service_not_message = (id & (1U << 7)) != 0;
+        if (service_not_message)
+        {
+            out_kind = uavcan::DataTypeKindService;
+            out_data_type_id = std::uint16_t((id >> 16) & 0xFFU);
+        }
+        else
+        {
+            const bool anonymous = (id & 0x7FU) == 0;
+            out_kind = uavcan::DataTypeKindMessage;
+            out_data_type_id = std::uint16_t((id >> 8) & (anonymous ? 0x3U : 0xFFFFU));
+        }
+
+        out_end_of_transfer = (frame.data[frame.dlc - 1] & 0x40U) != 0;   // Tail byte
+        return true;
+    }
+
+    void handleFrame(const uavcan::CanFrame& frame, bool tx)
+    {
+        uavcan::DataTypeKind kind = uavcan::DataTypeKindMessage;
+        std::uint16_t data_type_id = 0;
+        bool end_of_transfer = false;
+        const bool valid = parseFrame(frame, kind, data_type_id, end_of_transfer);
+
+        count(tx ? tx_total_ : rx_total_, frame, end_of_transfer);
+
+        if (valid)
+        {
+            DataTypeStatistics* const entry = findOrAdd(kind, data_type_id);
+            if (entry != nullptr)
+            {
+                count(tx ? entry->tx : entry->rx, frame, end_of_transfer);
+            }
+        }
+    }
+
+public:
+    void handleRxFrame(const uavcan::CanFrame& frame) { handleFrame(frame, false); }
+
+    void handleTxFrame(const uavcan::CanFrame& frame, uavcan::MonotonicDuration deadline_margin)
+    {
+        handleFrame(frame, true);
+        tx_deadline_margin_usec_.add(std::uint64_t(std::max<std::int64_t>(deadline_margin.toUSec(), 0)));
+    }
+
+    void handleTxRefused() { tx_refused_++; }
+
+    void handleTxError() { tx_errors_++; }
+
+    void handleRxLatency(uavcan::DataTypeKind kind, std::uint16_t data_type_id, uavcan::MonotonicDuration latency)
+    {
+        DataTypeStatistics* const entry = findOrAdd(kind, data_type_id);
+        if (entry != nullptr)
+        {
+            entry->rx_latency_usec.add(std::uint64_t(std::max<std::int64_t>(latency.toUSec(), 0)));
+        }
+    }
+
+    /**
+     * Resets the histograms, but not the counters. This is done after every snapshot.
+     */
+    void resetHistograms()
+    {
+        tx_deadline_margin_usec_.reset();
+        for (auto& x : data_types_)
+        {
+            x.rx_latency_usec.reset();
+        }
+    }
+
+    const DataTypeStatistics* getDataTypes() const { return data_types_; }
+
+    const TrafficCounters& getRxTotal() const { return rx_total_; }
+    const TrafficCounters& getTxTotal() const { return tx_total_; }
+    std::uint64_t getTxRefusedCount() const { return tx_refused_; }
+    std::uint64_t getTxErrorCount() const { return tx_errors_; }
+    std::uint64_t getDataTypeTableOverflowCount() const { return data_type_table_overflows_; }
+    const LogHistogram& getTxDeadlineMarginHistogram() const { return tx_deadline_margin_usec_; }
+};
+
+/**
+ * Forwards all calls to the real CAN interface and updates the statistics.
+ */
+class InstrumentedCanIface final : public uavcan::ICanIface,
+                                   uavcan::Noncopyable
+{
+    uavcan::ICanIface* iface_ = nullptr;
+    Statistics* stats_ = nullptr;
+    uavcan::ISystemClock* clock_ = nullptr;
+
+public:
+    void init(uavcan::ICanIface& iface, Statistics& stats, uavcan::ISystemClock& clock)
+    {
+        iface_ = &iface;
+        stats_ = &stats;
+        clock_ = &clock;
+    }
+
+    bool isInitialized() const { return iface_ != nullptr; }
+
+    std::int16_t send(const uavcan::CanFrame& frame,
+                      uavcan::MonotonicTime tx_deadline,
+                      uavcan::CanIOFlags flags) override
+    {
+        const std::int16_t res = iface_->send(frame, tx_deadline, flags);
+        if (res > 0)
+        {
+            stats_->handleTxFrame(frame, tx_deadline - clock_->getMonotonic());
+        }
+        else if (res == 0)
+        {
+            stats_->handleTxRefused();
+        }
+        else
+        {
+            stats_->handleTxError();
+        }
+        return res;
+    }
+
+    std::int16_t receive(uavcan::CanFrame& out_frame,
+                         uavcan::MonotonicTime& out_ts_monotonic,
+                         uavcan::UtcTime& out_ts_utc,
+                         uavcan::CanIOFlags& out_flags) override
+    {
+        const std::int16_t res = iface_->receive(out_frame, out_ts_monotonic, out_ts_utc, out_flags);
+        if ((res > 0) && ((out_flags & uavcan::CanIOFlagLoopback) == 0))       // Own frames are already counted
+        {
+            stats_->handleRxFrame(out_frame);
+        }
+        return res;
+    }
+
+    std::int16_t configureFilters(const uavcan::CanFilterConfig* filter_configs,
+                                  std::uint16_t num_configs) override
+    {
+        return iface_->configureFilters(filter_configs, num_configs);
+    }
+
+    std::uint16_t getNumFilters() const override { return iface_->getNumFilters(); }
+
+    std::uint64_t getErrorCount() const override { return iface_->getErrorCount(); }
+};
+
+/**
+ * CAN driver decorator. Pass it to the node instead of the real driver:
+ *
+ *      uavcan_instrumentation::InstrumentedCanDriver driver(getCanDriver(), getSystemClock());
+ *      uavcan::Node<16384> node(driver, getSystemClock());
+ */
+class InstrumentedCanDriver final : public uavcan::ICanDriver,
+                                    uavcan::Noncopyable
+{
+    uavcan::ICanDriver& driver_;
+    uavcan::ISystemClock& clock_;
+    InstrumentedCanIface ifaces_[uavcan::MaxCanIfaces];
+    Statistics stats_;
+
+public:
+    InstrumentedCanDriver(uavcan::ICanDriver& driver, uavcan::ISystemClock& clock) :
+        driver_(driver),
+        clock_(clock)
+    { }
+
+    uavcan::ICanIface* getIface(std::uint8_t iface_index) override
+    {
+        if (iface_index >= uavcan::MaxCanIfaces)
+        {
+            return nullptr;
+        }
+        if (!ifaces_[iface_index].isInitialized())
+        {
+            uavcan::ICanIface* const iface = driver_.getIface(iface_index);
+            if (iface == nullptr)
+            {
+                return nullptr;
+            }
+            ifaces_[iface_index].init(*iface, stats_, clock_);
+        }
+        return &ifaces_[iface_index];
+    }
+
+    std::uint8_t getNumIfaces() const override { return driver_.getNumIfaces(); }
+
+    std::int16_t select(uavcan::CanSelectMasks& inout_masks,
+                        const uavcan::CanFrame* (& pending_tx)[uavcan::MaxCanIfaces],
+                        uavcan::MonotonicTime blocking_deadline) override
+    {
+        return driver_.select(inout_masks, pending_tx, blocking_deadline);
+    }
+
+    Statistics& getStatistics() { return stats_; }
+    const Statistics& getStatistics() const { return stats_; }
+
+    /**
+     * Sum of the error counters of all interfaces, as reported by the real driver.
+     */
+    std::uint64_t getErrorCount() const
+    {
+        std::uint64_t sum = 0;
+        for (std::uint8_t i = 0; i < driver_.getNumIfaces(); i++)
+        {
+            const uavcan::ICanIface* const iface = driver_.getIface(i);
+            sum += (iface == nullptr) ? 0 : iface->getErrorCount();
+        }
+        return sum;
+    }
+};
+
+/**
+ * Periodically turns the raw statistics into a snapshot with rates and percentiles, and optionally publishes it
+ * as a set of uavcan.protocol.debug.KeyValue messages with the lowest priority.
+ *
+ * The published keys are:
+ *      bus.load        - estimated bus load caused by the frames this node has sent and received, percent
+ *      bus.fps         - frames per second, both directions
+ *      tx.margin_p1    - 1st percentile of the TX deadline margin, microseconds; zero if nothing was sent.
+ *                        The margin is the time left until the TX deadline when the frame reached the driver;
+ *                        if it approaches zero, frames are spending too much time in the TX queue.
+ *      tx.refused      - number of times the driver was not ready to accept a frame, since the start
+ *      pool.hwm        - memory pool high-water mark, blocks (see @ref setPoolUsageProbe())
+ *      <t><id>.fps     - frames per second of the data type, both directions, for the busiest data types;
+ *                        <t> is 'm' for messages and 's' for services
+ *      <t><id>.lat_p99 - 99th percentile of the RX-to-callback latency of the data type, microseconds;
+ *                        only if the latency is recorded (see @ref recordRxLatency())
+ */
+class NodeInstrumentation : private uavcan::TimerBase
+{
+public:
+    static constexpr unsigned MaxReportedDataTypes = 4;
+
+    struct DataTypeSnapshot
+    {
+        uavcan::DataTypeKind kind = uavcan::DataTypeKindMessage;
+        std::uint16_t data_type_id = 0;
+        float rx_frames_per_sec = 0;
+        float tx_frames_per_sec = 0;
+        float rx_transfers_per_sec = 0;
+        float tx_transfers_per_sec = 0;
+        float rx_bytes_per_sec = 0;
+        float tx_bytes_per_sec = 0;
+        std::uint64_t rx_latency_p50_usec = 0;
+        std::uint64_t rx_latency_p99_usec = 0;
+    };
+
+    struct Snapshot
+    {
+        float bus_load_percent = 0;
+        float frames_per_sec = 0;
+        float payload_bytes_per_sec = 0;
+        std::uint64_t tx_deadline_margin_p1_usec = 0;
+        std::uint64_t tx_refused = 0;
+        std::uint64_t tx_errors = 0;
+        std::uint64_t iface_errors = 0;
+        unsigned pool_usage_high_water_mark = 0;
+        unsigned num_data_types = 0;
+        DataTypeSnapshot data_types[MaxReportedDataTypes];      ///< Sorted by frame rate, busiest first
+    };
+
+private:
+    uavcan::INode& node_;
+    InstrumentedCanDriver& driver_;
+    const std::uint32_t can_bit_rate_;
+    uavcan::Publisher<uavcan::protocol::debug::KeyValue> kv_pub_;
+    bool publish_ = false;
+
+    std::function<unsigned ()> pool_usage_probe_;
+    unsigned pool_usage_high_water_mark_ = 0;
+
+    // Counters as of the previous snapshot, needed to compute the rates
+    TrafficCounters prev_rx_total_;
+    TrafficCounters prev_tx_total_;
+    TrafficCounters prev_rx_[Statistics::MaxDataTypes];
+    TrafficCounters prev_tx_[Statistics::MaxDataTypes];
+    uavcan::MonotonicTime prev_snapshot_ts_;
+
+    Snapshot snapshot_;
+
+    static float rate(std::uint64_t current, std::uint64_t previous, float seconds)
+    {
+        return float(current - previous) / seconds;
+    }
+
+    void makeSnapshot(uavcan::MonotonicTime ts)
+    {
+        Statistics& stats = driver_.getStatistics();
+        const float seconds = std::max(float((ts - prev_snapshot_ts_).toUSec()) * 1e-6F, 1e-3F);
+        prev_snapshot_ts_ = ts;
+
+        Snapshot s;
+
+        const TrafficCounters& rx = stats.getRxTotal();
+        const TrafficCounters& tx = stats.getTxTotal();
+        const float bits_per_sec = rate(rx.bus_bits + tx.bus_bits, prev_rx_total_.bus_bits + prev_tx_total_.bus_bits,
+                                        seconds);
+        s.bus_load_percent = 100.0F * bits_per_sec / float(can_bit_rate_);
+        s.frames_per_sec = rate(rx.frames + tx.frames, prev_rx_total_.frames + prev_tx_total_.frames, seconds);
+        s.payload_bytes_per_sec = rate(rx.payload_bytes + tx.payload_bytes,
+                                       prev_rx_total_.payload_bytes + prev_tx_total_.payload_bytes, seconds);
+        s.tx_deadline_margin_p1_usec = stats.getTxDeadlineMarginHistogram().getPercentileUpperBound(1);
+        s.tx_refused = stats.getTxRefusedCount();
+        s.tx_errors = stats.getTxErrorCount();
+        s.iface_errors = driver_.getErrorCount();
+
+        prev_rx_total_ = rx;
+        prev_tx_total_ = tx;
+
+        if (pool_usage_probe_)
+        {
+            pool_usage_high_water_mark_ = std::max(pool_usage_high_water_mark_, pool_usage_probe_());
+        }
+        s.pool_usage_high_water_mark = pool_usage_high_water_mark_;
+
+        /*
+         * Per data type rates; only the busiest data types are kept in the snapshot.
+         */
+        DataTypeSnapshot all[Statistics::MaxDataTypes];
+        unsigned num_used = 0;
+        for (unsigned i = 0; i < Statistics::MaxDataTypes; i++)
+        {
+            const DataTypeStatistics& dt = stats.getDataTypes()[i];
+            if (!dt.used)
+            {
+                continue;
+            }
+            DataTypeSnapshot& out = all[num_used++];
+            out.kind = dt.kind;
+            out.data_type_id = dt.data_type_id;
+            out.rx_frames_per_sec = rate(dt.rx.frames, prev_rx_[i].frames, seconds);
+            out.tx_frames_per_sec = rate(dt.tx.frames, prev_tx_[i].frames, seconds);
+            out.rx_transfers_per_sec = rate(dt.rx.transfers, prev_rx_[i].transfers, seconds);
+            out.tx_transfers_per_sec = rate(dt.tx.transfers, prev_tx_[i].transfers, seconds);
+            out.rx_bytes_per_sec = rate(dt.rx.payload_bytes, prev_rx_[i].payload_bytes, seconds);
+            out.tx_bytes_per_sec = rate(dt.tx.payload_bytes, prev_tx_[i].payload_bytes, seconds);
+            out.rx_latency_p50_usec = dt.rx_latency_usec.getPercentileUpperBound(50);
+            out.rx_latency_p99_usec = dt.rx_latency_usec.getPercentileUpperBound(99);
+            prev_rx_[i] = dt.rx;
+            prev_tx_[i] = dt.tx;
+        }
+
+        std::sort(all, all + num_used, [](const DataTypeSnapshot& a, const DataTypeSnapshot& b)
+            {
+                return (a.rx_frames_per_sec + a.tx_frames_per_sec) > (b.rx_frames_per_sec + b.tx_frames_per_sec);
+            });
+        s.num_data_types = (num_used < MaxReportedDataTypes) ? num_used : unsigned(MaxReportedDataTypes);
+        std::copy(all, all + s.num_data_types, s.data_types);
+
+        stats.resetHistograms();
+        snapshot_ = s;
+    }
+
+    void publishValue(const char* key, float value)
+    {
+        uavcan::protocol::debug::KeyValue msg;
+        msg.key = key;
+        msg.value = value;
+        (void)kv_pub_.broadcast(msg);         // Failures are accounted for by the statistics
+    }
+
+    void publishSnapshot()
+    {
+        publishValue("bus.load", snapshot_.bus_load_percent);
+        publishValue("bus.fps", snapshot_.frames_per_sec);
+        publishValue("tx.margin_p1", float(snapshot_.tx_deadline_margin_p1_usec));
+        publishValue("tx.refused", float(snapshot_.tx_refused));
+        if (pool_usage_probe_)
+        {
+            publishValue("pool.hwm", float(snapshot_.pool_usage_high_water_mark));
+        }
+
+        for (unsigned i = 0; i < snapshot_.num_data_types; i++)
+        {
+            const DataTypeSnapshot& dt = snapshot_.data_types[i];
+            const std::string prefix = ((dt.kind == uavcan::DataTypeKindService) ? "s" : "m") +
+                                       std::to_string(dt.data_type_id);
+            publishValue((prefix + ".fps").c_str(), dt.rx_frames_per_sec + dt.tx_frames_per_sec);
+            if (dt.rx_latency_p99_usec > 0)
+            {
+                publishValue((prefix + ".lat_p99").c_str(), float(dt.rx_latency_p99_usec));
+            }
+        }
+    }
+
+    void handleTimerEvent(const uavcan::TimerEvent& event) override
+    {
+        makeSnapshot(event.real_time);
+        if (publish_)
+        {
+            publishSnapshot();
+        }
+    }
+
+public:
+    /**
+     * @param node          The node that uses the instrumented driver.
+     * @param driver        The instrumented driver.
+     * @param can_bit_rate  Needed to estimate the bus load.
+     */
+    NodeInstrumentation(uavcan::INode& node, InstrumentedCanDriver& driver, std::uint32_t can_bit_rate = 1000000) :
+        uavcan::TimerBase(node),
+        node_(node),
+        driver_(driver),
+        can_bit_rate_(can_bit_rate),
+        kv_pub_(node)
+    { }
+
+    /**
+     * Starts making snapshots with the specified period.
+     * If publish is true, every snapshot will be published via uavcan.protocol.debug.KeyValue.
+     * Returns negative error code on failure.
+     */
+    int start(uavcan::MonotonicDuration period, bool publish)
+    {
+        publish_ = publish;
+        if (publish_)
+        {
+            const int res = kv_pub_.init();
+            if (res < 0)
+            {
+                return res;
+            }
+            kv_pub_.setPriority(uavcan::TransferPriority::Lowest);
+        }
+        prev_snapshot_ts_ = node_.getMonotonicTime();
+        uavcan::TimerBase::startPeriodic(period);
+        return 0;
+    }
+
+    /**
+     * Sets the function that reports memory pool usage in blocks. It is invoked once per snapshot, and the maximum
+     * of the returned values is reported as the high-water mark. Because of that, the function should return the
+     * peak usage, if the allocator keeps track of it, e.g.:
+     *
+     *      uavcan::PoolAllocator                   - getPeakNumUsedBlocks()
+     *      uavcan::HeapBasedPoolAllocator          - getNumReservedBlocks(), which only grows until shrink() is called
+     */
+    void setPoolUsageProbe(const std::function<unsigned ()>& probe) { pool_usage_probe_ = probe; }
+
+    /**
+     * Records the time between the reception of the first frame of the transfer and the moment this method is
+     * called. Call it from a message subscription callback.
+     *
+     * The data type ID is looked up in the registry by name, since the data type may have no default ID, or its ID
+     * may have been changed at run time. The registry is frozen once the node is started, so the lookup is done
+     * only once per data type.
+     */
+    template <typename DataType>
+    void recordRxLatency(const uavcan::ReceivedDataStructure<DataType>& msg)
+    {
+        static const uavcan::DataTypeDescriptor* const descriptor =
+            uavcan::GlobalDataTypeRegistry::instance().find(DataType::getDataTypeFullName());
+        if (descriptor != nullptr)
+        {
+            driver_.getStatistics().handleRxLatency(descriptor->getKind(), descriptor->getID().get(),
+                                                    node_.getMonotonicTime() - msg.getMonotonicTimestamp());
+        }
+    }
+
+    const Snapshot& getSnapshot() const { return snapshot_; }
+
+    const Statistics& getStatistics() const { return driver_.getStatistics(); }
+};
+
+}
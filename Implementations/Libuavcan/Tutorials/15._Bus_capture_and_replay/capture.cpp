@@ -0,0 +1,97 @@
+#include <iostream>
+#include <csignal>
+#include <unistd.h>
+#include <uavcan/uavcan.hpp>
+
+/*
+ * The capture format, the writer and the reader are implemented in a separate header (see below).
+ */
+#include "uavcan_bus_capture.hpp"
+
+extern uavcan::ICanDriver& getCanDriver();
+extern uavcan::ISystemClock& getSystemClock();
+
+constexpr unsigned NodeMemoryPoolSize = 16384;
+typedef uavcan::Node<NodeMemoryPoolSize> Node;
+
+static Node& getNode()
+{
+    static Node node(getCanDriver(), getSystemClock());
+    return node;
+}
+
+static volatile std::sig_atomic_t g_stop_requested = 0;
+
+static void handleStopSignal(int)
+{
+    g_stop_requested = 1;
+}
+
+int main(int argc, const char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <output-file> [node-id]" << std::endl;
+        return 1;
+    }
+
+    /*
+     * The capture file must be closed properly in order to get the index, hence the signal handlers.
+     */
+    uavcan_bus_capture::CaptureWriter writer;
+    const int open_res = writer.open(argv[1]);
+    if (open_res < 0)
+    {
+        throw std::runtime_error("Failed to open the capture file; error: " + std::to_string(open_res));
+    }
+
+    (void)std::signal(SIGINT, &handleStopSignal);
+    (void)std::signal(SIGTERM, &handleStopSignal);
+
+    /*
+     * Without a node ID, the node runs in passive mode, i.e. it doesn't emit anything, which is what
+     * a bus recorder is normally expected to do.
+     */
+    auto& node = getNode();
+    if (argc > 2)
+    {
+        node.setNodeID(std::stoi(argv[2]));
+    }
+    node.setName("org.uavcan.tutorial.capture");
+
+    const int node_start_res = node.start();
+    if (node_start_res < 0)
+    {
+        throw std::runtime_error("Failed to start the node; error: " + std::to_string(node_start_res));
+    }
+
+    /*
+     * The listener is invoked for every frame received by the node, regardless of the subscriptions.
+     */
+    uavcan_bus_capture::CaptureRxListener listener(writer);
+    node.getDispatcher().installRxFrameListener(&listener);
+
+    node.setModeOperational();
+
+    while (g_stop_requested == 0)
+    {
+        const int spin_res = node.spin(uavcan::MonotonicDuration::fromMSec(1000));
+        if (spin_res < 0)
+        {
+            std::cerr << "Transient failure: " << spin_res << std::endl;
+        }
+        std::cout << "Frames captured: " << writer.getNumRecords()
+                  << ", write errors: " << listener.getErrorCount() << std::endl;
+    }
+
+    node.getDispatcher().removeRxFrameListener();
+
+    const int close_res = writer.close();
+    if (close_res < 0)
+    {
+        std::cerr << "Failed to close the capture file; error: " << close_res << std::endl;
+        return 1;
+    }
+    std::cout << "Capture closed, " << writer.getNumRecords() << " frames" << std::endl;
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <map>
+#include <uavcan/uavcan.hpp>
+#include <uavcan/protocol/NodeStatus.hpp>       // uavcan.protocol.NodeStatus
+
+#include "uavcan_bus_capture.hpp"
+
+extern uavcan::ISystemClock& getSystemClock();
+
+constexpr unsigned NodeMemoryPoolSize = 16384;
+typedef uavcan::Node<NodeMemoryPoolSize> Node;
+
+static void printIndex(const uavcan_bus_capture::CaptureReader& reader)
+{
+    std::cout << "Frames in the capture: " << reader.getNumRecords() << std::endl;
+    if (!reader.hasIndex())
+    {
+        std::cout << "The capture has no index (it was not closed properly)" << std::endl;
+        return;
+    }
+
+    for (unsigned i = 0; i < reader.getNumIndexEntries(); i++)
+    {
+        const auto& e = reader.getIndexEntry(i);
+        std::cout << "\t" << ((e.kind == uavcan::DataTypeKindService) ? "Service " : "Message ")
+                  << std::setw(5) << e.data_type_id << ": " << e.num_records << " frames" << std::endl;
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <capture-file> <node-id> [speed-factor]" << std::endl;
+        return 1;
+    }
+
+    uavcan_bus_capture::CaptureReader reader;
+    const int open_res = reader.open(argv[1]);
+    if (open_res < 0)
+    {
+        throw std::runtime_error("Failed to open the capture file; error: " + std::to_string(open_res));
+    }
+    if (reader.getNumRecords() == 0)
+    {
+        std::cerr << "The capture is empty" << std::endl;
+        return 1;
+    }
+
+    printIndex(reader);
+
+    /*
+     * The node under test runs on the replay clock, which starts at the timestamp of the first recorded frame
+     * and runs faster than the real time by the specified factor; 100x by default.
+     */
+    const double speed_factor = (argc > 3) ? std::stod(argv[3]) : 100.0;
+    if (!(speed_factor > 0.0))
+    {
+        std::cerr << "Invalid speed factor" << std::endl;
+        return 1;
+    }
+
+    const auto& first = reader.getRecord(0);
+    uavcan_bus_capture::ReplayClock clock(getSystemClock(), speed_factor,
+                                          uavcan::MonotonicTime::fromUSec(first.ts_mono_usec),
+                                          uavcan::UtcTime::fromUSec(first.ts_utc_usec));
+
+    uavcan_bus_capture::ReplayDriver driver(reader, clock, reader.getNumIfaces());
+
+    Node node(driver, clock);
+    node.setNodeID(std::stoi(argv[2]));
+    node.setName("org.uavcan.tutorial.replay");
+
+    const int node_start_res = node.start();
+    if (node_start_res < 0)
+    {
+        throw std::runtime_error("Failed to start the node; error: " + std::to_string(node_start_res));
+    }
+
+    /*
+     * This is where the logic under test would be. Here we just count the status messages of every node.
+     */
+    std::map<int, unsigned> status_counts;
+    uavcan::Subscriber<uavcan::protocol::NodeStatus> status_sub(node);
+    const int status_sub_start_res = status_sub.start(
+        [&status_counts](const uavcan::ReceivedDataStructure<uavcan::protocol::NodeStatus>& msg)
+        {
+            status_counts[msg.getSrcNodeID().get()]++;
+        });
+    if (status_sub_start_res < 0)
+    {
+        throw std::runtime_error("Failed to start the subscriber; error: " + std::to_string(status_sub_start_res));
+    }
+
+    node.setModeOperational();
+
+    const auto started_at = std::chrono::steady_clock::now();
+
+    while (!driver.isFinished())
+    {
+        const int spin_res = node.spin(uavcan::MonotonicDuration::fromMSec(1000));
+        if (spin_res < 0)
+        {
+            std::cerr << "Transient failure: " << spin_res << std::endl;
+        }
+    }
+    (void)node.spinOnce();                      // Processing the last frames
+
+    const double real_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_at).count();
+    const double replay_sec =
+        double(reader.getRecord(reader.getNumRecords() - 1).ts_mono_usec - first.ts_mono_usec) * 1e-6;
+
+    std::cout << "Replayed " << driver.getNumReplayedRecords() << " frames (" << driver.getNumFilteredOutRecords()
+              << " filtered out) covering " << replay_sec << " s in " << real_sec << " s; "
+              << driver.getNumTxFrames() << " frames emitted by the node" << std::endl;
+
+    for (auto& kv : status_counts)
+    {
+        std::cout << "\tNode " << kv.first << ": " << kv.second << " status messages" << std::endl;
+    }
+    return 0;
+}
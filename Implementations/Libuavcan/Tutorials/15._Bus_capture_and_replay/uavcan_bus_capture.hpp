@@ -0,0 +1,780 @@
+/**
+ * This header implements a compact binary capture format for CAN bus traffic, a writer that records the frames
+ * received by a libuavcan node, and a reader that replays a capture into a node via a virtual CAN driver.
+ *
+ * File layout:
+ *  - FileHeader
+ *  - Record * FileHeader::num_records, in the order of reception
+ *  - Index (optional, written when the capture is closed):
+ *      - IndexHeader
+ *      - IndexEntry * IndexHeader::num_entries, one per data type
+ *      - For every entry, IndexEntry::num_records record numbers (uint32), in ascending order
+ *
+ * All records have the same size, so the file can be accessed randomly once mapped into memory.
+ * All fields are stored in the native byte order of the machine that made the capture; since all supported
+ * platforms are little-endian, the byte order is little-endian.
+ *
+ * @file uavcan_bus_capture.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <cstdio>               // For std::FILE
+#include <cstring>              // For std::memcpy(), std::memcmp()
+#include <cerrno>               // For errno
+#include <map>                  // For std::map, used by the index builder
+#include <vector>               // For std::vector
+#include <deque>                // For std::deque, used for loopback frames
+#include <algorithm>            // For std::min()
+#include <type_traits>          // For std::is_pod<>
+#include <fcntl.h>              // For open()
+#include <unistd.h>             // For close()
+#include <sys/mman.h>           // For mmap()
+#include <sys/stat.h>           // For fstat()
+#include <uavcan/uavcan.hpp>    // Main libuavcan header
+
+namespace uavcan_bus_capture
+{
+static constexpr std::uint8_t FileMagic[8] = { 'U', 'A', 'V', 'C', 'A', 'P', 0, 1 };
+static constexpr std::uint16_t FormatVersion = 1;
+
+struct FileHeader
+{
+    std::uint8_t magic[8];
+    std::uint16_t version;
+    std::uint16_t record_size;          ///< sizeof(Record); allows the format to be extended later
+    std::uint8_t num_ifaces;            ///< Highest iface index plus one
+    std::uint8_t reserved[3];
+    std::uint64_t num_records;          ///< Zero if the capture was not closed properly, see CaptureReader
+    std::uint64_t index_offset;         ///< Zero if there is no index
+};
+
+struct Record
+{
+    std::uint64_t ts_mono_usec;
+    std::uint64_t ts_utc_usec;          ///< Zero if the driver doesn't provide UTC timestamps
+    std::uint32_t can_id;               ///< As in uavcan::CanFrame, i.e. with flags
+    std::uint8_t iface_index;
+    std::uint8_t dlc;
+    std::uint16_t flags;                ///< uavcan::CanIOFlags
+    std::uint8_t data[8];
+
+    uavcan::CanRxFrame toCanRxFrame() const
+    {
+        uavcan::CanRxFrame frame;
+        static_cast<uavcan::CanFrame&>(frame) = uavcan::CanFrame(can_id, data, dlc);
+        frame.ts_mono = uavcan::MonotonicTime::fromUSec(ts_mono_usec);
+        frame.ts_utc = uavcan::UtcTime::fromUSec(ts_utc_usec);
+        frame.iface_index = iface_index;
+        return frame;
+    }
+};
+
+struct IndexHeader
+{
+    std::uint32_t num_entries;
+    std::uint32_t reserved;
+};
+
+struct IndexEntry
+{
+    std::uint16_t data_type_id;
+    std::uint8_t kind;                  ///< uavcan::DataTypeKind
+    std::uint8_t reserved;
+    std::uint32_t num_records;
+    std::uint64_t records_offset;       ///< Offset of the array of record numbers from the beginning of the file
+};
+
+static_assert(std::is_pod<FileHeader>::value && sizeof(FileHeader) == 32, "FileHeader layout");
+static_assert(std::is_pod<Record>::value && sizeof(Record) == 32, "Record layout");
+static_assert(std::is_pod<IndexHeader>::value && sizeof(IndexHeader) == 8, "IndexHeader layout");
+static_assert(std::is_pod<IndexEntry>::value && sizeof(IndexEntry) == 16, "IndexEntry layout");
+
+/**
+ * Extracts the data type from a UAVCAN frame. Returns false if the frame is not a UAVCAN frame.
+ */
+static inline bool parseDataType(const uavcan::CanFrame& frame,
+                                 uavcan::DataTypeKind& out_kind,
+                                 std::uint16_t& out_data_type_id)
+{
+    if (!frame.isExtended() || frame.isRemoteTransmissionRequest() || frame.isErrorFrame() || (frame.dlc == 0))
+    {
+        return false;
+    }
+
+    const std::uint32_t id = frame.id & uavcan::CanFrame::MaskExtID;
+    const bool service_not_message = (id & (1U << 7)) != 0;
+    if (service_not_message)
+    {
+        out_kind = uavcan::DataTypeKindService;
+        out_data_type_id = std::uint16_t((id >> 16) & 0xFFU);
+    }
+    else
+    {
+        const bool anonymous = (id & 0x7FU) == 0;
+        out_kind = uavcan::DataTypeKindMessage;
+        out_data_type_id = std::uint16_t((id >> 8) & (anonymous ? 0x3U : 0xFFFFU));
+    }
+    return true;
+}
+
+/**
+ * Writes a capture file. The index is accumulated in memory and written by close().
+ * All methods return negative errno on failure.
+ */
+class CaptureWriter : uavcan::Noncopyable
+{
+    std::FILE* file_ = nullptr;
+    FileHeader header_;
+    std::map<std::uint32_t, std::vector<std::uint32_t>> index_;     ///< (kind << 16 | data type ID) --> records
+
+    static std::uint32_t makeIndexKey(uavcan::DataTypeKind kind, std::uint16_t data_type_id)
+    {
+        return (std::uint32_t(kind) << 16) | data_type_id;
+    }
+
+    int writeExactly(const void* data, std::size_t size)
+    {
+        return (std::fwrite(data, 1, size, file_) == size) ? 0 : -EIO;
+    }
+
+public:
+    /**
+     * The output buffer is large, so that the recording thread doesn't have to make a system call on every frame.
+     */
+    static constexpr unsigned OutputBufferSize = 256 * 1024;
+
+    CaptureWriter()
+    {
+        std::memset(&header_, 0, sizeof(header_));
+    }
+
+    ~CaptureWriter() { (void)close(); }
+
+    int open(const char* path)
+    {
+        if (file_ != nullptr)
+        {
+            return -EBUSY;
+        }
+
+        file_ = std::fopen(path, "wb");
+        if (file_ == nullptr)
+        {
+            return -errno;
+        }
+        (void)std::setvbuf(file_, nullptr, _IOFBF, OutputBufferSize);
+
+        std::memset(&header_, 0, sizeof(header_));
+        std::memcpy(header_.magic, FileMagic, sizeof(FileMagic));
+        header_.version = FormatVersion;
+        header_.record_size = sizeof(Record);
+        index_.clear();
+
+        return writeExactly(&header_, sizeof(header_));
+    }
+
+    int write(const uavcan::CanRxFrame& frame, uavcan::CanIOFlags flags)
+    {
+        if (file_ == nullptr)
+        {
+            return -EBADF;
+        }
+        if (header_.num_records >= 0xFFFFFFFFULL)
+        {
+            return -EFBIG;                      // Record numbers in the index are 32 bit wide
+        }
+
+        Record record;
+        std::memset(&record, 0, sizeof(record));
+        record.ts_mono_usec = frame.ts_mono.toUSec();
+        record.ts_utc_usec = frame.ts_utc.toUSec();
+        record.can_id = frame.id;
+        record.iface_index = frame.iface_index;
+        record.dlc = frame.dlc;
+        record.flags = flags;
+        std::memcpy(record.data, frame.data, std::min<unsigned>(frame.dlc, sizeof(record.data)));
+
+        const int res = writeExactly(&record, sizeof(record));
+        if (res < 0)
+        {
+            return res;
+        }
+
+        uavcan::DataTypeKind kind = uavcan::DataTypeKindMessage;
+        std::uint16_t data_type_id = 0;
+        if (parseDataType(frame, kind, data_type_id))
+        {
+            index_[makeIndexKey(kind, data_type_id)].push_back(std::uint32_t(header_.num_records));
+        }
+
+        header_.num_records++;
+        header_.num_ifaces = std::max<std::uint8_t>(header_.num_ifaces, std::uint8_t(frame.iface_index + 1U));
+        return 0;
+    }
+
+    /**
+     * Writes the index, updates the header, and closes the file.
+     * If the application crashes before close() is called, the file remains readable, but without the index.
+     */
+    int close()
+    {
+        if (file_ == nullptr)
+        {
+            return 0;
+        }
+
+        header_.index_offset = sizeof(FileHeader) + header_.num_records * sizeof(Record);
+
+        IndexHeader index_header;
+        std::memset(&index_header, 0, sizeof(index_header));
+        index_header.num_entries = std::uint32_t(index_.size());
+        int res = writeExactly(&index_header, sizeof(index_header));
+
+        std::uint64_t records_offset = header_.index_offset + sizeof(IndexHeader) + index_.size() * sizeof(IndexEntry);
+        for (auto& kv : index_)
+        {
+            IndexEntry entry;
+            std::memset(&entry, 0, sizeof(entry));
+            entry.data_type_id = std::uint16_t(kv.first & 0xFFFFU);
+            entry.kind = std::uint8_t(kv.first >> 16);
+            entry.num_records = std::uint32_t(kv.second.size());
+            entry.records_offset = records_offset;
+            records_offset += kv.second.size() * sizeof(std::uint32_t);
+            res = (res < 0) ? res : writeExactly(&entry, sizeof(entry));
+        }
+        for (auto& kv : index_)
+        {
+            res = (res < 0) ? res : writeExactly(kv.second.data(), kv.second.size() * sizeof(std::uint32_t));
+        }
+
+        // Patching the header at last, so that a failure above leaves the file without the index, but valid
+        res = (res < 0) ? res : ((std::fseek(file_, 0, SEEK_SET) == 0) ? 0 : -errno);
+        res = (res < 0) ? res : writeExactly(&header_, sizeof(header_));
+
+        if (std::fclose(file_) != 0 && res >= 0)
+        {
+            res = -errno;
+        }
+        file_ = nullptr;
+        index_.clear();
+        return res;
+    }
+
+    std::uint64_t getNumRecords() const { return header_.num_records; }
+};
+
+/**
+ * Records all frames received by a node. Install with uavcan::Dispatcher::installRxFrameListener().
+ * Write errors are counted rather than reported, since the listener is invoked from the RX path of the node.
+ */
+class CaptureRxListener : public uavcan::IRxFrameListener,
+                          uavcan::Noncopyable
+{
+    CaptureWriter& writer_;
+    std::uint64_t error_count_ = 0;
+
+    void handleRxFrame(const uavcan::CanRxFrame& frame, uavcan::CanIOFlags flags) override
+    {
+        if (writer_.write(frame, flags) < 0)
+        {
+            error_count_++;
+        }
+    }
+
+public:
+    explicit CaptureRxListener(CaptureWriter& writer) : writer_(writer) { }
+
+    std::uint64_t getErrorCount() const { return error_count_; }
+};
+
+/**
+ * Provides read-only access to a memory-mapped capture file.
+ */
+class CaptureReader : uavcan::Noncopyable
+{
+    const std::uint8_t* data_ = nullptr;
+    std::size_t size_ = 0;
+    const FileHeader* header_ = nullptr;
+    const Record* records_ = nullptr;
+    std::uint64_t num_records_ = 0;
+    const IndexHeader* index_header_ = nullptr;
+    const IndexEntry* index_entries_ = nullptr;
+
+    void unmap()
+    {
+        if (data_ != nullptr)
+        {
+            (void)::munmap(const_cast<std::uint8_t*>(data_), size_);
+        }
+        data_ = nullptr;
+        size_ = 0;
+        header_ = nullptr;
+        records_ = nullptr;
+        num_records_ = 0;
+        index_header_ = nullptr;
+        index_entries_ = nullptr;
+    }
+
+    bool isWithinFile(std::uint64_t offset, std::uint64_t length) const
+    {
+        return (offset <= size_) && (length <= size_ - offset);
+    }
+
+    void loadIndex()
+    {
+        if ((header_->index_offset == 0) || !isWithinFile(header_->index_offset, sizeof(IndexHeader)))
+        {
+            return;
+        }
+        const auto index_header = reinterpret_cast<const IndexHeader*>(data_ + header_->index_offset);
+        const std::uint64_t entries_offset = header_->index_offset + sizeof(IndexHeader);
+        if (!isWithinFile(entries_offset, std::uint64_t(index_header->num_entries) * sizeof(IndexEntry)))
+        {
+            return;
+        }
+        const auto entries = reinterpret_cast<const IndexEntry*>(data_ + entries_offset);
+        for (std::uint32_t i = 0; i < index_header->num_entries; i++)
+        {
+            if (!isWithinFile(entries[i].records_offset, std::uint64_t(entries[i].num_records) * 4U) ||
+                (entries[i].records_offset % alignof(std::uint32_t)) != 0)
+            {
+                return;
+            }
+        }
+        index_header_ = index_header;
+        index_entries_ = entries;
+    }
+
+public:
+    ~CaptureReader() { unmap(); }
+
+    /**
+     * Maps the file into memory. Returns negative errno on failure.
+     * If the capture was not closed properly, the number of records is inferred from the file size,
+     * and the index is not available.
+     */
+    int open(const char* path)
+    {
+        unmap();
+
+        const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return -errno;
+        }
+
+        struct ::stat st;
+        if (::fstat(fd, &st) < 0)
+        {
+            const int err = errno;
+            (void)::close(fd);
+            return -err;
+        }
+        if (std::size_t(st.st_size) < sizeof(FileHeader))
+        {
+            (void)::close(fd);
+            return -EINVAL;
+        }
+
+        void* const mapping = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        const int mmap_errno = errno;
+        (void)::close(fd);                      // The mapping stays valid
+        if (mapping == MAP_FAILED)
+        {
+            return -mmap_errno;
+        }
+
+        // The replay reads the records sequentially
+        (void)::madvise(mapping, std::size_t(st.st_size), MADV_SEQUENTIAL);
+
+        data_ = static_cast<const std::uint8_t*>(mapping);
+        size_ = std::size_t(st.st_size);
+        header_ = reinterpret_cast<const FileHeader*>(data_);
+
+        if ((std::memcmp(header_->magic, FileMagic, sizeof(FileMagic)) != 0) ||
+            (header_->version != FormatVersion) ||
+            (header_->record_size != sizeof(Record)))
+        {
+            unmap();
+            return -EINVAL;
+        }
+
+        records_ = reinterpret_cast<const Record*>(data_ + sizeof(FileHeader));
+        const std::uint64_t max_num_records = (size_ - sizeof(FileHeader)) / sizeof(Record);
+        num_records_ = (header_->num_records == 0) ? max_num_records : header_->num_records;
+        if (num_records_ > max_num_records)
+        {
+            unmap();
+            return -EINVAL;
+        }
+
+        if (header_->num_records != 0)
+        {
+            loadIndex();
+        }
+        return 0;
+    }
+
+    bool isOpen() const { return data_ != nullptr; }
+
+    std::uint64_t getNumRecords() const { return num_records_; }
+
+    const Record& getRecord(std::uint64_t index) const { return records_[index]; }
+
+    /**
+     * Highest iface index plus one; computed from the records if the capture was not closed properly.
+     */
+    std::uint8_t getNumIfaces() const
+    {
+        if (header_->num_records != 0)
+        {
+            return header_->num_ifaces;
+        }
+        std::uint8_t out = 0;
+        for (std::uint64_t i = 0; i < num_records_; i++)
+        {
+            out = std::max<std::uint8_t>(out, std::uint8_t(records_[i].iface_index + 1U));
+        }
+        return out;
+    }
+
+    bool hasIndex() const { return index_entries_ != nullptr; }
+
+    unsigned getNumIndexEntries() const { return hasIndex() ? index_header_->num_entries : 0; }
+
+    const IndexEntry& getIndexEntry(unsigned index) const { return index_entries_[index]; }
+
+    /**
+     * Returns the numbers of the records that contain frames of the specified data type,
+     * or nullptr if there are none or if the index is not available.
+     */
+    const std::uint32_t* findRecordsOfDataType(uavcan::DataTypeKind kind,
+                                               std::uint16_t data_type_id,
+                                               std::uint32_t& out_num_records) const
+    {
+        out_num_records = 0;
+        for (unsigned i = 0; i < getNumIndexEntries(); i++)
+        {
+            const IndexEntry& e = index_entries_[i];
+            if ((e.kind == kind) && (e.data_type_id == data_type_id))
+            {
+                out_num_records = e.num_records;
+                return reinterpret_cast<const std::uint32_t*>(data_ + e.records_offset);
+            }
+        }
+        return nullptr;
+    }
+};
+
+/**
+ * System clock for replays. It runs SpeedFactor times faster than real time, starting from the monotonic
+ * timestamp of the first record, so that the node under test sees the same time base as the recorded frames.
+ * UTC runs at the same rate, starting from the UTC timestamp of the first record.
+ */
+class ReplayClock : public uavcan::ISystemClock,
+                    uavcan::Noncopyable
+{
+    const uavcan::ISystemClock& real_clock_;
+    const double speed_factor_;
+    const uavcan::MonotonicTime real_start_;
+    const uavcan::MonotonicTime replay_start_mono_;
+    uavcan::UtcTime replay_start_utc_;
+
+    std::uint64_t getElapsedReplayUSec() const
+    {
+        const std::int64_t real_elapsed = (real_clock_.getMonotonic() - real_start_).toUSec();
+        return std::uint64_t(double(real_elapsed) * speed_factor_);
+    }
+
+public:
+    ReplayClock(const uavcan::ISystemClock& real_clock,
+                double speed_factor,
+                uavcan::MonotonicTime replay_start_mono,
+                uavcan::UtcTime replay_start_utc) :
+        real_clock_(real_clock),
+        speed_factor_(speed_factor),
+        real_start_(real_clock.getMonotonic()),
+        replay_start_mono_(replay_start_mono),
+        replay_start_utc_(replay_start_utc)
+    { }
+
+    uavcan::MonotonicTime getMonotonic() const override
+    {
+        return replay_start_mono_ + uavcan::MonotonicDuration::fromUSec(std::int64_t(getElapsedReplayUSec()));
+    }
+
+    uavcan::UtcTime getUtc() const override
+    {
+        return replay_start_utc_ + uavcan::UtcDuration::fromUSec(std::int64_t(getElapsedReplayUSec()));
+    }
+
+    /**
+     * Adjustments are applied to the replayed UTC only; the real clock is never touched.
+     */
+    void adjustUtc(uavcan::UtcDuration adjustment) override { replay_start_utc_ += adjustment; }
+
+    /**
+     * Converts a duration of the replay time into the real time.
+     */
+    uavcan::MonotonicDuration toRealDuration(uavcan::MonotonicDuration replay_duration) const
+    {
+        return uavcan::MonotonicDuration::fromUSec(std::int64_t(double(replay_duration.toUSec()) / speed_factor_));
+    }
+};
+
+/**
+ * One interface of the replay driver.
+ * It receives the frames that the driver assigns to it; the frames sent by the node under test are discarded,
+ * except for loopback frames, which are received back, like a real driver would do.
+ */
+class ReplayIface final : public uavcan::ICanIface,
+                          uavcan::Noncopyable
+{
+    struct RxItem
+    {
+        uavcan::CanRxFrame frame;
+        uavcan::CanIOFlags flags = 0;
+    };
+
+    const uavcan::ISystemClock& clock_;
+    const Record* pending_ = nullptr;           ///< The next record, if it belongs to this iface and is due
+    std::deque<RxItem> loopback_;
+    std::uint64_t num_tx_frames_ = 0;
+
+    std::uint32_t filter_ids_[uavcan::MaxCanAcceptanceFilters] = {};
+    std::uint32_t filter_masks_[uavcan::MaxCanAcceptanceFilters] = {};
+    std::uint16_t num_filters_ = 0;             ///< Zero means that all frames are accepted
+
+    std::int16_t send(const uavcan::CanFrame& frame, uavcan::MonotonicTime, uavcan::CanIOFlags flags) override
+    {
+        num_tx_frames_++;
+        if (flags & uavcan::CanIOFlagLoopback)
+        {
+            RxItem item;
+            static_cast<uavcan::CanFrame&>(item.frame) = frame;
+            item.frame.ts_mono = clock_.getMonotonic();
+            item.frame.ts_utc = clock_.getUtc();
+            item.flags = flags;
+            loopback_.push_back(item);
+        }
+        return 1;
+    }
+
+    std::int16_t receive(uavcan::CanFrame& out_frame,
+                         uavcan::MonotonicTime& out_ts_monotonic,
+                         uavcan::UtcTime& out_ts_utc,
+                         uavcan::CanIOFlags& out_flags) override
+    {
+        RxItem item;
+        if (!loopback_.empty())
+        {
+            item = loopback_.front();
+            loopback_.pop_front();
+        }
+        else if (pending_ != nullptr)
+        {
+            item.frame = pending_->toCanRxFrame();
+            item.flags = pending_->flags;
+            pending_ = nullptr;
+        }
+        else
+        {
+            return 0;
+        }
+
+        out_frame = item.frame;
+        out_ts_monotonic = item.frame.ts_mono;
+        out_ts_utc = item.frame.ts_utc;
+        out_flags = item.flags;
+        return 1;
+    }
+
+    std::int16_t configureFilters(const uavcan::CanFilterConfig* filter_configs,
+                                  std::uint16_t num_configs) override
+    {
+        if ((num_configs > uavcan::MaxCanAcceptanceFilters) || ((num_configs > 0) && (filter_configs == nullptr)))
+        {
+            return -uavcan::ErrInvalidParam;
+        }
+        for (std::uint16_t i = 0; i < num_configs; i++)
+        {
+            filter_ids_[i] = filter_configs[i].id;
+            filter_masks_[i] = filter_configs[i].mask;
+        }
+        num_filters_ = num_configs;
+        return 0;
+    }
+
+    std::uint16_t getNumFilters() const override { return uavcan::MaxCanAcceptanceFilters; }
+
+    std::uint64_t getErrorCount() const override { return 0; }
+
+public:
+    explicit ReplayIface(const uavcan::ISystemClock& clock) : clock_(clock) { }
+
+    bool isAcceptedByFilters(const Record& record) const
+    {
+        bool accepted = (num_filters_ == 0);
+        for (std::uint16_t i = 0; !accepted && (i < num_filters_); i++)
+        {
+            accepted = (record.can_id & filter_masks_[i]) == (filter_ids_[i] & filter_masks_[i]);
+        }
+        return accepted;
+    }
+
+    void setPendingRecord(const Record* record) { pending_ = record; }
+
+    bool hasDataInRxQueue() const { return (pending_ != nullptr) || !loopback_.empty(); }
+
+    std::uint64_t getNumTxFrames() const { return num_tx_frames_; }
+};
+
+/**
+ * Virtual CAN driver that replays a capture into the node under test.
+ * The node must use the ReplayClock that is passed to the driver, so that the recorded timestamps are consistent
+ * with the time the node observes.
+ *
+ * The frames are released in the order of the capture as soon as the replay time reaches their monotonic
+ * timestamps; the driver sleeps in select() until then, so that the timers of the node under test fire as if
+ * the node were running on the real bus, only faster.
+ */
+class ReplayDriver final : public uavcan::ICanDriver,
+                           uavcan::Noncopyable
+{
+    const CaptureReader& reader_;
+    const ReplayClock& clock_;
+    uavcan::LazyConstructor<ReplayIface> ifaces_[uavcan::MaxCanIfaces];
+    const unsigned num_ifaces_;
+    std::uint64_t next_record_ = 0;
+    std::uint64_t num_filtered_out_ = 0;
+
+    /**
+     * Hands the next due record over to its iface, unless it is still holding the previous one.
+     * Records that are rejected by the acceptance filters of their iface, or that belong to an iface that is
+     * not replayed, are skipped.
+     */
+    void advance(uavcan::MonotonicTime now)
+    {
+        while (next_record_ < reader_.getNumRecords())
+        {
+            const Record& record = reader_.getRecord(next_record_);
+            if (record.ts_mono_usec > now.toUSec())
+            {
+                break;
+            }
+
+            if ((record.iface_index >= num_ifaces_) || !ifaces_[record.iface_index]->isAcceptedByFilters(record))
+            {
+                num_filtered_out_++;
+                next_record_++;
+                continue;
+            }
+            ReplayIface& iface = *ifaces_[record.iface_index];
+            if (iface.hasDataInRxQueue())
+            {
+                break;                          // Keeping the RX order across ifaces
+            }
+            iface.setPendingRecord(&record);
+            next_record_++;
+            break;
+        }
+    }
+
+    uavcan::ICanIface* getIface(std::uint8_t iface_index) override
+    {
+        return (iface_index < num_ifaces_) ? ifaces_[iface_index].operator ReplayIface*() : nullptr;
+    }
+
+    std::uint8_t getNumIfaces() const override { return std::uint8_t(num_ifaces_); }
+
+    std::int16_t select(uavcan::CanSelectMasks& inout_masks,
+                        const uavcan::CanFrame* (&)[uavcan::MaxCanIfaces],
+                        uavcan::MonotonicTime blocking_deadline) override
+    {
+        advance(clock_.getMonotonic());
+
+        bool need_block = (inout_masks.write == 0);    // Write queue is infinite
+        for (unsigned i = 0; need_block && (i < num_ifaces_); i++)
+        {
+            const bool need_read = inout_masks.read & (1U << i);
+            if (need_read && ifaces_[i]->hasDataInRxQueue())
+            {
+                need_block = false;
+            }
+        }
+
+        if (need_block)
+        {
+            // Sleeping until the next record is due or the deadline expires, whichever comes first
+            uavcan::MonotonicTime wake_up_at = blocking_deadline;
+            if (!isFinished())
+            {
+                const auto next_ts = uavcan::MonotonicTime::fromUSec(reader_.getRecord(next_record_).ts_mono_usec);
+                wake_up_at = (next_ts < wake_up_at) ? next_ts : wake_up_at;
+            }
+            const auto now = clock_.getMonotonic();
+            if (wake_up_at > now)
+            {
+                ::usleep(useconds_t(clock_.toRealDuration(wake_up_at - now).toUSec()));
+            }
+            advance(clock_.getMonotonic());
+        }
+
+        inout_masks = uavcan::CanSelectMasks();
+        for (unsigned i = 0; i < num_ifaces_; i++)
+        {
+            const std::uint8_t iface_mask = std::uint8_t(1U << i);
+            inout_masks.write |= iface_mask;           // Always ready to write
+            if (ifaces_[i]->hasDataInRxQueue())
+            {
+                inout_masks.read |= iface_mask;
+            }
+        }
+
+        return std::int16_t(num_ifaces_);
+    }
+
+public:
+    /**
+     * @param reader        An open capture; it must outlive the driver.
+     *
+     * @param clock         The clock that is used by the node under test.
+     *
+     * @param num_ifaces    Number of ifaces to replay; frames recorded on other ifaces are skipped.
+     *                      Normally it should be reader.getNumIfaces().
+     */
+    ReplayDriver(const CaptureReader& reader, const ReplayClock& clock, unsigned num_ifaces) :
+        reader_(reader),
+        clock_(clock),
+        num_ifaces_(std::min<unsigned>(std::max(num_ifaces, 1U), uavcan::MaxCanIfaces))
+    {
+        for (unsigned i = 0; i < num_ifaces_; i++)
+        {
+            ifaces_[i].construct<const uavcan::ISystemClock&>(clock_);
+        }
+    }
+
+    /**
+     * True after the last record has been released to the node.
+     */
+    bool isFinished() const { return next_record_ >= reader_.getNumRecords(); }
+
+    std::uint64_t getNumReplayedRecords() const { return next_record_; }
+
+    std::uint64_t getNumFilteredOutRecords() const { return num_filtered_out_; }
+
+    std::uint64_t getNumTxFrames() const
+    {
+        std::uint64_t out = 0;
+        for (unsigned i = 0; i < num_ifaces_; i++)
+        {
+            out += ifaces_[i]->getNumTxFrames();
+        }
+        return out;
+    }
+};
+
+}
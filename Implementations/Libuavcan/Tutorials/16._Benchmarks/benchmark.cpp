@@ -0,0 +1,806 @@
+/*
+ * This program runs pairs of libuavcan nodes under fixed load profiles, and prints the results in CSV format,
+ * one metric per row, so that the results obtained with different versions of the library can be compared
+ * automatically (see compare_benchmark_results.sh).
+ *
+ * The nodes of every pair run in different threads of this process. They are connected either via the virtual bus
+ * (see virtual_can_bus.hpp), which doesn't need any setup and gives the most repeatable results, or via a SocketCAN
+ * interface, in which case the kernel is included in the measurements.
+ *
+ * Usage: ./benchmark <virtual[:bit-rate]|iface-name> [scenario...] > results.csv
+ * For example:
+ *   ./benchmark virtual                    # Virtual bus at 1 Mbit/s, all scenarios
+ *   ./benchmark virtual:0 pubsub service   # Virtual bus with infinite bit rate, only two scenarios
+ *   ./benchmark vcan0                      # Virtual SocketCAN interface; make sure no other nodes are using it
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+#include <uavcan/uavcan.hpp>
+#include <uavcan/node/sub_node.hpp>
+#include <uavcan/protocol/debug/KeyValue.hpp>
+#include <uavcan/protocol/file/Read.hpp>
+#include <uavcan/protocol/file_server.hpp>
+#include <uavcan/protocol/GetNodeInfo.hpp>
+#include <uavcan/transport/can_acceptance_filter_configurator.hpp>
+#include <uavcan_linux/uavcan_linux.hpp>
+
+#include "virtual_can_bus.hpp"
+
+/*
+ * The nodes of the scenarios are the same as in the other tutorials; these headers are reused from there.
+ */
+#include "../11._Firmware_update/caching_file_server_backend.hpp"
+#include "../12._Multithreading/uavcan_virtual_driver.hpp"
+
+constexpr unsigned NodeMemoryPoolSize = 65536;
+typedef uavcan::Node<NodeMemoryPoolSize> Node;
+typedef uavcan::SubNode<NodeMemoryPoolSize> SubNode;
+
+/*
+ * Load profiles. They must not be changed, otherwise the results will not be comparable with the older ones.
+ */
+struct PubSubProfile
+{
+    const char* name;
+    unsigned key_length;                ///< Length of the key of uavcan.protocol.debug.KeyValue defines the frame count
+    unsigned rate_hz;
+    unsigned num_messages;
+};
+
+constexpr PubSubProfile PubSubSingleFrame { "pubsub", 1, 1000, 5000 };         // 1 frame per message
+constexpr PubSubProfile PubSubMultiFrame { "pubsub_multiframe", 40, 200, 1000 }; // 7 frames per message
+constexpr PubSubProfile MultithreadedProfile { "multithreaded", 1, 1000, 5000 };
+
+constexpr unsigned ServiceNumCalls = 2000;                                     // uavcan.protocol.GetNodeInfo
+
+constexpr unsigned FirmwareImageSize = 256 * 1024;
+constexpr unsigned FirmwareReadWindowSize = 8;                                 // As in the tutorial on updates
+
+/**
+ * After the load is over, the nodes are given this much time to deliver the rest of the transfers.
+ */
+const auto GracePeriod = std::chrono::milliseconds(500);
+
+static uavcan_linux::SystemClock& getClock()
+{
+    static uavcan_linux::SystemClock clock;
+    return clock;
+}
+
+/**
+ * Creates the CAN drivers of the nodes according to the command line.
+ */
+class Transport
+{
+    static constexpr std::uint32_t DefaultVirtualBusBitRate = 1000000;
+
+    std::string iface_name_;
+    std::unique_ptr<virtual_can_bus::Bus> bus_;
+
+public:
+    explicit Transport(const std::string& spec)
+    {
+        const std::string prefix = "virtual:";
+        if (spec == "virtual")
+        {
+            bus_.reset(new virtual_can_bus::Bus(getClock(), DefaultVirtualBusBitRate));
+        }
+        else if (spec.compare(0, prefix.size(), prefix) == 0)
+        {
+            const std::uint32_t bit_rate = std::uint32_t(std::stoul(spec.substr(prefix.size())));
+            bus_.reset(new virtual_can_bus::Bus(getClock(), bit_rate));
+        }
+        else
+        {
+            iface_name_ = spec;
+        }
+    }
+
+    std::unique_ptr<uavcan::ICanDriver> makeDriver()
+    {
+        if (bus_)
+        {
+            return std::unique_ptr<uavcan::ICanDriver>(new virtual_can_bus::Driver(*bus_));
+        }
+        std::unique_ptr<uavcan_linux::SocketCanDriver> driver(new uavcan_linux::SocketCanDriver(getClock()));
+        const int res = driver->addIface(iface_name_);
+        if (res < 0)
+        {
+            throw std::runtime_error("Failed to add iface " + iface_name_ + ": " + std::to_string(res));
+        }
+        return std::unique_ptr<uavcan::ICanDriver>(driver.release());
+    }
+
+    /**
+     * Frames transmitted by all nodes so far; only the virtual bus can count them.
+     */
+    std::uint64_t getNumFrames() const { return bus_ ? bus_->getNumFrames() : 0; }
+
+    virtual_can_bus::Bus* getVirtualBus() const { return bus_.get(); }
+};
+
+/**
+ * Prints the results as CSV. The last column tells whether higher or lower values are better.
+ */
+class ResultWriter
+{
+    std::ostream& out_;
+
+public:
+    explicit ResultWriter(std::ostream& out) : out_(out)
+    {
+        out_ << "scenario,metric,value,unit,better" << std::endl;
+    }
+
+    void add(const std::string& scenario, const std::string& metric, double value, const char* unit,
+             const char* better)
+    {
+        out_ << scenario << "," << metric << "," << value << "," << unit << "," << better << std::endl;
+        std::cerr << "  " << metric << ": " << value << " " << unit << std::endl;
+    }
+
+    /**
+     * Latency percentiles, in microseconds.
+     */
+    void addLatency(const std::string& scenario, const std::string& metric, std::vector<std::uint64_t> samples_usec)
+    {
+        if (samples_usec.empty())
+        {
+            return;
+        }
+        std::sort(samples_usec.begin(), samples_usec.end());
+        const auto percentile = [&samples_usec](double p)    // Nearest-rank method
+        {
+            const auto rank = std::size_t(std::ceil(p * double(samples_usec.size())));
+            return double(samples_usec[std::max<std::size_t>(rank, 1) - 1]);
+        };
+        add(scenario, metric + "_p50", percentile(0.5), "us", "lower");
+        add(scenario, metric + "_p99", percentile(0.99), "us", "lower");
+        add(scenario, metric + "_p999", percentile(0.999), "us", "lower");
+        add(scenario, metric + "_max", double(samples_usec.back()), "us", "lower");
+    }
+
+    template <typename NodeType>
+    void addPoolUsage(const std::string& scenario, const std::string& node_name, NodeType& node)
+    {
+        add(scenario, node_name + "_pool_peak", double(node.getAllocator().getPeakNumUsedBlocks() *
+                                                       uavcan::MemPoolBlockSize), "bytes", "lower");
+    }
+};
+
+/**
+ * Spins every node in its own thread until stopped, and measures the CPU time of the process meanwhile.
+ */
+class NodeThreads
+{
+    std::atomic<bool> stop_;
+    std::vector<std::thread> threads_;
+    std::chrono::steady_clock::time_point started_at_;
+    std::clock_t cpu_started_at_ = 0;
+    double elapsed_sec_ = 0;
+    double cpu_sec_ = 0;
+
+public:
+    NodeThreads() : stop_(false) { }
+
+    ~NodeThreads() { stop(); }
+
+    template <typename NodeType>
+    void add(NodeType& node)
+    {
+        threads_.emplace_back([this, &node]()
+            {
+                while (!stop_)
+                {
+                    const int res = node.spin(uavcan::MonotonicDuration::fromMSec(10));
+                    if (res < 0)
+                    {
+                        std::cerr << "Transient failure: " << res << std::endl;
+                    }
+                }
+            });
+    }
+
+    /**
+     * The function will be invoked from a separate thread repeatedly until the threads are stopped.
+     */
+    void addLoop(std::function<void ()> function)
+    {
+        threads_.emplace_back([this, function]()
+            {
+                while (!stop_)
+                {
+                    function();
+                }
+            });
+    }
+
+    void startMeasurement()
+    {
+        started_at_ = std::chrono::steady_clock::now();
+        cpu_started_at_ = std::clock();
+    }
+
+    /**
+     * Waits until the condition is true or the timeout expires, then waits for the grace period.
+     * Returns false on timeout.
+     */
+    bool waitFor(std::function<bool ()> condition, std::chrono::steady_clock::duration timeout)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!condition() && (std::chrono::steady_clock::now() < deadline))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        const bool finished = condition();
+        elapsed_sec_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_at_).count();
+        cpu_sec_ = double(std::clock() - cpu_started_at_) / CLOCKS_PER_SEC;
+        std::this_thread::sleep_for(GracePeriod);
+        return finished;
+    }
+
+    void stop()
+    {
+        stop_ = true;
+        for (auto& t : threads_)
+        {
+            if (t.joinable())
+            {
+                t.join();
+            }
+        }
+        threads_.clear();
+    }
+
+    double getElapsedSec() const { return elapsed_sec_; }
+
+    /**
+     * CPU time of all threads of the process, as a percentage of one core.
+     */
+    double getCpuPercent() const { return (elapsed_sec_ > 0) ? (100.0 * cpu_sec_ / elapsed_sec_) : 0.0; }
+};
+
+static std::unique_ptr<Node> makeNode(uavcan::ICanDriver& driver, std::uint8_t node_id, const char* name)
+{
+    std::unique_ptr<Node> node(new Node(driver, getClock()));
+    node->setNodeID(node_id);
+    node->setName(name);
+    const int res = node->start();
+    if (res < 0)
+    {
+        throw std::runtime_error("Failed to start the node " + std::string(name) + ": " + std::to_string(res));
+    }
+    node->setModeOperational();
+    return node;
+}
+
+static std::uint64_t getMonotonicUSec()
+{
+    return getClock().getMonotonic().toUSec();
+}
+
+/**
+ * The publisher broadcasts uavcan.protocol.debug.KeyValue at a fixed rate, the value being the sequence number.
+ * The latency is measured from the moment before the message is broadcast till the moment the subscription callback
+ * is invoked, so it includes serialization, the TX queue, the bus, reassembly of the transfer and deserialization.
+ *
+ * It keeps the number of messages published so far, and the publication times.
+ */
+class KeyValueSource
+{
+    const PubSubProfile& profile_;
+    uavcan::Publisher<uavcan::protocol::debug::KeyValue> publisher_;
+    uavcan::Timer timer_;
+    std::vector<std::uint64_t> published_at_usec_;
+    std::atomic<unsigned> num_published_;
+
+public:
+    KeyValueSource(uavcan::INode& node, const PubSubProfile& profile) :
+        profile_(profile),
+        publisher_(node),
+        timer_(node),
+        published_at_usec_(profile.num_messages),
+        num_published_(0)
+    {
+        const int res = publisher_.init();
+        if (res < 0)
+        {
+            throw std::runtime_error("Failed to start the publisher: " + std::to_string(res));
+        }
+
+        timer_.setCallback([this](const uavcan::TimerEvent&)
+            {
+                const unsigned seq = num_published_;
+                if (seq >= profile_.num_messages)
+                {
+                    timer_.stop();
+                    return;
+                }
+                uavcan::protocol::debug::KeyValue msg;
+                msg.key = std::string(profile_.key_length, 'k').c_str();
+                msg.value = float(seq);             // Integers are exact in float32 up to 2^24
+                published_at_usec_[seq] = getMonotonicUSec();
+                const int res = publisher_.broadcast(msg);
+                if (res < 0)
+                {
+                    std::cerr << "Publication failure: " << res << std::endl;
+                }
+                num_published_ = seq + 1;
+            });
+    }
+
+    void start()
+    {
+        timer_.startPeriodic(uavcan::MonotonicDuration::fromUSec(1000000 / profile_.rate_hz));
+    }
+
+    unsigned getNumPublished() const { return num_published_; }
+
+    /**
+     * The message is transmitted after the sequence number is stored, so this is safe to call from the thread of
+     * the subscriber.
+     */
+    std::uint64_t getPublicationTimeUSec(unsigned seq) const { return published_at_usec_[seq]; }
+};
+
+/**
+ * Collects the messages published by @ref KeyValueSource.
+ */
+class KeyValueSink
+{
+    uavcan::Subscriber<uavcan::protocol::debug::KeyValue> subscriber_;
+    std::vector<std::uint64_t> latencies_usec_;
+    std::atomic<unsigned> num_received_;
+
+public:
+    KeyValueSink(uavcan::INode& node, const KeyValueSource& source, const PubSubProfile& profile) :
+        subscriber_(node),
+        num_received_(0)
+    {
+        latencies_usec_.reserve(profile.num_messages);
+        const int res = subscriber_.start(
+            [this, &source, &profile](const uavcan::protocol::debug::KeyValue& msg)
+            {
+                const auto now = getMonotonicUSec();
+                const unsigned seq = unsigned(msg.value);
+                if (seq < profile.num_messages)
+                {
+                    latencies_usec_.push_back(now - source.getPublicationTimeUSec(seq));
+                }
+                num_received_++;
+            });
+        if (res < 0)
+        {
+            throw std::runtime_error("Failed to start the subscriber: " + std::to_string(res));
+        }
+    }
+
+    unsigned getNumReceived() const { return num_received_; }
+
+    /**
+     * Must be invoked once the thread of the node is stopped.
+     */
+    const std::vector<std::uint64_t>& getLatencies() const { return latencies_usec_; }
+};
+
+static void reportTransferStatistics(ResultWriter& results, const std::string& scenario, const NodeThreads& threads,
+                                     Transport& transport, std::uint64_t frames_before)
+{
+    results.add(scenario, "cpu", threads.getCpuPercent(), "percent", "lower");
+    if (transport.getVirtualBus() != nullptr)
+    {
+        results.add(scenario, "bus_frames", double(transport.getNumFrames() - frames_before), "frames", "lower");
+    }
+}
+
+/**
+ * Publisher and subscriber, each running in its own thread.
+ */
+static void runPubSub(ResultWriter& results, Transport& transport, const PubSubProfile& profile)
+{
+    const std::string scenario = profile.name;
+    std::cerr << scenario << ": " << profile.num_messages << " messages at " << profile.rate_hz << " Hz" << std::endl;
+
+    const auto publisher_driver = transport.makeDriver();
+    const auto subscriber_driver = transport.makeDriver();
+    const auto publisher_node = makeNode(*publisher_driver, 10, "org.uavcan.benchmark.publisher");
+    const auto subscriber_node = makeNode(*subscriber_driver, 11, "org.uavcan.benchmark.subscriber");
+
+    KeyValueSource source(*publisher_node, profile);
+    KeyValueSink sink(*subscriber_node, source, profile);
+
+    const auto frames_before = transport.getNumFrames();
+    NodeThreads threads;
+    threads.add(*publisher_node);
+    threads.add(*subscriber_node);
+    threads.startMeasurement();
+    source.start();
+
+    const auto expected_duration = std::chrono::milliseconds(1000ULL * profile.num_messages / profile.rate_hz);
+    (void)threads.waitFor([&]() { return sink.getNumReceived() >= profile.num_messages; }, expected_duration * 2);
+    threads.stop();
+
+    results.add(scenario, "received", sink.getNumReceived(), "messages", "higher");
+    results.add(scenario, "lost", source.getNumPublished() - std::min(source.getNumPublished(), sink.getNumReceived()),
+                "messages", "lower");
+    results.addLatency(scenario, "latency", sink.getLatencies());
+    reportTransferStatistics(results, scenario, threads, transport, frames_before);
+    results.addPoolUsage(scenario, "publisher", *publisher_node);
+    results.addPoolUsage(scenario, "subscriber", *subscriber_node);
+}
+
+/**
+ * The client calls uavcan.protocol.GetNodeInfo one call after another; the server is the standard one that every
+ * libuavcan node has.
+ */
+static void runService(ResultWriter& results, Transport& transport)
+{
+    const std::string scenario = "service";
+    std::cerr << scenario << ": " << ServiceNumCalls << " sequential calls of GetNodeInfo" << std::endl;
+
+    const auto server_driver = transport.makeDriver();
+    const auto client_driver = transport.makeDriver();
+    const auto server_node = makeNode(*server_driver, 20, "org.uavcan.benchmark.server");
+    const auto client_node = makeNode(*client_driver, 21, "org.uavcan.benchmark.client");
+
+    using uavcan::protocol::GetNodeInfo;
+    uavcan::ServiceClient<GetNodeInfo> client(*client_node);
+
+    std::vector<std::uint64_t> rtt_usec;
+    rtt_usec.reserve(ServiceNumCalls);
+    std::atomic<unsigned> num_completed(0);
+    unsigned num_failed = 0;
+    std::uint64_t called_at_usec = 0;
+
+    const auto call = [&]()
+    {
+        called_at_usec = getMonotonicUSec();
+        const int res = client.call(server_node->getNodeID(), GetNodeInfo::Request());
+        if (res < 0)
+        {
+            std::cerr << "Unable to perform service call: " << res << std::endl;  // The scenario will time out
+        }
+    };
+
+    /*
+     * The next call is never made from the callback of the client; it is made from a one-shot timer as soon as
+     * the client node gets back to its timers, the same way as in the firmware scenario.
+     */
+    uavcan::Timer call_timer(*client_node);
+    call_timer.setCallback([&](const uavcan::TimerEvent&) { call(); });
+
+    client.setCallback([&](const uavcan::ServiceCallResult<GetNodeInfo>& result)
+        {
+            if (result.isSuccessful())
+            {
+                rtt_usec.push_back(getMonotonicUSec() - called_at_usec);
+            }
+            else
+            {
+                num_failed++;
+            }
+            if (++num_completed < ServiceNumCalls)
+            {
+                call_timer.startOneShotWithDelay(uavcan::MonotonicDuration());
+            }
+        });
+
+    const auto frames_before = transport.getNumFrames();
+    NodeThreads threads;
+    threads.startMeasurement();
+    call();
+    threads.add(*server_node);
+    threads.add(*client_node);
+
+    (void)threads.waitFor([&]() { return num_completed >= ServiceNumCalls; }, std::chrono::seconds(60));
+    threads.stop();
+
+    results.add(scenario, "completed", num_completed, "calls", "higher");
+    results.add(scenario, "failed", num_failed, "calls", "lower");
+    results.add(scenario, "throughput", num_completed / threads.getElapsedSec(), "calls/s", "higher");
+    results.addLatency(scenario, "round_trip", rtt_usec);
+    reportTransferStatistics(results, scenario, threads, transport, frames_before);
+    results.addPoolUsage(scenario, "server", *server_node);
+    results.addPoolUsage(scenario, "client", *client_node);
+}
+
+/**
+ * The updatee reads a firmware image from the file server of the updater using uavcan.protocol.file.Read,
+ * keeping several requests in flight, like the updatee from the tutorial on firmware update does.
+ * The image is a temporary file with a known pattern, so that the received data can be verified.
+ */
+static void runFirmwareRead(ResultWriter& results, Transport& transport)
+{
+    const std::string scenario = "firmware";
+    std::cerr << scenario << ": reading " << FirmwareImageSize << " bytes, window " << FirmwareReadWindowSize
+              << std::endl;
+
+    using uavcan::protocol::file::Read;
+    const auto pattern = [](std::uint64_t offset) { return std::uint8_t((offset * 31U + 7U) & 0xFFU); };
+
+    char path[] = "/tmp/uavcan_benchmark_XXXXXX";
+    const int fd = ::mkstemp(path);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to create the image file");
+    }
+    {
+        std::vector<std::uint8_t> image(FirmwareImageSize);
+        for (unsigned i = 0; i < FirmwareImageSize; i++)
+        {
+            image[i] = pattern(i);
+        }
+        const bool written = ::write(fd, image.data(), image.size()) == ssize_t(image.size());
+        (void)::close(fd);
+        if (!written)
+        {
+            (void)::unlink(path);
+            throw std::runtime_error("Failed to write the image file");
+        }
+    }
+
+    const auto updater_driver = transport.makeDriver();
+    const auto updatee_driver = transport.makeDriver();
+    const auto updater_node = makeNode(*updater_driver, 30, "org.uavcan.benchmark.updater");
+    const auto updatee_node = makeNode(*updatee_driver, 31, "org.uavcan.benchmark.updatee");
+
+    uavcan_caching_file_server::CachingFileServerBackend file_server_backend;
+    uavcan::FileServer file_server(*updater_node, file_server_backend);
+    const int file_server_res = file_server.start();
+    if (file_server_res < 0)
+    {
+        throw std::runtime_error("Failed to start the file server: " + std::to_string(file_server_res));
+    }
+
+    struct Request
+    {
+        uavcan::ServiceCallID call_id;
+        std::uint64_t offset = 0;
+        std::uint64_t sent_at_usec = 0;
+        bool in_flight = false;
+    };
+    Request window[FirmwareReadWindowSize];
+    constexpr unsigned ChunkSize = Read::Response::FieldTypes::data::MaxSize;
+    std::uint64_t next_offset = 0;
+    std::atomic<std::uint64_t> num_bytes_received(0);
+    unsigned num_failed = 0;
+    unsigned num_corrupted = 0;
+    std::vector<std::uint64_t> rtt_usec;
+
+    uavcan::ServiceClient<Read> client(*updatee_node);
+
+    /*
+     * The requests are never sent from the callback of the client; they are queued and sent from a one-shot timer
+     * as soon as the node gets back to its timers, like the other clients in the tutorials do.
+     */
+    uavcan::Timer send_timer(*updatee_node);
+    std::vector<Request*> send_queue;
+
+    const auto send = [&](Request& request, std::uint64_t offset)
+    {
+        Read::Request req;
+        req.path.path = path;
+        req.offset = offset;
+        request.offset = offset;
+        request.sent_at_usec = getMonotonicUSec();
+        const int res = client.call(updater_node->getNodeID(), req, request.call_id);
+        if (res < 0)
+        {
+            std::cerr << "Read call failed: " << res << std::endl;             // The scenario will time out
+            return;
+        }
+        request.in_flight = true;
+    };
+
+    const auto scheduleSend = [&](Request& request, std::uint64_t offset)
+    {
+        request.offset = offset;
+        send_queue.push_back(&request);
+        send_timer.startOneShotWithDelay(uavcan::MonotonicDuration());
+    };
+
+    send_timer.setCallback([&](const uavcan::TimerEvent&)
+        {
+            std::vector<Request*> requests;
+            requests.swap(send_queue);
+            for (auto r : requests)
+            {
+                send(*r, r->offset);
+            }
+        });
+
+    client.setCallback([&](const uavcan::ServiceCallResult<Read>& result)
+        {
+            Request* request = nullptr;
+            for (auto& r : window)
+            {
+                if (r.in_flight && (r.call_id == result.getCallID()))
+                {
+                    request = &r;
+                }
+            }
+            if (request == nullptr)
+            {
+                return;
+            }
+            request->in_flight = false;
+
+            if (!result.isSuccessful() || (result.getResponse().error.value != 0))
+            {
+                num_failed++;
+                scheduleSend(*request, request->offset);    // Retrying the same chunk
+                return;
+            }
+
+            rtt_usec.push_back(getMonotonicUSec() - request->sent_at_usec);
+            const auto& data = result.getResponse().data;
+            for (unsigned i = 0; i < data.size(); i++)
+            {
+                if (data[i] != pattern(request->offset + i))
+                {
+                    num_corrupted++;
+                    break;
+                }
+            }
+            num_bytes_received += data.size();
+
+            if (next_offset < FirmwareImageSize)
+            {
+                scheduleSend(*request, next_offset);
+                next_offset += ChunkSize;
+            }
+        });
+
+    const auto frames_before = transport.getNumFrames();
+    NodeThreads threads;
+    threads.startMeasurement();
+    for (auto& request : window)
+    {
+        send(request, next_offset);
+        next_offset += ChunkSize;
+    }
+    threads.add(*updater_node);
+    threads.add(*updatee_node);
+
+    (void)threads.waitFor([&]() { return num_bytes_received >= FirmwareImageSize; }, std::chrono::seconds(120));
+    threads.stop();
+    (void)::unlink(path);
+
+    results.add(scenario, "received", double(num_bytes_received), "bytes", "higher");
+    results.add(scenario, "failed", num_failed, "requests", "lower");
+    results.add(scenario, "corrupted", num_corrupted, "requests", "lower");
+    results.add(scenario, "throughput", double(num_bytes_received) / threads.getElapsedSec(), "bytes/s", "higher");
+    results.addLatency(scenario, "read_round_trip", rtt_usec);
+    reportTransferStatistics(results, scenario, threads, transport, frames_before);
+    results.addPoolUsage(scenario, "updater", *updater_node);
+    results.addPoolUsage(scenario, "updatee", *updatee_node);
+}
+
+/**
+ * The subscriber runs in a sub-node, in a separate thread of the receiving node, as shown in the tutorial on
+ * multithreading. So the latency includes the virtual driver between the main node and the sub-node.
+ */
+static void runMultithreaded(ResultWriter& results, Transport& transport, const PubSubProfile& profile)
+{
+    const std::string scenario = profile.name;
+    std::cerr << scenario << ": " << profile.num_messages << " messages at " << profile.rate_hz
+              << " Hz to a sub-node" << std::endl;
+
+    const auto publisher_driver = transport.makeDriver();
+    const auto main_driver = transport.makeDriver();
+    const auto publisher_node = makeNode(*publisher_driver, 40, "org.uavcan.benchmark.publisher");
+    const auto main_node = makeNode(*main_driver, 41, "org.uavcan.benchmark.main_node");
+
+    uavcan_virtual_driver::Driver<128> virtual_driver(main_driver->getNumIfaces(), getClock());
+    SubNode sub_node(virtual_driver, getClock());
+    sub_node.setNodeID(main_node->getNodeID());
+    main_node->getDispatcher().installRxFrameListener(&virtual_driver);
+    uavcan_virtual_driver::ITxQueueInjector& tx_injector = virtual_driver;
+
+    KeyValueSource source(*publisher_node, profile);
+    KeyValueSink sink(sub_node, source, profile);
+
+    /*
+     * The main node will only copy the frames of the subscription into the queues of the sub-node.
+     */
+    const int filter_res = uavcan::configureCanAcceptanceFilters(sub_node);
+    if (filter_res < 0)
+    {
+        throw std::runtime_error("Failed to configure acceptance filters; error: " + std::to_string(filter_res));
+    }
+
+    const auto frames_before = transport.getNumFrames();
+    NodeThreads threads;
+    threads.add(*publisher_node);
+    threads.addLoop([&]()
+        {
+            // The sub-node doesn't publish anything, so a fallback polling period is enough for the TX injection
+            const int res = main_node->spin(uavcan::MonotonicDuration::fromMSec(10));
+            if (res < 0)
+            {
+                std::cerr << "Transient failure: " << res << std::endl;
+            }
+            tx_injector.injectTxFramesInto(*main_node);
+        });
+    threads.add(sub_node);
+    threads.startMeasurement();
+    source.start();
+
+    const auto expected_duration = std::chrono::milliseconds(1000ULL * profile.num_messages / profile.rate_hz);
+    (void)threads.waitFor([&]() { return sink.getNumReceived() >= profile.num_messages; }, expected_duration * 2);
+    threads.stop();
+    main_node->getDispatcher().installRxFrameListener(nullptr);
+
+    results.add(scenario, "received", sink.getNumReceived(), "messages", "higher");
+    results.add(scenario, "lost", source.getNumPublished() - std::min(source.getNumPublished(), sink.getNumReceived()),
+                "messages", "lower");
+    results.add(scenario, "virtual_driver_overflows", double(virtual_driver.getRxQueueOverflowCount()), "frames",
+                "lower");
+    results.addLatency(scenario, "latency", sink.getLatencies());
+    reportTransferStatistics(results, scenario, threads, transport, frames_before);
+    results.addPoolUsage(scenario, "publisher", *publisher_node);
+    results.addPoolUsage(scenario, "main_node", *main_node);
+    results.addPoolUsage(scenario, "sub_node", sub_node);
+}
+
+int main(int argc, const char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <virtual[:bit-rate]|iface-name> [scenario...]\n"
+                  << "Scenarios: pubsub pubsub_multiframe service firmware multithreaded (default: all)" << std::endl;
+        return 1;
+    }
+
+    Transport transport(argv[1]);
+    std::vector<std::string> scenarios(argv + 2, argv + argc);
+    if (scenarios.empty())
+    {
+        scenarios = { "pubsub", "pubsub_multiframe", "service", "firmware", "multithreaded" };
+    }
+
+    ResultWriter results(std::cout);
+
+    for (auto& s : scenarios)
+    {
+        if (s == PubSubSingleFrame.name)
+        {
+            runPubSub(results, transport, PubSubSingleFrame);
+        }
+        else if (s == PubSubMultiFrame.name)
+        {
+            runPubSub(results, transport, PubSubMultiFrame);
+        }
+        else if (s == "service")
+        {
+            runService(results, transport);
+        }
+        else if (s == "firmware")
+        {
+            runFirmwareRead(results, transport);
+        }
+        else if (s == MultithreadedProfile.name)
+        {
+            runMultithreaded(results, transport, MultithreadedProfile);
+        }
+        else
+        {
+            std::cerr << "Unknown scenario: " << s << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+#!/bin/bash
+#
+# Compares two result files produced by the benchmark, e.g. before and after an upgrade of libuavcan.
+# Prints every metric that got worse by more than the tolerance, and exits with a non-zero status if there are any.
+#
+# Usage: ./compare_benchmark_results.sh <baseline.csv> <current.csv> [tolerance-percent=10]
+#
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 <baseline.csv> <current.csv> [tolerance-percent=10]" >&2
+    exit 2
+fi
+
+baseline=$1
+current=$2
+tolerance=${3:-10}
+
+awk -F, -v tolerance="$tolerance" '
+    FNR == 1 { next }                                   # Header
+    NR == FNR { baseline[$1 "," $2] = $3; next }
+    {
+        key = $1 "," $2
+        if (!(key in baseline)) {
+            printf "%-36s new metric: %s %s\n", key, $3, $4
+            next
+        }
+        old = baseline[key]
+        new = $3
+        delete baseline[key]
+        # Zero baselines (e.g. the number of lost messages) are compared against the tolerance itself
+        reference = (old < 0 ? -old : old)
+        if (reference == 0) { reference = 1 }
+        change = 100 * (new - old) / reference
+        worse = ($5 == "higher") ? -change : change
+        status = "ok"
+        if (worse > tolerance) { status = "REGRESSION"; num_regressions++ }
+        printf "%-36s %14g -> %-14g %-9s %+8.1f%%  %s\n", key, old, new, $4, change, status
+    }
+    END {
+        for (key in baseline) {
+            printf "%-36s missing in the current results\n", key
+            num_regressions++
+        }
+        if (num_regressions > 0) {
+            printf "%d regression(s) found\n", num_regressions
+            exit 1
+        }
+        print "No regressions found"
+    }
+' "$baseline" "$current"
@@ -0,0 +1,321 @@
+/**
+ * This header implements a virtual CAN bus that connects several libuavcan nodes within one process.
+ * Every node gets its own driver with one interface; a frame sent by one node is received by all the other nodes,
+ * and by the sender itself if loopback was requested, just like on a real bus.
+ *
+ * The bus can emulate the CAN bit rate: the frames are transmitted one after another, every frame occupying the bus
+ * for the time needed to transmit its bits (bit stuffing is not accounted for), and the receivers get the frame
+ * when its transmission is finished. Every driver has three TX mailboxes, like a typical CAN controller, so the
+ * rest of the outgoing frames wait in the prioritized TX queue of the library. Arbitration between the nodes is not
+ * emulated; the frames are transmitted in the order in which they were sent.
+ *
+ * The nodes may run in different threads; all methods are thread-safe.
+ *
+ * @file virtual_can_bus.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <algorithm>            // For std::max(), std::min()
+#include <chrono>               // For std::chrono::microseconds
+#include <condition_variable>   // For std::condition_variable
+#include <deque>                // For std::deque, used by the RX queues
+#include <mutex>                // For std::mutex
+#include <vector>               // For std::vector
+#include <uavcan/uavcan.hpp>    // Main libuavcan header
+
+namespace virtual_can_bus
+{
+class Driver;
+
+/**
+ * The bus, shared by all drivers.
+ */
+class Bus : uavcan::Noncopyable
+{
+    friend class Driver;
+
+    uavcan::ISystemClock& clock_;
+    const std::uint32_t bit_rate_;
+    std::mutex mutex_;
+    std::condition_variable activity_;
+    std::vector<Driver*> drivers_;
+    uavcan::MonotonicTime idle_since_;              ///< When the last frame on the bus ends
+    std::uint64_t num_frames_ = 0;
+    std::uint64_t busy_usec_ = 0;
+
+    /**
+     * The length of an extended data frame is 67 bits plus payload, including the interframe space;
+     * that of a base frame is 47 bits plus payload.
+     */
+    uavcan::MonotonicDuration computeFrameDuration(const uavcan::CanFrame& frame) const
+    {
+        if (bit_rate_ == 0)
+        {
+            return uavcan::MonotonicDuration();
+        }
+        const std::uint64_t num_bits = (frame.isExtended() ? 67U : 47U) + 8U * frame.dlc;
+        return uavcan::MonotonicDuration::fromUSec(std::int64_t((num_bits * 1000000U + bit_rate_ - 1) / bit_rate_));
+    }
+
+    inline uavcan::MonotonicTime transmit(const Driver& sender, const uavcan::CanFrame& frame,
+                                          uavcan::CanIOFlags flags);
+
+public:
+    /**
+     * @param clock         The clock of the nodes.
+     * @param bit_rate      Bit rate to emulate; zero means that the frames are delivered immediately.
+     */
+    Bus(uavcan::ISystemClock& clock, std::uint32_t bit_rate) :
+        clock_(clock),
+        bit_rate_(bit_rate)
+    { }
+
+    std::uint32_t getBitRate() const { return bit_rate_; }
+
+    std::uint64_t getNumFrames()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return num_frames_;
+    }
+
+    /**
+     * Total time during which the bus was transmitting; zero if the bit rate is not emulated.
+     */
+    uavcan::MonotonicDuration getBusyTime()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return uavcan::MonotonicDuration::fromUSec(std::int64_t(busy_usec_));
+    }
+};
+
+/**
+ * The driver of one node. It must be destroyed before the bus.
+ */
+class Driver final : public uavcan::ICanDriver,
+                     uavcan::Noncopyable
+{
+    friend class Bus;
+
+    static constexpr unsigned NumTxMailboxes = 3;
+    static constexpr unsigned MaxFilters = 8;
+    static constexpr std::int64_t MaxWaitUSec = 1000000;    ///< The deadline may be infinite
+
+    struct RxItem
+    {
+        uavcan::CanFrame frame;
+        uavcan::MonotonicTime ts;                   ///< The frame can't be received before this time
+        uavcan::CanIOFlags flags;
+    };
+
+    class Iface final : public uavcan::ICanIface
+    {
+        Driver& owner_;
+
+        std::int16_t send(const uavcan::CanFrame& frame, uavcan::MonotonicTime, uavcan::CanIOFlags flags) override
+        {
+            return owner_.send(frame, flags);
+        }
+
+        std::int16_t receive(uavcan::CanFrame& out_frame, uavcan::MonotonicTime& out_ts_monotonic,
+                             uavcan::UtcTime& out_ts_utc, uavcan::CanIOFlags& out_flags) override
+        {
+            return owner_.receive(out_frame, out_ts_monotonic, out_ts_utc, out_flags);
+        }
+
+        std::int16_t configureFilters(const uavcan::CanFilterConfig* filter_configs,
+                                      std::uint16_t num_configs) override
+        {
+            return owner_.configureFilters(filter_configs, num_configs);
+        }
+
+        std::uint16_t getNumFilters() const override { return MaxFilters; }
+
+        std::uint64_t getErrorCount() const override { return 0; }
+
+    public:
+        explicit Iface(Driver& owner) : owner_(owner) { }
+    };
+
+    Bus& bus_;
+    Iface iface_;
+
+    /*
+     * These are protected by the mutex of the bus.
+     */
+    std::deque<RxItem> rx_queue_;
+    uavcan::MonotonicTime tx_mailbox_release_times_[NumTxMailboxes];
+    uavcan::CanFilterConfig filters_[MaxFilters];
+    unsigned num_filters_ = 0;
+
+    bool accepts(const uavcan::CanFrame& frame) const
+    {
+        for (unsigned i = 0; i < num_filters_; i++)
+        {
+            if (((frame.id ^ filters_[i].id) & filters_[i].mask) == 0)
+            {
+                return true;
+            }
+        }
+        return num_filters_ == 0;
+    }
+
+    uavcan::MonotonicTime* findFreeTxMailbox(uavcan::MonotonicTime now)
+    {
+        for (auto& release_time : tx_mailbox_release_times_)
+        {
+            if (release_time <= now)
+            {
+                return &release_time;
+            }
+        }
+        return nullptr;
+    }
+
+    bool hasRxFrame(uavcan::MonotonicTime now) const
+    {
+        return !rx_queue_.empty() && (rx_queue_.front().ts <= now);
+    }
+
+    std::int16_t send(const uavcan::CanFrame& frame, uavcan::CanIOFlags flags)
+    {
+        std::lock_guard<std::mutex> lock(bus_.mutex_);
+        uavcan::MonotonicTime* const mailbox = findFreeTxMailbox(bus_.clock_.getMonotonic());
+        if (mailbox == nullptr)
+        {
+            return 0;
+        }
+        *mailbox = bus_.transmit(*this, frame, flags);
+        return 1;
+    }
+
+    std::int16_t receive(uavcan::CanFrame& out_frame, uavcan::MonotonicTime& out_ts_monotonic,
+                         uavcan::UtcTime& out_ts_utc, uavcan::CanIOFlags& out_flags)
+    {
+        std::lock_guard<std::mutex> lock(bus_.mutex_);
+        if (!hasRxFrame(bus_.clock_.getMonotonic()))
+        {
+            return 0;
+        }
+        const RxItem& item = rx_queue_.front();
+        out_frame = item.frame;
+        out_ts_monotonic = item.ts;
+        out_ts_utc = bus_.clock_.getUtc();
+        out_flags = item.flags;
+        rx_queue_.pop_front();
+        return 1;
+    }
+
+    std::int16_t configureFilters(const uavcan::CanFilterConfig* filter_configs, std::uint16_t num_configs)
+    {
+        if (num_configs > MaxFilters)
+        {
+            return -uavcan::ErrInvalidParam;
+        }
+        std::lock_guard<std::mutex> lock(bus_.mutex_);
+        std::copy(filter_configs, filter_configs + num_configs, filters_);
+        num_filters_ = num_configs;
+        return 0;
+    }
+
+    uavcan::ICanIface* getIface(std::uint8_t iface_index) override
+    {
+        return (iface_index == 0) ? &iface_ : nullptr;
+    }
+
+    std::uint8_t getNumIfaces() const override { return 1; }
+
+    /**
+     * Sleeps until a frame can be received or sent, or until the deadline.
+     */
+    std::int16_t select(uavcan::CanSelectMasks& inout_masks,
+                        const uavcan::CanFrame* (&)[uavcan::MaxCanIfaces],
+                        uavcan::MonotonicTime blocking_deadline) override
+    {
+        const uavcan::CanSelectMasks requested = inout_masks;
+        std::unique_lock<std::mutex> lock(bus_.mutex_);
+
+        while (true)
+        {
+            const auto now = bus_.clock_.getMonotonic();
+
+            inout_masks = uavcan::CanSelectMasks();
+            inout_masks.read = ((requested.read & 1U) && hasRxFrame(now)) ? 1U : 0U;
+            inout_masks.write = ((requested.write & 1U) && (findFreeTxMailbox(now) != nullptr)) ? 1U : 0U;
+
+            if ((inout_masks.read != 0) || (inout_masks.write != 0) || (now >= blocking_deadline))
+            {
+                break;
+            }
+
+            /*
+             * Waking up when the first frame in the RX queue or a TX mailbox becomes available, or when
+             * another driver sends something.
+             */
+            auto wake_up_at = blocking_deadline;
+            if ((requested.read & 1U) && !rx_queue_.empty())
+            {
+                wake_up_at = std::min(wake_up_at, rx_queue_.front().ts);
+            }
+            if (requested.write & 1U)
+            {
+                for (auto release_time : tx_mailbox_release_times_)
+                {
+                    wake_up_at = std::min(wake_up_at, release_time);
+                }
+            }
+            const auto timeout_usec = std::min<std::int64_t>((wake_up_at - now).toUSec(), MaxWaitUSec);
+            (void)bus_.activity_.wait_for(lock, std::chrono::microseconds(timeout_usec));
+        }
+
+        return std::int16_t(((inout_masks.read != 0) || (inout_masks.write != 0)) ? 1 : 0);
+    }
+
+public:
+    explicit Driver(Bus& bus) :
+        bus_(bus),
+        iface_(*this)
+    {
+        std::lock_guard<std::mutex> lock(bus_.mutex_);
+        bus_.drivers_.push_back(this);
+    }
+
+    ~Driver()
+    {
+        std::lock_guard<std::mutex> lock(bus_.mutex_);
+        bus_.drivers_.erase(std::find(bus_.drivers_.begin(), bus_.drivers_.end(), this));
+    }
+};
+
+/**
+ * Must be invoked with the mutex locked. Returns the time when the transmission of the frame ends.
+ */
+inline uavcan::MonotonicTime Bus::transmit(const Driver& sender, const uavcan::CanFrame& frame,
+                                           uavcan::CanIOFlags flags)
+{
+    const auto duration = computeFrameDuration(frame);
+    const auto start = std::max(clock_.getMonotonic(), idle_since_);
+    idle_since_ = start + duration;
+    num_frames_++;
+    busy_usec_ += std::uint64_t(duration.toUSec());
+
+    for (auto driver : drivers_)
+    {
+        const bool loopback = (driver == &sender);
+        if ((loopback && ((flags & uavcan::CanIOFlagLoopback) != 0)) || (!loopback && driver->accepts(frame)))
+        {
+            Driver::RxItem item;
+            item.frame = frame;
+            item.ts = idle_since_;
+            item.flags = loopback ? uavcan::CanIOFlagLoopback : uavcan::CanIOFlags(0);
+            driver->rx_queue_.push_back(item);
+        }
+    }
+
+    activity_.notify_all();
+    return idle_since_;
+}
+
+}
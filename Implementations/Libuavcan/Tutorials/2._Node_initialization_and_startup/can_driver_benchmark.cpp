@@ -0,0 +1,352 @@
+/*
+ * This program compares the standard Linux driver uavcan_linux::SocketCanDriver with
+ * uavcan_linux_epoll::EpollCanDriver under a synthetic load.
+ *
+ * Every interface gets a generator thread that sends frames at the specified rate through its own socket.
+ * The main thread acts as a gateway: it receives the frames through the driver under test and forwards the frames
+ * received from the interface N to the interface N+1, so both directions are loaded equally. The drivers are used
+ * directly through the interface uavcan::ICanDriver, the same way the library uses them.
+ *
+ * The benchmark is repeated for the first one, two, etc. interfaces from the list, for both drivers.
+ * Frames per second are those received and sent by the gateway; the CPU use is that of the gateway thread only.
+ *
+ * Maximum load of a CAN bus at 1 Mbit/s is about 7500 frames per second (extended frames, 8 bytes of payload).
+ * Virtual interfaces don't have such a limit; with zero rate the generators send as fast as they can.
+ *
+ * Usage: ./can_driver_benchmark <duration-sec> <frames-per-sec-per-iface (0 = max)> <iface> [iface...]
+ * For example:
+ *   ./can_driver_benchmark 5 7500 vcan0 vcan1 vcan2
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <net/if.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <uavcan/uavcan.hpp>
+#include <uavcan_linux/uavcan_linux.hpp>
+
+#include "uavcan_linux_epoll.hpp"
+
+/*
+ * The gateway keeps at most this many frames waiting for every interface; the rest is counted as lost.
+ */
+constexpr unsigned MaxForwardQueueLength = 1000;
+constexpr unsigned GeneratorBatchSize = 32;
+
+static std::atomic<bool> g_stop_generators(false);
+
+static double getCpuTime(clockid_t clock)
+{
+    ::timespec ts = ::timespec();
+    (void)::clock_gettime(clock, &ts);
+    return double(ts.tv_sec) + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * The generator socket doesn't receive anything, so it doesn't waste CPU time on the frames of the gateway.
+ */
+static int openGeneratorSocket(const std::string& iface_name)
+{
+    const int fd = ::socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to open socket: " + std::to_string(errno));
+    }
+    ::sockaddr_can addr = ::sockaddr_can();
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = int(::if_nametoindex(iface_name.c_str()));
+    if ((::setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, nullptr, 0) < 0) ||
+        (::bind(fd, reinterpret_cast<const ::sockaddr*>(&addr), sizeof(addr)) < 0))
+    {
+        (void)::close(fd);
+        throw std::runtime_error("Failed to open iface " + iface_name + ": " + std::to_string(errno));
+    }
+    return fd;
+}
+
+/**
+ * Sends the frames in batches, once per millisecond, so the average rate is as requested.
+ */
+static void runGenerator(int fd, unsigned frames_per_sec, std::atomic<std::uint64_t>& num_sent)
+{
+    ::can_frame frames[GeneratorBatchSize];
+    ::iovec iovecs[GeneratorBatchSize];
+    ::mmsghdr messages[GeneratorBatchSize];
+    for (unsigned i = 0; i < GeneratorBatchSize; i++)
+    {
+        frames[i] = ::can_frame();
+        frames[i].can_id = CAN_EFF_FLAG | (0x1234000U + i);
+        frames[i].can_dlc = 8;
+        iovecs[i].iov_base = &frames[i];
+        iovecs[i].iov_len = sizeof(::can_frame);
+        messages[i] = ::mmsghdr();
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    const auto started_at = std::chrono::steady_clock::now();
+    std::uint64_t sent = 0;
+    while (!g_stop_generators)
+    {
+        unsigned batch_size = GeneratorBatchSize;
+        if (frames_per_sec > 0)
+        {
+            const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_at).count();
+            const auto due = std::uint64_t(elapsed * frames_per_sec);
+            if (due <= sent)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            batch_size = unsigned(std::min<std::uint64_t>(due - sent, GeneratorBatchSize));
+        }
+
+        for (unsigned i = 0; i < batch_size; i++)
+        {
+            std::memcpy(frames[i].data, &sent, sizeof(sent));   // Some varying payload
+        }
+        const int res = ::sendmmsg(fd, messages, batch_size, 0);
+        if (res > 0)
+        {
+            sent += unsigned(res);
+            num_sent = sent;
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));    // ENOBUFS, the queue is full
+        }
+    }
+}
+
+struct Result
+{
+    std::uint64_t generated = 0;
+    std::uint64_t received = 0;
+    std::uint64_t sent = 0;
+    std::uint64_t lost = 0;
+    double elapsed_sec = 0;
+    double cpu_sec = 0;
+    long context_switches = 0;
+};
+
+/**
+ * Runs the gateway on the given driver for the specified time.
+ */
+static Result runGateway(uavcan::ICanDriver& driver, const uavcan::ISystemClock& clock,
+                         const std::vector<std::string>& iface_names, double duration_sec, unsigned frames_per_sec)
+{
+    const unsigned num_ifaces = driver.getNumIfaces();
+    std::vector<std::deque<uavcan::CanFrame>> forward_queues(num_ifaces);
+    Result result;
+
+    g_stop_generators = false;
+    std::vector<std::atomic<std::uint64_t>> num_generated(num_ifaces);
+    std::vector<int> generator_fds;
+    std::vector<std::thread> generators;
+    for (unsigned i = 0; i < num_ifaces; i++)
+    {
+        num_generated[i] = 0;
+        generator_fds.push_back(openGeneratorSocket(iface_names[i]));
+        generators.emplace_back(runGenerator, generator_fds.back(), frames_per_sec, std::ref(num_generated[i]));
+    }
+
+    ::rusage usage_before = ::rusage();
+    (void)::getrusage(RUSAGE_THREAD, &usage_before);
+    const double cpu_before = getCpuTime(CLOCK_THREAD_CPUTIME_ID);
+    const auto started_at = clock.getMonotonic();
+    const auto stop_generators_at = started_at + uavcan::MonotonicDuration::fromUSec(std::int64_t(duration_sec * 1e6));
+    const auto finish_at = stop_generators_at + uavcan::MonotonicDuration::fromMSec(200);   // To receive the rest
+
+    while (true)
+    {
+        const auto now = clock.getMonotonic();
+        if (now >= finish_at)
+        {
+            break;
+        }
+        if ((now >= stop_generators_at) && !g_stop_generators)
+        {
+            g_stop_generators = true;
+        }
+
+        uavcan::CanSelectMasks masks;
+        for (unsigned i = 0; i < num_ifaces; i++)
+        {
+            masks.read |= std::uint8_t(1U << i);
+            if (!forward_queues[i].empty())
+            {
+                masks.write |= std::uint8_t(1U << i);
+            }
+        }
+        const uavcan::CanFrame* pending_tx[uavcan::MaxCanIfaces] = {};
+        const int select_res = driver.select(masks, pending_tx, now + uavcan::MonotonicDuration::fromMSec(10));
+        if (select_res < 0)
+        {
+            throw std::runtime_error("Select failed: " + std::to_string(select_res));
+        }
+
+        for (unsigned i = 0; i < num_ifaces; i++)
+        {
+            uavcan::ICanIface* const iface = driver.getIface(std::uint8_t(i));
+
+            if (masks.write & (1U << i))
+            {
+                const auto tx_deadline = clock.getMonotonic() + uavcan::MonotonicDuration::fromMSec(100);
+                auto& queue = forward_queues[i];
+                while (!queue.empty() && (iface->send(queue.front(), tx_deadline, 0) > 0))
+                {
+                    queue.pop_front();
+                    result.sent++;
+                }
+            }
+
+            if (masks.read & (1U << i))
+            {
+                uavcan::CanFrame frame;
+                uavcan::MonotonicTime ts_mono;
+                uavcan::UtcTime ts_utc;
+                uavcan::CanIOFlags flags = 0;
+                while (iface->receive(frame, ts_mono, ts_utc, flags) > 0)
+                {
+                    result.received++;
+                    auto& queue = forward_queues[(i + 1) % num_ifaces];
+                    if (queue.size() < MaxForwardQueueLength)
+                    {
+                        queue.push_back(frame);
+                    }
+                    else
+                    {
+                        result.lost++;
+                    }
+                }
+            }
+        }
+    }
+
+    result.elapsed_sec = (clock.getMonotonic() - started_at).toUSec() * 1e-6;
+    result.cpu_sec = getCpuTime(CLOCK_THREAD_CPUTIME_ID) - cpu_before;
+    ::rusage usage_after = ::rusage();
+    (void)::getrusage(RUSAGE_THREAD, &usage_after);
+    result.context_switches = (usage_after.ru_nvcsw + usage_after.ru_nivcsw) -
+                              (usage_before.ru_nvcsw + usage_before.ru_nivcsw);
+
+    for (unsigned i = 0; i < num_ifaces; i++)
+    {
+        generators[i].join();
+        (void)::close(generator_fds[i]);
+        result.generated += num_generated[i];
+    }
+    result.lost += (result.generated > result.received) ? (result.generated - result.received) : 0;
+    return result;
+}
+
+static void printHeader()
+{
+    std::cout << std::setw(10) << std::left << "Driver" << std::right
+              << std::setw(8) << "Ifaces"
+              << std::setw(12) << "RX fr/s"
+              << std::setw(12) << "TX fr/s"
+              << std::setw(10) << "Lost"
+              << std::setw(8) << "CPU %"
+              << std::setw(12) << "Switches"
+              << std::setw(14) << "Syscalls/fr" << std::endl;
+}
+
+/**
+ * The standard driver doesn't count its system calls, so the last column is only printed for the epoll driver.
+ */
+static void printRow(const char* driver_name, unsigned num_ifaces, const Result& r, double syscalls)
+{
+    std::cout << std::setw(10) << std::left << driver_name << std::right << std::fixed
+              << std::setw(8) << num_ifaces
+              << std::setw(12) << std::setprecision(0) << (r.received / r.elapsed_sec)
+              << std::setw(12) << std::setprecision(0) << (r.sent / r.elapsed_sec)
+              << std::setw(10) << r.lost
+              << std::setw(8) << std::setprecision(1) << (100.0 * r.cpu_sec / r.elapsed_sec)
+              << std::setw(12) << r.context_switches;
+    if (syscalls > 0)
+    {
+        std::cout << std::setw(14) << std::setprecision(3) << (syscalls / double(r.received + r.sent));
+    }
+    else
+    {
+        std::cout << std::setw(14) << "-";
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, const char** argv)
+{
+    if (argc < 4)
+    {
+        std::cerr << "Usage: " << argv[0] << " <duration-sec> <frames-per-sec-per-iface (0 = max)> <iface> [iface...]"
+                  << std::endl;
+        return 1;
+    }
+
+    const double duration_sec = std::stod(argv[1]);
+    const unsigned frames_per_sec = unsigned(std::stoul(argv[2]));
+    std::vector<std::string> iface_names(argv + 3, argv + argc);
+    if (iface_names.size() > uavcan::MaxCanIfaces)
+    {
+        std::cerr << "At most " << int(uavcan::MaxCanIfaces) << " ifaces are supported" << std::endl;
+        return 1;
+    }
+
+    uavcan_linux::SystemClock clock;
+
+    printHeader();
+
+    for (unsigned num_ifaces = 1; num_ifaces <= iface_names.size(); num_ifaces++)
+    {
+        {
+            uavcan_linux::SocketCanDriver driver(clock);
+            for (unsigned i = 0; i < num_ifaces; i++)
+            {
+                if (driver.addIface(iface_names[i]) < 0)
+                {
+                    throw std::runtime_error("Failed to add iface " + iface_names[i]);
+                }
+            }
+            const Result r = runGateway(driver, clock, iface_names, duration_sec, frames_per_sec);
+            printRow("standard", num_ifaces, r, 0);
+        }
+
+        {
+            uavcan_linux_epoll::EpollCanDriver driver(clock);
+            for (unsigned i = 0; i < num_ifaces; i++)
+            {
+                const int res = driver.addIface(iface_names[i]);
+                if (res < 0)
+                {
+                    throw std::runtime_error("Failed to add iface " + iface_names[i] + ": " + std::to_string(res));
+                }
+            }
+            const Result r = runGateway(driver, clock, iface_names, duration_sec, frames_per_sec);
+
+            double syscalls = double(driver.getNumEpollWaits());
+            for (unsigned i = 0; i < num_ifaces; i++)
+            {
+                const auto& stats = driver.getIface(std::uint8_t(i))->getStatistics();
+                syscalls += double(stats.rx_syscalls + stats.tx_syscalls);
+            }
+            printRow("epoll", num_ifaces, r, syscalls);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,33 @@
+/*
+ * This file can be used instead of platform_linux.cpp; it provides the same functions, but the CAN driver is
+ * uavcan_linux_epoll::EpollCanDriver, which is intended for nodes that handle heavy traffic on several interfaces.
+ */
+
+#include <uavcan_linux/uavcan_linux.hpp>
+#include "uavcan_linux_epoll.hpp"
+
+uavcan::ISystemClock& getSystemClock()
+{
+    static uavcan_linux::SystemClock clock;
+    return clock;
+}
+
+uavcan::ICanDriver& getCanDriver()
+{
+    static uavcan_linux_epoll::EpollCanDriver driver(getSystemClock());
+    if (driver.getNumIfaces() == 0)     // Will be executed once
+    {
+        /*
+         * More interfaces can be added here, e.g. vcan1 and vcan2; up to uavcan::MaxCanIfaces.
+         */
+        for (auto iface_name : { "vcan0" })
+        {
+            const int res = driver.addIface(iface_name);
+            if (res < 0)
+            {
+                throw std::runtime_error("Failed to add iface " + std::string(iface_name) + ": " + std::to_string(res));
+            }
+        }
+    }
+    return driver;
+}
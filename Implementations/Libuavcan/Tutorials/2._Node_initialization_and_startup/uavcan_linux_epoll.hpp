@@ -0,0 +1,856 @@
+/**
+ * SocketCAN driver for gateways that serve several CAN interfaces under high load.
+ *
+ * The standard driver uavcan_linux::SocketCanDriver polls the sockets on every select() and reads or writes one
+ * frame per system call, so the CPU time per frame grows with the number of interfaces. This driver is built
+ * for the same use case as the standard one, with the following differences:
+ *
+ *  - All sockets are registered in one epoll instance, so a select() takes one system call regardless of
+ *    the number of interfaces, and no system calls at all if the answer is already known.
+ *  - Frames are received with recvmmsg() in batches, each frame having its own kernel timestamp.
+ *  - Every interface has its own bounded TX queue, ordered by CAN ID priority like the queue of the standard
+ *    driver, which is flushed with sendmmsg() in batches. An interface whose kernel queue is full doesn't stall
+ *    the others: it reports that it is not ready for writing until the kernel accepts frames again, so libuavcan
+ *    keeps the rest of the frames for it in its own prioritized queue.
+ *  - The TX queues are flushed when the library starts receiving or is about to block, or when a queue holds
+ *    a full batch; frames whose deadline has passed are discarded rather than sent late.
+ *
+ * Loopback frames are produced by the driver itself when the frame is accepted by the kernel, so their timestamp
+ * is the time of submission rather than the time of transmission. Part of the RX queue is reserved for them,
+ * so they are not lost when the bus is busy.
+ *
+ * io_uring is not used, since it would bring a dependency on liburing and a recent kernel, whereas epoll with
+ * batched socket calls already removes the per-frame system calls.
+ *
+ * All methods that can fail return negative errno.
+ *
+ * @file uavcan_linux_epoll.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <algorithm>            // For std::min(), std::max(), std::upper_bound()
+#include <cerrno>               // For errno
+#include <climits>              // For INT_MAX
+#include <cstring>              // For std::memcpy()
+#include <ctime>                // For clock_gettime()
+#include <memory>               // For std::unique_ptr
+#include <string>
+#include <vector>               // For std::vector, used by the queues
+#include <net/if.h>             // For if_nametoindex()
+#include <sys/epoll.h>          // For epoll_create1(), epoll_ctl(), epoll_wait()
+#include <sys/socket.h>         // For socket(), recvmmsg(), sendmmsg()
+#include <unistd.h>             // For close()
+#include <linux/can.h>          // For struct can_frame, struct sockaddr_can
+#include <linux/can/raw.h>      // For CAN_RAW_FILTER
+#include <uavcan/uavcan.hpp>    // Main libuavcan header
+
+namespace uavcan_linux_epoll
+{
+constexpr unsigned RxBatchSize = 32;                ///< Max frames per recvmmsg()
+constexpr unsigned TxBatchSize = 32;                ///< Max frames per sendmmsg()
+constexpr unsigned DefaultTxQueueCapacity = 32;
+constexpr unsigned MaxFilters = 32;
+
+/**
+ * If the kernel rejects a frame with ENOBUFS, the socket may well be reported as writable, so the interface is
+ * retried after this interval rather than when epoll says so.
+ */
+constexpr std::int64_t TxRetryIntervalUSec = 1000;
+
+inline ::can_frame makeSocketCanFrame(const uavcan::CanFrame& frame)
+{
+    ::can_frame out = ::can_frame();
+    out.can_id = frame.id & uavcan::CanFrame::MaskExtID;
+    if (frame.id & uavcan::CanFrame::FlagEFF)
+    {
+        out.can_id |= CAN_EFF_FLAG;
+    }
+    if (frame.id & uavcan::CanFrame::FlagRTR)
+    {
+        out.can_id |= CAN_RTR_FLAG;
+    }
+    if (frame.id & uavcan::CanFrame::FlagERR)
+    {
+        out.can_id |= CAN_ERR_FLAG;
+    }
+    out.can_dlc = frame.dlc;
+    std::memcpy(out.data, frame.data, frame.dlc);
+    return out;
+}
+
+inline uavcan::CanFrame makeUavcanFrame(const ::can_frame& frame)
+{
+    uavcan::CanFrame out(frame.can_id & CAN_EFF_MASK, frame.data, std::min<std::uint8_t>(frame.can_dlc, 8));
+    if (frame.can_id & CAN_EFF_FLAG)
+    {
+        out.id |= uavcan::CanFrame::FlagEFF;
+    }
+    if (frame.can_id & CAN_RTR_FLAG)
+    {
+        out.id |= uavcan::CanFrame::FlagRTR;
+    }
+    if (frame.can_id & CAN_ERR_FLAG)
+    {
+        out.id |= uavcan::CanFrame::FlagERR;
+    }
+    return out;
+}
+
+/**
+ * Fixed capacity FIFO; the storage is allocated once.
+ */
+template <typename T>
+class Ring
+{
+    std::vector<T> items_;
+    unsigned head_ = 0;
+    unsigned size_ = 0;
+
+public:
+    explicit Ring(unsigned capacity) : items_(std::max(capacity, 1U)) { }
+
+    bool push(const T& item)
+    {
+        if (isFull())
+        {
+            return false;
+        }
+        items_[(head_ + size_) % items_.size()] = item;
+        size_++;
+        return true;
+    }
+
+    void pop()
+    {
+        if (size_ > 0)
+        {
+            head_ = (head_ + 1) % items_.size();
+            size_--;
+        }
+    }
+
+    T& operator[](unsigned index) { return items_[(head_ + index) % items_.size()]; }
+
+    unsigned getSize() const { return size_; }
+    unsigned getCapacity() const { return unsigned(items_.size()); }
+    bool isEmpty() const { return size_ == 0; }
+    bool isFull() const { return size_ >= items_.size(); }
+};
+
+/**
+ * Fixed capacity queue ordered by CAN ID priority; frames of equal priority are kept in the order of insertion,
+ * so the frames of one transfer are never reordered. The storage is allocated once.
+ */
+template <typename T>
+class PriorityQueue
+{
+    std::vector<T> items_;
+    const unsigned capacity_;
+
+public:
+    explicit PriorityQueue(unsigned capacity) : capacity_(std::max(capacity, 1U)) { items_.reserve(capacity_); }
+
+    bool push(const T& item)
+    {
+        if (isFull())
+        {
+            return false;
+        }
+        const auto position = std::upper_bound(items_.begin(), items_.end(), item, [](const T& a, const T& b)
+            {
+                return a.frame.priorityHigherThan(b.frame);
+            });
+        (void)items_.insert(position, item);
+        return true;
+    }
+
+    void pop()
+    {
+        if (!items_.empty())
+        {
+            (void)items_.erase(items_.begin());
+        }
+    }
+
+    T& operator[](unsigned index) { return items_[index]; }
+
+    unsigned getSize() const { return unsigned(items_.size()); }
+    unsigned getCapacity() const { return capacity_; }
+    bool isEmpty() const { return items_.empty(); }
+    bool isFull() const { return items_.size() >= capacity_; }
+};
+
+/**
+ * Counters of one interface.
+ */
+struct IfaceStatistics
+{
+    std::uint64_t rx_frames = 0;
+    std::uint64_t tx_frames = 0;
+    std::uint64_t rx_syscalls = 0;                  ///< Calls of recvmmsg()
+    std::uint64_t tx_syscalls = 0;                  ///< Calls of sendmmsg()
+    std::uint64_t tx_timeouts = 0;                  ///< Frames discarded because of their deadline
+    std::uint64_t rx_kernel_drops = 0;              ///< Frames dropped by the kernel because the socket was full
+    std::uint64_t errors = 0;                       ///< Failed system calls, except for the full queues
+};
+
+/**
+ * One CAN interface. The instances are owned by the driver.
+ */
+class EpollCanIface final : public uavcan::ICanIface,
+                            uavcan::Noncopyable
+{
+    struct TxItem
+    {
+        uavcan::CanFrame frame;
+        uavcan::MonotonicTime deadline;
+        uavcan::CanIOFlags flags = 0;
+    };
+
+    struct RxItem
+    {
+        uavcan::CanFrame frame;
+        uavcan::MonotonicTime ts_mono;
+        uavcan::UtcTime ts_utc;
+        uavcan::CanIOFlags flags = 0;
+    };
+
+    static constexpr unsigned ControlBufferSize = CMSG_SPACE(sizeof(::timeval)) + CMSG_SPACE(sizeof(std::uint32_t));
+
+    const uavcan::ISystemClock& clock_;
+    const int fd_;
+    PriorityQueue<TxItem> tx_queue_;
+    Ring<RxItem> rx_queue_;                         ///< Received frames and loopback frames, see hasRxSpace()
+    IfaceStatistics stats_;
+
+    bool blocked_ = false;
+    bool waiting_for_epollout_ = false;
+    uavcan::MonotonicTime retry_at_;
+
+    /*
+     * Buffers of the batched system calls; they are large, so the instances are allocated on the heap.
+     */
+    ::can_frame rx_frames_[RxBatchSize];
+    ::iovec rx_iovecs_[RxBatchSize];
+    ::mmsghdr rx_messages_[RxBatchSize];
+    alignas(::cmsghdr) std::uint8_t rx_control_[RxBatchSize][ControlBufferSize];
+
+    ::can_frame tx_frames_[TxBatchSize];
+    ::iovec tx_iovecs_[TxBatchSize];
+    ::mmsghdr tx_messages_[TxBatchSize];
+    unsigned tx_queue_positions_[TxBatchSize];      ///< Where in the queue every frame of the batch is
+
+    std::int16_t send(const uavcan::CanFrame& frame, uavcan::MonotonicTime tx_deadline,
+                      uavcan::CanIOFlags flags) override
+    {
+        TxItem item;
+        item.frame = frame;
+        item.deadline = tx_deadline;
+        item.flags = flags;
+        if (!tx_queue_.push(item))
+        {
+            return 0;
+        }
+        if (tx_queue_.getSize() >= TxBatchSize)
+        {
+            (void)flush(clock_.getMonotonic());
+        }
+        return 1;
+    }
+
+    std::int16_t receive(uavcan::CanFrame& out_frame, uavcan::MonotonicTime& out_ts_monotonic,
+                         uavcan::UtcTime& out_ts_utc, uavcan::CanIOFlags& out_flags) override
+    {
+        if (rx_queue_.isEmpty())
+        {
+            return 0;
+        }
+        const RxItem& item = rx_queue_[0];
+        out_frame = item.frame;
+        out_ts_monotonic = item.ts_mono;
+        out_ts_utc = item.ts_utc;
+        out_flags = item.flags;
+        rx_queue_.pop();
+        return 1;
+    }
+
+    std::int16_t configureFilters(const uavcan::CanFilterConfig* filter_configs, std::uint16_t num_configs) override
+    {
+        if ((num_configs > MaxFilters) || ((num_configs > 0) && (filter_configs == nullptr)))
+        {
+            return -uavcan::ErrInvalidParam;
+        }
+
+        ::can_filter filters[MaxFilters];
+        for (std::uint16_t i = 0; i < num_configs; i++)
+        {
+            const uavcan::CanFilterConfig& fc = filter_configs[i];
+            filters[i].can_id = fc.id & uavcan::CanFrame::MaskExtID;
+            filters[i].can_mask = fc.mask & uavcan::CanFrame::MaskExtID;
+            if (fc.id & uavcan::CanFrame::FlagEFF)
+            {
+                filters[i].can_id |= CAN_EFF_FLAG;
+            }
+            if (fc.id & uavcan::CanFrame::FlagRTR)
+            {
+                filters[i].can_id |= CAN_RTR_FLAG;
+            }
+            if (fc.mask & uavcan::CanFrame::FlagEFF)
+            {
+                filters[i].can_mask |= CAN_EFF_FLAG;
+            }
+            if (fc.mask & uavcan::CanFrame::FlagRTR)
+            {
+                filters[i].can_mask |= CAN_RTR_FLAG;
+            }
+        }
+        if (num_configs == 0)
+        {
+            filters[0] = ::can_filter();            // Zero mask accepts everything
+            num_configs = 1;
+        }
+
+        if (::setsockopt(fd_, SOL_CAN_RAW, CAN_RAW_FILTER, filters, socklen_t(sizeof(::can_filter) * num_configs)) < 0)
+        {
+            return std::int16_t(-errno);
+        }
+        return 0;
+    }
+
+    std::uint16_t getNumFilters() const override { return MaxFilters; }
+
+    std::uint64_t getErrorCount() const override
+    {
+        return stats_.errors + stats_.tx_timeouts + stats_.rx_kernel_drops;
+    }
+
+    void pushLoopback(const uavcan::CanFrame& frame, uavcan::MonotonicTime ts_mono, uavcan::UtcTime ts_utc)
+    {
+        RxItem item;
+        item.frame = frame;
+        item.ts_mono = ts_mono;
+        item.ts_utc = ts_utc;
+        item.flags = uavcan::CanIOFlagLoopback;
+        if (!rx_queue_.push(item))
+        {
+            stats_.errors++;
+        }
+    }
+
+public:
+    /**
+     * Takes the ownership of the socket.
+     */
+    EpollCanIface(const uavcan::ISystemClock& clock, int fd, unsigned tx_queue_capacity) :
+        clock_(clock),
+        fd_(fd),
+        tx_queue_(tx_queue_capacity),
+        rx_queue_(RxBatchSize + tx_queue_capacity)
+    {
+        for (unsigned i = 0; i < RxBatchSize; i++)
+        {
+            rx_iovecs_[i].iov_base = &rx_frames_[i];
+            rx_iovecs_[i].iov_len = sizeof(::can_frame);
+        }
+        for (unsigned i = 0; i < TxBatchSize; i++)
+        {
+            tx_iovecs_[i].iov_base = &tx_frames_[i];
+            tx_iovecs_[i].iov_len = sizeof(::can_frame);
+            tx_messages_[i] = ::mmsghdr();
+            tx_messages_[i].msg_hdr.msg_iov = &tx_iovecs_[i];
+            tx_messages_[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    ~EpollCanIface() { (void)::close(fd_); }
+
+    int getFD() const { return fd_; }
+
+    /**
+     * Reads one batch of frames, if there's enough space in the RX queue.
+     * Returns the number of frames read.
+     */
+    int readBatch()
+    {
+        if (!hasRxSpace())
+        {
+            return 0;
+        }
+        const unsigned batch_size = std::min(RxBatchSize, rx_queue_.getCapacity() - tx_queue_.getCapacity() -
+                                                          rx_queue_.getSize());
+
+        for (unsigned i = 0; i < batch_size; i++)
+        {
+            rx_messages_[i] = ::mmsghdr();
+            rx_messages_[i].msg_hdr.msg_iov = &rx_iovecs_[i];
+            rx_messages_[i].msg_hdr.msg_iovlen = 1;
+            rx_messages_[i].msg_hdr.msg_control = rx_control_[i];
+            rx_messages_[i].msg_hdr.msg_controllen = ControlBufferSize;
+        }
+
+        stats_.rx_syscalls++;
+        const int res = ::recvmmsg(fd_, rx_messages_, batch_size, MSG_DONTWAIT, nullptr);
+        if (res < 0)
+        {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                return 0;
+            }
+            stats_.errors++;
+            return -errno;
+        }
+
+        /*
+         * The kernel timestamps are in the system real time; the age of every frame is applied to both clocks
+         * of the node, which may be adjusted differently.
+         */
+        const auto now_mono = clock_.getMonotonic();
+        const auto now_utc = clock_.getUtc();
+        ::timespec now_real = ::timespec();
+        (void)::clock_gettime(CLOCK_REALTIME, &now_real);
+        const std::int64_t now_real_usec = std::int64_t(now_real.tv_sec) * 1000000 + now_real.tv_nsec / 1000;
+
+        for (int i = 0; i < res; i++)
+        {
+            std::int64_t age_usec = 0;
+            for (::cmsghdr* cmsg = CMSG_FIRSTHDR(&rx_messages_[i].msg_hdr);
+                 cmsg != nullptr;
+                 cmsg = CMSG_NXTHDR(&rx_messages_[i].msg_hdr, cmsg))
+            {
+                if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_TIMESTAMP))
+                {
+                    ::timeval tv;
+                    std::memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+                    age_usec = std::max<std::int64_t>(0, now_real_usec -
+                                                         (std::int64_t(tv.tv_sec) * 1000000 + tv.tv_usec));
+                }
+                else if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SO_RXQ_OVFL))
+                {
+                    std::uint32_t num_dropped = 0;
+                    std::memcpy(&num_dropped, CMSG_DATA(cmsg), sizeof(num_dropped));
+                    stats_.rx_kernel_drops = num_dropped;   // The kernel reports the total count
+                }
+            }
+
+            if (rx_messages_[i].msg_len != sizeof(::can_frame))
+            {
+                stats_.errors++;
+                continue;
+            }
+
+            RxItem item;
+            item.frame = makeUavcanFrame(rx_frames_[i]);
+            item.ts_mono = now_mono - uavcan::MonotonicDuration::fromUSec(age_usec);
+            item.ts_utc = now_utc - uavcan::UtcDuration::fromUSec(age_usec);
+            (void)rx_queue_.push(item);             // There's enough space, see above
+            stats_.rx_frames++;
+        }
+        return res;
+    }
+
+    /**
+     * Writes the queued frames in batches until the queue is empty or the kernel stops accepting them.
+     * Frames whose deadline has passed are discarded. Does nothing while the iface is blocked, see isBlocked().
+     * Returns the number of frames written.
+     */
+    int flush(uavcan::MonotonicTime now)
+    {
+        if (blocked_)
+        {
+            if (waiting_for_epollout_ || (now < retry_at_))
+            {
+                return 0;
+            }
+            blocked_ = false;
+        }
+
+        int num_written = 0;
+        while (!tx_queue_.isEmpty())
+        {
+            /*
+             * The batch consists of the first frames of the queue, except for the expired ones.
+             */
+            unsigned batch_size = 0;
+            unsigned num_scanned = 0;
+            unsigned num_loopback = 0;
+            bool no_space_for_loopback = false;
+            for (; (num_scanned < tx_queue_.getSize()) && (batch_size < TxBatchSize); num_scanned++)
+            {
+                const TxItem& item = tx_queue_[num_scanned];
+                if (item.deadline < now)
+                {
+                    continue;
+                }
+                /*
+                 * A loopback frame is not sent until there is space for it in the RX queue.
+                 */
+                if (item.flags & uavcan::CanIOFlagLoopback)
+                {
+                    if (rx_queue_.getSize() + num_loopback >= rx_queue_.getCapacity())
+                    {
+                        no_space_for_loopback = true;
+                        break;
+                    }
+                    num_loopback++;
+                }
+                tx_frames_[batch_size] = makeSocketCanFrame(item.frame);
+                tx_queue_positions_[batch_size] = num_scanned;
+                batch_size++;
+            }
+
+            int num_sent = 0;
+            unsigned num_to_remove = num_scanned;   // Everything is expired if the batch is empty
+            if (batch_size > 0)
+            {
+                stats_.tx_syscalls++;
+                const int res = ::sendmmsg(fd_, tx_messages_, batch_size, MSG_DONTWAIT);
+                if (res > 0)
+                {
+                    num_sent = res;
+                    num_to_remove = tx_queue_positions_[res - 1] + 1U;
+                }
+                else if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == ENOBUFS))
+                {
+                    blocked_ = true;
+                    waiting_for_epollout_ = (errno != ENOBUFS);
+                    retry_at_ = now + uavcan::MonotonicDuration::fromUSec(TxRetryIntervalUSec);
+                    num_to_remove = tx_queue_positions_[0];
+                }
+                else
+                {
+                    stats_.errors++;
+                    num_to_remove = tx_queue_positions_[0] + 1U;    // The first frame is dropped
+                }
+            }
+
+            /*
+             * Every removed frame that has not expired is either written, or dropped because of an error.
+             */
+            for (unsigned i = 0; i < num_to_remove; i++)
+            {
+                if (tx_queue_[0].deadline < now)
+                {
+                    stats_.tx_timeouts++;
+                }
+                else if (num_sent > 0)
+                {
+                    num_written++;
+                    stats_.tx_frames++;
+                    if (tx_queue_[0].flags & uavcan::CanIOFlagLoopback)
+                    {
+                        pushLoopback(tx_queue_[0].frame, now, clock_.getUtc());
+                    }
+                }
+                tx_queue_.pop();
+            }
+
+            if (blocked_ || no_space_for_loopback)
+            {
+                break;
+            }
+        }
+        return num_written;
+    }
+
+    /**
+     * Called when epoll reports that the socket is writable again.
+     */
+    void handleWritable() { waiting_for_epollout_ = false; }
+
+    bool hasDataInRxQueue() const { return !rx_queue_.isEmpty(); }
+    bool hasFramesInTxQueue() const { return !tx_queue_.isEmpty(); }
+    bool isTxQueueFull() const { return tx_queue_.isFull(); }
+
+    /**
+     * The last tx_queue_capacity slots of the RX queue are reserved for loopback frames, so the frames are read
+     * from the socket only while the rest of the queue is not full.
+     */
+    bool hasRxSpace() const { return rx_queue_.getSize() + tx_queue_.getCapacity() < rx_queue_.getCapacity(); }
+
+    /**
+     * True if the kernel has rejected the last batch because its queue was full. The iface stays blocked until
+     * epoll reports that the socket is writable, or, if the kernel has reported ENOBUFS, until the retry time.
+     */
+    bool isBlocked() const { return blocked_; }
+    bool isWaitingForEpollOut() const { return blocked_ && waiting_for_epollout_; }
+    bool isWaitingForRetry() const { return blocked_ && !waiting_for_epollout_; }
+    uavcan::MonotonicTime getRetryTime() const { return retry_at_; }
+
+    const IfaceStatistics& getStatistics() const { return stats_; }
+};
+
+/**
+ * The driver. Interfaces are added with addIface() before the node is started.
+ */
+class EpollCanDriver final : public uavcan::ICanDriver,
+                             uavcan::Noncopyable
+{
+    const uavcan::ISystemClock& clock_;
+    const unsigned tx_queue_capacity_;
+    const int epoll_fd_;
+    std::unique_ptr<EpollCanIface> ifaces_[uavcan::MaxCanIfaces];
+    std::uint32_t registered_events_[uavcan::MaxCanIfaces] = {};
+    unsigned num_ifaces_ = 0;
+    std::uint64_t num_epoll_waits_ = 0;
+
+    static int openSocket(const std::string& iface_name)
+    {
+        const unsigned iface_index = ::if_nametoindex(iface_name.c_str());
+        if (iface_index == 0)
+        {
+            return -ENODEV;
+        }
+
+        const int fd = ::socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_RAW);
+        if (fd < 0)
+        {
+            return -errno;
+        }
+
+        ::sockaddr_can addr = ::sockaddr_can();
+        addr.can_family = AF_CAN;
+        addr.can_ifindex = int(iface_index);
+
+        const int on = 1;
+        if ((::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on)) < 0) ||
+            (::setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) < 0) ||
+            (::bind(fd, reinterpret_cast<const ::sockaddr*>(&addr), sizeof(addr)) < 0))
+        {
+            const int error = errno;
+            (void)::close(fd);
+            return -error;
+        }
+        return fd;
+    }
+
+    /**
+     * EPOLLIN is disabled while there is no space for reading in the RX queue of the iface, otherwise
+     * epoll_wait() would return at once until the library reads the queue; EPOLLOUT is enabled only while
+     * the iface waits for it.
+     * The events are updated only when they change, so normally this doesn't make any system calls.
+     */
+    void updateEvents(unsigned index)
+    {
+        const EpollCanIface& iface = *ifaces_[index];
+        const std::uint32_t events = (iface.hasRxSpace() ? std::uint32_t(EPOLLIN) : 0U) |
+                                     (iface.isWaitingForEpollOut() ? std::uint32_t(EPOLLOUT) : 0U);
+        if (events != registered_events_[index])
+        {
+            ::epoll_event event = ::epoll_event();
+            event.events = events;
+            event.data.u32 = index;
+            if (::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, iface.getFD(), &event) >= 0)
+            {
+                registered_events_[index] = events;
+            }
+        }
+    }
+
+    void flushAll(uavcan::MonotonicTime now)
+    {
+        for (unsigned i = 0; i < num_ifaces_; i++)
+        {
+            (void)ifaces_[i]->flush(now);
+            updateEvents(i);
+        }
+    }
+
+    uavcan::CanSelectMasks getReadyMasks(const uavcan::CanSelectMasks& requested) const
+    {
+        uavcan::CanSelectMasks ready;
+        for (unsigned i = 0; i < num_ifaces_; i++)
+        {
+            const std::uint8_t bit = std::uint8_t(1U << i);
+            if ((requested.read & bit) && ifaces_[i]->hasDataInRxQueue())
+            {
+                ready.read |= bit;
+            }
+            if ((requested.write & bit) && !ifaces_[i]->isBlocked() && !ifaces_[i]->isTxQueueFull())
+            {
+                ready.write |= bit;
+            }
+        }
+        return ready;
+    }
+
+    /**
+     * The epoll timeout is in milliseconds; it is rounded up, so the deadline is never missed by waking up early.
+     * The ifaces that are blocked because of ENOBUFS are retried after their retry interval.
+     */
+    int computeTimeoutMSec(uavcan::MonotonicTime now, uavcan::MonotonicTime deadline) const
+    {
+        for (unsigned i = 0; i < num_ifaces_; i++)
+        {
+            const EpollCanIface& iface = *ifaces_[i];
+            if (iface.isWaitingForRetry() && iface.hasFramesInTxQueue() && (iface.getRetryTime() < deadline))
+            {
+                deadline = iface.getRetryTime();
+            }
+        }
+        if (deadline <= now)
+        {
+            return 0;
+        }
+        const std::int64_t timeout_msec = ((deadline - now).toUSec() + 999) / 1000;
+        return int(std::min<std::int64_t>(timeout_msec, INT_MAX));
+    }
+
+    /**
+     * Returns the number of events, or negative errno.
+     */
+    int poll(int timeout_msec)
+    {
+        ::epoll_event events[uavcan::MaxCanIfaces];
+        num_epoll_waits_++;
+        const int res = ::epoll_wait(epoll_fd_, events, int(uavcan::MaxCanIfaces), timeout_msec);
+        if (res < 0)
+        {
+            return (errno == EINTR) ? 0 : -errno;
+        }
+
+        const auto now = clock_.getMonotonic();
+        for (int i = 0; i < res; i++)
+        {
+            const unsigned index = events[i].data.u32;
+            if (index >= num_ifaces_)
+            {
+                continue;
+            }
+            if (events[i].events & EPOLLOUT)
+            {
+                ifaces_[index]->handleWritable();
+                (void)ifaces_[index]->flush(now);
+            }
+            if (events[i].events & (EPOLLIN | EPOLLERR))
+            {
+                (void)ifaces_[index]->readBatch();
+            }
+            updateEvents(index);
+        }
+        return res;
+    }
+
+    std::int16_t select(uavcan::CanSelectMasks& inout_masks,
+                        const uavcan::CanFrame* (&)[uavcan::MaxCanIfaces],
+                        uavcan::MonotonicTime blocking_deadline) override
+    {
+        const uavcan::CanSelectMasks requested = inout_masks;
+
+        /*
+         * If the library asks for reading, it has no more frames to send for now, so the queued frames are
+         * written out; and the sockets are polled once without waiting, unless every requested iface has
+         * some data already.
+         */
+        bool need_poll = false;
+        if (requested.read != 0)
+        {
+            flushAll(clock_.getMonotonic());        // Also re-enables EPOLLIN if the library has read the queues
+            need_poll = getReadyMasks(requested).read != requested.read;
+        }
+
+        while (true)
+        {
+            inout_masks = getReadyMasks(requested);
+            const bool ready = (inout_masks.read != 0) || (inout_masks.write != 0);
+            const auto now = clock_.getMonotonic();
+
+            if (!need_poll && (ready || (now >= blocking_deadline)))
+            {
+                break;
+            }
+            if (!ready)
+            {
+                flushAll(now);                      // About to block, nothing can be batched anymore
+                if (getReadyMasks(requested).write != 0)
+                {
+                    continue;                       // An iface that was waiting for the retry became writable
+                }
+            }
+
+            const int res = poll(ready ? 0 : computeTimeoutMSec(now, blocking_deadline));
+            if (res < 0)
+            {
+                return std::int16_t(res);
+            }
+            need_poll = false;
+        }
+
+        std::int16_t num_ready = 0;
+        for (unsigned i = 0; i < num_ifaces_; i++)
+        {
+            if ((inout_masks.read | inout_masks.write) & (1U << i))
+            {
+                num_ready++;
+            }
+        }
+        return num_ready;
+    }
+
+public:
+    explicit EpollCanDriver(const uavcan::ISystemClock& clock,
+                            unsigned tx_queue_capacity = DefaultTxQueueCapacity) :
+        clock_(clock),
+        tx_queue_capacity_(tx_queue_capacity),
+        epoll_fd_(::epoll_create1(EPOLL_CLOEXEC))
+    { }
+
+    ~EpollCanDriver()
+    {
+        if (epoll_fd_ >= 0)
+        {
+            (void)::close(epoll_fd_);
+        }
+    }
+
+    /**
+     * Returns the index of the new iface, or negative errno.
+     */
+    int addIface(const std::string& iface_name)
+    {
+        if (epoll_fd_ < 0)
+        {
+            return -EBADF;
+        }
+        if (num_ifaces_ >= uavcan::MaxCanIfaces)
+        {
+            return -EMFILE;
+        }
+
+        const int fd = openSocket(iface_name);
+        if (fd < 0)
+        {
+            return fd;
+        }
+
+        ::epoll_event event = ::epoll_event();
+        event.events = EPOLLIN;
+        event.data.u32 = num_ifaces_;
+        if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0)
+        {
+            const int error = errno;
+            (void)::close(fd);
+            return -error;
+        }
+
+        ifaces_[num_ifaces_].reset(new EpollCanIface(clock_, fd, tx_queue_capacity_));
+        registered_events_[num_ifaces_] = EPOLLIN;
+        return int(num_ifaces_++);
+    }
+
+    EpollCanIface* getIface(std::uint8_t iface_index) override
+    {
+        return (iface_index < num_ifaces_) ? ifaces_[iface_index].get() : nullptr;
+    }
+
+    std::uint8_t getNumIfaces() const override { return std::uint8_t(num_ifaces_); }
+
+    /**
+     * Number of calls of epoll_wait(); the counters of the other system calls are kept by the ifaces.
+     */
+    std::uint64_t getNumEpollWaits() const { return num_epoll_waits_; }
+};
+
+}
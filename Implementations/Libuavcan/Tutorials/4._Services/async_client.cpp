@@ -0,0 +1,145 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <unistd.h>
+#include <uavcan/uavcan.hpp>
+
+/*
+ * This example uses the service type uavcan.protocol.GetNodeInfo, which is supported by every libuavcan node,
+ * including the server from this tutorial.
+ */
+#include <uavcan/protocol/GetNodeInfo.hpp>
+
+/*
+ * The client facade is implemented in a separate header (see below).
+ */
+#include "async_service_client.hpp"
+
+extern uavcan::ICanDriver& getCanDriver();
+extern uavcan::ISystemClock& getSystemClock();
+
+/*
+ * Every call that doesn't fit into the static call slots of the client takes a few blocks from the pool.
+ */
+constexpr unsigned NodeMemoryPoolSize = 65536;
+typedef uavcan::Node<NodeMemoryPoolSize> Node;
+
+constexpr unsigned CallsPerServer = 100;
+
+static Node& getNode()
+{
+    static Node node(getCanDriver(), getSystemClock());
+    return node;
+}
+
+int main(int argc, const char** argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <node-id> <server-node-id> [server-node-id...]" << std::endl;
+        return 1;
+    }
+
+    const uavcan::NodeID self_node_id = std::stoi(argv[1]);
+    std::vector<uavcan::NodeID> server_node_ids;
+    for (int i = 2; i < argc; i++)
+    {
+        server_node_ids.push_back(std::stoi(argv[i]));
+    }
+
+    auto& node = getNode();
+    node.setNodeID(self_node_id);
+    node.setName("org.uavcan.tutorial.async_client");
+
+    const int node_start_res = node.start();
+    if (node_start_res < 0)
+    {
+        throw std::runtime_error("Failed to start the node; error: " + std::to_string(node_start_res));
+    }
+
+    /*
+     * Initializing the client. Up to 64 calls will be in flight at any moment, at most 4 per server.
+     */
+    using uavcan::protocol::GetNodeInfo;
+    async_service_client::AsyncServiceClient<GetNodeInfo> client(node);
+
+    const int client_init_res = client.init(64, 4);
+    if (client_init_res < 0)
+    {
+        throw std::runtime_error("Failed to init the client; error: " + std::to_string(client_init_res));
+    }
+
+    node.setModeOperational();
+
+    /*
+     * A call that returns a future.
+     * The future is fulfilled from within spin(), so blocking on it here would stall the node forever.
+     */
+    auto first_info = client.call(server_node_ids.front(), GetNodeInfo::Request());
+
+    /*
+     * Submitting all calls at once; the client starts as many of them as the limits allow, and queues the rest.
+     * The handlers are invoked in the order in which the responses arrive.
+     */
+    const auto started_at = std::chrono::steady_clock::now();
+    double total_latency_sec = 0;
+
+    for (auto server_node_id : server_node_ids)
+    {
+        for (unsigned i = 0; i < CallsPerServer; i++)
+        {
+            const auto submitted_at = std::chrono::steady_clock::now();
+            const int call_res = client.call(server_node_id, GetNodeInfo::Request(),
+                [&, submitted_at](const async_service_client::CallResult<GetNodeInfo>& result)
+                {
+                    total_latency_sec +=
+                        std::chrono::duration<double>(std::chrono::steady_clock::now() - submitted_at).count();
+                    if (!result.isSuccessful())
+                    {
+                        std::cerr << "Call to node " << int(result.server_node_id.get())
+                                  << " has failed: " << result.status << std::endl;
+                    }
+                });
+            if (call_res < 0)
+            {
+                throw std::runtime_error("Unable to perform service call: " + std::to_string(call_res));
+            }
+        }
+    }
+
+    /*
+     * The completions are delivered as soon as the responses arrive, regardless of the spin duration;
+     * the duration only defines how soon this loop notices that all calls are done.
+     */
+    while (!client.isIdle())
+    {
+        const int res = node.spin(uavcan::MonotonicDuration::fromMSec(100));
+        if (res < 0)
+        {
+            std::cerr << "Transient failure: " << res << std::endl;
+        }
+    }
+
+    const double elapsed_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_at).count();
+    const unsigned num_calls = client.getNumCompletedCalls() - 1U;  // The first call is not included
+
+    if (first_info.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        const auto result = first_info.get();
+        if (result.isSuccessful())
+        {
+            std::cout << "Node info of node " << int(result.server_node_id.get()) << ":\n"
+                      << result.response << std::endl;
+        }
+    }
+
+    std::cout << "Calls:             " << num_calls << "\n"
+              << "Failed calls:      " << client.getNumFailedCalls() << "\n"
+              << "Peak in flight:    " << client.getPeakNumCallsInFlight() << "\n"
+              << "Elapsed:           " << elapsed_sec << " s\n"
+              << "Calls per second:  " << (num_calls / elapsed_sec) << "\n"
+              << "Mean latency:      " << (total_latency_sec / num_calls * 1000) << " ms "
+              << "(including the time in the queue)" << std::endl;
+
+    return 0;
+}
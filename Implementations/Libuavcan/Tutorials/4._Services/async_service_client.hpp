@@ -0,0 +1,295 @@
+/**
+ * Service client facade for applications that keep many service calls in flight.
+ *
+ * The common pattern of calling a service and then spinning the node until the client has no pending calls
+ * performs one call at a time, and the result is noticed only when the spin step ends. This facade instead
+ * accepts any number of calls at once and completes each of them with a handler or a std::future, as soon as
+ * the response arrives or the call times out:
+ *
+ *  - The number of calls in flight is limited by credits: a global limit, and a limit per server, so that one
+ *    slow server doesn't take all of the capacity. The calls that exceed the limits are queued, and started
+ *    in submission order as the credits are returned.
+ *  - Completions are delivered in the order in which the responses arrive, from within spin().
+ *  - Every call is completed exactly once, including the calls that could not be started.
+ *
+ * The states of the first NumStaticCalls calls are allocated statically; the rest are allocated from the node's
+ * memory pool, so the pool must be sized accordingly.
+ *
+ * The futures are fulfilled from within spin(), so the thread that spins the node must never block on them;
+ * check them with wait_for(std::chrono::seconds(0)), or use the handlers.
+ *
+ * @file async_service_client.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <algorithm>                                // For std::max()
+#include <array>                                    // For std::array
+#include <deque>                                    // For std::deque
+#include <functional>                               // For std::function
+#include <future>                                   // For std::future, std::promise
+#include <map>                                      // For std::map
+#include <memory>                                   // For std::shared_ptr
+#include <vector>                                   // For std::vector
+#include <uavcan/uavcan.hpp>                        // Main libuavcan header
+
+namespace async_service_client
+{
+/**
+ * Outcome of a service call.
+ */
+template <typename DataType>
+struct CallResult
+{
+    int status = 0;                                 ///< Zero on success, negative error code otherwise
+    uavcan::NodeID server_node_id;
+    typename DataType::Response response;           ///< Valid only if the call was successful
+
+    bool isSuccessful() const { return status >= 0; }
+};
+
+template <typename DataType, unsigned NumStaticCalls = 16>
+class AsyncServiceClient : private uavcan::TimerBase
+{
+public:
+    typedef typename DataType::Request Request;
+    typedef CallResult<DataType> Result;
+    typedef std::function<void (const Result&)> CompletionHandler;
+
+    static constexpr unsigned DefaultMaxCallsInFlight = 64;
+    static constexpr unsigned DefaultMaxCallsPerServer = 4;
+
+    /**
+     * Calls are told apart by their transfer ID, which is 5 bits wide; some margin is left for the calls
+     * that are being cancelled.
+     */
+    static constexpr unsigned MaxCallsPerServer = 16;
+
+private:
+    typedef std::function<void (const uavcan::ServiceCallResult<DataType>&)> Callback;
+
+    struct QueuedCall
+    {
+        uavcan::NodeID server_node_id;
+        Request request;
+        CompletionHandler handler;
+    };
+
+    uavcan::ServiceClient<DataType, Callback, NumStaticCalls> client_;
+    unsigned max_calls_in_flight_ = DefaultMaxCallsInFlight;
+    unsigned max_calls_per_server_ = DefaultMaxCallsPerServer;
+
+    std::deque<QueuedCall> queue_;
+    std::map<std::uint16_t, CompletionHandler> calls_in_flight_;    ///< Key is made of the server ID and transfer ID
+    std::array<std::uint8_t, uavcan::NodeID::Max + 1> calls_per_server_ = {};
+
+    bool in_callback_ = false;                      ///< New calls must not be started from the callback
+
+    unsigned num_completed_ = 0;
+    unsigned num_failed_ = 0;
+    unsigned peak_calls_in_flight_ = 0;
+
+    static std::uint16_t makeCallKey(const uavcan::ServiceCallID& call_id)
+    {
+        return std::uint16_t((call_id.server_node_id.get() << 8) | call_id.transfer_id.get());
+    }
+
+    void complete(const CompletionHandler& handler, const Result& result)
+    {
+        num_completed_++;
+        if (!result.isSuccessful())
+        {
+            num_failed_++;
+        }
+        if (handler)
+        {
+            handler(result);
+        }
+    }
+
+    void fail(const QueuedCall& call, int error)
+    {
+        Result result;
+        result.status = error;
+        result.server_node_id = call.server_node_id;
+        complete(call.handler, result);
+    }
+
+    /**
+     * Starts the queued calls that fit into the limits, preserving the submission order for every server.
+     * The handlers of the calls that failed to start are invoked after the queue is processed, because they
+     * may submit new calls.
+     */
+    void pump()
+    {
+        std::vector<QueuedCall> failed;
+        std::vector<int> errors;
+
+        for (auto it = queue_.begin(); (it != queue_.end()) && (calls_in_flight_.size() < max_calls_in_flight_);)
+        {
+            std::uint8_t& server_calls = calls_per_server_[it->server_node_id.get()];
+            if (server_calls >= max_calls_per_server_)
+            {
+                ++it;
+                continue;
+            }
+
+            uavcan::ServiceCallID call_id;
+            const int res = client_.call(it->server_node_id, it->request, call_id);
+            const QueuedCall call = *it;
+            it = queue_.erase(it);
+
+            if (res < 0)
+            {
+                failed.push_back(call);
+                errors.push_back(res);
+                continue;
+            }
+
+            server_calls++;
+            calls_in_flight_[makeCallKey(call_id)] = call.handler;
+            peak_calls_in_flight_ = std::max(peak_calls_in_flight_, unsigned(calls_in_flight_.size()));
+        }
+
+        for (unsigned i = 0; i < failed.size(); i++)
+        {
+            fail(failed[i], errors[i]);
+        }
+    }
+
+    void schedulePump()
+    {
+        startOneShotWithDelay(uavcan::MonotonicDuration());
+    }
+
+    void handleCallResult(const uavcan::ServiceCallResult<DataType>& call_result)
+    {
+        const auto it = calls_in_flight_.find(makeCallKey(call_result.getCallID()));
+        if (it == calls_in_flight_.end())
+        {
+            return;
+        }
+        const CompletionHandler handler = it->second;
+        calls_in_flight_.erase(it);
+        calls_per_server_[call_result.getCallID().server_node_id.get()]--;
+
+        Result result;
+        result.status = call_result.isSuccessful() ? 0 : -uavcan::ErrFailure;
+        result.server_node_id = call_result.getCallID().server_node_id;
+        if (call_result.isSuccessful())
+        {
+            result.response = call_result.getResponse();
+        }
+        in_callback_ = true;
+        complete(handler, result);
+        in_callback_ = false;
+
+        /*
+         * New calls are not started from the callback of the service client; the credit is used as soon as
+         * the node gets back to its timers.
+         */
+        if (!queue_.empty())
+        {
+            schedulePump();
+        }
+    }
+
+    void handleTimerEvent(const uavcan::TimerEvent&) override
+    {
+        pump();
+    }
+
+public:
+    explicit AsyncServiceClient(uavcan::INode& node) :
+        uavcan::TimerBase(node),
+        client_(node)
+    { }
+
+    /**
+     * Must be called once before use.
+     */
+    int init(unsigned max_calls_in_flight = DefaultMaxCallsInFlight,
+             unsigned max_calls_per_server = DefaultMaxCallsPerServer)
+    {
+        if ((max_calls_in_flight == 0) || (max_calls_per_server == 0) || (max_calls_per_server > MaxCallsPerServer))
+        {
+            return -uavcan::ErrInvalidParam;
+        }
+        max_calls_in_flight_ = max_calls_in_flight;
+        max_calls_per_server_ = max_calls_per_server;
+
+        const int res = client_.init();
+        if (res < 0)
+        {
+            return res;
+        }
+        client_.setCallback([this](const uavcan::ServiceCallResult<DataType>& result) { handleCallResult(result); });
+        return 0;
+    }
+
+    void setRequestTimeout(uavcan::MonotonicDuration timeout) { client_.setRequestTimeout(timeout); }
+    void setPriority(uavcan::TransferPriority priority) { client_.setPriority(priority); }
+
+    /**
+     * Submits a call. The handler will be invoked exactly once, possibly from within this method
+     * if the call fails to start.
+     * Returns a negative error code if the call is not accepted; the handler will not be invoked in this case.
+     */
+    int call(uavcan::NodeID server_node_id, const Request& request, const CompletionHandler& handler)
+    {
+        if (!server_node_id.isUnicast())
+        {
+            return -uavcan::ErrInvalidParam;
+        }
+
+        QueuedCall call;
+        call.server_node_id = server_node_id;
+        call.request = request;
+        call.handler = handler;
+        queue_.push_back(call);
+
+        if (in_callback_)
+        {
+            schedulePump();
+        }
+        else
+        {
+            pump();
+        }
+        return 0;
+    }
+
+    /**
+     * Same as above, but the result is delivered via a future.
+     */
+    std::future<Result> call(uavcan::NodeID server_node_id, const Request& request)
+    {
+        auto promise = std::make_shared<std::promise<Result>>();
+        auto future = promise->get_future();
+
+        const int res = call(server_node_id, request, [promise](const Result& result) { promise->set_value(result); });
+        if (res < 0)
+        {
+            Result result;
+            result.status = res;
+            result.server_node_id = server_node_id;
+            promise->set_value(result);
+        }
+        return future;
+    }
+
+    /**
+     * True if there are no queued calls and no calls in flight.
+     */
+    bool isIdle() const { return queue_.empty() && calls_in_flight_.empty(); }
+
+    unsigned getNumQueuedCalls() const { return unsigned(queue_.size()); }
+    unsigned getNumCallsInFlight() const { return unsigned(calls_in_flight_.size()); }
+    unsigned getPeakNumCallsInFlight() const { return peak_calls_in_flight_; }
+    unsigned getNumCompletedCalls() const { return num_completed_; }
+    unsigned getNumFailedCalls() const { return num_failed_; }
+};
+
+}
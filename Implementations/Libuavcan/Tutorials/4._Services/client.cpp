@@ -137,6 +137,8 @@ int main(int argc, const char** argv)
 
     /*
      * Spin until the call is completed, then exit.
+     * Applications that need to perform many calls should rather keep them in flight concurrently;
+     * see the asynchronous client example in async_client.cpp (section "Asynchronous client" of this tutorial).
      */
     node.setModeOperational();
     while (client.hasPendingCalls())  // Whether the call has completed (doesn't matter successfully or not)
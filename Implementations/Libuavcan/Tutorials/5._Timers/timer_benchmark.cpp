@@ -0,0 +1,175 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <ctime>
+#include <uavcan/uavcan.hpp>
+
+/*
+ * The timer wheel is implemented in a separate header (see below).
+ */
+#include "timer_wheel.hpp"
+
+/*
+ * This application compares the standard libuavcan timers against the timer wheel, using the workload of a gateway
+ * node: every timer is a watchdog of some remote node, which expires periodically unless it gets restarted.
+ * Every timer event restarts a few random watchdogs, as if messages from the respective nodes were received.
+ */
+extern uavcan::ICanDriver& getCanDriver();
+extern uavcan::ISystemClock& getSystemClock();
+
+constexpr unsigned NodeMemoryPoolSize = 16384;
+typedef uavcan::Node<NodeMemoryPoolSize> Node;
+
+constexpr unsigned MinTimerPeriodMSec = 100;
+constexpr unsigned MaxTimerPeriodMSec = 1000;
+constexpr unsigned RestartsPerEvent = 2;
+
+static Node& getNode()
+{
+    static Node node(getCanDriver(), getSystemClock());
+    return node;
+}
+
+struct TrialResult
+{
+    double start_usec_per_timer = 0;
+    double cpu_usec_per_event = 0;
+    double cpu_load_percent = 0;
+    double mean_lateness_usec = 0;
+    std::uint64_t num_events = 0;
+};
+
+/**
+ * The timer type must provide the same API as uavcan::Timer; the owner is passed to the timer's constructor.
+ */
+template <typename Timer, typename Owner>
+static TrialResult runTrial(Node& node, Owner& owner, unsigned num_timers, unsigned duration_sec)
+{
+    std::minstd_rand prng(42);                  // Same sequence for all trials
+    std::uniform_int_distribution<unsigned> period_dist(MinTimerPeriodMSec, MaxTimerPeriodMSec);
+    std::uniform_int_distribution<unsigned> index_dist(0, num_timers - 1U);
+
+    std::vector<std::unique_ptr<Timer>> timers;
+    std::vector<uavcan::MonotonicDuration> periods;
+    TrialResult result;
+    double lateness_sum_usec = 0;
+
+    for (unsigned i = 0; i < num_timers; i++)
+    {
+        timers.emplace_back(new Timer(owner));
+        periods.push_back(uavcan::MonotonicDuration::fromMSec(period_dist(prng)));
+    }
+
+    for (unsigned i = 0; i < num_timers; i++)
+    {
+        timers[i]->setCallback([&](const uavcan::TimerEvent& event)
+            {
+                result.num_events++;
+                lateness_sum_usec += double((event.real_time - event.scheduled_time).toUSec());
+
+                for (unsigned k = 0; k < RestartsPerEvent; k++)
+                {
+                    const unsigned index = index_dist(prng);
+                    timers[index]->startPeriodic(periods[index]);
+                }
+            });
+    }
+
+    /*
+     * Starting the timers. This is where the cost of the sorted deadline list of the standard scheduler shows up.
+     */
+    const auto start_started_at = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < num_timers; i++)
+    {
+        timers[i]->startPeriodic(periods[i]);
+    }
+    result.start_usec_per_timer =
+        std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_started_at).count() /
+        num_timers;
+
+    /*
+     * Running the node. The CPU time is measured rather than the wall time, since the node sleeps between events.
+     */
+    const std::clock_t cpu_started_at = std::clock();
+    const auto spin_started_at = std::chrono::steady_clock::now();
+
+    const int res = node.spin(uavcan::MonotonicDuration::fromMSec(duration_sec * 1000U));
+    if (res < 0)
+    {
+        throw std::runtime_error("Spin failure: " + std::to_string(res));
+    }
+
+    const double cpu_usec = double(std::clock() - cpu_started_at) * 1e6 / CLOCKS_PER_SEC;
+    const double wall_usec =
+        std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - spin_started_at).count();
+
+    if (result.num_events > 0)
+    {
+        result.cpu_usec_per_event = cpu_usec / double(result.num_events);
+        result.mean_lateness_usec = lateness_sum_usec / double(result.num_events);
+    }
+    result.cpu_load_percent = cpu_usec * 100.0 / wall_usec;
+
+    return result;
+}
+
+static void printResult(const char* name, const TrialResult& result)
+{
+    std::cout << std::setw(16) << name << std::fixed << std::setprecision(2)
+              << std::setw(14) << result.start_usec_per_timer
+              << std::setw(14) << result.cpu_usec_per_event
+              << std::setw(12) << result.cpu_load_percent
+              << std::setw(14) << result.mean_lateness_usec
+              << std::setw(12) << result.num_events << std::endl;
+}
+
+int main(int argc, const char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <node-id> [num-timers] [duration-sec]" << std::endl;
+        return 1;
+    }
+
+    const int self_node_id = std::stoi(argv[1]);
+    const unsigned num_timers = (argc > 2) ? unsigned(std::stoi(argv[2])) : 10000U;
+    const unsigned duration_sec = (argc > 3) ? unsigned(std::stoi(argv[3])) : 10U;
+    if ((num_timers < 1) || (duration_sec < 1))
+    {
+        std::cerr << "The number of timers and the duration must be positive" << std::endl;
+        return 1;
+    }
+
+    auto& node = getNode();
+    node.setNodeID(self_node_id);
+    node.setName("org.uavcan.tutorial.timer_benchmark");
+
+    const int node_start_res = node.start();
+    if (node_start_res < 0)
+    {
+        throw std::runtime_error("Failed to start the node; error: " + std::to_string(node_start_res));
+    }
+
+    node.setModeOperational();
+
+    std::cout << num_timers << " timers, " << duration_sec << " seconds per trial" << std::endl;
+    std::cout << std::setw(16) << "Scheduler" << std::setw(14) << "Start, us" << std::setw(14) << "CPU/event, us"
+              << std::setw(12) << "CPU load, %" << std::setw(14) << "Lateness, us" << std::setw(12) << "Events"
+              << std::endl;
+
+    printResult("uavcan::Timer", runTrial<uavcan::Timer>(node, node, num_timers, duration_sec));
+
+    /*
+     * The wheel with the default tick of 1 millisecond.
+     */
+    {
+        timer_wheel::TimerWheel wheel(node);
+        printResult("Timer wheel", runTrial<timer_wheel::WheelTimer>(node, wheel, num_timers, duration_sec));
+        std::cout << "Wheel wakeups: " << wheel.getNumWakeups() << std::endl;
+    }
+
+    return 0;
+}
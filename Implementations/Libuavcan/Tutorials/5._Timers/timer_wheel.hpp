@@ -0,0 +1,407 @@
+/**
+ * Hierarchical timing wheel for applications that need thousands of timers.
+ *
+ * Every uavcan::Timer is a deadline handler of the libuavcan scheduler, which keeps the handlers in a list sorted
+ * by deadline, so starting a timer costs O(N) in the number of running timers. This becomes noticeable when
+ * a node keeps a timer per tracked remote node or per pending request, e.g. in gateways.
+ *
+ * The wheel implemented here uses only one uavcan::Timer, and keeps its own timers in a hierarchical timing wheel:
+ * four levels of 64 slots each, where every level is 64 times coarser than the one below. Starting and stopping
+ * a timer is O(1); expiration is O(1) amortized, since every timer is moved to a lower level at most three times.
+ * The nearest non-empty slot is found with one bit scan per level, and the underlying uavcan::Timer is armed
+ * for it, so the node still sleeps until there is work to do.
+ *
+ * Deadlines are rounded up to the tick of the wheel; the timers that expire within the same tick are processed
+ * in one wakeup. The tick should be chosen according to the required timing precision; e.g. 1 ms is plenty for
+ * watchdogs and retries. The deadlines that don't fit the wheel (2^24 ticks, i.e. 4.6 hours at 1 ms) are handled
+ * correctly, at the cost of an extra cascade every 2^24 ticks.
+ *
+ * The API of WheelTimer mirrors that of uavcan::Timer. The wheel is not thread safe, same as the rest of libuavcan.
+ *
+ * @file timer_wheel.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>                           // For std::function
+#include <uavcan/uavcan.hpp>                    // Main libuavcan header
+
+namespace timer_wheel
+{
+class TimerWheel;
+
+/**
+ * The wheel must outlive the timers.
+ */
+class WheelTimer : uavcan::Noncopyable
+{
+    friend class TimerWheel;
+
+public:
+    typedef std::function<void (const uavcan::TimerEvent&)> Callback;
+
+private:
+    static constexpr std::uint8_t LevelNone = 0xFF;
+    static constexpr std::uint8_t LevelFiring = 0xFE;
+
+    TimerWheel& wheel_;
+    Callback callback_;
+
+    WheelTimer* prev_ = nullptr;
+    WheelTimer* next_ = nullptr;
+    std::uint8_t level_ = LevelNone;
+    std::uint8_t slot_ = 0;
+
+    uavcan::MonotonicTime deadline_;
+    uavcan::MonotonicDuration period_ = uavcan::MonotonicDuration::getInfinite();
+    std::uint64_t expiry_tick_ = 0;
+
+    void start(uavcan::MonotonicTime deadline, uavcan::MonotonicDuration period);
+
+public:
+    explicit WheelTimer(TimerWheel& wheel) :
+        wheel_(wheel)
+    { }
+
+    WheelTimer(TimerWheel& wheel, const Callback& callback) :
+        wheel_(wheel),
+        callback_(callback)
+    { }
+
+    ~WheelTimer() { stop(); }
+
+    void setCallback(const Callback& callback) { callback_ = callback; }
+
+    void startOneShotWithDeadline(uavcan::MonotonicTime deadline);
+    void startOneShotWithDelay(uavcan::MonotonicDuration delay);
+    void startPeriodic(uavcan::MonotonicDuration period);
+    void stop();
+
+    bool isRunning() const { return level_ != LevelNone; }
+
+    /**
+     * Returns infinite duration for one-shot timers.
+     */
+    uavcan::MonotonicDuration getPeriod() const { return period_; }
+
+    uavcan::MonotonicTime getDeadline() const { return deadline_; }
+};
+
+class TimerWheel : private uavcan::TimerBase
+{
+    friend class WheelTimer;
+
+public:
+    static constexpr unsigned BitsPerLevel = 6;
+    static constexpr unsigned SlotsPerLevel = 1U << BitsPerLevel;      ///< Matches the width of the occupancy masks
+    static constexpr unsigned NumLevels = 4;
+
+    static constexpr unsigned DefaultTickUSec = 1000;
+
+private:
+    static constexpr std::uint64_t NoTick = ~std::uint64_t(0);
+
+    uavcan::INode& node_;
+    const std::uint64_t tick_usec_;
+    const std::uint64_t origin_usec_;
+
+    std::uint64_t current_tick_ = 0;                                ///< The next tick to be processed
+    std::uint64_t armed_tick_ = NoTick;                             ///< The tick the uavcan::Timer is started for
+    std::uint64_t occupancy_[NumLevels] = {};                       ///< One bit per non-empty slot
+    WheelTimer* slots_[NumLevels][SlotsPerLevel] = {};
+    WheelTimer* firing_ = nullptr;                                  ///< Timers of the tick being processed
+
+    unsigned num_running_ = 0;
+    std::uint64_t num_wakeups_ = 0;
+
+    static unsigned getLevelShift(unsigned level) { return level * BitsPerLevel; }
+
+    std::uint64_t getTickCeil(uavcan::MonotonicTime time) const
+    {
+        const std::uint64_t usec = time.toUSec();
+        return (usec <= origin_usec_) ? 0 : ((usec - origin_usec_ + tick_usec_ - 1U) / tick_usec_);
+    }
+
+    std::uint64_t getTickFloor(uavcan::MonotonicTime time) const
+    {
+        const std::uint64_t usec = time.toUSec();
+        return (usec <= origin_usec_) ? 0 : ((usec - origin_usec_) / tick_usec_);
+    }
+
+    uavcan::MonotonicTime getTickTime(std::uint64_t tick) const
+    {
+        return uavcan::MonotonicTime::fromUSec(origin_usec_ + tick * tick_usec_);
+    }
+
+    /**
+     * Rotates the mask so that the bit of the specified slot becomes bit 0.
+     */
+    static std::uint64_t rotateMask(std::uint64_t mask, unsigned first_slot)
+    {
+        return (first_slot == 0) ? mask : ((mask >> first_slot) | (mask << (SlotsPerLevel - first_slot)));
+    }
+
+    void link(WheelTimer& timer, unsigned level, unsigned slot)
+    {
+        timer.level_ = std::uint8_t(level);
+        timer.slot_ = std::uint8_t(slot);
+        timer.prev_ = nullptr;
+        timer.next_ = slots_[level][slot];
+        if (timer.next_ != nullptr)
+        {
+            timer.next_->prev_ = &timer;
+        }
+        slots_[level][slot] = &timer;
+        occupancy_[level] |= std::uint64_t(1) << slot;
+    }
+
+    void unlink(WheelTimer& timer)
+    {
+        WheelTimer*& head = (timer.level_ == WheelTimer::LevelFiring) ? firing_ : slots_[timer.level_][timer.slot_];
+
+        if (timer.prev_ != nullptr)
+        {
+            timer.prev_->next_ = timer.next_;
+        }
+        else
+        {
+            head = timer.next_;
+        }
+        if (timer.next_ != nullptr)
+        {
+            timer.next_->prev_ = timer.prev_;
+        }
+
+        if ((timer.level_ != WheelTimer::LevelFiring) && (head == nullptr))
+        {
+            occupancy_[timer.level_] &= ~(std::uint64_t(1) << timer.slot_);
+        }
+
+        timer.prev_ = timer.next_ = nullptr;
+        timer.level_ = WheelTimer::LevelNone;
+    }
+
+    /**
+     * Puts the timer into the lowest level whose range covers its expiry tick.
+     * Deadlines beyond the range of the wheel are parked in the farthest slot of the top level,
+     * and re-inserted when that slot is reached.
+     */
+    void insert(WheelTimer& timer)
+    {
+        const std::uint64_t tick = (timer.expiry_tick_ > current_tick_) ? timer.expiry_tick_ : current_tick_;
+
+        for (unsigned level = 0; level < NumLevels; level++)
+        {
+            const unsigned shift = getLevelShift(level);
+            if (((tick >> shift) - (current_tick_ >> shift)) < SlotsPerLevel)
+            {
+                link(timer, level, unsigned(tick >> shift) & (SlotsPerLevel - 1U));
+                return;
+            }
+        }
+
+        const unsigned shift = getLevelShift(NumLevels - 1U);
+        link(timer, NumLevels - 1U, unsigned((current_tick_ >> shift) + SlotsPerLevel - 1U) & (SlotsPerLevel - 1U));
+    }
+
+    /**
+     * Returns the earliest tick at which a timer expires or a slot has to be cascaded; NoTick if there are no timers.
+     */
+    std::uint64_t findNextTick() const
+    {
+        std::uint64_t next = NoTick;
+        for (unsigned level = 0; level < NumLevels; level++)
+        {
+            const unsigned shift = getLevelShift(level);
+            const unsigned current_slot = unsigned(current_tick_ >> shift) & (SlotsPerLevel - 1U);
+            const std::uint64_t mask = rotateMask(occupancy_[level], current_slot);
+            if (mask != 0)
+            {
+                const std::uint64_t distance = unsigned(__builtin_ctzll(mask));     // Index of the lowest set bit
+                std::uint64_t tick = ((current_tick_ >> shift) + distance) << shift;
+                tick = (tick > current_tick_) ? tick : current_tick_;
+                next = (tick < next) ? tick : next;
+            }
+        }
+        return next;
+    }
+
+    void cascade(unsigned level, unsigned slot)
+    {
+        WheelTimer* timer = slots_[level][slot];
+        slots_[level][slot] = nullptr;
+        occupancy_[level] &= ~(std::uint64_t(1) << slot);
+
+        while (timer != nullptr)
+        {
+            WheelTimer* const next = timer->next_;
+            insert(*timer);
+            timer = next;
+        }
+    }
+
+    void processTick(std::uint64_t tick, uavcan::MonotonicTime real_time)
+    {
+        current_tick_ = tick;
+
+        for (unsigned level = NumLevels - 1U; level > 0; level--)
+        {
+            const unsigned shift = getLevelShift(level);
+            if ((tick & ((std::uint64_t(1) << shift) - 1U)) == 0)
+            {
+                cascade(level, unsigned(tick >> shift) & (SlotsPerLevel - 1U));
+            }
+        }
+
+        /*
+         * The slot is detached before the callbacks are invoked, because the callbacks may start timers that will
+         * land in the same slot in the next rotation.
+         */
+        const unsigned slot = unsigned(tick) & (SlotsPerLevel - 1U);
+        firing_ = slots_[0][slot];
+        slots_[0][slot] = nullptr;
+        occupancy_[0] &= ~(std::uint64_t(1) << slot);
+        for (WheelTimer* t = firing_; t != nullptr; t = t->next_)
+        {
+            t->level_ = WheelTimer::LevelFiring;
+        }
+
+        current_tick_ = tick + 1U;
+
+        while (firing_ != nullptr)
+        {
+            WheelTimer& timer = *firing_;
+            unlink(timer);
+            num_running_--;
+
+            uavcan::TimerEvent event(timer.deadline_, real_time);
+
+            /*
+             * Periodic timers don't accumulate phase error, unless they fall behind by more than one period.
+             */
+            if (timer.period_ != uavcan::MonotonicDuration::getInfinite())
+            {
+                auto next_deadline = timer.deadline_ + timer.period_;
+                if (next_deadline <= real_time)
+                {
+                    next_deadline = real_time + timer.period_;
+                }
+                timer.start(next_deadline, timer.period_);
+            }
+
+            if (timer.callback_)
+            {
+                timer.callback_(event);
+            }
+        }
+    }
+
+    void advance(uavcan::MonotonicTime now)
+    {
+        const std::uint64_t target_tick = getTickFloor(now);
+        while (true)
+        {
+            const std::uint64_t next = findNextTick();
+            if ((next == NoTick) || (next > target_tick))
+            {
+                break;
+            }
+            processTick(next, now);
+        }
+        if (current_tick_ <= target_tick)
+        {
+            current_tick_ = target_tick + 1U;           // Nothing was scheduled in between
+        }
+    }
+
+    /**
+     * The underlying timer is only re-armed if the wheel needs to wake up earlier than it is already armed for.
+     * If the earliest timer is stopped, the wheel wakes up in vain once, which is cheaper than tracking the
+     * deadline precisely.
+     */
+    void rearmIfEarlier()
+    {
+        const std::uint64_t next = findNextTick();
+        if (next < armed_tick_)
+        {
+            armed_tick_ = next;
+            startOneShotWithDeadline(getTickTime(next));
+        }
+    }
+
+    void handleTimerEvent(const uavcan::TimerEvent& event) override
+    {
+        num_wakeups_++;
+        armed_tick_ = NoTick;
+        advance(event.real_time);
+        rearmIfEarlier();
+    }
+
+public:
+    explicit TimerWheel(uavcan::INode& node,
+                        uavcan::MonotonicDuration tick = uavcan::MonotonicDuration::fromUSec(DefaultTickUSec)) :
+        uavcan::TimerBase(node),
+        node_(node),
+        tick_usec_((tick.toUSec() > 0) ? std::uint64_t(tick.toUSec()) : 1U),
+        origin_usec_(node.getMonotonicTime().toUSec())
+    { }
+
+    unsigned getNumRunningTimers() const { return num_running_; }
+
+    /**
+     * Number of times the wheel has been woken up by the scheduler.
+     */
+    std::uint64_t getNumWakeups() const { return num_wakeups_; }
+
+    uavcan::MonotonicDuration getTick() const
+    {
+        return uavcan::MonotonicDuration::fromUSec(std::int64_t(tick_usec_));
+    }
+
+    uavcan::MonotonicTime getMonotonicTime() const { return node_.getMonotonicTime(); }
+};
+
+inline void WheelTimer::start(uavcan::MonotonicTime deadline, uavcan::MonotonicDuration period)
+{
+    if (isRunning())
+    {
+        wheel_.unlink(*this);
+        wheel_.num_running_--;
+    }
+    deadline_ = deadline;
+    period_ = period;
+    expiry_tick_ = wheel_.getTickCeil(deadline);
+    wheel_.insert(*this);
+    wheel_.num_running_++;
+}
+
+inline void WheelTimer::startOneShotWithDeadline(uavcan::MonotonicTime deadline)
+{
+    start(deadline, uavcan::MonotonicDuration::getInfinite());
+    wheel_.rearmIfEarlier();
+}
+
+inline void WheelTimer::startOneShotWithDelay(uavcan::MonotonicDuration delay)
+{
+    startOneShotWithDeadline(wheel_.getMonotonicTime() + delay);
+}
+
+inline void WheelTimer::startPeriodic(uavcan::MonotonicDuration period)
+{
+    start(wheel_.getMonotonicTime() + period, period);
+    wheel_.rearmIfEarlier();
+}
+
+inline void WheelTimer::stop()
+{
+    if (isRunning())
+    {
+        wheel_.unlink(*this);
+        wheel_.num_running_--;
+    }
+}
+
+}
@@ -0,0 +1,86 @@
+#include <iostream>
+#include <cstdio>
+#include <unistd.h>
+#include <uavcan/uavcan.hpp>
+
+/*
+ * The filtered slave is implemented in a separate header (see below).
+ */
+#include "time_sync_filter.hpp"
+
+extern uavcan::ICanDriver& getCanDriver();
+extern uavcan::ISystemClock& getSystemClock();
+
+constexpr unsigned NodeMemoryPoolSize = 16384;
+
+int main(int argc, const char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <node-id>" << std::endl;
+        return 1;
+    }
+
+    const int self_node_id = std::stoi(argv[1]);
+
+    /*
+     * The node is using the disciplined clock instead of the platform clock, so that INode::getUtcTime()
+     * returns the filtered network time. The CAN driver keeps using the platform clock for timestamping.
+     */
+    time_sync_filter::FilterConfig filter_config;
+    filter_config.measurement_noise_usec = 10.0;    // Adjust according to the timestamping precision of the driver
+
+    time_sync_filter::DisciplinedClock clock(getSystemClock(), filter_config);
+
+    uavcan::Node<NodeMemoryPoolSize> node(getCanDriver(), clock);
+    node.setNodeID(self_node_id);
+    node.setName("org.uavcan.tutorial.filtered_time_sync_slave");
+
+    const int node_start_res = node.start();
+    if (node_start_res < 0)
+    {
+        throw std::runtime_error("Failed to start the node; error: " + std::to_string(node_start_res));
+    }
+
+    /*
+     * Starting the filtered time sync slave.
+     * As with the standard slave, no more than one time sync slave can exist per node.
+     */
+    time_sync_filter::FilteredTimeSyncSlave slave(node, clock);
+    const int slave_init_res = slave.start();
+    if (slave_init_res < 0)
+    {
+        throw std::runtime_error("Failed to start the time sync slave; error: " + std::to_string(slave_init_res));
+    }
+
+    /*
+     * Running the node, and printing the filter statistics once a second.
+     * The statistics can be exported in the same way, e.g. via the instrumentation described in a later tutorial.
+     */
+    node.setModeOperational();
+    while (true)
+    {
+        const int spin_res = node.spin(uavcan::MonotonicDuration::fromMSec(1000));
+        if (spin_res < 0)
+        {
+            std::cerr << "Transient failure: " << spin_res << std::endl;
+        }
+
+        const auto& stats = slave.getStatistics();
+
+        std::printf("Filtered time sync slave status:\n"
+                    "    Active: %d\n"
+                    "    Master Node ID: %d\n"
+                    "    Driver timestamps: %d\n"
+                    "    Residual: %.1f usec\n"
+                    "    Jitter: %.1f usec\n"
+                    "    Drift: %.3f ppm\n"
+                    "    Offset uncertainty: %.1f usec\n"
+                    "    Measurements: %u, outliers: %u, resets: %u\n"
+                    "    UTC: %s\n\n",
+                    int(slave.isActive()), int(slave.getMasterNodeID().get()), int(stats.using_driver_timestamps),
+                    stats.residual_usec, stats.jitter_usec, stats.drift_ppm, stats.offset_stddev_usec,
+                    unsigned(stats.num_measurements), unsigned(stats.num_outliers), unsigned(stats.num_resets),
+                    node.getUtcTime().toString().c_str());
+    }
+}
@@ -20,12 +20,32 @@ int main(int argc, const char** argv)
 {
     if (argc < 2)
     {
-        std::cerr << "Usage: " << argv[0] << " <node-id>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <node-id> [publication-period-ms]" << std::endl;
         return 1;
     }
 
     const int self_node_id = std::stoi(argv[1]);
 
+    /*
+     * Slaves that filter the measurements, like the one in filtered_slave.cpp, benefit from higher publication rates.
+     * The specification limits the publication period to the range [MIN_BROADCASTING_PERIOD_MS,
+     * MAX_BROADCASTING_PERIOD_MS].
+     */
+    using uavcan::protocol::GlobalTimeSync;
+
+    int publication_period_ms = 1000;
+    if (argc > 2)
+    {
+        publication_period_ms = std::stoi(argv[2]);
+    }
+    if ((publication_period_ms < GlobalTimeSync::MIN_BROADCASTING_PERIOD_MS) ||
+        (publication_period_ms > GlobalTimeSync::MAX_BROADCASTING_PERIOD_MS))
+    {
+        std::cerr << "Publication period must be within [" << GlobalTimeSync::MIN_BROADCASTING_PERIOD_MS << ", "
+                  << GlobalTimeSync::MAX_BROADCASTING_PERIOD_MS << "] ms" << std::endl;
+        return 1;
+    }
+
     uavcan::Node<NodeMemoryPoolSize> node(getCanDriver(), getSystemClock());
     node.setNodeID(self_node_id);
     node.setName("org.uavcan.tutorial.time_sync_master");
@@ -61,10 +81,28 @@ int main(int argc, const char** argv)
     }
 
     /*
-     * Create a timer to publish the time sync message once a second.
+     * Create a timer to publish the time sync message periodically.
      * Note that in real applications the logic governing time sync master can be even more complex,
      * i.e. if the local time source is not always available (like in GNSS receivers).
+     *
+     * The timer doesn't poll: the node sleeps in the CAN driver until either a frame arrives or the next timer
+     * deadline is reached, so a higher publication rate only costs the work done in the callback.
+     * For the same reason, the status is printed only when it changes.
      */
+    enum class MasterState { Unknown, Highest, Syncing, Alone };
+    MasterState master_state = MasterState::Unknown;
+    uavcan::NodeID remote_master_node_id;
+
+    const auto report_state = [&](MasterState new_state, const char* text)
+        {
+            if ((new_state != master_state) || (slave.getMasterNodeID() != remote_master_node_id))
+            {
+                master_state = new_state;
+                remote_master_node_id = slave.getMasterNodeID();
+                std::cout << text << "; remote master Node ID " << int(remote_master_node_id.get()) << std::endl;
+            }
+        };
+
     uavcan::Timer master_timer(node);
     master_timer.setCallback([&](const uavcan::TimerEvent&)
         {
@@ -82,8 +120,7 @@ int main(int argc, const char** argv)
                      * lower priority masters.
                      */
                     slave.suppress(true);  // SUPPRESS
-                    std::cout << "I am the highest priority master; the next one has Node ID "
-                              << int(slave.getMasterNodeID().get()) << std::endl;
+                    report_state(MasterState::Highest, "I am the highest priority master");
                 }
                 else
                 {
@@ -92,8 +129,7 @@ int main(int argc, const char** argv)
                      * We need to allow the slave to adjust our local clock in order to be in sync.
                      */
                     slave.suppress(false);  // UNSUPPRESS
-                    std::cout << "Syncing with a higher priority master with Node ID "
-                              << int(slave.getMasterNodeID().get()) << std::endl;
+                    report_state(MasterState::Syncing, "Syncing with a higher priority master");
                 }
             }
             else
@@ -104,7 +140,7 @@ int main(int argc, const char** argv)
                  * lower priority master suddenly appears in the network.
                  */
                 slave.suppress(true);
-                std::cout << "No other masters detected in the network" << std::endl;
+                report_state(MasterState::Alone, "No other masters detected in the network");
             }
             /*
              * Publish the sync message now, even if we're not a higher priority master.
@@ -117,7 +153,7 @@ int main(int argc, const char** argv)
             }
         });
 
-    master_timer.startPeriodic(uavcan::MonotonicDuration::fromMSec(1000));
+    master_timer.startPeriodic(uavcan::MonotonicDuration::fromMSec(publication_period_ms));
 
     /*
      * Running the node.
@@ -0,0 +1,395 @@
+/**
+ * Time synchronization slave that filters the measurements instead of applying every correction in one step.
+ *
+ * The standard slave (uavcan::GlobalTimeSyncSlave) measures the phase error on every second sync message and
+ * passes it to ISystemClock::adjustUtc() as is, so the timestamp noise of every single measurement goes straight
+ * into the local clock. The slave implemented here uses every pair of consecutive sync messages instead, and feeds
+ * the measurements into a Kalman filter that tracks the offset of the master's clock relative to the local
+ * monotonic clock, as well as its drift rate. The filtered estimate is then exposed as the UTC clock of the node:
+ *
+ *  - ClockFilter - the filter itself; it also rejects outliers and keeps the statistics.
+ *  - DisciplinedClock - an implementation of uavcan::ISystemClock that takes the monotonic time from the platform
+ *    clock and computes the UTC time from the filter state. The node must be constructed with this clock.
+ *  - FilteredTimeSyncSlave - subscribes to the sync messages, selects the master, and updates the filter.
+ *
+ * The reception timestamps provided by the CAN driver are preferred, because they are sampled as close to the
+ * hardware as the driver allows (e.g. by the kernel in the case of SocketCAN), whereas the monotonic timestamps
+ * may be sampled later, when the frame is read by the application.
+ *
+ * Do not run uavcan::GlobalTimeSyncSlave on the same node, since its adjustments would be applied on top of
+ * the filtered estimate.
+ *
+ * @file time_sync_filter.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <cmath>                                    // For std::sqrt(), std::abs(), std::llround()
+#include <cstdint>
+#include <functional>                               // For std::function
+#include <uavcan/uavcan.hpp>                        // Main libuavcan header
+#include <uavcan/protocol/GlobalTimeSync.hpp>       // For uavcan::protocol::GlobalTimeSync
+
+namespace time_sync_filter
+{
+/**
+ * Default values are suitable for a typical crystal oscillator and a CAN bus with moderate load.
+ */
+struct FilterConfig
+{
+    double measurement_noise_usec = 10.0;       ///< Standard deviation of the timestamp noise
+    double offset_process_noise = 0.1;          ///< Random walk of the phase, usec per sqrt(second)
+    double drift_process_noise = 0.01;          ///< Random walk of the drift rate, ppm per sqrt(second)
+    double initial_drift_uncertainty_ppm = 100.0;
+    double outlier_threshold = 5.0;             ///< In standard deviations of the innovation
+    unsigned max_consecutive_outliers = 5;      ///< The filter is restarted after this many outliers in a row
+    double jitter_averaging_factor = 0.1;       ///< Weight of the latest residual in the jitter estimate
+    bool prefer_driver_timestamps = true;
+};
+
+/**
+ * All fields are in microseconds unless stated otherwise.
+ */
+struct FilterStatistics
+{
+    bool synchronized = false;
+    uavcan::NodeID master_node_id;              ///< Invalid if there is no master
+    bool using_driver_timestamps = false;
+
+    double residual_usec = 0.0;                 ///< Prediction error of the latest accepted measurement
+    double jitter_usec = 0.0;                   ///< Averaged RMS of the residuals
+    double drift_ppm = 0.0;                     ///< Rate of the master's clock relative to the local monotonic clock
+    double offset_stddev_usec = 0.0;            ///< Estimated uncertainty of the disciplined clock
+
+    std::uint32_t num_measurements = 0;
+    std::uint32_t num_outliers = 0;
+    std::uint32_t num_resets = 0;
+};
+
+/**
+ * Two-state Kalman filter: offset of the master's clock relative to the local monotonic clock, and its drift rate.
+ * The offset is kept relative to the first measurement, so that the double precision is not wasted on the epoch.
+ */
+class ClockFilter
+{
+    const FilterConfig config_;
+
+    bool initialized_ = false;
+    std::int64_t base_offset_usec_ = 0;
+    std::uint64_t last_update_mono_usec_ = 0;
+    double offset_ = 0.0;                           ///< Relative to the base offset, usec
+    double drift_ = 0.0;                            ///< usec per second, i.e. ppm
+    double cov_[2][2] = {};
+    double jitter_squared_ = 0.0;
+    unsigned num_consecutive_outliers_ = 0;
+
+    FilterStatistics stats_;
+
+    void initialize(std::uint64_t mono_usec, std::int64_t measured_offset_usec)
+    {
+        const double r = config_.measurement_noise_usec;
+        const double d = config_.initial_drift_uncertainty_ppm;
+
+        initialized_ = true;
+        base_offset_usec_ = measured_offset_usec;
+        last_update_mono_usec_ = mono_usec;
+        offset_ = 0.0;
+        drift_ = 0.0;
+        cov_[0][0] = r * r;
+        cov_[0][1] = cov_[1][0] = 0.0;
+        cov_[1][1] = d * d;
+        jitter_squared_ = 0.0;
+        num_consecutive_outliers_ = 0;
+    }
+
+public:
+    explicit ClockFilter(const FilterConfig& config = FilterConfig()) :
+        config_(config)
+    { }
+
+    /**
+     * Forgets the state, e.g. when the master changes.
+     */
+    void reset()
+    {
+        if (initialized_)
+        {
+            stats_.num_resets++;
+        }
+        initialized_ = false;
+        stats_.synchronized = false;
+    }
+
+    /**
+     * @param mono_usec             Monotonic time at which the measurement was taken.
+     * @param measured_offset_usec  Master's UTC minus local monotonic time.
+     * @return                      False if the measurement has been rejected as an outlier.
+     */
+    bool update(std::uint64_t mono_usec, std::int64_t measured_offset_usec)
+    {
+        stats_.num_measurements++;
+
+        if (!initialized_)
+        {
+            initialize(mono_usec, measured_offset_usec);
+            stats_.synchronized = true;
+            stats_.residual_usec = 0.0;
+            return true;
+        }
+
+        /*
+         * Prediction. The measurements are expected to arrive in order; an out of order one is treated as
+         * simultaneous with the previous one.
+         */
+        const double dt =
+            (mono_usec > last_update_mono_usec_) ? (double(mono_usec - last_update_mono_usec_) * 1e-6) : 0.0;
+        const double qo = config_.offset_process_noise * config_.offset_process_noise;
+        const double qd = config_.drift_process_noise * config_.drift_process_noise;
+
+        const double pred_offset = offset_ + drift_ * dt;
+        const double p00 = cov_[0][0] + dt * (cov_[1][0] + cov_[0][1]) + dt * dt * cov_[1][1] +
+                           qo * dt + qd * dt * dt * dt / 3.0;
+        const double p01 = cov_[0][1] + dt * cov_[1][1] + qd * dt * dt / 2.0;
+        const double p11 = cov_[1][1] + qd * dt;
+
+        /*
+         * Outlier rejection. If the measurements keep disagreeing with the prediction, the master's clock has
+         * most likely been stepped, so the filter is restarted.
+         */
+        const double innovation = double(measured_offset_usec - base_offset_usec_) - pred_offset;
+        const double r = config_.measurement_noise_usec;
+        const double innovation_variance = p00 + r * r;
+
+        if (std::abs(innovation) > config_.outlier_threshold * std::sqrt(innovation_variance))
+        {
+            stats_.num_outliers++;
+            num_consecutive_outliers_++;
+            if (num_consecutive_outliers_ >= config_.max_consecutive_outliers)
+            {
+                reset();
+                initialize(mono_usec, measured_offset_usec);
+                stats_.synchronized = true;
+            }
+            return false;
+        }
+        num_consecutive_outliers_ = 0;
+
+        /*
+         * Correction.
+         */
+        const double k0 = p00 / innovation_variance;
+        const double k1 = p01 / innovation_variance;
+
+        offset_ = pred_offset + k0 * innovation;
+        drift_ += k1 * innovation;
+        cov_[0][0] = (1.0 - k0) * p00;
+        cov_[0][1] = cov_[1][0] = (1.0 - k0) * p01;
+        cov_[1][1] = p11 - k1 * p01;
+        last_update_mono_usec_ = mono_usec;
+
+        const double a = config_.jitter_averaging_factor;
+        jitter_squared_ = (1.0 - a) * jitter_squared_ + a * innovation * innovation;
+
+        stats_.residual_usec = innovation;
+        stats_.jitter_usec = std::sqrt(jitter_squared_);
+        stats_.drift_ppm = drift_;
+        stats_.offset_stddev_usec = std::sqrt(cov_[0][0]);
+        return true;
+    }
+
+    /**
+     * Estimated offset of the master's clock relative to the local monotonic clock at the specified time.
+     * The filter must be initialized.
+     */
+    std::int64_t getOffsetUSec(std::uint64_t mono_usec) const
+    {
+        const double dt = (double(mono_usec) - double(last_update_mono_usec_)) * 1e-6;
+        return base_offset_usec_ + std::llround(offset_ + drift_ * dt);
+    }
+
+    /**
+     * Applies a step to the estimate, e.g. if the application adjusts the clock explicitly.
+     */
+    void shift(std::int64_t adjustment_usec)
+    {
+        base_offset_usec_ += adjustment_usec;
+    }
+
+    bool isInitialized() const { return initialized_; }
+
+    const FilterConfig& getConfig() const { return config_; }
+
+    FilterStatistics& getStatistics() { return stats_; }
+    const FilterStatistics& getStatistics() const { return stats_; }
+};
+
+/**
+ * UTC is computed from the local monotonic clock and the filter state.
+ * Until the first measurement arrives, UTC is taken from the platform clock.
+ */
+class DisciplinedClock : public uavcan::ISystemClock,
+                         uavcan::Noncopyable
+{
+    uavcan::ISystemClock& platform_clock_;
+    ClockFilter filter_;
+
+public:
+    explicit DisciplinedClock(uavcan::ISystemClock& platform_clock, const FilterConfig& config = FilterConfig()) :
+        platform_clock_(platform_clock),
+        filter_(config)
+    { }
+
+    uavcan::MonotonicTime getMonotonic() const override
+    {
+        return platform_clock_.getMonotonic();
+    }
+
+    uavcan::UtcTime getUtc() const override
+    {
+        if (!filter_.isInitialized())
+        {
+            return platform_clock_.getUtc();
+        }
+        const auto mono = platform_clock_.getMonotonic().toUSec();
+        return uavcan::UtcTime::fromUSec(std::uint64_t(std::int64_t(mono) + filter_.getOffsetUSec(mono)));
+    }
+
+    void adjustUtc(uavcan::UtcDuration adjustment) override
+    {
+        if (filter_.isInitialized())
+        {
+            filter_.shift(adjustment.toUSec());
+        }
+        else
+        {
+            platform_clock_.adjustUtc(adjustment);
+        }
+    }
+
+    /**
+     * Converts a UTC timestamp of the platform clock (e.g. the one provided by the CAN driver) to its monotonic time.
+     */
+    uavcan::MonotonicTime convertPlatformUtcToMonotonic(uavcan::UtcTime utc) const
+    {
+        const auto mono_now = std::int64_t(platform_clock_.getMonotonic().toUSec());
+        const auto utc_now = std::int64_t(platform_clock_.getUtc().toUSec());
+        return uavcan::MonotonicTime::fromUSec(std::uint64_t(std::int64_t(utc.toUSec()) - (utc_now - mono_now)));
+    }
+
+    ClockFilter& getFilter() { return filter_; }
+    const ClockFilter& getFilter() const { return filter_; }
+};
+
+/**
+ * Follows the master with the lowest node ID, as required by the specification. Every pair of consecutive sync
+ * messages from the master yields one measurement.
+ */
+class FilteredTimeSyncSlave : uavcan::Noncopyable
+{
+    typedef uavcan::protocol::GlobalTimeSync GlobalTimeSync;
+    typedef std::function<void (const uavcan::ReceivedDataStructure<GlobalTimeSync>&)> GlobalTimeSyncCallback;
+
+    uavcan::Subscriber<GlobalTimeSync, GlobalTimeSyncCallback> sub_;
+    DisciplinedClock& clock_;
+    const bool prefer_driver_timestamps_;
+
+    uavcan::NodeID master_node_id_;
+    std::uint8_t iface_index_ = 0;
+    uavcan::TransferID prev_transfer_id_;
+    uavcan::MonotonicTime prev_rx_mono_;            ///< Reception time of the previous message, as precise as possible
+    uavcan::MonotonicTime prev_rx_received_at_;     ///< When the previous message was processed
+    bool prev_valid_ = false;
+
+    uavcan::MonotonicTime getPreciseRxTimestamp(const uavcan::ReceivedDataStructure<GlobalTimeSync>& msg)
+    {
+        auto& stats = clock_.getFilter().getStatistics();
+        if (prefer_driver_timestamps_ && !msg.getUtcTimestamp().isZero())
+        {
+            stats.using_driver_timestamps = true;
+            return clock_.convertPlatformUtcToMonotonic(msg.getUtcTimestamp());
+        }
+        stats.using_driver_timestamps = false;
+        return msg.getMonotonicTimestamp();
+    }
+
+    void handleTimeSync(const uavcan::ReceivedDataStructure<GlobalTimeSync>& msg)
+    {
+        const auto timeout = uavcan::MonotonicDuration::fromMSec(GlobalTimeSync::RECOMMENDED_BROADCASTER_TIMEOUT_MS);
+        const auto max_period = uavcan::MonotonicDuration::fromMSec(GlobalTimeSync::MAX_BROADCASTING_PERIOD_MS);
+
+        const bool master_timed_out = prev_valid_ && ((msg.getMonotonicTimestamp() - prev_rx_received_at_) > timeout);
+        const bool switch_master = !master_node_id_.isUnicast() ||
+                                   (msg.getSrcNodeID() < master_node_id_) ||
+                                   ((msg.getSrcNodeID() != master_node_id_) && master_timed_out);
+
+        if (switch_master)
+        {
+            master_node_id_ = msg.getSrcNodeID();
+            iface_index_ = msg.getIfaceIndex();
+            prev_valid_ = false;
+            clock_.getFilter().reset();
+            clock_.getFilter().getStatistics().master_node_id = master_node_id_;
+        }
+        else if ((msg.getSrcNodeID() != master_node_id_) || (msg.getIfaceIndex() != iface_index_))
+        {
+            return;
+        }
+        else
+        {
+            ;   // Same master, same interface
+        }
+
+        const auto rx_mono = getPreciseRxTimestamp(msg);
+
+        /*
+         * The message carries the transmission time of the previous message, which is matched with the local
+         * reception time of the previous message.
+         */
+        if (prev_valid_ &&
+            (msg.previous_transmission_timestamp_usec > 0) &&
+            (prev_transfer_id_.computeForwardDistance(msg.getTransferID()) == 1) &&
+            ((rx_mono - prev_rx_mono_) <= max_period))
+        {
+            const std::int64_t measured_offset = std::int64_t(msg.previous_transmission_timestamp_usec) -
+                                                 std::int64_t(prev_rx_mono_.toUSec());
+            (void)clock_.getFilter().update(prev_rx_mono_.toUSec(), measured_offset);
+        }
+
+        prev_transfer_id_ = msg.getTransferID();
+        prev_rx_mono_ = rx_mono;
+        prev_rx_received_at_ = msg.getMonotonicTimestamp();
+        prev_valid_ = true;
+    }
+
+public:
+    /**
+     * The node must be using the specified clock.
+     */
+    FilteredTimeSyncSlave(uavcan::INode& node, DisciplinedClock& clock) :
+        sub_(node),
+        clock_(clock),
+        prefer_driver_timestamps_(clock.getFilter().getConfig().prefer_driver_timestamps)
+    { }
+
+    int start()
+    {
+        return sub_.start(std::bind(&FilteredTimeSyncSlave::handleTimeSync, this, std::placeholders::_1));
+    }
+
+    /**
+     * Whether the master has been heard from recently.
+     */
+    bool isActive() const
+    {
+        const auto timeout = uavcan::MonotonicDuration::fromMSec(GlobalTimeSync::RECOMMENDED_BROADCASTER_TIMEOUT_MS);
+        return prev_valid_ && ((clock_.getMonotonic() - prev_rx_received_at_) <= timeout);
+    }
+
+    uavcan::NodeID getMasterNodeID() const { return isActive() ? master_node_id_ : uavcan::NodeID(); }
+
+    const FilterStatistics& getStatistics() const { return clock_.getFilter().getStatistics(); }
+};
+
+}
@@ -0,0 +1,160 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <unistd.h>
+#include <uavcan/uavcan.hpp>
+
+/*
+ * The engine is implemented in a separate header (see below).
+ */
+#include "param_configurator_engine.hpp"
+
+extern uavcan::ICanDriver& getCanDriver();
+extern uavcan::ISystemClock& getSystemClock();
+
+/*
+ * Every call in flight may need a reception buffer for a multi-frame response, so the memory pool is larger
+ * than in the other tutorials.
+ */
+constexpr unsigned NodeMemoryPoolSize = 65536;
+
+using param_configurator::ParamConfiguratorEngine;
+
+static void spinUntilIdle(uavcan::INode& node, const ParamConfiguratorEngine& engine)
+{
+    while (!engine.isIdle())
+    {
+        const int res = node.spin(uavcan::MonotonicDuration::fromMSec(10));
+        if (res < 0)
+        {
+            std::cerr << "Transient failure: " << res << std::endl;
+        }
+    }
+}
+
+static double getElapsedSec(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+int main(int argc, const char** argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <node-id> <remote-node-id> [remote-node-id...]" << std::endl;
+        return 1;
+    }
+
+    const uavcan::NodeID self_node_id = std::stoi(argv[1]);
+    std::vector<uavcan::NodeID> remote_node_ids;
+    for (int i = 2; i < argc; i++)
+    {
+        remote_node_ids.push_back(std::stoi(argv[i]));
+    }
+
+    uavcan::Node<NodeMemoryPoolSize> node(getCanDriver(), getSystemClock());
+    node.setNodeID(self_node_id);
+    node.setName("org.uavcan.tutorial.batch_configurator");
+
+    const int node_start_res = node.start();
+    if (node_start_res < 0)
+    {
+        throw std::runtime_error("Failed to start the node; error: " + std::to_string(node_start_res));
+    }
+
+    node.setModeOperational();
+
+    /*
+     * At most 4 calls per remote node and 16 calls in total will be in flight at any moment.
+     */
+    ParamConfiguratorEngine engine(node, 4, 16);
+    const int engine_init_res = engine.init();
+    if (engine_init_res < 0)
+    {
+        throw std::runtime_error("Failed to init the engine; error: " + std::to_string(engine_init_res));
+    }
+
+    /*
+     * Reading all params from all remote nodes at once.
+     */
+    auto started_at = std::chrono::steady_clock::now();
+    for (auto nid : remote_node_ids)
+    {
+        engine.fetchAll(nid);
+    }
+    spinUntilIdle(node, engine);
+
+    for (auto nid : remote_node_ids)
+    {
+        const auto& p = *engine.getNodeParams(nid);
+        std::cout << "Node " << int(nid.get()) << ": " << p.params.size() << " params, "
+                  << (p.listed ? "complete" : "INCOMPLETE") << ", " << p.num_failed_calls << " failed calls"
+                  << std::endl;
+    }
+    std::cout << "Param read done in " << getElapsedSec(started_at) << " sec\n\n" << std::endl;
+
+    /*
+     * Setting all parameters to their maximum values, if applicable. The parameters that are already at their
+     * maximum values are not written.
+     */
+    started_at = std::chrono::steady_clock::now();
+    unsigned num_writes = 0;
+    for (auto nid : remote_node_ids)
+    {
+        for (auto& p : engine.getNodeParams(nid)->params)
+        {
+            uavcan::protocol::param::Value value;
+            if (p.max_value.is(uavcan::protocol::param::NumericValue::Tag::integer_value))
+            {
+                value.to<uavcan::protocol::param::Value::Tag::integer_value>() =
+                    p.max_value.to<uavcan::protocol::param::NumericValue::Tag::integer_value>();
+            }
+            else if (p.max_value.is(uavcan::protocol::param::NumericValue::Tag::real_value))
+            {
+                value.to<uavcan::protocol::param::Value::Tag::real_value>() =
+                    p.max_value.to<uavcan::protocol::param::NumericValue::Tag::real_value>();
+            }
+            else
+            {
+                continue;
+            }
+
+            if (engine.set(nid, p.name.c_str(), value))
+            {
+                num_writes++;
+            }
+        }
+    }
+    spinUntilIdle(node, engine);
+    std::cout << "Param set done in " << getElapsedSec(started_at) << " sec, " << num_writes << " params written\n\n"
+              << std::endl;
+
+    /*
+     * Reading back only the parameters that have been written.
+     */
+    started_at = std::chrono::steady_clock::now();
+    for (auto nid : remote_node_ids)
+    {
+        engine.verify(nid);
+    }
+    spinUntilIdle(node, engine);
+
+    for (auto nid : remote_node_ids)
+    {
+        for (auto& name : engine.getNodeParams(nid)->mismatched)
+        {
+            std::cout << "Node " << int(nid.get()) << ": param '" << name << "' does not match" << std::endl;
+        }
+        for (auto& name : engine.getNodeParams(nid)->failed_writes)
+        {
+            std::cout << "Node " << int(nid.get()) << ": param '" << name << "' could not be written" << std::endl;
+        }
+        for (auto& name : engine.getNodeParams(nid)->failed_verifications)
+        {
+            std::cout << "Node " << int(nid.get()) << ": param '" << name << "' could not be read back" << std::endl;
+        }
+    }
+    std::cout << "Param verify done in " << getElapsedSec(started_at) << " sec" << std::endl;
+
+    return 0;
+}
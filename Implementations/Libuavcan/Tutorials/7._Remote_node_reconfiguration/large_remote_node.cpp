@@ -0,0 +1,142 @@
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <uavcan/uavcan.hpp>
+#include <uavcan/protocol/param_server.hpp>
+
+/*
+ * The param manager is implemented in a separate header (see below).
+ */
+#include "table_param_manager.hpp"
+
+extern uavcan::ICanDriver& getCanDriver();
+extern uavcan::ISystemClock& getSystemClock();
+
+constexpr unsigned NodeMemoryPoolSize = 16384;
+
+constexpr unsigned NumMotors = 32;
+constexpr unsigned MaxParams = 256;
+
+/*
+ * The configuration storage. The parameters are bound to these variables, so the application can use them directly.
+ */
+static struct Params
+{
+    unsigned foo = 0;
+    float bar = 0.0F;
+    double baz = 0.0;
+    std::string booz;
+    bool armed_on_boot = false;
+
+    struct Motor
+    {
+        float kp = 0.0F;
+        float ki = 0.0F;
+        float kd = 0.0F;
+        std::int32_t max_rpm = 0;
+        std::uint8_t pole_pairs = 0;
+        bool reverse = false;
+    } motors[NumMotors];
+} configuration;
+
+static table_param_manager::TableParamManager<MaxParams> param_manager;
+
+/*
+ * The names must outlive the manager, so the names of the generated parameters are stored here.
+ */
+static std::string motor_param_names[NumMotors][6];
+
+static void check(int res, const std::string& what)
+{
+    if (res < 0)
+    {
+        throw std::runtime_error("Failed to register " + what + "; error: " + std::to_string(res));
+    }
+}
+
+static void registerParams()
+{
+    check(param_manager.addInteger("foo", configuration.foo, 42U, 0U, 9000U), "foo");
+    check(param_manager.addReal("bar", configuration.bar, 0.123456F, 0.0F, 1.0F), "bar");
+    check(param_manager.addReal("baz", configuration.baz, 1e-5, 0.0, 1.0), "baz");
+    check(param_manager.addString("booz", configuration.booz, "Hello world!"), "booz");
+    check(param_manager.addBoolean("armed_on_boot", configuration.armed_on_boot, false), "armed_on_boot");
+
+    for (unsigned i = 0; i < NumMotors; i++)
+    {
+        auto& m = configuration.motors[i];
+        auto& names = motor_param_names[i];
+        const std::string prefix = "motor" + std::to_string(i) + ".";
+        names[0] = prefix + "kp";
+        names[1] = prefix + "ki";
+        names[2] = prefix + "kd";
+        names[3] = prefix + "max_rpm";
+        names[4] = prefix + "pole_pairs";
+        names[5] = prefix + "reverse";
+
+        check(param_manager.addReal(names[0].c_str(), m.kp, 0.5F, 0.0F, 10.0F), names[0]);
+        check(param_manager.addReal(names[1].c_str(), m.ki, 0.1F, 0.0F, 10.0F), names[1]);
+        check(param_manager.addReal(names[2].c_str(), m.kd, 0.0F, 0.0F, 10.0F), names[2]);
+        check(param_manager.addInteger(names[3].c_str(), m.max_rpm, 12000, 0, 60000), names[3]);
+        check(param_manager.addInteger<std::uint8_t>(names[4].c_str(), m.pole_pairs, 7, 1, 50), names[4]);
+        check(param_manager.addBoolean(names[5].c_str(), m.reverse, false), names[5]);
+    }
+
+    /*
+     * The perfect hash is built once all parameters are known.
+     */
+    check(param_manager.finalize(), "the hash table");
+
+    /*
+     * A real application would write the values into the non-volatile memory here.
+     * Only the parameters that have been changed since the last save are passed to the handler.
+     */
+    param_manager.setSaveHandler([](uavcan::IParamManager::Index index, const char* name,
+                                    const uavcan::IParamManager::Value& value)
+        {
+            std::cout << "Saving param #" << index << " '" << name << "':\n" << value << std::endl;
+            return 0;
+        });
+}
+
+int main(int argc, const char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <node-id>" << std::endl;
+        return 1;
+    }
+
+    const int self_node_id = std::stoi(argv[1]);
+
+    uavcan::Node<NodeMemoryPoolSize> node(getCanDriver(), getSystemClock());
+    node.setNodeID(self_node_id);
+    node.setName("org.uavcan.tutorial.large_configuree");
+
+    const int node_start_res = node.start();
+    if (node_start_res < 0)
+    {
+        throw std::runtime_error("Failed to start the node; error: " + std::to_string(node_start_res));
+    }
+
+    registerParams();
+    std::cout << param_manager.getNumParams() << " params registered" << std::endl;
+
+    uavcan::ParamServer server(node);
+    const int server_start_res = server.start(&param_manager);
+    if (server_start_res < 0)
+    {
+        throw std::runtime_error("Failed to start ParamServer: " + std::to_string(server_start_res));
+    }
+
+    node.setModeOperational();
+    while (true)
+    {
+        const int res = node.spin(uavcan::MonotonicDuration::getInfinite());
+        if (res < 0)
+        {
+            std::cerr << "Transient failure: " << res << std::endl;
+        }
+    }
+}
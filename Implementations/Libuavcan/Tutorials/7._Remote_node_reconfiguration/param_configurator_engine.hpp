@@ -0,0 +1,469 @@
+/**
+ * Asynchronous engine for reading and writing configuration parameters of many remote nodes at once.
+ *
+ * A blocking GetSet call per parameter is limited by the round trip time: the configurator spends most of its time
+ * waiting for the responses. This engine keeps a bounded number of GetSet calls in flight per remote node and in
+ * total, reusing one service client for all of them, and stores the results in a local cache:
+ *  - Listing of the parameters by index is speculative: the indices are requested ahead of time, and the listing
+ *    is finished once a response with an empty name is received and all lower indices have been read.
+ *  - Writes are skipped if the cached value is already equal to the new one.
+ *  - The verification pass re-reads only the parameters that have been written by the engine.
+ *
+ * The engine is driven by the node: enqueue the work, then spin the node until isIdle() returns true.
+ * Failed calls are retried a few times, then counted as failures of the respective node; if a listing call fails,
+ * the listing of that node is aborted, so that an offline node doesn't keep the engine busy. The parameters that
+ * could not be written are reported separately from the ones that failed the verification, and from the ones that
+ * could not be read back.
+ *
+ * @file param_configurator_engine.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <deque>                                    // For std::deque
+#include <algorithm>                                // For std::min()
+#include <map>                                      // For std::map
+#include <string>                                   // For std::string
+#include <vector>                                   // For std::vector
+#include <functional>                               // For std::function
+#include <uavcan/uavcan.hpp>                        // Main libuavcan header
+#include <uavcan/protocol/param/GetSet.hpp>         // For uavcan::protocol::param::GetSet
+
+namespace param_configurator
+{
+using uavcan::protocol::param::GetSet;
+using uavcan::protocol::param::Value;
+
+/**
+ * Local copy of the parameters of one remote node.
+ */
+struct RemoteNodeParams
+{
+    std::vector<GetSet::Response> params;                   ///< Ordered by index
+    bool listed = false;                                    ///< All parameters have been read
+    std::map<std::string, Value> written;                   ///< Written values that are not verified yet
+    std::vector<std::string> mismatched;                    ///< Verification failed
+    std::vector<std::string> failed_writes;                 ///< No such parameter, or the calls have failed
+    std::vector<std::string> failed_verifications;          ///< The read-back calls have failed
+    unsigned num_failed_calls = 0;
+
+    const GetSet::Response* find(const std::string& name) const
+    {
+        for (auto& p : params)
+        {
+            if (name == p.name.c_str())
+            {
+                return &p;
+            }
+        }
+        return nullptr;
+    }
+};
+
+class ParamConfiguratorEngine : private uavcan::TimerBase
+{
+public:
+    static constexpr unsigned DefaultMaxCallsPerNode = 4;
+    static constexpr unsigned DefaultMaxCallsInFlight = 16;
+    static constexpr unsigned MaxAttempts = 3;
+
+    /**
+     * The highest parameter index that can be represented in a GetSet request, plus one.
+     */
+    static constexpr unsigned MaxParams = 8192;
+
+private:
+    typedef std::function<void (const uavcan::ServiceCallResult<GetSet>&)> Callback;
+
+    /**
+     * States of the calls are allocated from the node's memory pool if there are more than this number
+     * of calls in flight.
+     */
+    static constexpr unsigned NumStaticCalls = DefaultMaxCallsInFlight;
+
+    enum class JobKind { List, Set, Verify };
+
+    struct Job
+    {
+        uavcan::NodeID node_id;
+        JobKind kind = JobKind::List;
+        GetSet::Request request;
+        unsigned attempts = 0;
+    };
+
+    struct NodeState
+    {
+        RemoteNodeParams cache;
+        std::deque<Job> queue;                  ///< Retries and the jobs that didn't fit into the limits
+        unsigned num_calls_in_flight = 0;
+
+        bool listing = false;
+        bool listing_failed = false;
+        unsigned next_index = 0;                ///< Next index to request speculatively
+        unsigned num_params = MaxParams;        ///< Becomes known when an empty name is received
+        unsigned num_listed = 0;
+        unsigned num_listing_calls = 0;         ///< Queued or in flight
+    };
+
+    uavcan::ServiceClient<GetSet, Callback, NumStaticCalls> client_;
+    const unsigned max_calls_per_node_;
+    const unsigned max_calls_in_flight_;
+
+    std::map<std::uint8_t, NodeState> nodes_;
+    std::map<std::uint16_t, Job> calls_in_flight_;      ///< Key is made of the server node ID and transfer ID
+    std::uint8_t last_served_node_id_ = 0;
+
+    static std::uint16_t makeCallKey(const uavcan::ServiceCallID& call_id)
+    {
+        return std::uint16_t((call_id.server_node_id.get() << 8) | call_id.transfer_id.get());
+    }
+
+    bool wantsMoreListingCalls(const NodeState& ns) const
+    {
+        return ns.listing && !ns.listing_failed && (ns.next_index < ns.num_params);
+    }
+
+    /**
+     * Starts as many calls as the limits allow. The nodes are served in round robin order.
+     * The timer is not restarted: once the limits are reached, nothing can be started until a call completes.
+     */
+    void pump()
+    {
+        bool progress = true;
+        while (progress && (calls_in_flight_.size() < max_calls_in_flight_))
+        {
+            progress = false;
+            auto it = nodes_.upper_bound(last_served_node_id_);
+            for (unsigned i = 0; i < nodes_.size(); i++, it++)
+            {
+                if (it == nodes_.end())
+                {
+                    it = nodes_.begin();
+                }
+                NodeState& ns = it->second;
+                if (ns.num_calls_in_flight >= max_calls_per_node_)
+                {
+                    continue;
+                }
+
+                Job job;
+                if (!ns.queue.empty())
+                {
+                    job = ns.queue.front();
+                    ns.queue.pop_front();
+                    if ((job.kind == JobKind::List) && (job.request.index >= ns.num_params))
+                    {
+                        completeListingCall(ns);        // This index is known to be empty by now
+                        progress = true;
+                        break;
+                    }
+                }
+                else if (wantsMoreListingCalls(ns))
+                {
+                    job.node_id = it->first;
+                    job.kind = JobKind::List;
+                    job.request.index = std::uint16_t(ns.next_index++);
+                    ns.num_listing_calls++;
+                }
+                else
+                {
+                    continue;
+                }
+
+                startCall(ns, job);
+                last_served_node_id_ = it->first;
+                progress = true;
+                break;
+            }
+        }
+    }
+
+    void startCall(NodeState& ns, Job& job)
+    {
+        job.attempts++;
+        uavcan::ServiceCallID call_id;
+        const int res = client_.call(job.node_id, job.request, call_id);
+        if (res < 0)
+        {
+            handleFailure(ns, job);
+            return;
+        }
+        ns.num_calls_in_flight++;
+        calls_in_flight_[makeCallKey(call_id)] = job;
+    }
+
+    void handleFailure(NodeState& ns, const Job& job)
+    {
+        if (job.attempts < MaxAttempts)
+        {
+            ns.queue.push_front(job);           // GetSet is idempotent, so it's safe to repeat
+            return;
+        }
+        ns.cache.num_failed_calls++;
+        if (job.kind == JobKind::List)
+        {
+            ns.listing_failed = true;
+            completeListingCall(ns);
+        }
+        else if (job.kind == JobKind::Set)
+        {
+            ns.cache.failed_writes.push_back(job.request.name.c_str());
+        }
+        else if (job.kind == JobKind::Verify)
+        {
+            const std::string name(job.request.name.c_str());
+            ns.cache.failed_verifications.push_back(name);
+            ns.cache.written.erase(name);
+        }
+    }
+
+    void completeListingCall(NodeState& ns)
+    {
+        ns.num_listing_calls--;
+        if (ns.listing && !wantsMoreListingCalls(ns) && (ns.num_listing_calls == 0))
+        {
+            ns.listing = false;
+            ns.cache.listed = !ns.listing_failed && (ns.num_listed == ns.num_params);
+            if (ns.cache.listed)
+            {
+                ns.cache.params.resize(ns.num_params);  // Drops the responses to the indices that turned out empty
+            }
+        }
+    }
+
+    void handleListResponse(NodeState& ns, const Job& job, const GetSet::Response& response)
+    {
+        const unsigned index = job.request.index;
+        if (response.name.empty())
+        {
+            // Empty name means that there is no such parameter, so all higher indices are empty too
+            if (index < ns.num_params)
+            {
+                ns.num_params = index;
+                ns.next_index = std::min(ns.next_index, ns.num_params);
+            }
+        }
+        else if (index < ns.num_params)
+        {
+            if (ns.cache.params.size() <= index)
+            {
+                ns.cache.params.resize(index + 1U);
+            }
+            if (ns.cache.params[index].name.empty())
+            {
+                ns.num_listed++;
+            }
+            ns.cache.params[index] = response;
+        }
+        completeListingCall(ns);
+    }
+
+    void handleSetResponse(NodeState& ns, const Job& job, const GetSet::Response& response)
+    {
+        const std::string name = job.request.name.c_str();
+        if (response.name.empty())
+        {
+            ns.cache.failed_writes.push_back(name);     // No such parameter
+            return;
+        }
+
+        // The response contains the value that has actually been applied, which may differ from the requested one
+        for (auto& p : ns.cache.params)
+        {
+            if (name == p.name.c_str())
+            {
+                p = response;
+            }
+        }
+        ns.cache.written[name] = response.value;
+    }
+
+    void handleVerifyResponse(NodeState& ns, const Job& job, const GetSet::Response& response)
+    {
+        const std::string name = job.request.name.c_str();
+        const auto expected = ns.cache.written.find(name);
+        if (expected == ns.cache.written.end())
+        {
+            return;
+        }
+        if (response.name.empty() || !(response.value == expected->second))
+        {
+            ns.cache.mismatched.push_back(name);
+        }
+        ns.cache.written.erase(expected);
+    }
+
+    void handleCallResult(const uavcan::ServiceCallResult<GetSet>& result)
+    {
+        const auto it = calls_in_flight_.find(makeCallKey(result.getCallID()));
+        if (it == calls_in_flight_.end())
+        {
+            return;
+        }
+        const Job job = it->second;
+        calls_in_flight_.erase(it);
+
+        NodeState& ns = nodes_[job.node_id.get()];
+        ns.num_calls_in_flight--;
+
+        if (!result.isSuccessful())
+        {
+            handleFailure(ns, job);
+        }
+        else if (job.kind == JobKind::List)
+        {
+            handleListResponse(ns, job, result.getResponse());
+        }
+        else if (job.kind == JobKind::Set)
+        {
+            handleSetResponse(ns, job, result.getResponse());
+        }
+        else
+        {
+            handleVerifyResponse(ns, job, result.getResponse());
+        }
+
+        // New calls are not started from the callback; the credit is used when the node gets back to its timers
+        if (!isIdle())
+        {
+            schedulePump();
+        }
+    }
+
+    void handleTimerEvent(const uavcan::TimerEvent&) override
+    {
+        pump();
+    }
+
+    void schedulePump()
+    {
+        startOneShotWithDelay(uavcan::MonotonicDuration());
+    }
+
+    void enqueue(uavcan::NodeID node_id, const Job& job)
+    {
+        nodes_[node_id.get()].queue.push_back(job);
+        schedulePump();
+    }
+
+public:
+    explicit ParamConfiguratorEngine(uavcan::INode& node,
+                                     unsigned max_calls_per_node = DefaultMaxCallsPerNode,
+                                     unsigned max_calls_in_flight = DefaultMaxCallsInFlight) :
+        uavcan::TimerBase(node),
+        client_(node),
+        max_calls_per_node_(max_calls_per_node),
+        max_calls_in_flight_(max_calls_in_flight)
+    { }
+
+    /**
+     * Must be called once before use.
+     * @param request_timeout   Calls that take longer are retried.
+     */
+    int init(uavcan::MonotonicDuration request_timeout = uavcan::MonotonicDuration::fromMSec(500))
+    {
+        if ((max_calls_per_node_ == 0) || (max_calls_in_flight_ == 0))
+        {
+            return -uavcan::ErrInvalidParam;
+        }
+        const int res = client_.init();
+        if (res < 0)
+        {
+            return res;
+        }
+        client_.setRequestTimeout(request_timeout);
+        client_.setCallback([this](const uavcan::ServiceCallResult<GetSet>& result) { handleCallResult(result); });
+        return 0;
+    }
+
+    /**
+     * Reads all parameters of the remote node into the cache, replacing the previous contents.
+     */
+    void fetchAll(uavcan::NodeID node_id)
+    {
+        NodeState& ns = nodes_[node_id.get()];
+        ns.cache.params.clear();
+        ns.cache.listed = false;
+        ns.listing = true;
+        ns.listing_failed = false;
+        ns.next_index = 0;
+        ns.num_params = MaxParams;
+        ns.num_listed = 0;
+        schedulePump();
+    }
+
+    /**
+     * Writes the parameter, unless the cache says that it already has this value.
+     * @return True if a call has been enqueued.
+     */
+    bool set(uavcan::NodeID node_id, const std::string& name, const Value& value)
+    {
+        const GetSet::Response* const cached = nodes_[node_id.get()].cache.find(name);
+        if ((cached != nullptr) && (cached->value == value))
+        {
+            return false;
+        }
+        Job job;
+        job.node_id = node_id;
+        job.kind = JobKind::Set;
+        job.request.name = name.c_str();
+        job.request.value = value;
+        enqueue(node_id, job);
+        return true;
+    }
+
+    /**
+     * Re-reads the parameters that have been written since the last verification, and compares them with
+     * the values reported in the responses to the writes. The parameters that don't match are reported
+     * in RemoteNodeParams::mismatched, and the ones that could not be read back in
+     * RemoteNodeParams::failed_verifications; the writes that have failed are kept in RemoteNodeParams::failed_writes.
+     */
+    void verify(uavcan::NodeID node_id)
+    {
+        NodeState& ns = nodes_[node_id.get()];
+        ns.cache.mismatched.clear();
+        ns.cache.failed_verifications.clear();
+        for (auto& kv : ns.cache.written)
+        {
+            Job job;
+            job.node_id = node_id;
+            job.kind = JobKind::Verify;
+            job.request.name = kv.first.c_str();
+            enqueue(node_id, job);
+        }
+    }
+
+    /**
+     * True when there are no calls in flight and nothing left to do.
+     */
+    bool isIdle() const
+    {
+        if (!calls_in_flight_.empty())
+        {
+            return false;
+        }
+        for (auto& kv : nodes_)
+        {
+            if (!kv.second.queue.empty() || wantsMoreListingCalls(kv.second))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Returns nullptr if nothing has been requested from this node.
+     */
+    const RemoteNodeParams* getNodeParams(uavcan::NodeID node_id) const
+    {
+        const auto it = nodes_.find(node_id.get());
+        return (it == nodes_.end()) ? nullptr : &it->second.cache;
+    }
+
+    unsigned getNumCallsInFlight() const { return unsigned(calls_in_flight_.size()); }
+};
+
+}
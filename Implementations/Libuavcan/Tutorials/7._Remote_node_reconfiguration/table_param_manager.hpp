@@ -0,0 +1,615 @@
+/**
+ * Table-driven implementation of uavcan::IParamManager for nodes with many parameters.
+ *
+ * The parameters are registered once at startup, each bound to a typed variable of the application, so the
+ * variables can be used directly and the values are converted to and from uavcan::protocol::param::Value only
+ * when they are accessed via UAVCAN. Access by index is a plain array lookup. Access by name uses a perfect hash
+ * built by finalize(), so that every lookup costs one pass over the name and one string comparison,
+ * regardless of the number of parameters.
+ *
+ * The perfect hash uses the hash-and-displace scheme: the names are distributed among buckets by one part of
+ * the hash, and every bucket gets a displacement that moves all of its names into free slots of the table.
+ * The buckets are placed largest first, while the table is still mostly empty.
+ *
+ * Every parameter that is changed via UAVCAN is marked in a bitmap, so that saveAllParams() can pass only the
+ * modified parameters to the application's save handler.
+ *
+ * @file table_param_manager.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <cstdint>                              // For std::uint8_t, etc.
+#include <cstring>                              // For std::strlen()
+#include <string>                               // For std::string
+#include <bitset>                               // For std::bitset<>
+#include <algorithm>                            // For std::min(), std::max()
+#include <functional>                           // For std::function<>
+#include <type_traits>                          // For std::is_integral<>, etc.
+#include <uavcan/uavcan.hpp>                    // Main libuavcan header
+#include <uavcan/protocol/param_server.hpp>     // For uavcan::IParamManager
+
+namespace table_param_manager
+{
+/**
+ * @tparam MaxParams    Maximum number of parameters; the storage is allocated statically.
+ */
+template <unsigned MaxParams>
+class TableParamManager : public uavcan::IParamManager
+{
+public:
+    /**
+     * Maximum length of a parameter name allowed by uavcan.protocol.param.GetSet.
+     */
+    static constexpr unsigned MaxNameLength = 92;
+
+    /**
+     * Invoked by saveAllParams() for every parameter that has to be saved; non-negative result means success.
+     */
+    typedef std::function<int (Index index, const char* name, const Value& value)> SaveHandler;
+
+private:
+    static constexpr unsigned roundUpToPowerOfTwo(unsigned x, unsigned p = 1)
+    {
+        return (p >= x) ? p : roundUpToPowerOfTwo(x, p * 2U);
+    }
+
+    static constexpr unsigned TableSize = roundUpToPowerOfTwo(MaxParams + MaxParams / 4U + 1U);
+    static constexpr unsigned NumBuckets = (MaxParams + 1U) / 2U;
+
+    static_assert(MaxParams > 0, "At least one parameter is needed");
+    static_assert(TableSize <= 0xFFFFU, "Too many parameters");
+
+    enum class Kind : std::uint8_t { Integer, Real, Boolean, String };
+
+    union Scalar
+    {
+        std::int64_t integer;
+        double real;
+    };
+
+    struct Entry
+    {
+        const char* name = nullptr;
+        unsigned name_length = 0;
+        Kind kind = Kind::Integer;
+        void* storage = nullptr;
+        Scalar (*load)(const void* storage) = nullptr;          ///< Not used for strings
+        void (*store)(void* storage, Scalar value) = nullptr;   ///< Ditto
+        Scalar default_value = Scalar();
+        Scalar min_value = Scalar();
+        Scalar max_value = Scalar();
+        const char* default_string = nullptr;
+    };
+
+    Entry entries_[MaxParams];
+    unsigned num_entries_ = 0;
+
+    std::uint16_t slots_[TableSize] = {};                   ///< Entry index plus one; zero means empty
+    std::uint16_t displacements_[NumBuckets] = {};
+    bool finalized_ = false;
+
+    std::bitset<MaxParams> modified_;
+    SaveHandler save_handler_;
+    bool save_only_modified_ = true;
+
+    /*
+     * Typed access to the application's variables.
+     */
+    template <typename T>
+    static Scalar loadInteger(const void* storage)
+    {
+        Scalar s;
+        s.integer = std::int64_t(*static_cast<const T*>(storage));
+        return s;
+    }
+
+    template <typename T>
+    static void storeInteger(void* storage, Scalar value)
+    {
+        *static_cast<T*>(storage) = T(value.integer);
+    }
+
+    template <typename T>
+    static Scalar loadReal(const void* storage)
+    {
+        Scalar s;
+        s.real = double(*static_cast<const T*>(storage));
+        return s;
+    }
+
+    template <typename T>
+    static void storeReal(void* storage, Scalar value)
+    {
+        *static_cast<T*>(storage) = T(value.real);
+    }
+
+    /*
+     * 64-bit FNV-1a. The lower half defines the starting slot, the upper half defines the bucket and the step.
+     */
+    struct Hash
+    {
+        std::uint32_t slot = 0;
+        std::uint32_t step = 0;
+        std::uint32_t bucket = 0;
+    };
+
+    template <typename Chars>
+    static Hash computeHash(const Chars& chars, unsigned length)
+    {
+        std::uint64_t h = 0xCBF29CE484222325ULL;
+        for (unsigned i = 0; i < length; i++)
+        {
+            h ^= std::uint8_t(chars[i]);
+            h *= 0x100000001B3ULL;
+        }
+        Hash out;
+        out.slot = std::uint32_t(h);
+        out.step = std::uint32_t(h >> 32) | 1U;     // Odd, so that all slots are visited
+        out.bucket = std::uint32_t(h >> 32) % NumBuckets;
+        return out;
+    }
+
+    static unsigned getSlot(const Hash& hash, unsigned displacement)
+    {
+        return (hash.slot + displacement * hash.step) & (TableSize - 1U);
+    }
+
+    template <typename Chars>
+    static bool isSameName(const Entry& e, const Chars& chars, unsigned length)
+    {
+        if (e.name_length != length)
+        {
+            return false;
+        }
+        for (unsigned i = 0; i < length; i++)
+        {
+            if (e.name[i] != char(chars[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename Chars>
+    int findByChars(const Chars& chars, unsigned length) const
+    {
+        if (finalized_)
+        {
+            const Hash hash = computeHash(chars, length);
+            const unsigned slot = slots_[getSlot(hash, displacements_[hash.bucket])];
+            return ((slot > 0) && isSameName(entries_[slot - 1U], chars, length)) ? int(slot - 1U) : -1;
+        }
+        for (unsigned i = 0; i < num_entries_; i++)
+        {
+            if (isSameName(entries_[i], chars, length))
+            {
+                return int(i);
+            }
+        }
+        return -1;
+    }
+
+    int addEntry(const Entry& entry)
+    {
+        if (finalized_)
+        {
+            return -uavcan::ErrLogic;
+        }
+        if (num_entries_ >= MaxParams)
+        {
+            return -uavcan::ErrMemory;
+        }
+        if ((entry.name_length == 0) || (entry.name_length > MaxNameLength) ||
+            (findByChars(entry.name, entry.name_length) >= 0))
+        {
+            return -uavcan::ErrInvalidParam;
+        }
+        entries_[num_entries_] = entry;
+        return int(num_entries_++);
+    }
+
+    static Entry makeEntry(const char* name, Kind kind, void* storage)
+    {
+        Entry e;
+        e.name = name;
+        e.name_length = (name == nullptr) ? 0U : unsigned(std::strlen(name));
+        e.kind = kind;
+        e.storage = storage;
+        return e;
+    }
+
+    bool tryPlaceBucket(const unsigned* members, unsigned num_members, unsigned displacement)
+    {
+        unsigned placed = 0;
+        for (; placed < num_members; placed++)
+        {
+            const Entry& e = entries_[members[placed]];
+            const unsigned slot = getSlot(computeHash(e.name, e.name_length), displacement);
+            if (slots_[slot] != 0)
+            {
+                break;
+            }
+            slots_[slot] = std::uint16_t(members[placed] + 1U);
+        }
+        if (placed == num_members)
+        {
+            return true;
+        }
+        while (placed-- > 0)    // Roll back
+        {
+            const Entry& e = entries_[members[placed]];
+            slots_[getSlot(computeHash(e.name, e.name_length), displacement)] = 0;
+        }
+        return false;
+    }
+
+    /**
+     * Returns true if the value has been changed.
+     */
+    bool assignEntry(Entry& e, const Value& value)
+    {
+        if ((e.kind == Kind::Integer) && value.is(Value::Tag::integer_value))
+        {
+            Scalar s;
+            s.integer = std::max(e.min_value.integer,
+                                 std::min(e.max_value.integer, std::int64_t(*value.as<Value::Tag::integer_value>())));
+            const bool changed = e.load(e.storage).integer != s.integer;
+            e.store(e.storage, s);
+            return changed;
+        }
+        if ((e.kind == Kind::Real) && value.is(Value::Tag::real_value))
+        {
+            Scalar s;
+            s.real = std::max(e.min_value.real,
+                              std::min(e.max_value.real, double(*value.as<Value::Tag::real_value>())));
+            const bool changed = e.load(e.storage).real != s.real;
+            e.store(e.storage, s);
+            return changed;
+        }
+        if ((e.kind == Kind::Boolean) && value.is(Value::Tag::boolean_value))
+        {
+            Scalar s;
+            s.integer = (*value.as<Value::Tag::boolean_value>() != 0) ? 1 : 0;
+            const bool changed = e.load(e.storage).integer != s.integer;
+            e.store(e.storage, s);
+            return changed;
+        }
+        if ((e.kind == Kind::String) && value.is(Value::Tag::string_value))
+        {
+            std::string& str = *static_cast<std::string*>(e.storage);
+            const char* const new_value = value.as<Value::Tag::string_value>()->c_str();
+            const bool changed = str != new_value;
+            str = new_value;
+            return changed;
+        }
+        return false;           // Type mismatch; the value is not changed
+    }
+
+    void readEntry(const Entry& e, Value& out_value) const
+    {
+        switch (e.kind)
+        {
+        case Kind::Integer:
+        {
+            out_value.to<Value::Tag::integer_value>() = e.load(e.storage).integer;
+            break;
+        }
+        case Kind::Real:
+        {
+            out_value.to<Value::Tag::real_value>() = float(e.load(e.storage).real);
+            break;
+        }
+        case Kind::Boolean:
+        {
+            out_value.to<Value::Tag::boolean_value>() = e.load(e.storage).integer != 0;
+            break;
+        }
+        case Kind::String:
+        {
+            out_value.to<Value::Tag::string_value>() = static_cast<const std::string*>(e.storage)->c_str();
+            break;
+        }
+        }
+    }
+
+    void getParamNameByIndex(Index index, Name& out_name) const override
+    {
+        if (index < num_entries_)
+        {
+            out_name = entries_[index].name;
+        }
+    }
+
+    void assignParamValue(const Name& name, const Value& value) override
+    {
+        const int index = find(name);
+        if ((index >= 0) && assignEntry(entries_[index], value))
+        {
+            modified_.set(unsigned(index));
+        }
+    }
+
+    void readParamValue(const Name& name, Value& out_value) const override
+    {
+        const int index = find(name);
+        if (index >= 0)
+        {
+            readEntry(entries_[index], out_value);
+        }
+    }
+
+    void readParamDefaultMaxMin(const Name& name, Value& out_def,
+                                NumericValue& out_max, NumericValue& out_min) const override
+    {
+        const int index = find(name);
+        if (index < 0)
+        {
+            return;
+        }
+
+        const Entry& e = entries_[index];
+        switch (e.kind)
+        {
+        case Kind::Integer:
+        {
+            out_def.to<Value::Tag::integer_value>() = e.default_value.integer;
+            out_max.to<NumericValue::Tag::integer_value>() = e.max_value.integer;
+            out_min.to<NumericValue::Tag::integer_value>() = e.min_value.integer;
+            break;
+        }
+        case Kind::Real:
+        {
+            out_def.to<Value::Tag::real_value>() = float(e.default_value.real);
+            out_max.to<NumericValue::Tag::real_value>() = float(e.max_value.real);
+            out_min.to<NumericValue::Tag::real_value>() = float(e.min_value.real);
+            break;
+        }
+        case Kind::Boolean:
+        {
+            out_def.to<Value::Tag::boolean_value>() = e.default_value.integer != 0;
+            break;
+        }
+        case Kind::String:
+        {
+            out_def.to<Value::Tag::string_value>() = e.default_string;
+            break;
+        }
+        }
+    }
+
+    int saveAllParams() override
+    {
+        for (unsigned i = 0; i < num_entries_; i++)
+        {
+            if (save_only_modified_ && !modified_.test(i))
+            {
+                continue;
+            }
+            if (save_handler_)
+            {
+                Value value;
+                readEntry(entries_[i], value);
+                const int res = save_handler_(Index(i), entries_[i].name, value);
+                if (res < 0)
+                {
+                    return res;         // The remaining parameters stay marked as modified
+                }
+            }
+            modified_.reset(i);
+        }
+        return 0;
+    }
+
+    /**
+     * Resets all parameters to their default values. The parameters whose values have changed are marked
+     * as modified, so that the next save will store the defaults.
+     */
+    int eraseAllParams() override
+    {
+        for (unsigned i = 0; i < num_entries_; i++)
+        {
+            Entry& e = entries_[i];
+            bool changed = false;
+            if (e.kind == Kind::String)
+            {
+                std::string& str = *static_cast<std::string*>(e.storage);
+                changed = str != e.default_string;
+                str = e.default_string;
+            }
+            else
+            {
+                changed = (e.kind == Kind::Real) ? (e.load(e.storage).real != e.default_value.real) :
+                                                   (e.load(e.storage).integer != e.default_value.integer);
+                e.store(e.storage, e.default_value);
+            }
+            if (changed)
+            {
+                modified_.set(i);
+            }
+        }
+        return 0;
+    }
+
+public:
+    /*
+     * The methods below register a parameter bound to a variable of the application; the variable is set to the
+     * default value. The name must remain valid for the lifetime of the manager, e.g. a string literal.
+     * Returns the index of the new parameter or a negative error code.
+     */
+    template <typename T>
+    int addInteger(const char* name, T& storage, T default_value, T min_value, T max_value)
+    {
+        static_assert(std::is_integral<T>::value, "Integer storage is expected");
+        Entry e = makeEntry(name, Kind::Integer, &storage);
+        e.load = &loadInteger<T>;
+        e.store = &storeInteger<T>;
+        e.default_value.integer = std::int64_t(default_value);
+        e.min_value.integer = std::int64_t(min_value);
+        e.max_value.integer = std::int64_t(max_value);
+        const int res = addEntry(e);
+        if (res >= 0)
+        {
+            storage = default_value;
+        }
+        return res;
+    }
+
+    template <typename T>
+    int addReal(const char* name, T& storage, T default_value, T min_value, T max_value)
+    {
+        static_assert(std::is_floating_point<T>::value, "Floating point storage is expected");
+        Entry e = makeEntry(name, Kind::Real, &storage);
+        e.load = &loadReal<T>;
+        e.store = &storeReal<T>;
+        e.default_value.real = double(default_value);
+        e.min_value.real = double(min_value);
+        e.max_value.real = double(max_value);
+        const int res = addEntry(e);
+        if (res >= 0)
+        {
+            storage = default_value;
+        }
+        return res;
+    }
+
+    int addBoolean(const char* name, bool& storage, bool default_value)
+    {
+        Entry e = makeEntry(name, Kind::Boolean, &storage);
+        e.load = &loadInteger<bool>;
+        e.store = &storeInteger<bool>;
+        e.default_value.integer = default_value ? 1 : 0;
+        const int res = addEntry(e);
+        if (res >= 0)
+        {
+            storage = default_value;
+        }
+        return res;
+    }
+
+    int addString(const char* name, std::string& storage, const char* default_value)
+    {
+        if (default_value == nullptr)
+        {
+            return -uavcan::ErrInvalidParam;
+        }
+        Entry e = makeEntry(name, Kind::String, &storage);
+        e.default_string = default_value;
+        const int res = addEntry(e);
+        if (res >= 0)
+        {
+            storage = default_value;
+        }
+        return res;
+    }
+
+    /**
+     * Builds the perfect hash. Must be called once after all parameters have been registered and before the
+     * server is started; no parameters can be added afterwards. Lookups before this call are linear.
+     */
+    int finalize()
+    {
+        if (finalized_)
+        {
+            return -uavcan::ErrLogic;
+        }
+
+        /*
+         * Counting sort of the entries by bucket, then the buckets are placed starting from the largest.
+         */
+        unsigned bucket_sizes[NumBuckets] = {};
+        unsigned bucket_of[MaxParams] = {};
+        for (unsigned i = 0; i < num_entries_; i++)
+        {
+            bucket_of[i] = computeHash(entries_[i].name, entries_[i].name_length).bucket;
+            bucket_sizes[bucket_of[i]]++;
+        }
+
+        unsigned max_bucket_size = 0;
+        for (unsigned b = 0; b < NumBuckets; b++)
+        {
+            max_bucket_size = std::max(max_bucket_size, bucket_sizes[b]);
+        }
+
+        unsigned members[MaxParams] = {};
+        for (unsigned size = max_bucket_size; size > 0; size--)
+        {
+            for (unsigned b = 0; b < NumBuckets; b++)
+            {
+                if (bucket_sizes[b] != size)
+                {
+                    continue;
+                }
+                unsigned num_members = 0;
+                for (unsigned i = 0; i < num_entries_; i++)
+                {
+                    if (bucket_of[i] == b)
+                    {
+                        members[num_members++] = i;
+                    }
+                }
+
+                bool placed = false;
+                for (unsigned d = 0; (d < TableSize) && !placed; d++)
+                {
+                    placed = tryPlaceBucket(members, num_members, d);
+                    displacements_[b] = std::uint16_t(d);
+                }
+                if (!placed)
+                {
+                    std::fill_n(slots_, TableSize, std::uint16_t(0));
+                    return -uavcan::ErrLogic;       // Practically impossible at this load factor
+                }
+            }
+        }
+
+        finalized_ = true;
+        return 0;
+    }
+
+    /**
+     * Index of the parameter, or negative if there is no such parameter.
+     */
+    int find(const Name& name) const
+    {
+        return findByChars(name, unsigned(name.size()));
+    }
+
+    int find(const char* name) const
+    {
+        return findByChars(name, unsigned(std::strlen(name)));
+    }
+
+    /**
+     * @param handler           Will be invoked from saveAllParams().
+     * @param only_modified     If true, only the parameters that have been changed via UAVCAN since the last
+     *                          successful save are passed to the handler.
+     */
+    void setSaveHandler(const SaveHandler& handler, bool only_modified = true)
+    {
+        save_handler_ = handler;
+        save_only_modified_ = only_modified;
+    }
+
+    /**
+     * Marks the parameter as modified, e.g. if the application has changed the variable on its own.
+     */
+    void markModified(unsigned index)
+    {
+        if (index < num_entries_)
+        {
+            modified_.set(index);
+        }
+    }
+
+    bool isModified(unsigned index) const { return (index < num_entries_) && modified_.test(index); }
+
+    unsigned getNumParams() const { return num_entries_; }
+
+    const char* getParamName(unsigned index) const { return (index < num_entries_) ? entries_[index].name : ""; }
+};
+
+}
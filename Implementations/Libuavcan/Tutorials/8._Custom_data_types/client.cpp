@@ -1,3 +1,4 @@
+#include <cassert>
 #include <cstdlib>
 #include <iostream>
 #include <unistd.h>
@@ -8,9 +9,25 @@
  */
 #include <sirius_cybernetics_corporation/GetCurrentTime.hpp>
 #include <sirius_cybernetics_corporation/PerformLinearLeastSquaresFit.hpp>
+#include <sirius_cybernetics_corporation/PerformBatchLinearLeastSquaresFit.hpp>
 
 using sirius_cybernetics_corporation::GetCurrentTime;
 using sirius_cybernetics_corporation::PerformLinearLeastSquaresFit;
+using sirius_cybernetics_corporation::PerformBatchLinearLeastSquaresFit;
+
+/*
+ * Unlike the server, the client defines its data type configuration at compile time.
+ * The compiler makes sure that the IDs are unique; see the header for details.
+ */
+#include "static_data_type_registry.hpp"
+
+typedef static_data_type_registry::StaticDataTypeRegistry<
+    static_data_type_registry::Entry<GetCurrentTime, 211>,
+    static_data_type_registry::Entry<PerformLinearLeastSquaresFit, 243>,
+    static_data_type_registry::Entry<PerformBatchLinearLeastSquaresFit, 244>
+> DataTypes;
+
+static_assert(DataTypes::getDataTypeID<PerformLinearLeastSquaresFit>() == 243, "The ID is a compile-time constant");
 
 extern uavcan::ICanDriver& getCanDriver();
 extern uavcan::ISystemClock& getSystemClock();
@@ -34,21 +51,24 @@ int main(int argc, const char** argv)
 
     /*
      * Configuring the Data Type IDs.
-     * See the server sources for details.
+     * See the server sources for details. Here, the whole configuration is applied in one step,
+     * and the Data Type Registry is frozen right away, so the node can't start with a partial configuration.
      */
-    auto regist_result =
-        uavcan::GlobalDataTypeRegistry::instance().registerDataType<PerformLinearLeastSquaresFit>(243);
+    const auto regist_result = DataTypes::applyAndFreeze();
     if (regist_result != uavcan::GlobalDataTypeRegistry::RegistrationResultOk)
     {
-        throw std::runtime_error("Failed to register the data type: " + std::to_string(regist_result));
+        throw std::runtime_error("Failed to apply the data type configuration: " + std::to_string(regist_result));
     }
 
-    regist_result =
-        uavcan::GlobalDataTypeRegistry::instance().registerDataType<GetCurrentTime>(211);
-    if (regist_result != uavcan::GlobalDataTypeRegistry::RegistrationResultOk)
-    {
-        throw std::runtime_error("Failed to register the data type: " + std::to_string(regist_result));
-    }
+    /*
+     * The lookups don't involve the Data Type Registry; the lookup by ID takes constant time.
+     */
+    const auto descriptor = DataTypes::find(uavcan::DataTypeKindService, uavcan::DataTypeID(244));
+    assert(descriptor != nullptr);
+    assert(std::string(descriptor->getFullName()) ==
+           "sirius_cybernetics_corporation.PerformBatchLinearLeastSquaresFit");
+    assert(DataTypes::find("sirius_cybernetics_corporation.GetCurrentTime")->getID() == uavcan::DataTypeID(211));
+    (void)descriptor;
 
     /*
      * Starting the node
@@ -60,7 +80,7 @@ int main(int argc, const char** argv)
     }
 
     /*
-     * Calling both services once; the result will be printed to stdout as YAML.
+     * Calling all services once; the result will be printed to stdout as YAML.
      */
     uavcan::ServiceClient<GetCurrentTime> cln_time(node);
     cln_time.setCallback([](const uavcan::ServiceCallResult<GetCurrentTime>& res)
@@ -93,10 +113,38 @@ int main(int argc, const char** argv)
     }
 
     /*
-     * Spinning the node until both calls are finished.
+     * The batch variant fits several series in one call; the points of all series are concatenated.
+     * Here, the first series is the same as above, and the next ones have the slope doubled and tripled.
+     */
+    uavcan::ServiceClient<PerformBatchLinearLeastSquaresFit> cln_batch_least_squares(node);
+    cln_batch_least_squares.setCallback([](const uavcan::ServiceCallResult<PerformBatchLinearLeastSquaresFit>& res)
+        {
+            std::cout << res << std::endl;
+        });
+    PerformBatchLinearLeastSquaresFit::Request batch_request;
+    for (unsigned series = 1; series <= 3; series++)
+    {
+        batch_request.segment_lengths.push_back(30);
+        for (unsigned i = 0; i < 30; i++)
+        {
+            sirius_cybernetics_corporation::PointXY p;
+            p.x = i * 2.5 + 10;
+            p.y = i * series;
+            batch_request.points.push_back(p);
+        }
+    }
+    res = cln_batch_least_squares.call(remote_node_id, batch_request);
+    if (res < 0)
+    {
+        throw std::runtime_error("Failed to call PerformBatchLinearLeastSquaresFit: " + std::to_string(res));
+    }
+
+    /*
+     * Spinning the node until all calls are finished.
      */
     node.setModeOperational();
-    while (cln_time.hasPendingCalls() && cln_least_squares.hasPendingCalls())
+    while (cln_time.hasPendingCalls() || cln_least_squares.hasPendingCalls() ||
+           cln_batch_least_squares.hasPendingCalls())
     {
         const int res = node.spin(uavcan::MonotonicDuration::fromMSec(10));
         if (res < 0)
@@ -0,0 +1,296 @@
+/*
+ * This program measures the handlers of the least squares fit services, without a node:
+ *  - a single series of 63 points, using the scalar handler that the server used before and the vectorized one;
+ *  - 15 series of 6 points each, using 15 separate calls and one batch call.
+ *
+ * For every workload it also shows the decoding time of the request, which includes the conversion of the float16
+ * coordinates, and the number of CAN frames needed to transfer the request.
+ *
+ * Usage: ./least_squares_benchmark [number_of_iterations]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <uavcan/uavcan.hpp>
+
+/*
+ * The handlers are implemented in a separate header (see below).
+ */
+#include "least_squares_fit.hpp"
+
+using sirius_cybernetics_corporation::PerformLinearLeastSquaresFit;
+using sirius_cybernetics_corporation::PerformBatchLinearLeastSquaresFit;
+
+constexpr unsigned SingleSeriesLength = 63;
+constexpr unsigned NumBatchSeries = 15;
+constexpr unsigned BatchSeriesLength = 6;
+
+/**
+ * This is the handler that the server used before the vectorized one was introduced.
+ */
+static void handleFitScalar(const PerformLinearLeastSquaresFit::Request& request,
+                            PerformLinearLeastSquaresFit::Response& response)
+{
+    double sum_x = 0, sum_y = 0, sum_xy = 0, sum_xx = 0;
+    for (auto point : request.points)
+    {
+        sum_x += point.x;
+        sum_y += point.y;
+        sum_xy += point.x * point.y;
+        sum_xx += point.x * point.x;
+    }
+    const double a = sum_x * sum_y - request.points.size() * sum_xy;
+    const double b = sum_x * sum_x - request.points.size() * sum_xx;
+    if (std::abs(b) > 1e-12)
+    {
+        response.slope = a / b;
+        response.y_intercept = (sum_y - response.slope * sum_x) / request.points.size();
+    }
+}
+
+/**
+ * The points are located around a random line; the coordinates fit into the range of float16.
+ */
+static std::vector<sirius_cybernetics_corporation::PointXY> makeSeries(std::minstd_rand& prng, unsigned length)
+{
+    std::uniform_real_distribution<float> coefficient_dist(-10.0F, 10.0F);
+    std::uniform_real_distribution<float> x_dist(-100.0F, 100.0F);
+    std::normal_distribution<float> noise_dist(0.0F, 1.0F);
+
+    const float slope = coefficient_dist(prng);
+    const float y_intercept = coefficient_dist(prng);
+
+    std::vector<sirius_cybernetics_corporation::PointXY> series(length);
+    for (auto& p : series)
+    {
+        p.x = x_dist(prng);
+        p.y = slope * p.x + y_intercept + noise_dist(prng);
+    }
+    return series;
+}
+
+/**
+ * Returns the average time of one invocation of the function, in nanoseconds.
+ */
+template <typename Function>
+static double measure(unsigned num_iterations, Function function)
+{
+    const auto started_at = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < num_iterations; i++)
+    {
+        function();
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started_at).count() /
+           num_iterations;
+}
+
+typedef uavcan::StaticTransferBuffer<1024> Buffer;
+
+/**
+ * Encodes the request the same way the library does before sending it.
+ * Returns the length of the payload in bytes.
+ */
+template <typename Request>
+static unsigned encode(const Request& request, Buffer& buffer)
+{
+    uavcan::BitStream bit_stream(buffer);
+    uavcan::ScalarCodec codec(bit_stream);
+    const int res = Request::encode(request, codec);
+    if (res <= 0)
+    {
+        throw std::runtime_error("Failed to encode the request: " + std::to_string(res));
+    }
+    return buffer.getMaxWritePos();
+}
+
+template <typename Request>
+static void decode(Buffer& buffer, Request& out_request)
+{
+    uavcan::BitStream bit_stream(buffer);
+    uavcan::ScalarCodec codec(bit_stream);
+    const int res = Request::decode(out_request, codec);
+    if (res <= 0)
+    {
+        throw std::runtime_error("Failed to decode the request: " + std::to_string(res));
+    }
+}
+
+/**
+ * A multi-frame transfer carries 7 bytes of payload per frame, plus the 2-byte transfer CRC.
+ */
+static unsigned computeNumFrames(unsigned payload_len)
+{
+    return (payload_len <= 7) ? 1 : ((payload_len + 2U + 6U) / 7U);
+}
+
+static void printRow(const char* name, double nanoseconds, unsigned num_points)
+{
+    std::cout << std::setw(36) << std::left << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(12) << nanoseconds
+              << std::setw(12) << (nanoseconds / num_points) << std::endl;
+}
+
+int main(int argc, const char** argv)
+{
+    const unsigned num_iterations = (argc > 1) ? unsigned(std::stoi(argv[1])) : 1000000U;
+    if (num_iterations < 1)
+    {
+        std::cerr << "The number of iterations must be positive" << std::endl;
+        return 1;
+    }
+
+    std::minstd_rand prng(42);
+
+    /*
+     * The requests are encoded and decoded back, so that the coordinates are rounded to float16,
+     * as they would be on the server.
+     */
+    PerformLinearLeastSquaresFit::Request single_request;
+    for (auto& p : makeSeries(prng, SingleSeriesLength))
+    {
+        single_request.points.push_back(p);
+    }
+    Buffer single_buffer;
+    const unsigned single_frames = computeNumFrames(encode(single_request, single_buffer));
+    decode(single_buffer, single_request);
+
+    PerformLinearLeastSquaresFit::Request separate_requests[NumBatchSeries];
+    Buffer separate_buffers[NumBatchSeries];
+    unsigned separate_frames = 0;
+    PerformBatchLinearLeastSquaresFit::Request batch_request;
+    for (unsigned i = 0; i < NumBatchSeries; i++)
+    {
+        batch_request.segment_lengths.push_back(BatchSeriesLength);
+        for (auto& p : makeSeries(prng, BatchSeriesLength))
+        {
+            separate_requests[i].points.push_back(p);
+            batch_request.points.push_back(p);
+        }
+        separate_frames += computeNumFrames(encode(separate_requests[i], separate_buffers[i]));
+        decode(separate_buffers[i], separate_requests[i]);
+    }
+    Buffer batch_buffer;
+    const unsigned batch_frames = computeNumFrames(encode(batch_request, batch_buffer));
+    decode(batch_buffer, batch_request);
+
+    /*
+     * Making sure that both handlers produce the same results.
+     * The last digits may differ, since the vectorized handler adds the points in a different order.
+     */
+    PerformLinearLeastSquaresFit::Response scalar_response;
+    PerformLinearLeastSquaresFit::Response vector_response;
+    handleFitScalar(single_request, scalar_response);
+    least_squares_fit::handleFit(single_request, vector_response);
+
+    PerformBatchLinearLeastSquaresFit::Response batch_response;
+    least_squares_fit::handleBatchFit(batch_request, batch_response);
+    if (batch_response.fits.size() != NumBatchSeries)
+    {
+        throw std::runtime_error("The batch handler has rejected the request");
+    }
+
+    double max_difference = std::abs(scalar_response.slope - vector_response.slope);
+    for (unsigned i = 0; i < NumBatchSeries; i++)
+    {
+        PerformLinearLeastSquaresFit::Response response;
+        handleFitScalar(separate_requests[i], response);
+        max_difference = std::max(max_difference, std::abs(response.slope - batch_response.fits[i].slope));
+    }
+    std::cout << "Max slope difference between the scalar and vectorized handlers: " << max_difference << "\n"
+#if defined(__AVX__)
+              << "Vector lanes: 4 (AVX)\n"
+#elif defined(__SSE2__)
+              << "Vector lanes: 2 (SSE2)\n"
+#else
+              << "Vector lanes: none\n"
+#endif
+              << std::endl;
+
+    /*
+     * The results are accumulated into a volatile variable, so that the compiler can't throw the calls away.
+     */
+    volatile double sink = 0;
+
+    std::cout << std::setw(36) << std::left << "Handler" << std::right
+              << std::setw(12) << "ns/call" << std::setw(12) << "ns/point" << std::endl;
+
+    std::cout << "1 series of " << SingleSeriesLength << " points, " << single_frames << " frames:" << std::endl;
+
+    printRow("  Decoding", measure(num_iterations, [&]()
+        {
+            PerformLinearLeastSquaresFit::Request request;
+            decode(single_buffer, request);
+            sink = sink + request.points[0].x;
+        }), SingleSeriesLength);
+
+    printRow("  Scalar", measure(num_iterations, [&]()
+        {
+            PerformLinearLeastSquaresFit::Response response;
+            handleFitScalar(single_request, response);
+            sink = sink + response.slope;
+        }), SingleSeriesLength);
+
+    printRow("  Vectorized", measure(num_iterations, [&]()
+        {
+            PerformLinearLeastSquaresFit::Response response;
+            least_squares_fit::handleFit(single_request, response);
+            sink = sink + response.slope;
+        }), SingleSeriesLength);
+
+    constexpr unsigned NumBatchPoints = NumBatchSeries * BatchSeriesLength;
+
+    std::cout << NumBatchSeries << " series of " << BatchSeriesLength << " points, "
+              << separate_frames << " frames in " << NumBatchSeries << " calls, "
+              << batch_frames << " frames in one batch call:" << std::endl;
+
+    printRow("  Decoding, separate calls", measure(num_iterations, [&]()
+        {
+            for (unsigned i = 0; i < NumBatchSeries; i++)
+            {
+                PerformLinearLeastSquaresFit::Request request;
+                decode(separate_buffers[i], request);
+                sink = sink + request.points[0].x;
+            }
+        }), NumBatchPoints);
+
+    printRow("  Decoding, batch call", measure(num_iterations, [&]()
+        {
+            PerformBatchLinearLeastSquaresFit::Request request;
+            decode(batch_buffer, request);
+            sink = sink + request.points[0].x;
+        }), NumBatchPoints);
+
+    printRow("  Scalar, separate calls", measure(num_iterations, [&]()
+        {
+            for (auto& request : separate_requests)
+            {
+                PerformLinearLeastSquaresFit::Response response;
+                handleFitScalar(request, response);
+                sink = sink + response.slope;
+            }
+        }), NumBatchPoints);
+
+    printRow("  Vectorized, separate calls", measure(num_iterations, [&]()
+        {
+            for (auto& request : separate_requests)
+            {
+                PerformLinearLeastSquaresFit::Response response;
+                least_squares_fit::handleFit(request, response);
+                sink = sink + response.slope;
+            }
+        }), NumBatchPoints);
+
+    printRow("  Vectorized, batch call", measure(num_iterations, [&]()
+        {
+            PerformBatchLinearLeastSquaresFit::Response response;
+            least_squares_fit::handleBatchFit(batch_request, response);
+            sink = sink + response.fits[0].slope;
+        }), NumBatchPoints);
+
+    return 0;
+}
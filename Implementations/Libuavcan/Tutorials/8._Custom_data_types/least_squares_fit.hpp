@@ -0,0 +1,200 @@
+/**
+ * Handlers of the services sirius_cybernetics_corporation.PerformLinearLeastSquaresFit and
+ * sirius_cybernetics_corporation.PerformBatchLinearLeastSquaresFit.
+ *
+ * The fit reduces to four sums over the points: Σx, Σy, Σxy, Σx². The handlers take the coordinates of four points
+ * at a time, widen them to double precision and accumulate the sums in vector lanes: four lanes if AVX is enabled
+ * (e.g. -mavx or -march=native), or two pairs of lanes with SSE2, which is always available on x86-64.
+ * Other platforms use the plain loop.
+ *
+ * Note that the float16 coordinates are converted to float by libuavcan while the request is being decoded,
+ * before the handler is invoked. The sums are accumulated in double precision, like in the original handler.
+ *
+ * @file least_squares_fit.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <cmath>                                    // For std::abs()
+#include <limits>                                   // For std::numeric_limits
+#include <sirius_cybernetics_corporation/PerformLinearLeastSquaresFit.hpp>
+#include <sirius_cybernetics_corporation/PerformBatchLinearLeastSquaresFit.hpp>
+
+#if defined(__AVX__)
+# include <immintrin.h>                             // For AVX intrinsics
+#elif defined(__SSE2__)
+# include <emmintrin.h>                             // For SSE2 intrinsics
+#endif
+
+namespace least_squares_fit
+{
+/**
+ * Sums over a series of points.
+ */
+struct Sums
+{
+    double x = 0;
+    double y = 0;
+    double xy = 0;
+    double xx = 0;
+    unsigned n = 0;
+};
+
+/**
+ * Computes the sums over a series of points of type sirius_cybernetics_corporation.PointXY.
+ *
+ * The vectors are assembled from the fields of four consecutive points directly; copying the coordinates into
+ * temporary arrays first would make every vector load wait for four scalar stores to complete.
+ */
+template <typename PointIterator>
+inline Sums sumPoints(PointIterator points, unsigned num_points)
+{
+    Sums sums;
+    unsigned i = 0;
+
+#if defined(__AVX__)
+    __m256d sx = _mm256_setzero_pd();
+    __m256d sy = _mm256_setzero_pd();
+    __m256d sxy = _mm256_setzero_pd();
+    __m256d sxx = _mm256_setzero_pd();
+
+    for (; (i + 4) <= num_points; i += 4)
+    {
+        const __m256d vx = _mm256_cvtps_pd(_mm_set_ps(points[i + 3].x, points[i + 2].x,
+                                                      points[i + 1].x, points[i].x));
+        const __m256d vy = _mm256_cvtps_pd(_mm_set_ps(points[i + 3].y, points[i + 2].y,
+                                                      points[i + 1].y, points[i].y));
+        sx = _mm256_add_pd(sx, vx);
+        sy = _mm256_add_pd(sy, vy);
+        sxy = _mm256_add_pd(sxy, _mm256_mul_pd(vx, vy));
+        sxx = _mm256_add_pd(sxx, _mm256_mul_pd(vx, vx));
+    }
+
+    alignas(32) double lanes[4][4];
+    _mm256_store_pd(lanes[0], sx);
+    _mm256_store_pd(lanes[1], sy);
+    _mm256_store_pd(lanes[2], sxy);
+    _mm256_store_pd(lanes[3], sxx);
+#elif defined(__SSE2__)
+    /*
+     * Every vector of four floats is widened into the lower and the upper pairs of doubles,
+     * each pair having its own accumulators.
+     */
+    __m128d sx_lo = _mm_setzero_pd();
+    __m128d sx_hi = _mm_setzero_pd();
+    __m128d sy_lo = _mm_setzero_pd();
+    __m128d sy_hi = _mm_setzero_pd();
+    __m128d sxy_lo = _mm_setzero_pd();
+    __m128d sxy_hi = _mm_setzero_pd();
+    __m128d sxx_lo = _mm_setzero_pd();
+    __m128d sxx_hi = _mm_setzero_pd();
+
+    for (; (i + 4) <= num_points; i += 4)
+    {
+        const __m128 x4 = _mm_set_ps(points[i + 3].x, points[i + 2].x, points[i + 1].x, points[i].x);
+        const __m128 y4 = _mm_set_ps(points[i + 3].y, points[i + 2].y, points[i + 1].y, points[i].y);
+        const __m128d x_lo = _mm_cvtps_pd(x4);
+        const __m128d x_hi = _mm_cvtps_pd(_mm_movehl_ps(x4, x4));
+        const __m128d y_lo = _mm_cvtps_pd(y4);
+        const __m128d y_hi = _mm_cvtps_pd(_mm_movehl_ps(y4, y4));
+        sx_lo = _mm_add_pd(sx_lo, x_lo);
+        sx_hi = _mm_add_pd(sx_hi, x_hi);
+        sy_lo = _mm_add_pd(sy_lo, y_lo);
+        sy_hi = _mm_add_pd(sy_hi, y_hi);
+        sxy_lo = _mm_add_pd(sxy_lo, _mm_mul_pd(x_lo, y_lo));
+        sxy_hi = _mm_add_pd(sxy_hi, _mm_mul_pd(x_hi, y_hi));
+        sxx_lo = _mm_add_pd(sxx_lo, _mm_mul_pd(x_lo, x_lo));
+        sxx_hi = _mm_add_pd(sxx_hi, _mm_mul_pd(x_hi, x_hi));
+    }
+
+    alignas(16) double lanes[4][4];
+    _mm_store_pd(&lanes[0][0], sx_lo);
+    _mm_store_pd(&lanes[0][2], sx_hi);
+    _mm_store_pd(&lanes[1][0], sy_lo);
+    _mm_store_pd(&lanes[1][2], sy_hi);
+    _mm_store_pd(&lanes[2][0], sxy_lo);
+    _mm_store_pd(&lanes[2][2], sxy_hi);
+    _mm_store_pd(&lanes[3][0], sxx_lo);
+    _mm_store_pd(&lanes[3][2], sxx_hi);
+#endif
+
+#if defined(__SSE2__)
+    sums.x = (lanes[0][0] + lanes[0][1]) + (lanes[0][2] + lanes[0][3]);
+    sums.y = (lanes[1][0] + lanes[1][1]) + (lanes[1][2] + lanes[1][3]);
+    sums.xy = (lanes[2][0] + lanes[2][1]) + (lanes[2][2] + lanes[2][3]);
+    sums.xx = (lanes[3][0] + lanes[3][1]) + (lanes[3][2] + lanes[3][3]);
+#endif
+
+    for (; i < num_points; i++)
+    {
+        const double x = points[i].x;
+        const double y = points[i].y;
+        sums.x += x;
+        sums.y += y;
+        sums.xy += x * y;
+        sums.xx += x * x;
+    }
+
+    sums.n = num_points;
+    return sums;
+}
+
+/**
+ * Returns false if the series can't be fitted, e.g. if it contains less than two distinct X values;
+ * the output arguments are not modified in this case.
+ */
+inline bool solve(const Sums& sums, double& slope, double& y_intercept)
+{
+    const double a = sums.x * sums.y - sums.n * sums.xy;
+    const double b = sums.x * sums.x - sums.n * sums.xx;
+    if (std::abs(b) > 1e-12)
+    {
+        slope = a / b;
+        y_intercept = (sums.y - slope * sums.x) / sums.n;
+        return true;
+    }
+    return false;
+}
+
+using sirius_cybernetics_corporation::PerformLinearLeastSquaresFit;
+using sirius_cybernetics_corporation::PerformBatchLinearLeastSquaresFit;
+
+/**
+ * The response is left zeroed if the points can't be fitted.
+ */
+inline void handleFit(const PerformLinearLeastSquaresFit::Request& request,
+                      PerformLinearLeastSquaresFit::Response& response)
+{
+    (void)solve(sumPoints(request.points.begin(), request.points.size()), response.slope, response.y_intercept);
+}
+
+inline void handleBatchFit(const PerformBatchLinearLeastSquaresFit::Request& request,
+                           PerformBatchLinearLeastSquaresFit::Response& response)
+{
+    unsigned total_length = 0;
+    for (auto length : request.segment_lengths)
+    {
+        total_length += length;
+    }
+    if (total_length != request.points.size())
+    {
+        return;                                     // Malformed request, no fits
+    }
+
+    auto segment = request.points.begin();
+    for (auto length : request.segment_lengths)
+    {
+        sirius_cybernetics_corporation::LinearFunction fit;
+        if (!solve(sumPoints(segment, length), fit.slope, fit.y_intercept))
+        {
+            fit.slope = std::numeric_limits<double>::quiet_NaN();
+            fit.y_intercept = std::numeric_limits<double>::quiet_NaN();
+        }
+        response.fits.push_back(fit);
+        segment += length;
+    }
+}
+
+}
@@ -12,9 +12,16 @@
  */
 #include <sirius_cybernetics_corporation/GetCurrentTime.hpp>
 #include <sirius_cybernetics_corporation/PerformLinearLeastSquaresFit.hpp>
+#include <sirius_cybernetics_corporation/PerformBatchLinearLeastSquaresFit.hpp>
+
+/*
+ * The handlers of the least squares fit services are implemented in a separate header (see below).
+ */
+#include "least_squares_fit.hpp"
 
 using sirius_cybernetics_corporation::GetCurrentTime;
 using sirius_cybernetics_corporation::PerformLinearLeastSquaresFit;
+using sirius_cybernetics_corporation::PerformBatchLinearLeastSquaresFit;
 
 extern uavcan::ICanDriver& getCanDriver();
 extern uavcan::ISystemClock& getSystemClock();
@@ -36,10 +43,11 @@ int main(int argc, const char** argv)
     node.setName("org.uavcan.tutorial.custom_dsdl_server");
 
     /*
-     * We defined two data types, but only one of them has a default Data Type ID (DTID):
-     *  - sirius_cybernetics_corporation.GetCurrentTime               - default DTID 242
-     *  - sirius_cybernetics_corporation.PerformLinearLeastSquaresFit - default DTID is not set
-     * The first one can be used as is; the second one needs to be registered first.
+     * We defined three services, but only one of them has a default Data Type ID (DTID):
+     *  - sirius_cybernetics_corporation.GetCurrentTime                    - default DTID 242
+     *  - sirius_cybernetics_corporation.PerformLinearLeastSquaresFit      - default DTID is not set
+     *  - sirius_cybernetics_corporation.PerformBatchLinearLeastSquaresFit - default DTID is not set
+     * The first one can be used as is; the other two need to be registered first.
      */
     auto regist_result =
         uavcan::GlobalDataTypeRegistry::instance().registerDataType<PerformLinearLeastSquaresFit>(243); // DTID = 243
@@ -54,10 +62,19 @@ int main(int argc, const char** argv)
         throw std::runtime_error("Failed to register the data type: " + std::to_string(regist_result));
     }
 
+    regist_result =
+        uavcan::GlobalDataTypeRegistry::instance().registerDataType<PerformBatchLinearLeastSquaresFit>(244);
+
+    if (regist_result != uavcan::GlobalDataTypeRegistry::RegistrationResultOk)
+    {
+        throw std::runtime_error("Failed to register the data type: " + std::to_string(regist_result));
+    }
+
     /*
-     * Now we can use both data types:
-     *  - sirius_cybernetics_corporation.GetCurrentTime               - DTID 242
-     *  - sirius_cybernetics_corporation.PerformLinearLeastSquaresFit - DTID 243
+     * Now we can use all three data types:
+     *  - sirius_cybernetics_corporation.GetCurrentTime                    - DTID 242
+     *  - sirius_cybernetics_corporation.PerformLinearLeastSquaresFit      - DTID 243
+     *  - sirius_cybernetics_corporation.PerformBatchLinearLeastSquaresFit - DTID 244
      *
      * But here's more:
      * The specification requires that "the end user must be able to change the ID of any non-standard data type".
@@ -92,9 +109,10 @@ int main(int argc, const char** argv)
 
     /*
      * The current configuration is as follows:
-     *  - sirius_cybernetics_corporation.GetCurrentTime                - DTID 211
-     *  - sirius_cybernetics_corporation.PerformLinearLeastSquaresFit  - DTID 243
-     *  - uavcan.protocol.debug.LogMessage                             - DTID 20999
+     *  - sirius_cybernetics_corporation.GetCurrentTime                    - DTID 211
+     *  - sirius_cybernetics_corporation.PerformLinearLeastSquaresFit      - DTID 243
+     *  - sirius_cybernetics_corporation.PerformBatchLinearLeastSquaresFit - DTID 244
+     *  - uavcan.protocol.debug.LogMessage                                 - DTID 20999
      * Let's check it.
      * We can query data type info either by full name or by data type ID using the method find().
      * If there's no such type, find() returns nullptr.
@@ -151,31 +169,24 @@ int main(int argc, const char** argv)
         throw std::runtime_error("Failed to start the GetCurrentTime server: " + std::to_string(res));
     }
 
+    /*
+     * The handlers can be plain functions as well.
+     */
     uavcan::ServiceServer<PerformLinearLeastSquaresFit> srv_least_squares(node);
-    res = srv_least_squares.start(
-        [](const PerformLinearLeastSquaresFit::Request& request, PerformLinearLeastSquaresFit::Response& response)
-        {
-            double sum_x = 0, sum_y = 0, sum_xy = 0, sum_xx = 0;
-            for (auto point : request.points)
-            {
-                sum_x += point.x;
-                sum_y += point.y;
-                sum_xy += point.x * point.y;
-                sum_xx += point.x * point.x;
-            }
-            const double a = sum_x * sum_y - request.points.size() * sum_xy;
-            const double b = sum_x * sum_x - request.points.size() * sum_xx;
-            if (std::abs(b) > 1e-12)
-            {
-                response.slope = a / b;
-                response.y_intercept = (sum_y - response.slope * sum_x) / request.points.size();
-            }
-        });
+    res = srv_least_squares.start(&least_squares_fit::handleFit);
     if (res < 0)
     {
         throw std::runtime_error("Failed to start the PerformLinearLeastSquaresFit server: " + std::to_string(res));
     }
 
+    uavcan::ServiceServer<PerformBatchLinearLeastSquaresFit> srv_batch_least_squares(node);
+    res = srv_batch_least_squares.start(&least_squares_fit::handleBatchFit);
+    if (res < 0)
+    {
+        throw std::runtime_error("Failed to start the PerformBatchLinearLeastSquaresFit server: " +
+                                 std::to_string(res));
+    }
+
     /*
      * Running the node as usual.
      */
@@ -0,0 +1,329 @@
+/**
+ * Data type configuration that is defined at compile time.
+ *
+ * The application lists all data types it uses together with their data type IDs in one typedef:
+ *
+ *     typedef static_data_type_registry::StaticDataTypeRegistry<
+ *         static_data_type_registry::Entry<sirius_cybernetics_corporation::GetCurrentTime, 211>,
+ *         static_data_type_registry::DefaultEntry<uavcan::protocol::NodeStatus>
+ *     > DataTypes;
+ *
+ * The compiler checks that the IDs are valid and unique, and builds a perfect hash table of the configuration,
+ * which is placed in read-only memory together with the descriptors of the types:
+ *
+ *  - The ID of a type is a compile-time constant, see getDataTypeID<>().
+ *  - Lookup by kind and ID takes one hash computation and one comparison, regardless of the number of types.
+ *  - Lookup by full name compares the names of the listed types; it is not intended for the hot paths.
+ *
+ * The hash table is searched for at compile time, which takes a few seconds for a hundred types;
+ * the configuration can contain up to 254 types, although the default constexpr limits of the compiler
+ * may need to be raised for large configurations.
+ *
+ * libuavcan itself still looks the types up in uavcan::GlobalDataTypeRegistry, so applyAndFreeze() registers all
+ * listed types there at once and then freezes it, before the node is started. The order of the entries
+ * doesn't matter. Once the configuration is applied, the application doesn't need to search
+ * GlobalDataTypeRegistry at all.
+ *
+ * @file static_data_type_registry.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>                                  // For std::strcmp()
+#include <uavcan/uavcan.hpp>                        // Main libuavcan header
+
+namespace static_data_type_registry
+{
+/**
+ * Service data type IDs are 8 bits wide; message data type IDs are 16 bits wide.
+ */
+constexpr unsigned MaxServiceDataTypeID = 255;
+
+/**
+ * Describes one data type of the configuration. Instances live in read-only memory.
+ */
+struct DataTypeDescriptor
+{
+    uavcan::DataTypeKind kind;
+    std::uint16_t id;
+    const char* (*get_full_name)();
+    uavcan::DataTypeSignature (*get_signature)();
+
+    uavcan::DataTypeID getID() const { return uavcan::DataTypeID(id); }
+    const char* getFullName() const { return get_full_name(); }
+    uavcan::DataTypeSignature getSignature() const { return get_signature(); }
+};
+
+/**
+ * Assigns the specified ID to the data type.
+ */
+template <typename DataType_, std::uint16_t ID_>
+struct Entry
+{
+    typedef DataType_ DataType;
+
+    static constexpr uavcan::DataTypeKind Kind = uavcan::DataTypeKind(DataType::DataTypeKind);
+    static constexpr std::uint16_t ID = ID_;
+
+    static_assert((Kind == uavcan::DataTypeKindMessage) || (ID <= MaxServiceDataTypeID),
+                  "Service data type ID is out of range");
+};
+
+/**
+ * Uses the default ID of the data type; the data type must have one.
+ */
+template <typename DataType>
+using DefaultEntry = Entry<DataType, DataType::DefaultDataTypeID>;
+
+namespace detail
+{
+constexpr std::uint8_t EmptySlot = 0xFF;
+constexpr unsigned MaxHashBits = 12;                ///< 4096 slots, enough for any practical configuration
+constexpr unsigned MaxSeedsPerTableSize = 64;
+
+constexpr std::uint32_t makeKey(uavcan::DataTypeKind kind, std::uint16_t id)
+{
+    return (std::uint32_t(kind) << 16) | id;
+}
+
+/**
+ * Multiplicative hash; the result has the specified number of bits.
+ */
+constexpr unsigned hashKey(std::uint32_t key, std::uint32_t seed, unsigned bits)
+{
+    return unsigned(std::uint32_t((key ^ seed) * std::uint32_t(2654435761U)) >> (32U - bits));
+}
+
+constexpr std::uint32_t makeSeed(unsigned attempt)
+{
+    return std::uint32_t(attempt * std::uint32_t(0x9E3779B9U));
+}
+
+/*
+ * C++11 constexpr functions can't contain loops, hence the recursion. The recursion depth is linear
+ * in the number of types.
+ */
+constexpr bool isKeyRepeated(const std::uint32_t* keys, unsigned i, unsigned j)
+{
+    return (j < i) && ((keys[i] == keys[j]) || isKeyRepeated(keys, i, j + 1));
+}
+
+constexpr bool areKeysUnique(const std::uint32_t* keys, unsigned num_keys, unsigned i = 0)
+{
+    return (i >= num_keys) || (!isKeyRepeated(keys, i, 0) && areKeysUnique(keys, num_keys, i + 1));
+}
+
+constexpr bool isHashRepeated(const std::uint32_t* keys, unsigned i, unsigned j, std::uint32_t seed, unsigned bits)
+{
+    return (j < i) && ((hashKey(keys[i], seed, bits) == hashKey(keys[j], seed, bits)) ||
+                       isHashRepeated(keys, i, j + 1, seed, bits));
+}
+
+constexpr bool isPerfectHash(const std::uint32_t* keys, unsigned num_keys, std::uint32_t seed, unsigned bits,
+                             unsigned i = 0)
+{
+    return (i >= num_keys) || (!isHashRepeated(keys, i, 0, seed, bits) &&
+                               isPerfectHash(keys, num_keys, seed, bits, i + 1));
+}
+
+/**
+ * Returns MaxSeedsPerTableSize if no seed produces a perfect hash for this table size.
+ */
+constexpr unsigned findSeedAttempt(const std::uint32_t* keys, unsigned num_keys, unsigned bits,
+                                   unsigned attempt = 0)
+{
+    return (attempt >= MaxSeedsPerTableSize) ? MaxSeedsPerTableSize :
+           isPerfectHash(keys, num_keys, makeSeed(attempt), bits) ? attempt :
+           findSeedAttempt(keys, num_keys, bits, attempt + 1);
+}
+
+/**
+ * The table starts at the load factor of 1/2, and grows until a perfect hash is found.
+ */
+constexpr unsigned findHashBits(const std::uint32_t* keys, unsigned num_keys, unsigned bits)
+{
+    return ((bits >= MaxHashBits) || (findSeedAttempt(keys, num_keys, bits) < MaxSeedsPerTableSize)) ? bits :
+           findHashBits(keys, num_keys, bits + 1);
+}
+
+constexpr unsigned getInitialHashBits(unsigned num_keys, unsigned bits = 1)
+{
+    return ((1U << bits) >= (num_keys * 2U)) ? bits : getInitialHashBits(num_keys, bits + 1);
+}
+
+constexpr std::uint8_t findEntryInSlot(const std::uint32_t* keys, unsigned num_keys, std::uint32_t seed,
+                                       unsigned bits, unsigned slot, unsigned i = 0)
+{
+    return (i >= num_keys) ? EmptySlot :
+           (hashKey(keys[i], seed, bits) == slot) ? std::uint8_t(i) :
+           findEntryInSlot(keys, num_keys, seed, bits, slot, i + 1);
+}
+
+/*
+ * Index sequence, which is not available in C++11. It is generated in logarithmic depth.
+ */
+template <unsigned... Indexes> struct IndexSequence { };
+
+template <typename, typename> struct ConcatIndexSequences;
+
+template <unsigned... A, unsigned... B>
+struct ConcatIndexSequences<IndexSequence<A...>, IndexSequence<B...>>
+{
+    typedef IndexSequence<A..., (unsigned(sizeof...(A)) + B)...> Type;
+};
+
+template <unsigned N>
+struct MakeIndexSequence
+{
+    typedef typename ConcatIndexSequences<typename MakeIndexSequence<N / 2>::Type,
+                                          typename MakeIndexSequence<N - N / 2>::Type>::Type Type;
+};
+
+template <> struct MakeIndexSequence<0> { typedef IndexSequence<> Type; };
+template <> struct MakeIndexSequence<1> { typedef IndexSequence<0> Type; };
+
+/**
+ * Keys of the configuration and the parameters of the perfect hash.
+ */
+template <typename... Entries>
+struct KeyTable
+{
+    static constexpr unsigned NumKeys = sizeof...(Entries);
+    static constexpr std::uint32_t Keys[NumKeys] = { makeKey(Entries::Kind, Entries::ID)... };
+
+    static_assert(NumKeys > 0, "The configuration is empty");
+    static_assert(NumKeys < EmptySlot, "Too many data types");
+    static_assert(areKeysUnique(Keys, NumKeys), "Data type IDs are not unique");
+
+    static constexpr unsigned HashBits = findHashBits(Keys, NumKeys, getInitialHashBits(NumKeys));
+    static constexpr unsigned NumSlots = 1U << HashBits;
+    static constexpr std::uint32_t Seed = makeSeed(findSeedAttempt(Keys, NumKeys, HashBits));
+
+    static_assert(findSeedAttempt(Keys, NumKeys, HashBits) < MaxSeedsPerTableSize, "No perfect hash found");
+};
+
+template <typename... Entries>
+constexpr std::uint32_t KeyTable<Entries...>::Keys[KeyTable<Entries...>::NumKeys];
+
+/**
+ * Maps every slot of the hash table to the index of the entry, or to EmptySlot.
+ */
+template <typename Keys, typename Slots> struct SlotTable;
+
+template <typename Keys, unsigned... Slots>
+struct SlotTable<Keys, IndexSequence<Slots...>>
+{
+    static constexpr std::uint8_t EntryIndexes[sizeof...(Slots)] = {
+        findEntryInSlot(Keys::Keys, Keys::NumKeys, Keys::Seed, Keys::HashBits, Slots)...
+    };
+};
+
+template <typename Keys, unsigned... Slots>
+constexpr std::uint8_t SlotTable<Keys, IndexSequence<Slots...>>::EntryIndexes[sizeof...(Slots)];
+
+/**
+ * Index of the data type in the configuration; fails to compile if the data type is not listed.
+ */
+template <typename DataType, unsigned Index, typename... Entries> struct IndexOf;
+
+template <typename DataType, unsigned Index, typename Head, typename... Tail>
+struct IndexOf<DataType, Index, Head, Tail...> : IndexOf<DataType, Index + 1, Tail...> { };
+
+template <typename DataType, unsigned Index, std::uint16_t ID, typename... Tail>
+struct IndexOf<DataType, Index, Entry<DataType, ID>, Tail...>
+{
+    static constexpr unsigned Value = Index;
+};
+}
+
+template <typename... Entries>
+class StaticDataTypeRegistry
+{
+    typedef detail::KeyTable<Entries...> Keys;
+    typedef detail::SlotTable<Keys, typename detail::MakeIndexSequence<Keys::NumSlots>::Type> Slots;
+
+    static constexpr DataTypeDescriptor Descriptors[sizeof...(Entries)] = {
+        {
+            Entries::Kind,
+            Entries::ID,
+            &Entries::DataType::getDataTypeFullName,
+            &Entries::DataType::getDataTypeSignature
+        }...
+    };
+
+    template <typename Entry>
+    static uavcan::GlobalDataTypeRegistry::RegistrationResult registerOne()
+    {
+        return uavcan::GlobalDataTypeRegistry::instance().registerDataType<typename Entry::DataType>(Entry::ID);
+    }
+
+public:
+    static constexpr unsigned NumDataTypes = sizeof...(Entries);
+    static constexpr unsigned NumHashSlots = Keys::NumSlots;
+
+    /**
+     * Compile-time constant; fails to compile if the data type is not listed in the configuration.
+     */
+    template <typename DataType>
+    static constexpr std::uint16_t getDataTypeID()
+    {
+        return Descriptors[detail::IndexOf<DataType, 0, Entries...>::Value].id;
+    }
+
+    /**
+     * Returns a null pointer if there's no such data type in the configuration.
+     */
+    static const DataTypeDescriptor* find(uavcan::DataTypeKind kind, uavcan::DataTypeID id)
+    {
+        const std::uint32_t key = detail::makeKey(kind, id.get());
+        const std::uint8_t index = Slots::EntryIndexes[detail::hashKey(key, Keys::Seed, Keys::HashBits)];
+        return ((index != detail::EmptySlot) && (Keys::Keys[index] == key)) ? &Descriptors[index] : nullptr;
+    }
+
+    /**
+     * Compares the full name against every data type of the configuration.
+     * Returns a null pointer if there's no such data type in the configuration.
+     */
+    static const DataTypeDescriptor* find(const char* full_name)
+    {
+        for (auto& d : Descriptors)
+        {
+            if (std::strcmp(d.getFullName(), full_name) == 0)
+            {
+                return &d;
+            }
+        }
+        return nullptr;
+    }
+
+    static const DataTypeDescriptor* begin() { return Descriptors; }
+    static const DataTypeDescriptor* end() { return Descriptors + NumDataTypes; }
+
+    /**
+     * Registers all data types of the configuration in uavcan::GlobalDataTypeRegistry, and then freezes it.
+     * Must be called before the node is started. If any registration fails (e.g. if the registry is frozen already,
+     * or if the ID is taken by a type that is not listed in the configuration), the first failed result is returned,
+     * and the registry is not frozen.
+     */
+    static uavcan::GlobalDataTypeRegistry::RegistrationResult applyAndFreeze()
+    {
+        const uavcan::GlobalDataTypeRegistry::RegistrationResult results[] = { registerOne<Entries>()... };
+        for (auto res : results)
+        {
+            if (res != uavcan::GlobalDataTypeRegistry::RegistrationResultOk)
+            {
+                return res;
+            }
+        }
+        uavcan::GlobalDataTypeRegistry::instance().freeze();
+        return uavcan::GlobalDataTypeRegistry::RegistrationResultOk;
+    }
+};
+
+template <typename... Entries>
+constexpr DataTypeDescriptor StaticDataTypeRegistry<Entries...>::Descriptors[sizeof...(Entries)];
+
+}
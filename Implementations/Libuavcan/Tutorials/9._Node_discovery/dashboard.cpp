@@ -0,0 +1,144 @@
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <unistd.h>
+#include <uavcan/uavcan.hpp>
+#include <uavcan/protocol/node_info_retriever.hpp>      // For uavcan::NodeInfoRetriever
+
+/*
+ * The registry is implemented in a separate header (see below).
+ */
+#include "node_registry.hpp"
+
+extern uavcan::ICanDriver& getCanDriver();
+extern uavcan::ISystemClock& getSystemClock();
+
+/**
+ * Nodes that have not published their status for longer than this are displayed as stale.
+ * The maximum publication period of uavcan.protocol.NodeStatus is 1 second.
+ */
+static const auto StaleTimeout = uavcan::MonotonicDuration::fromMSec(1500);
+
+static const auto RefreshPeriod = uavcan::MonotonicDuration::fromMSec(100);
+
+static void render(const node_registry::NodeRegistry& registry, uavcan::MonotonicTime now)
+{
+    using uavcan::protocol::NodeStatus;
+
+    std::cout << "\x1b[1J"  // Clear screen from the current cursor position to the beginning
+              << "\x1b[H"   // Move cursor to the coordinates 1,1
+              << "Nodes: " << registry.getNumberOfNodes() << "\n";
+
+    /*
+     * Each query is a single pass over one property array.
+     */
+    std::cout << "Operational: " << registry.selectByMode(NodeStatus::MODE_OPERATIONAL).count() << "  "
+              << "Initialization: " << registry.selectByMode(NodeStatus::MODE_INITIALIZATION).count() << "  "
+              << "Maintenance: " << registry.selectByMode(NodeStatus::MODE_MAINTENANCE).count() << "  "
+              << "Software update: " << registry.selectByMode(NodeStatus::MODE_SOFTWARE_UPDATE).count() << "\n";
+
+    const int worst_health = registry.getWorstHealth();
+    if (worst_health >= 0)
+    {
+        std::cout << "Worst health: " << worst_health << " (node "
+                  << int(registry.findNodeWithWorstHealth().get()) << ")\n";
+    }
+
+    const auto unhealthy = registry.selectByHealthAtLeast(NodeStatus::HEALTH_WARNING);
+    const auto stale = registry.selectStale(now, StaleTimeout);
+
+    std::cout << "Unhealthy:";
+    unhealthy.forEach([&](uavcan::NodeID nid) { std::cout << " " << int(nid.get()); });
+    std::cout << "\nStale:";
+    stale.forEach([&](uavcan::NodeID nid) { std::cout << " " << int(nid.get()); });
+    std::cout << "\n\n";
+
+    /*
+     * Grouping the nodes by name. Since the names are interned, nodes of the same kind share the same name index,
+     * so the grouping doesn't need to compare strings.
+     */
+    std::map<std::uint16_t, node_registry::NodeMask> groups;
+    registry.getNodesWithInfo().forEach([&](uavcan::NodeID nid) { groups[registry.getNameIndex(nid)].set(nid); });
+
+    for (auto& group : groups)
+    {
+        std::cout << std::setw(40) << std::left << registry.getStringPool().get(group.first) << std::right;
+        group.second.forEach([&](uavcan::NodeID nid)
+            {
+                const auto& version = registry.getVersion(nid);
+                std::cout << " " << std::setw(3) << int(nid.get()) << "(v" << int(version.software_major) << "."
+                          << int(version.software_minor) << ")";
+            });
+        std::cout << "\n";
+    }
+
+    std::cout << std::flush;
+}
+
+int main(int argc, const char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <node-id>" << std::endl;
+        return 1;
+    }
+
+    const int self_node_id = std::stoi(argv[1]);
+
+    uavcan::Node<16384> node(getCanDriver(), getSystemClock());
+
+    node.setNodeID(self_node_id);
+    node.setName("org.uavcan.tutorial.dashboard");
+
+    const int node_start_res = node.start();
+    if (node_start_res < 0)
+    {
+        throw std::runtime_error("Failed to start the node; error: " + std::to_string(node_start_res));
+    }
+
+    uavcan::NodeInfoRetriever retriever(node);
+
+    const int retriever_res = retriever.start();
+    if (retriever_res < 0)
+    {
+        throw std::runtime_error("Failed to start the retriever; error: " + std::to_string(retriever_res));
+    }
+
+    /*
+     * The registry is a listener of the retriever, like the collector in the active monitor example.
+     * It is large (a few kilobytes), so it should not be allocated on the stack of small embedded systems.
+     */
+    node_registry::NodeRegistry registry;
+
+    const int add_listener_res = retriever.addListener(&registry);
+    if (add_listener_res < 0)
+    {
+        throw std::runtime_error("Failed to add listener; error: " + std::to_string(add_listener_res));
+    }
+
+    /*
+     * The screen is redrawn only if the registry has changed, or if the set of stale nodes has changed.
+     */
+    node.setModeOperational();
+    std::uint32_t rendered_revision = registry.getRevision() - 1U;
+    node_registry::NodeMask rendered_stale;
+    while (true)
+    {
+        const int res = node.spin(RefreshPeriod);
+        if (res < 0)
+        {
+            std::cerr << "Transient failure: " << res << std::endl;
+        }
+
+        const auto now = node.getMonotonicTime();
+        const auto stale = registry.selectStale(now, StaleTimeout);
+        if ((registry.getRevision() != rendered_revision) || (stale != rendered_stale))
+        {
+            render(registry, now);
+            rendered_revision = registry.getRevision();
+            rendered_stale = stale;
+        }
+    }
+
+    return 0;
+}
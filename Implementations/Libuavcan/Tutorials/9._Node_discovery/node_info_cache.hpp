@@ -0,0 +1,386 @@
+/**
+ * Node info cache that can be shared by all components of an application that need uavcan.protocol.GetNodeInfo.
+ *
+ * Every instance of uavcan::NodeInfoRetriever requests node info from every node it discovers, so an application
+ * that runs several retrievers (e.g. a firmware updater next to a network monitor) multiplies the GetNodeInfo
+ * traffic, which is the most noticeable after a bus restart, when all nodes appear at once. This cache owns the only
+ * retriever of the application and relays its events to any number of listeners, which are implemented exactly
+ * like the listeners of the retriever:
+ *
+ *  - Entries are keyed by node ID and uptime: an entry is valid until the node restarts, which is detected by
+ *    its uptime going backwards; then the retriever requests the info again.
+ *  - Listeners that are added later receive the cached entries immediately, without any new requests.
+ *  - Requests are spread over time according to a bus load budget, see RequestBudget.
+ *  - Optionally, the cache is saved into a file. The changes are coalesced, and the file is written from
+ *    a background thread in one go, so the node thread never blocks on the file system.
+ *
+ * Components that require a reference to the retriever itself (e.g. uavcan::FirmwareUpdateTrigger) can use
+ * getRetriever(); they will share the same requests.
+ *
+ * @file node_info_cache.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <algorithm>                                    // For std::find(), std::max()
+#include <bitset>                                       // For std::bitset
+#include <condition_variable>                           // For std::condition_variable
+#include <cstdio>                                       // For std::rename()
+#include <fstream>                                      // For std::ofstream
+#include <memory>                                       // For std::unique_ptr
+#include <mutex>                                        // For std::mutex
+#include <string>
+#include <thread>                                       // For std::thread
+#include <utility>                                      // For std::pair
+#include <vector>
+#include <uavcan/uavcan.hpp>                            // Main libuavcan header
+#include <uavcan/protocol/node_info_retriever.hpp>      // For uavcan::NodeInfoRetriever, uavcan::INodeInfoListener
+
+namespace node_info_cache
+{
+typedef uavcan::protocol::GetNodeInfo::Response NodeInfo;
+
+/**
+ * Defines how fast node info can be requested, as a fraction of the bus capacity.
+ * One exchange is one request frame plus the response frames; the size of the response depends mostly on the
+ * length of the node name and of the certificate of authenticity, hence the expected number of frames is
+ * configurable.
+ */
+struct RequestBudget
+{
+    static constexpr unsigned BitsPerFrame = 160;       ///< Worst case 29-bit frame with 8 bytes and bit stuffing
+
+    unsigned can_bit_rate = 1000000;
+    unsigned max_bus_load_permille = 20;
+    unsigned expected_response_frames = 12;             ///< Typical response without a certificate
+
+    uavcan::MonotonicDuration getRequestInterval() const
+    {
+        const std::uint64_t bits_per_exchange = (1U + expected_response_frames) * std::uint64_t(BitsPerFrame);
+        const std::uint64_t budget_bits_per_sec =
+            std::max<std::uint64_t>(1U, std::uint64_t(can_bit_rate) * max_bus_load_permille / 1000U);
+        const std::uint64_t interval_usec = bits_per_exchange * 1000000U / budget_bits_per_sec;
+        return uavcan::MonotonicDuration::fromUSec(std::int64_t(std::max<std::uint64_t>(interval_usec, 1000U)));
+    }
+};
+
+/**
+ * Writes snapshots of the cache from a background thread.
+ * If a new snapshot is submitted while the previous one is still pending, the previous one is discarded.
+ * The file is replaced atomically, so readers never observe a partially written file.
+ */
+class SnapshotWriter : uavcan::Noncopyable
+{
+public:
+    typedef std::vector<std::pair<std::uint8_t, NodeInfo>> Snapshot;
+
+private:
+    const std::string path_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    Snapshot pending_;
+    bool have_pending_ = false;
+    bool stop_requested_ = false;
+    unsigned num_writes_ = 0;
+    bool last_write_failed_ = false;
+
+    std::thread thread_;                                ///< Must be initialized last
+
+    bool write(const Snapshot& snapshot) const
+    {
+        const std::string tmp_path = path_ + ".tmp";
+        {
+            std::ofstream out(tmp_path, std::ios::trunc);
+            for (auto& x : snapshot)
+            {
+                out << "# Node " << int(x.first) << "\n" << x.second << "\n\n";
+            }
+            out.flush();
+            if (!out)
+            {
+                return false;
+            }
+        }
+        return std::rename(tmp_path.c_str(), path_.c_str()) == 0;
+    }
+
+    void run()
+    {
+        while (true)
+        {
+            Snapshot snapshot;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]() { return have_pending_ || stop_requested_; });
+                if (!have_pending_)
+                {
+                    return;
+                }
+                snapshot.swap(pending_);
+                have_pending_ = false;
+            }
+
+            const bool ok = write(snapshot);        // The lock is not held here, so submit() never blocks on I/O
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            num_writes_++;
+            last_write_failed_ = !ok;
+        }
+    }
+
+public:
+    explicit SnapshotWriter(const std::string& path) :
+        path_(path),
+        thread_(&SnapshotWriter::run, this)
+    { }
+
+    /**
+     * Writes the pending snapshot, if any, before returning.
+     */
+    ~SnapshotWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_requested_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+    }
+
+    void submit(Snapshot&& snapshot)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_ = std::move(snapshot);
+            have_pending_ = true;
+        }
+        cv_.notify_one();
+    }
+
+    unsigned getNumWrites()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return num_writes_;
+    }
+
+    bool hasLastWriteFailed()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return last_write_failed_;
+    }
+};
+
+/**
+ * The cache is not thread-safe, except for the file writing; it must be used from the thread of its node.
+ * Listeners must not be removed from within their callbacks.
+ */
+class NodeInfoCache final : public uavcan::INodeInfoListener,
+                            private uavcan::TimerBase
+{
+    struct Entry
+    {
+        bool info_available = false;
+        std::uint32_t uptime_sec = 0;                   ///< Uptime from the last NodeStatus
+        NodeInfo info;
+    };
+
+    static constexpr unsigned NumEntries = uavcan::NodeID::Max + 1U;
+
+    uavcan::NodeInfoRetriever retriever_;
+    std::vector<Entry> entries_;                        ///< The table is large, so it lives on the heap
+    std::bitset<NumEntries> present_;
+    std::vector<uavcan::INodeInfoListener*> listeners_;
+
+    std::unique_ptr<SnapshotWriter> writer_;
+    bool dirty_ = false;
+
+    unsigned num_retrieved_ = 0;
+    unsigned num_replayed_ = 0;
+
+    void handleNodeInfoRetrieved(uavcan::NodeID node_id, const NodeInfo& node_info) override
+    {
+        Entry& e = entries_[node_id.get()];
+        e.info = node_info;
+        e.info_available = true;
+        e.uptime_sec = node_info.status.uptime_sec;
+        present_.set(node_id.get());
+        dirty_ = true;
+        num_retrieved_++;
+
+        for (auto l : listeners_)
+        {
+            l->handleNodeInfoRetrieved(node_id, node_info);
+        }
+    }
+
+    void handleNodeInfoUnavailable(uavcan::NodeID node_id) override
+    {
+        for (auto l : listeners_)
+        {
+            l->handleNodeInfoUnavailable(node_id);
+        }
+    }
+
+    void handleNodeStatusChange(const uavcan::NodeStatusMonitor::NodeStatusChangeEvent& event) override
+    {
+        if (event.status.mode == uavcan::protocol::NodeStatus::MODE_OFFLINE)
+        {
+            entries_[event.node_id.get()] = Entry();
+            present_.reset(event.node_id.get());
+            dirty_ = true;
+        }
+
+        for (auto l : listeners_)
+        {
+            l->handleNodeStatusChange(event);
+        }
+    }
+
+    void handleNodeStatusMessage(const uavcan::ReceivedDataStructure<uavcan::protocol::NodeStatus>& msg) override
+    {
+        Entry& e = entries_[msg.getSrcNodeID().get()];
+        if (msg.uptime_sec < e.uptime_sec)
+        {
+            e.info_available = false;                   // Restarted; the retriever will request the info again
+            dirty_ = true;
+        }
+        e.uptime_sec = msg.uptime_sec;
+        present_.set(msg.getSrcNodeID().get());
+
+        for (auto l : listeners_)
+        {
+            l->handleNodeStatusMessage(msg);
+        }
+    }
+
+    void handleTimerEvent(const uavcan::TimerEvent&) override
+    {
+        if (dirty_ && writer_)
+        {
+            dirty_ = false;
+            SnapshotWriter::Snapshot snapshot;
+            for (unsigned i = 1; i < NumEntries; i++)
+            {
+                if (entries_[i].info_available)
+                {
+                    snapshot.emplace_back(std::uint8_t(i), entries_[i].info);
+                }
+            }
+            writer_->submit(std::move(snapshot));
+        }
+    }
+
+public:
+    explicit NodeInfoCache(uavcan::INode& node) :
+        uavcan::TimerBase(node),
+        retriever_(node),
+        entries_(NumEntries)
+    { }
+
+    int start(const RequestBudget& budget = RequestBudget(),
+              const uavcan::TransferPriority priority = uavcan::TransferPriority::OneHigherThanLowest)
+    {
+        retriever_.setRequestInterval(budget.getRequestInterval());
+
+        const int start_res = retriever_.start(priority);
+        if (start_res < 0)
+        {
+            return start_res;
+        }
+
+        return retriever_.addListener(this);
+    }
+
+    /**
+     * Enables saving the cache into the specified file.
+     * The file is written at most once per the specified period, and only if the cache has changed.
+     */
+    void enablePersistence(const std::string& path,
+                           uavcan::MonotonicDuration period = uavcan::MonotonicDuration::fromMSec(1000))
+    {
+        writer_.reset(new SnapshotWriter(path));
+        dirty_ = true;
+        TimerBase::startPeriodic(period);
+    }
+
+    /**
+     * The listener immediately receives all cached entries via handleNodeInfoRetrieved().
+     */
+    int addListener(uavcan::INodeInfoListener* listener)
+    {
+        if (listener == nullptr)
+        {
+            return -uavcan::ErrInvalidParam;
+        }
+        if (std::find(listeners_.begin(), listeners_.end(), listener) == listeners_.end())
+        {
+            listeners_.push_back(listener);
+            for (unsigned i = 1; i < NumEntries; i++)
+            {
+                if (entries_[i].info_available)
+                {
+                    listener->handleNodeInfoRetrieved(uavcan::NodeID(std::uint8_t(i)), entries_[i].info);
+                    num_replayed_++;
+                }
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Delivers the cached entry of the node to the listener once again, e.g. to make it reconsider a decision
+     * it has made earlier; no requests are sent. Returns false if the info for this node is not known or is outdated.
+     */
+    bool replay(uavcan::NodeID node_id, uavcan::INodeInfoListener& listener)
+    {
+        const NodeInfo* const info = getNodeInfo(node_id);
+        if (info == nullptr)
+        {
+            return false;
+        }
+        listener.handleNodeInfoRetrieved(node_id, *info);
+        num_replayed_++;
+        return true;
+    }
+
+    void removeListener(uavcan::INodeInfoListener* listener)
+    {
+        listeners_.erase(std::remove(listeners_.begin(), listeners_.end(), listener), listeners_.end());
+    }
+
+    /**
+     * Returns a null pointer if the info for this node is not known or is outdated.
+     * The pointer is invalidated when the node restarts or goes offline.
+     */
+    const NodeInfo* getNodeInfo(uavcan::NodeID node_id) const
+    {
+        if (node_id.isUnicast() && entries_[node_id.get()].info_available)
+        {
+            return &entries_[node_id.get()].info;
+        }
+        return nullptr;
+    }
+
+    bool isNodeKnown(uavcan::NodeID node_id) const
+    {
+        return node_id.isUnicast() && present_.test(node_id.get());
+    }
+
+    uavcan::NodeInfoRetriever& getRetriever() { return retriever_; }
+
+    /**
+     * Number of responses received from the bus, and number of entries delivered to late listeners from the cache.
+     */
+    unsigned getNumRetrieved() const { return num_retrieved_; }
+    unsigned getNumReplayed() const { return num_replayed_; }
+
+    /**
+     * Returns a null pointer if persistence is not enabled.
+     */
+    SnapshotWriter* getWriter() { return writer_.get(); }
+};
+
+}
@@ -0,0 +1,442 @@
+/**
+ * Compact registry of the nodes in the network, for monitoring tools that query it at high rates.
+ *
+ * The registry is laid out as a structure of arrays: each property of the nodes is stored in its own fixed array
+ * indexed by node ID, and the set of known nodes is a 128-bit presence mask. A query touches only the arrays it
+ * needs, and runs a branchless loop over them, which never allocates and is easy for the compiler to vectorize.
+ * Results are returned as node masks, which can be combined with bitwise operators.
+ *
+ * Node names are interned: every distinct name is stored once, and the registry keeps a 16-bit index per node.
+ * Networks usually contain many nodes of the same kind, so this also makes grouping nodes by name cheap.
+ * Interned names are never released; their number is bounded by the number of distinct names seen so far.
+ *
+ * The registry can be attached to uavcan::NodeInfoRetriever as a listener (active monitoring), or it can be
+ * fed from uavcan::NodeStatusMonitor directly (passive monitoring, see updateStatus() and markOffline()).
+ *
+ * @file node_registry.hpp
+ *
+ * The source code contained in this file is distributed under the terms of CC0 (public domain dedication).
+ */
+
+#pragma once
+
+#include <array>                                        // For std::array
+#include <cstdint>
+#include <string>                                       // For std::string
+#include <unordered_map>                                // For std::unordered_map
+#include <vector>                                       // For std::vector
+#include <uavcan/uavcan.hpp>                            // Main libuavcan header
+#include <uavcan/protocol/node_info_retriever.hpp>      // For uavcan::NodeInfoRetriever, uavcan::INodeInfoListener
+
+namespace node_registry
+{
+constexpr unsigned NumSlots = uavcan::NodeID::Max + 1U;       ///< Slot 0 is never used
+constexpr unsigned WordBits = 64;
+constexpr unsigned NumWords = NumSlots / WordBits;
+
+/**
+ * A set of node IDs.
+ */
+class NodeMask
+{
+    std::uint64_t words_[NumWords] = {};
+
+public:
+    void set(uavcan::NodeID nid)   { words_[nid.get() / WordBits] |= std::uint64_t(1) << (nid.get() % WordBits); }
+    void clear(uavcan::NodeID nid) { words_[nid.get() / WordBits] &= ~(std::uint64_t(1) << (nid.get() % WordBits)); }
+
+    bool test(uavcan::NodeID nid) const
+    {
+        return ((words_[nid.get() / WordBits] >> (nid.get() % WordBits)) & 1U) != 0;
+    }
+
+    std::uint64_t getWord(unsigned index) const { return words_[index]; }
+    void setWord(unsigned index, std::uint64_t value) { words_[index] = value; }
+
+    bool isEmpty() const { return (words_[0] | words_[1]) == 0; }
+
+    unsigned count() const
+    {
+        return unsigned(__builtin_popcountll(words_[0]) + __builtin_popcountll(words_[1]));
+    }
+
+    /**
+     * Returns an invalid node ID if the mask is empty.
+     */
+    uavcan::NodeID getFirst() const
+    {
+        for (unsigned i = 0; i < NumWords; i++)
+        {
+            if (words_[i] != 0)
+            {
+                return uavcan::NodeID(std::uint8_t(i * WordBits + unsigned(__builtin_ctzll(words_[i]))));
+            }
+        }
+        return uavcan::NodeID();
+    }
+
+    /**
+     * Invokes the functor for every node ID in the mask, in ascending order.
+     */
+    template <typename Functor>
+    void forEach(Functor functor) const
+    {
+        for (unsigned i = 0; i < NumWords; i++)
+        {
+            for (std::uint64_t w = words_[i]; w != 0; w &= w - 1U)     // Clearing the lowest set bit
+            {
+                functor(uavcan::NodeID(std::uint8_t(i * WordBits + unsigned(__builtin_ctzll(w)))));
+            }
+        }
+    }
+
+    NodeMask operator&(const NodeMask& rhs) const
+    {
+        NodeMask out;
+        for (unsigned i = 0; i < NumWords; i++)
+        {
+            out.words_[i] = words_[i] & rhs.words_[i];
+        }
+        return out;
+    }
+
+    NodeMask operator|(const NodeMask& rhs) const
+    {
+        NodeMask out;
+        for (unsigned i = 0; i < NumWords; i++)
+        {
+            out.words_[i] = words_[i] | rhs.words_[i];
+        }
+        return out;
+    }
+
+    NodeMask operator~() const
+    {
+        NodeMask out;
+        for (unsigned i = 0; i < NumWords; i++)
+        {
+            out.words_[i] = ~words_[i];
+        }
+        out.words_[0] &= ~std::uint64_t(1);                     // Node ID 0 is not a valid node
+        return out;
+    }
+
+    bool operator==(const NodeMask& rhs) const
+    {
+        return (words_[0] == rhs.words_[0]) && (words_[1] == rhs.words_[1]);
+    }
+    bool operator!=(const NodeMask& rhs) const { return !operator==(rhs); }
+};
+
+/**
+ * Stores every distinct string once.
+ */
+class StringPool
+{
+    std::vector<std::string> strings_;
+    std::unordered_map<std::string, std::uint16_t> index_;
+
+public:
+    static constexpr std::uint16_t Empty = 0;                  ///< Index of the empty string
+
+    StringPool() { strings_.emplace_back(); }
+
+    /**
+     * Returns the index of the string, adding it to the pool if necessary.
+     * Returns the index of the empty string if the pool is full.
+     */
+    std::uint16_t intern(const char* str)
+    {
+        if ((str == nullptr) || (*str == '\0'))
+        {
+            return Empty;
+        }
+        const std::string key(str);
+        const auto it = index_.find(key);
+        if (it != index_.end())
+        {
+            return it->second;
+        }
+        if (strings_.size() > 0xFFFFU)
+        {
+            return Empty;
+        }
+        const auto index = std::uint16_t(strings_.size());
+        strings_.push_back(key);
+        index_.emplace(key, index);
+        return index;
+    }
+
+    const std::string& get(std::uint16_t index) const
+    {
+        return (index < strings_.size()) ? strings_[index] : strings_[Empty];
+    }
+
+    unsigned getSize() const { return unsigned(strings_.size()); }
+};
+
+/**
+ * Property arrays are indexed by node ID. The properties of the nodes that are not present in the presence mask
+ * are undefined, and must not be used.
+ */
+class NodeRegistry final : public uavcan::INodeInfoListener
+{
+public:
+    typedef uavcan::protocol::NodeStatus NodeStatus;
+    typedef uavcan::protocol::GetNodeInfo::Response NodeInfo;
+    typedef std::array<std::uint8_t, 16> UniqueID;              ///< See uavcan.protocol.HardwareVersion
+
+    /**
+     * Node info fields, stored separately from the status because they change rarely and are queried rarely.
+     */
+    struct VersionInfo
+    {
+        std::uint8_t software_major = 0;
+        std::uint8_t software_minor = 0;
+        std::uint8_t software_optional_field_flags = 0;
+        std::uint8_t hardware_major = 0;
+        std::uint8_t hardware_minor = 0;
+        std::uint32_t software_vcs_commit = 0;
+        std::uint64_t software_image_crc = 0;
+    };
+
+private:
+    NodeMask present_;
+    NodeMask info_known_;                                       ///< Nodes that have responded to GetNodeInfo
+
+    std::uint8_t mode_[NumSlots] = {};
+    std::uint8_t health_[NumSlots] = {};
+    std::uint8_t sub_mode_[NumSlots] = {};
+    std::uint16_t vendor_specific_status_code_[NumSlots] = {};
+    std::uint32_t uptime_sec_[NumSlots] = {};
+    std::uint64_t last_seen_usec_[NumSlots] = {};              ///< Monotonic timestamp of the last NodeStatus
+
+    std::uint16_t name_[NumSlots] = {};                        ///< Index in the string pool
+    VersionInfo version_[NumSlots];
+    UniqueID unique_id_[NumSlots] = {};
+
+    StringPool strings_;
+    std::uint32_t revision_ = 0;
+
+    /**
+     * Builds a mask from a per-slot predicate. The loop has no branches, so the compiler can vectorize it.
+     */
+    template <typename Predicate>
+    NodeMask select(Predicate predicate) const
+    {
+        NodeMask out;
+        for (unsigned w = 0; w < NumWords; w++)
+        {
+            std::uint64_t bits = 0;
+            for (unsigned i = 0; i < WordBits; i++)
+            {
+                bits |= std::uint64_t(predicate(w * WordBits + i) ? 1U : 0U) << i;
+            }
+            out.setWord(w, bits & present_.getWord(w));
+        }
+        return out;
+    }
+
+    void handleNodeInfoRetrieved(uavcan::NodeID node_id, const NodeInfo& node_info) override
+    {
+        updateInfo(node_id, node_info);
+    }
+
+    void handleNodeInfoUnavailable(uavcan::NodeID node_id) override
+    {
+        (void)node_id;                                          // The status is still being tracked
+    }
+
+    void handleNodeStatusChange(const uavcan::NodeStatusMonitor::NodeStatusChangeEvent& event) override
+    {
+        if (event.status.mode == NodeStatus::MODE_OFFLINE)
+        {
+            markOffline(event.node_id);
+        }
+    }
+
+    void handleNodeStatusMessage(const uavcan::ReceivedDataStructure<NodeStatus>& msg) override
+    {
+        updateStatus(msg.getSrcNodeID(), msg, msg.getMonotonicTimestamp());
+    }
+
+public:
+    /**
+     * Updates the status of the node, adding it to the registry if necessary.
+     * The status change is detected here, so that the revision can be used to avoid redundant rendering.
+     */
+    void updateStatus(uavcan::NodeID node_id, const NodeStatus& status, uavcan::MonotonicTime timestamp)
+    {
+        if (!node_id.isUnicast())
+        {
+            return;
+        }
+        const unsigned i = node_id.get();
+
+        const bool changed = !present_.test(node_id) ||
+                             (mode_[i] != status.mode) ||
+                             (health_[i] != status.health) ||
+                             (sub_mode_[i] != status.sub_mode) ||
+                             (vendor_specific_status_code_[i] != status.vendor_specific_status_code) ||
+                             (status.uptime_sec < uptime_sec_[i]);      // Restart
+
+        if (changed && (status.uptime_sec < uptime_sec_[i]))
+        {
+            info_known_.clear(node_id);                                 // Will be re-requested by the retriever
+        }
+
+        present_.set(node_id);
+        mode_[i] = std::uint8_t(status.mode);
+        health_[i] = std::uint8_t(status.health);
+        sub_mode_[i] = std::uint8_t(status.sub_mode);
+        vendor_specific_status_code_[i] = status.vendor_specific_status_code;
+        uptime_sec_[i] = status.uptime_sec;
+        last_seen_usec_[i] = timestamp.toUSec();
+
+        if (changed)
+        {
+            revision_++;
+        }
+    }
+
+    void updateInfo(uavcan::NodeID node_id, const NodeInfo& info)
+    {
+        if (!node_id.isUnicast())
+        {
+            return;
+        }
+        const unsigned i = node_id.get();
+
+        info_known_.set(node_id);
+        name_[i] = strings_.intern(info.name.c_str());
+
+        VersionInfo& v = version_[i];
+        v.software_major = info.software_version.major;
+        v.software_minor = info.software_version.minor;
+        v.software_optional_field_flags = info.software_version.optional_field_flags;
+        v.software_vcs_commit = info.software_version.vcs_commit;
+        v.software_image_crc = info.software_version.image_crc;
+        v.hardware_major = info.hardware_version.major;
+        v.hardware_minor = info.hardware_version.minor;
+
+        unique_id_[i].fill(0);
+        for (unsigned k = 0; (k < info.hardware_version.unique_id.size()) && (k < unique_id_[i].size()); k++)
+        {
+            unique_id_[i][k] = info.hardware_version.unique_id[k];
+        }
+
+        revision_++;
+    }
+
+    void markOffline(uavcan::NodeID node_id)
+    {
+        if (node_id.isUnicast() && present_.test(node_id))
+        {
+            present_.clear(node_id);
+            info_known_.clear(node_id);
+            uptime_sec_[node_id.get()] = 0;
+            revision_++;
+        }
+    }
+
+    /**
+     * Incremented on every change except the uptime and the last seen timestamp.
+     * Dashboards can skip rendering if the revision has not changed since the last poll.
+     */
+    std::uint32_t getRevision() const { return revision_; }
+
+    const NodeMask& getPresentNodes() const { return present_; }
+    const NodeMask& getNodesWithInfo() const { return info_known_; }
+    unsigned getNumberOfNodes() const { return present_.count(); }
+
+    /*
+     * Per-node accessors. The node must be present.
+     */
+    std::uint8_t getMode(uavcan::NodeID nid) const                  { return mode_[nid.get()]; }
+    std::uint8_t getHealth(uavcan::NodeID nid) const                { return health_[nid.get()]; }
+    std::uint8_t getSubMode(uavcan::NodeID nid) const               { return sub_mode_[nid.get()]; }
+    std::uint16_t getVendorSpecificStatusCode(uavcan::NodeID nid) const
+    {
+        return vendor_specific_status_code_[nid.get()];
+    }
+    std::uint32_t getUptimeSec(uavcan::NodeID nid) const            { return uptime_sec_[nid.get()]; }
+    uavcan::MonotonicTime getLastSeen(uavcan::NodeID nid) const
+    {
+        return uavcan::MonotonicTime::fromUSec(last_seen_usec_[nid.get()]);
+    }
+
+    /*
+     * Node info accessors. The node must be present in the mask returned by getNodesWithInfo().
+     */
+    const std::string& getName(uavcan::NodeID nid) const            { return strings_.get(name_[nid.get()]); }
+    std::uint16_t getNameIndex(uavcan::NodeID nid) const            { return name_[nid.get()]; }
+    const VersionInfo& getVersion(uavcan::NodeID nid) const         { return version_[nid.get()]; }
+    const UniqueID& getUniqueID(uavcan::NodeID nid) const           { return unique_id_[nid.get()]; }
+    const StringPool& getStringPool() const                         { return strings_; }
+
+    /*
+     * Queries.
+     */
+    NodeMask selectByMode(std::uint8_t mode) const
+    {
+        return select([&](unsigned i) { return mode_[i] == mode; });
+    }
+
+    NodeMask selectByHealthAtLeast(std::uint8_t health) const
+    {
+        return select([&](unsigned i) { return health_[i] >= health; });
+    }
+
+    /**
+     * Nodes that have not published NodeStatus for longer than the specified time.
+     * Note that uavcan::NodeStatusMonitor declares nodes offline after a fixed timeout; this query allows to
+     * detect nodes that publish at lower rates than expected well before that happens.
+     */
+    NodeMask selectStale(uavcan::MonotonicTime now, uavcan::MonotonicDuration max_age) const
+    {
+        const std::uint64_t now_usec = now.toUSec();
+        const std::uint64_t max_age_usec = std::uint64_t(max_age.toUSec());
+        return select([&](unsigned i) { return (now_usec - last_seen_usec_[i]) > max_age_usec; });
+    }
+
+    /**
+     * Nodes whose name is the specified interned string (see getNameIndex()).
+     */
+    NodeMask selectByNameIndex(std::uint16_t name_index) const
+    {
+        return select([&](unsigned i) { return name_[i] == name_index; }) & info_known_;
+    }
+
+    /**
+     * Returns the worst health code among the present nodes, or a negative value if there are no nodes.
+     */
+    int getWorstHealth() const
+    {
+        if (present_.isEmpty())
+        {
+            return -1;
+        }
+        std::uint8_t worst = 0;
+        for (unsigned w = 0; w < NumWords; w++)
+        {
+            const std::uint64_t mask = present_.getWord(w);
+            for (unsigned i = 0; i < WordBits; i++)
+            {
+                const std::uint8_t h = ((mask >> i) & 1U) ? health_[w * WordBits + i] : 0U;
+                worst = (h > worst) ? h : worst;
+            }
+        }
+        return worst;
+    }
+
+    /**
+     * Same as uavcan::NodeStatusMonitor::findNodeWithWorstHealth(): the first node with the worst health code.
+     */
+    uavcan::NodeID findNodeWithWorstHealth() const
+    {
+        const int worst = getWorstHealth();
+        return (worst < 0) ? uavcan::NodeID() : selectByHealthAtLeast(std::uint8_t(worst)).getFirst();
+    }
+};
+
+}
@@ -1,4 +1,18 @@
 #!/bin/bash
+#
+# Usage: ./rebuild_all_tutorials_using_cmake.sh [--run-benchmarks [baseline.csv]]
+#
+# If --run-benchmarks is given, the benchmark from the tutorial '16._Benchmarks' is executed on the virtual bus
+# after the build, and its results are written to 16._Benchmarks/build/results.csv.
+# If a baseline result file is provided as well, the results are compared against it, and the script fails
+# if any of the metrics got worse.
+#
+
+run_benchmarks=0
+if [ "$1" == "--run-benchmarks" ]; then
+    run_benchmarks=1
+    benchmark_baseline=$2
+fi
 
 echo ">>> Purging build directories..."
 rm -rf */build &> /dev/null
@@ -23,3 +37,14 @@ for cmake_script in */CMakeLists.txt ; do
 done
 
 echo ">>> All builds succeeded"
+
+if [ $run_benchmarks -ne 0 ]; then
+    echo ">>> Running benchmarks..."
+    16._Benchmarks/build/benchmark virtual > 16._Benchmarks/build/results.csv
+    echo ">>> Benchmark results written to 16._Benchmarks/build/results.csv"
+
+    if [ -n "$benchmark_baseline" ]; then
+        echo ">>> Comparing against $benchmark_baseline..."
+        16._Benchmarks/compare_benchmark_results.sh "$benchmark_baseline" 16._Benchmarks/build/results.csv
+    fi
+fi